@@ -0,0 +1,182 @@
+#include "libk2/async.hpp"
+
+extern "C" {
+#include <poll.h>
+}
+
+#include <argparse/argparse.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Stress test and benchmark of AsyncSession with many producer threads
+ * @details Every producer registers and unregisters its own pid in a loop without waiting for completions, so the
+ * submission cost is what an event loop pays per operation and the throughput is bound by the worker draining the
+ * queue. Completions are collected through futures, callbacks or the eventfd from a separate reactor thread. Uses
+ * an in-process FakeDriver unless --device is given; with the fake driver the run fails if any completion is lost,
+ * reordered within a producer or a task is left registered.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-bench-async", "0.1");
+
+    program.add_argument("--device", "-d")
+            .help("issue the requests through the ioctl backend against this device instead of the fake driver");
+
+    program.add_argument("--disk")
+            .default_value(std::string{"nvme0n1"})
+            .help("block device name passed to the driver");
+
+    program.add_argument("--threads", "-t")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{16})
+            .help("number of producer threads");
+
+    program.add_argument("--iterations", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{20000})
+            .help("register/unregister pairs per producer");
+
+    program.add_argument("--mode", "-m")
+            .default_value(std::string{"eventfd"})
+            .help("completion channel: future, callback or eventfd");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto device = program.present<std::string>("--device");
+    const auto disk = program.get<std::string>("--disk");
+    const auto threads = std::max<std::size_t>(program.get<std::size_t>("--threads"), 1);
+    const auto iterations = std::max<std::size_t>(program.get<std::size_t>("--iterations"), 1);
+    const auto mode = program.get<std::string>("--mode");
+    if (mode != "future" && mode != "callback" && mode != "eventfd") {
+        std::cerr << "Unknown mode " << mode << std::endl;
+        return 1;
+    }
+
+    std::shared_ptr<k2::FakeDriver> driver;
+    if (device) {
+        const std::string devName = *device;
+        k2::setDefaultBackend([devName]() { return std::make_unique<k2::IoctlBackend>(devName); });
+    } else {
+        driver = std::make_shared<k2::FakeDriver>(std::vector<std::string>{disk});
+        k2::setDefaultBackend([driver]() { return std::make_unique<k2::FakeBackend>(driver); });
+    }
+
+    const pid_t pid = getpid();
+    const std::int64_t intervalNs = 10 * 1000 * 1000;
+    const std::size_t total = threads * iterations * 2;
+
+    std::atomic<std::size_t> completed{0};
+    std::atomic<std::size_t> failed{0};
+    std::atomic<std::size_t> reordered{0};
+    std::vector<double> submitNs(threads);
+    std::chrono::steady_clock::time_point end;
+    const auto start = std::chrono::steady_clock::now();
+    {
+        k2::AsyncSession session;
+        if (!session.isOpen()) {
+            std::cerr << session.error() << std::endl;
+            return 1;
+        }
+
+        // Tags encode producer and sequence number, so the reactor can check the per-producer order
+        std::thread reactor;
+        if (mode == "eventfd") {
+            reactor = std::thread([&]() {
+                std::vector<std::uint64_t> expected(threads, 0);
+                std::vector<k2::AsyncCompletion> ready;
+                struct pollfd pfd{session.eventFd(), POLLIN, 0};
+                while (completed.load() < total) {
+                    if (poll(&pfd, 1, 1000) < 0 && errno != EINTR) {
+                        break;
+                    }
+                    ready.clear();
+                    session.reap(ready);
+                    for (const auto &completion: ready) {
+                        const std::uint64_t producer = completion.tag >> 32;
+                        const std::uint64_t sequence = completion.tag & 0xffffffff;
+                        reordered += sequence != expected[producer];
+                        expected[producer] = sequence + 1;
+                        failed += !completion.result.ok();
+                    }
+                    completed += ready.size();
+                }
+            });
+        }
+
+        std::vector<std::thread> producers;
+        for (std::size_t t = 0; t < threads; t++) {
+            producers.emplace_back([&, t]() {
+                const auto threadPid = static_cast<pid_t>(pid + t);
+                std::vector<std::future<k2::Result>> futures;
+                if (mode == "future") {
+                    futures.reserve(iterations * 2);
+                }
+                const auto done = [&](const k2::Result &result) {
+                    failed += !result.ok();
+                    completed++;
+                };
+                const auto submitStart = std::chrono::steady_clock::now();
+                for (std::size_t i = 0; i < iterations; i++) {
+                    if (mode == "future") {
+                        futures.push_back(session.registerTask(disk, threadPid, intervalNs));
+                        futures.push_back(session.unregisterTask(disk, threadPid));
+                    } else if (mode == "callback") {
+                        session.registerTask(disk, threadPid, intervalNs, k2::Completion(done));
+                        session.unregisterTask(disk, threadPid, k2::Completion(done));
+                    } else {
+                        const std::uint64_t tag = static_cast<std::uint64_t>(t) << 32 | i * 2;
+                        session.registerTask(disk, threadPid, intervalNs, tag);
+                        session.unregisterTask(disk, threadPid, tag + 1);
+                    }
+                }
+                const auto submitEnd = std::chrono::steady_clock::now();
+                submitNs[t] = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        submitEnd - submitStart).count()) / static_cast<double>(iterations * 2);
+                for (auto &future: futures) {
+                    done(future.get());
+                }
+            });
+        }
+        for (auto &producer: producers) {
+            producer.join();
+        }
+        if (reactor.joinable()) {
+            reactor.join();
+        }
+        end = std::chrono::steady_clock::now();
+    }
+
+    double meanSubmitNs = 0;
+    for (const double ns: submitNs) {
+        meanSubmitNs += ns / static_cast<double>(threads);
+    }
+    const double totalNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - start).count());
+    std::cout << "Mode " << mode << ", " << threads << " producers" << std::endl;
+    std::cout << "Submit: " << meanSubmitNs << " ns/op" << std::endl;
+    std::cout << "Completed " << completed.load() << " of " << total << " operations, " << failed.load()
+              << " failed, " << reordered.load() << " out of order, " << totalNs / static_cast<double>(total)
+              << " ns/op, " << static_cast<double>(total) * 1e9 / totalNs << " ops/s" << std::endl;
+
+    bool ok = completed.load() == total && reordered.load() == 0;
+    if (driver) {
+        const std::size_t left = driver->taskCount(disk);
+        ok = ok && failed.load() == 0 && left == 0;
+        if (left) {
+            std::cerr << left << " tasks left registered" << std::endl;
+        }
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,214 @@
+#include "libk2/control.hpp"
+
+extern "C" {
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+}
+
+#include <argparse/argparse.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+/**
+ * @brief Runs func iterations times and returns the mean duration of one iteration in ns
+ */
+double measure(const std::size_t iterations, const std::function<void(std::size_t)> &func)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; i++) {
+        func(i);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+           static_cast<double>(iterations);
+}
+
+void report(const std::string &name, const double nsPerOp)
+{
+    std::cout << name << ": " << nsPerOp << " ns/op, " << 1e9 / nsPerOp << " ops/s" << std::endl;
+}
+
+/**
+ * @brief Forks count idle child processes, the daemon only accepts tasks of processes that exist
+ */
+std::vector<pid_t> spawnIdleProcesses(const std::size_t count)
+{
+    std::vector<pid_t> pids;
+    for (std::size_t i = 0; i < count; i++) {
+        const pid_t pid = fork();
+        if (pid == 0) {
+            pause();
+            _exit(0);
+        }
+        if (pid > 0) {
+            pids.push_back(pid);
+        }
+    }
+    return pids;
+}
+
+void killProcesses(const std::vector<pid_t> &pids)
+{
+    for (const auto pid: pids) {
+        kill(pid, SIGKILL);
+    }
+    for (const auto pid: pids) {
+        waitpid(pid, nullptr, 0);
+    }
+}
+
+/**
+ * @brief Load test of the k2-register-task daemon protocol
+ * @details Starts an in-process ControlServer on top of a FakeDriver by default, so the numbers show the cost of the
+ * socket round trip and the epoll loop. With --socket the requests go to an already running daemon instead.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-bench-control", "0.1");
+
+    program.add_argument("--socket", "-s")
+            .help("send the requests to the daemon listening on this socket instead of an in-process server");
+
+    program.add_argument("--disk")
+            .default_value(std::string{"nvme0n1"})
+            .help("block device name passed to the driver");
+
+    program.add_argument("--iterations", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{20000})
+            .help("number of register/unregister pairs per client");
+
+    program.add_argument("--clients", "-c")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{8})
+            .help("number of concurrently connected clients for the throughput run");
+
+    program.add_argument("--tasks")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{1000})
+            .help("number of tasks whose processes are killed at once to measure the automatic unregistration");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto disk = program.get<std::string>("--disk");
+    const auto iterations = std::max<std::size_t>(program.get<std::size_t>("--iterations"), 1);
+    const auto clients = std::max<std::size_t>(program.get<std::size_t>("--clients"), 1);
+    const auto taskCount = program.get<std::size_t>("--tasks");
+
+    // Every supervised task holds a pidfd in the server
+    struct rlimit files{};
+    if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+        files.rlim_cur = files.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &files);
+    }
+
+    std::unique_ptr<k2::Session> session;
+    std::unique_ptr<k2::ControlServer> server;
+    std::thread serverThread;
+    std::string socketPath;
+    if (const auto socket = program.present<std::string>("--socket")) {
+        socketPath = *socket;
+    } else {
+        socketPath = "/tmp/k2-bench-control-" + std::to_string(getpid()) + ".sock";
+        auto driver = std::make_shared<k2::FakeDriver>(std::vector<std::string>{disk});
+        session = std::make_unique<k2::Session>(std::make_unique<k2::FakeBackend>(driver));
+        server = std::make_unique<k2::ControlServer>(*session, socketPath);
+        const int ret = server->open();
+        if (ret) {
+            std::cerr << "Could not listen on " << socketPath << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+        serverThread = std::thread([&server]() { static_cast<void>(server->run()); });
+    }
+
+    const pid_t pid = getpid();
+    const std::int64_t intervalNs = 10 * 1000 * 1000;
+    const std::vector<pid_t> clientPids = spawnIdleProcesses(clients);
+
+    k2::ControlClient client(socketPath);
+    if (!client.isOpen()) {
+        std::cerr << client.error() << std::endl;
+        return 1;
+    }
+
+    std::atomic<std::size_t> errors{0};
+    report("Persistent connection register+unregister", measure(iterations, [&](std::size_t) {
+        errors += !client.registerTask(disk, pid, intervalNs);
+        errors += !client.unregisterTask(disk, pid);
+    }));
+
+    // Comparable to a one-shot CLI invocation without the cost of exec and opening the driver
+    report("Connection per request register+unregister", measure(iterations / 10 + 1, [&](std::size_t) {
+        errors += !k2::ControlClient(socketPath).registerTask(disk, pid, intervalNs);
+        errors += !k2::ControlClient(socketPath).unregisterTask(disk, pid);
+    }));
+
+    // Every client works on its own process, so registrations of different clients never collide
+    std::vector<std::thread> workers;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t c = 0; c < clients; c++) {
+        workers.emplace_back([&, c]() {
+            k2::ControlClient threadClient(socketPath);
+            const auto clientPid = clientPids[c % clientPids.size()];
+            for (std::size_t i = 0; i < iterations; i++) {
+                errors += !threadClient.registerTask(disk, clientPid, intervalNs);
+                errors += !threadClient.unregisterTask(disk, clientPid);
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const double totalNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - start).count());
+    // Each iteration issues two requests
+    report("Concurrent clients requests (" + std::to_string(clients) + " clients)",
+           totalNs / static_cast<double>(2 * iterations * clients));
+
+    killProcesses(clientPids);
+
+    // Register many tasks, kill all of their processes at once and wait until the daemon dropped every one of them
+    const std::vector<pid_t> taskPids = spawnIdleProcesses(taskCount);
+    for (const auto taskPid: taskPids) {
+        errors += !client.registerTask(disk, taskPid, intervalNs);
+    }
+    std::vector<k2::TaskSpec> tasks;
+    const auto killed = std::chrono::steady_clock::now();
+    killProcesses(taskPids);
+    do {
+        errors += !client.listTasks(tasks);
+    } while (!tasks.empty() && std::chrono::steady_clock::now() - killed < std::chrono::seconds(10));
+    const auto drained = std::chrono::steady_clock::now();
+    if (!tasks.empty()) {
+        std::cerr << tasks.size() << " tasks were not unregistered" << std::endl;
+        errors += tasks.size();
+    }
+    std::cout << "Unregistered " << taskPids.size() << " exited tasks in "
+              << std::chrono::duration_cast<std::chrono::microseconds>(drained - killed).count() << " us"
+              << std::endl;
+
+    if (server) {
+        server->requestStop();
+        serverThread.join();
+    }
+    if (errors.load()) {
+        std::cerr << errors.load() << " requests failed" << std::endl;
+        return 1;
+    }
+    return 0;
+}
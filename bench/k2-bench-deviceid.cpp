@@ -0,0 +1,73 @@
+#include "libk2/deviceid.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+
+/**
+ * @brief Throughput benchmark of the batch device id converter behind dev_t-to-internal
+ * @details Converts a generated stream of major:minor numbers in memory, so the result shows the parsing and
+ * formatting cost without terminal or pipe overhead. With --resolve every line is a device name that has to be
+ * looked up in sysfs instead.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-bench-deviceid", "0.1");
+
+    program.add_argument("--lines", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{1000000})
+            .help("number of identifiers to convert");
+
+    program.add_argument("--format", "-f")
+            .default_value(std::string{"internal"})
+            .help("output format: internal, number or name");
+
+    program.add_argument("--resolve")
+            .help("convert this device name on every line instead of generated numbers");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto lines = std::max<std::size_t>(program.get<std::size_t>("--lines"), 1);
+    const auto format = k2::deviceIdFormatToEnum(program.get<std::string>("--format"));
+    const auto resolve = program.present<std::string>("--resolve");
+
+    std::string input;
+    input.reserve(lines * 12);
+    for (std::size_t i = 0; i < lines; i++) {
+        if (resolve) {
+            input += *resolve;
+        } else {
+            input += k2::toString(k2::DeviceId{static_cast<std::uint32_t>(i % k2::kernelMajorMax),
+                                               static_cast<std::uint32_t>(i % k2::kernelMinorMask)});
+        }
+        input += '\n';
+    }
+
+    std::istringstream in(input);
+    std::ostringstream out;
+    std::size_t failedLine = 0;
+    const auto start = std::chrono::steady_clock::now();
+    const int ret = k2::convertDeviceIds(in, out, format, failedLine);
+    const auto end = std::chrono::steady_clock::now();
+    if (ret) {
+        std::cerr << "Conversion failed in line " << failedLine << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+
+    const double ns = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    std::cout << "Converted " << lines << " identifiers to " << k2::toString(format) << ": "
+              << ns / static_cast<double>(lines) << " ns/line, " << static_cast<double>(lines) * 1e9 / ns
+              << " lines/s" << std::endl;
+    return 0;
+}
@@ -0,0 +1,233 @@
+#include "libk2/regtable.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace {
+    constexpr std::int64_t intervalStep = 1000 * 1000;
+
+    enum class Writer
+    {
+        Idle,
+        /**
+         * @brief Updates every task and removes and reinserts a tenth of them under the same pids
+         */
+        Updating,
+        /**
+         * @brief Replaces tasks with new ones under pids never used before, like a daemon serving short-lived tasks
+         */
+        Churning
+    };
+
+    struct Phase
+    {
+        double lookupNs = 0;
+        std::uint64_t lookups = 0;
+        std::uint64_t found = 0;
+        std::uint64_t torn = 0;
+        std::uint64_t updates = 0;
+    };
+
+    /**
+     * @brief Looks up random tasks from several reader threads while the writer optionally keeps changing them
+     * @details Intervals are always a multiple of intervalStep plus the pid modulo intervalStep, so a reader that
+     * returned a value mixed from two updates is detected as torn. Once churning replaced the initial tasks, the
+     * readers only measure misses.
+     */
+    Phase runPhase(k2::RegistrationTable &table, const std::string &path, const std::vector<std::string> &devices,
+                   std::vector<pid_t> &pids, const std::size_t readers, const std::chrono::milliseconds duration,
+                   const Writer writer)
+    {
+        const std::size_t tasks = pids.size();
+        Phase phase;
+        std::atomic<bool> stop{false};
+        std::atomic<std::size_t> ready{0};
+        std::vector<Phase> results(readers);
+
+        std::vector<std::thread> threads;
+        for (std::size_t r = 0; r < readers; r++) {
+            threads.emplace_back([&, r]() {
+                k2::RegistrationTableReader reader;
+                if (reader.open(path)) {
+                    ready++;
+                    return;
+                }
+                std::minstd_rand random(static_cast<unsigned>(r + 1));
+                Phase &result = results[r];
+                ready++;
+                const auto start = std::chrono::steady_clock::now();
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (int i = 0; i < 256; i++) {
+                        const std::size_t task = random() % tasks;
+                        const auto pid = static_cast<pid_t>(1000 + task);
+                        std::int64_t interval = 0;
+                        if (reader.lookup(devices[task % devices.size()], pid, interval) == 0) {
+                            result.found++;
+                            result.torn += interval % intervalStep != pid % intervalStep;
+                        }
+                    }
+                    result.lookups += 256;
+                }
+                const auto end = std::chrono::steady_clock::now();
+                result.lookupNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        end - start).count());
+            });
+        }
+        while (ready.load() < readers) {
+            std::this_thread::yield();
+        }
+
+        // Every updating round updates all intervals and removes and reinserts a tenth of the tasks, which exercises
+        // the tombstones as well as in-place updates
+        const auto deadline = std::chrono::steady_clock::now() + duration;
+        std::int64_t round = 1;
+        pid_t nextPid = *std::max_element(pids.begin(), pids.end()) + 1;
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (writer == Writer::Idle) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            for (std::size_t task = 0; task < tasks; task++) {
+                const std::string &device = devices[task % devices.size()];
+                if (writer == Writer::Churning) {
+                    table.erase(device, pids[task]);
+                    pids[task] = nextPid++;
+                    if (table.set(device, pids[task], round * intervalStep + pids[task] % intervalStep) == 0) {
+                        phase.updates += 2;
+                    }
+                    continue;
+                }
+                const pid_t pid = pids[task];
+                if (task % 10 == static_cast<std::size_t>(round % 10)) {
+                    table.erase(device, pid);
+                    phase.updates++;
+                }
+                if (table.set(device, pid, round * intervalStep + pid % intervalStep) == 0) {
+                    phase.updates++;
+                }
+            }
+            round++;
+        }
+        stop = true;
+        for (auto &thread: threads) {
+            thread.join();
+        }
+
+        double ns = 0;
+        for (const auto &result: results) {
+            ns += result.lookupNs;
+            phase.lookups += result.lookups;
+            phase.found += result.found;
+            phase.torn += result.torn;
+        }
+        phase.lookupNs = phase.lookups ? ns / static_cast<double>(phase.lookups) : 0;
+        return phase;
+    }
+
+    void printPhase(const char *name, const Phase &phase, const std::chrono::milliseconds duration)
+    {
+        std::cout << name << ": " << phase.lookupNs << " ns/lookup, " << phase.lookups << " lookups, "
+                  << (phase.lookups ? 100.0 * static_cast<double>(phase.found) / static_cast<double>(phase.lookups) : 0)
+                  << "% found, " << phase.torn << " torn, "
+                  << static_cast<double>(phase.updates) * 1000 / static_cast<double>(duration.count())
+                  << " updates/s" << std::endl;
+    }
+}
+
+/**
+ * @brief Benchmark of registration table lookups, idle and while a writer keeps changing the table
+ * @details The writer and the readers map the table separately, like the daemon and a monitoring agent would. The
+ * run fails if any reader observes a torn entry.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-bench-regtable", "0.1");
+
+    program.add_argument("--path", "-p")
+            .default_value(std::string{"/dev/shm/k2-bench-registrations"})
+            .help("path of the table, created for the run and removed afterwards");
+
+    program.add_argument("--tasks", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{1024})
+            .help("number of registered tasks");
+
+    program.add_argument("--devices")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{4})
+            .help("number of devices the tasks are spread over");
+
+    program.add_argument("--capacity")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{4096})
+            .help("slots of the table");
+
+    program.add_argument("--readers", "-t")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{4})
+            .help("number of reader threads");
+
+    program.add_argument("--duration-ms")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{1000})
+            .help("length of each phase in ms");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto path = program.get<std::string>("--path");
+    const auto tasks = std::max<std::size_t>(program.get<std::size_t>("--tasks"), 1);
+    const auto deviceCount = std::max<std::size_t>(program.get<std::size_t>("--devices"), 1);
+    const auto readers = std::max<std::size_t>(program.get<std::size_t>("--readers"), 1);
+    const std::chrono::milliseconds duration(std::max(program.get<std::int64_t>("--duration-ms"), std::int64_t{1}));
+
+    k2::RegistrationTable table(path, program.get<std::size_t>("--capacity"));
+    int ret = table.open();
+    if (ret) {
+        std::cerr << "Could not create " << path << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+    std::vector<std::string> devices;
+    for (std::size_t d = 0; d < deviceCount; d++) {
+        devices.push_back("nvme" + std::to_string(d) + "n1");
+    }
+    std::vector<pid_t> pids;
+    for (std::size_t task = 0; task < tasks; task++) {
+        const auto pid = static_cast<pid_t>(1000 + task);
+        pids.push_back(pid);
+        ret = table.set(devices[task % deviceCount], pid, intervalStep + pid);
+        if (ret) {
+            std::cerr << "Could not insert task " << task << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+    }
+
+    std::cout << tasks << " tasks on " << deviceCount << " devices, " << readers << " readers" << std::endl;
+    const Phase idle = runPhase(table, path, devices, pids, readers, duration, Writer::Idle);
+    printPhase("Idle", idle, duration);
+    const Phase updating = runPhase(table, path, devices, pids, readers, duration, Writer::Updating);
+    printPhase("Updating", updating, duration);
+    // Misses must stay as cheap as hits after many times the capacity in distinct pids came and went
+    const Phase churning = runPhase(table, path, devices, pids, readers, duration, Writer::Churning);
+    printPhase("Churning", churning, duration);
+
+    if (idle.lookups == 0 || updating.lookups == 0 || churning.lookups == 0) {
+        std::cerr << "Readers could not open " << path << std::endl;
+        return 1;
+    }
+    return idle.torn == 0 && updating.torn == 0 && churning.torn == 0 && idle.found == idle.lookups ? 0 : 1;
+}
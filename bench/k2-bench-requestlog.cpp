@@ -0,0 +1,102 @@
+#include "libk2/requestlog.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Hot path cost of logging requests through RequestRing while a RequestCollector drains the rings
+ * @details Every producer thread pushes records as fast as it can, which is far more than any device completes, so
+ * the ns per record is an upper bound of what logging adds to a workload loop. Drops show the collector falling
+ * behind at that rate; pass --trace to include writing the trace file.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-bench-requestlog", "0.1");
+
+    program.add_argument("--records", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{10000000})
+            .help("records to push per thread");
+
+    program.add_argument("--threads", "-t")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{1})
+            .help("number of producer threads");
+
+    program.add_argument("--capacity", "-c")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{1 << 16})
+            .help("records per ring");
+
+    program.add_argument("--interval", "-i")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{1})
+            .help("collector wake up interval in ms");
+
+    program.add_argument("--trace")
+            .help("also write all records to this trace file");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto records = std::max<std::size_t>(program.get<std::size_t>("--records"), 1);
+    const auto threads = std::max<std::size_t>(program.get<std::size_t>("--threads"), 1);
+
+    workload::CollectorOptions options;
+    options.ringCapacity = program.get<std::size_t>("--capacity");
+    options.interval = std::chrono::milliseconds(program.get<std::int64_t>("--interval"));
+    options.tracePath = program.present<std::string>("--trace").value_or("");
+    workload::RequestCollector collector(options);
+    const int ret = collector.start();
+    if (ret) {
+        std::cerr << "Could not start the collector: " << strerror(ret) << std::endl;
+        return 1;
+    }
+
+    std::vector<double> nsPerRecord(threads);
+    std::vector<std::thread> producers;
+    for (std::size_t t = 0; t < threads; t++) {
+        producers.emplace_back([&, t] {
+            workload::RequestRing *ring = collector.attach(static_cast<std::uint16_t>(t));
+            workload::RequestRecord record;
+            record.length = 4096;
+            record.stream = static_cast<std::uint16_t>(t);
+            const auto start = std::chrono::steady_clock::now();
+            for (std::size_t i = 0; i < records; i++) {
+                record.submitNs = static_cast<std::int64_t>(i);
+                record.completeNs = static_cast<std::int64_t>(i + 1000);
+                record.offset = i * 4096;
+                ring->push(record);
+            }
+            const auto end = std::chrono::steady_clock::now();
+            nsPerRecord[t] = static_cast<double>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) / records;
+        });
+    }
+    for (auto &producer: producers) {
+        producer.join();
+    }
+    collector.stop();
+
+    for (std::size_t t = 0; t < threads; t++) {
+        std::cout << "Thread " << t << ": " << nsPerRecord[t] << " ns/record" << std::endl;
+    }
+    std::cout << "Collected " << collector.collected() << " of " << records * threads << " records, "
+              << collector.dropped() << " dropped" << std::endl;
+    if (collector.traceError()) {
+        std::cerr << "Writing the trace failed: " << strerror(collector.traceError()) << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,146 @@
+#include "libk2/libk2.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <thread>
+
+/**
+ * @brief Runs func iterations times and returns the mean duration of one iteration in ns
+ */
+double measure(const std::size_t iterations, const std::function<void(std::size_t)> &func)
+{
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0; i < iterations; i++) {
+        func(i);
+    }
+    const auto end = std::chrono::steady_clock::now();
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()) /
+           static_cast<double>(iterations);
+}
+
+void report(const std::string &name, const double nsPerOp)
+{
+    std::cout << name << ": " << nsPerOp << " ns/op, " << 1e9 / nsPerOp << " ops/s" << std::endl;
+}
+
+/**
+ * @brief Latency and throughput benchmark of the libk2 request paths
+ * @details Uses an in-process FakeDriver by default so it runs without the k2 kernel module. With --device the
+ * requests are issued through the ioctl backend against that device instead, e.g. /dev/null to measure the raw
+ * syscall overhead or /dev/k2-iosched to measure the real driver.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-bench-session", "0.1");
+
+    program.add_argument("--device", "-d")
+            .help("issue the requests through the ioctl backend against this device instead of the fake driver");
+
+    program.add_argument("--disk")
+            .default_value(std::string{"nvme0n1"})
+            .help("block device name passed to the driver");
+
+    program.add_argument("--iterations", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{100000})
+            .help("number of register/unregister pairs per path");
+
+    program.add_argument("--batch")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{64})
+            .help("number of tasks per batch");
+
+    program.add_argument("--threads", "-t")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{4})
+            .help("number of threads, each with its own session, for the throughput run");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto device = program.present<std::string>("--device");
+    const auto disk = program.get<std::string>("--disk");
+    const auto iterations = program.get<std::size_t>("--iterations");
+    const auto batchSize = std::max<std::size_t>(program.get<std::size_t>("--batch"), 1);
+    const auto threads = std::max<std::size_t>(program.get<std::size_t>("--threads"), 1);
+
+    if (device) {
+        const std::string devName = *device;
+        k2::setDefaultBackend([devName]() { return std::make_unique<k2::IoctlBackend>(devName); });
+    } else {
+        auto driver = std::make_shared<k2::FakeDriver>(std::vector<std::string>{disk});
+        k2::setDefaultBackend([driver]() { return std::make_unique<k2::FakeBackend>(driver); });
+    }
+
+    const pid_t pid = getpid();
+    const std::int64_t intervalNs = 10 * 1000 * 1000;
+
+    k2::Session session;
+    if (!session.isOpen()) {
+        std::cerr << session.error() << std::endl;
+        return 1;
+    }
+
+    report("Free functions register+unregister", measure(iterations, [&](std::size_t) {
+        k2::registerTask(disk, pid, intervalNs);
+        k2::unregisterTask(disk, pid);
+    }));
+
+    report("Session register+unregister", measure(iterations, [&](std::size_t) {
+        session.registerTask(disk, pid, intervalNs);
+        session.unregisterTask(disk, pid);
+    }));
+
+    // With a warm inventory cache the validation adds no driver round trip
+    session.setValidateDevices(true);
+    report("Validating session register+unregister", measure(iterations, [&](std::size_t) {
+        session.registerTask(disk, pid, intervalNs);
+        session.unregisterTask(disk, pid);
+    }));
+    session.setValidateDevices(false);
+
+    std::vector<k2::TaskSpec> specs;
+    for (std::size_t i = 0; i < batchSize; i++) {
+        specs.push_back(k2::TaskSpec{disk, static_cast<pid_t>(pid + i), intervalNs});
+    }
+    const std::size_t batches = std::max<std::size_t>(iterations / batchSize, 1);
+    const double batchNs = measure(batches, [&](std::size_t) {
+        session.registerTasks(specs);
+        session.unregisterTasks(specs);
+    });
+    report("Batched register+unregister per task", batchNs / static_cast<double>(batchSize));
+
+    // Every thread works on its own pid range, so registrations of different threads never collide
+    const std::size_t perThread = std::max<std::size_t>(iterations / threads, 1);
+    std::vector<std::thread> workers;
+    const auto start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threads; t++) {
+        workers.emplace_back([&, t]() {
+            k2::Session threadSession;
+            const auto threadPid = static_cast<pid_t>(pid + batchSize + t);
+            for (std::size_t i = 0; i < perThread; i++) {
+                threadSession.registerTask(disk, threadPid, intervalNs);
+                threadSession.unregisterTask(disk, threadPid);
+            }
+        });
+    }
+    for (auto &worker: workers) {
+        worker.join();
+    }
+    const auto end = std::chrono::steady_clock::now();
+    const double totalNs = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            end - start).count());
+    report("Concurrent sessions register+unregister (" + std::to_string(threads) + " threads)",
+           totalNs / static_cast<double>(perThread * threads));
+
+    return 0;
+}
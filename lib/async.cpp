@@ -0,0 +1,311 @@
+#include "libk2/async.hpp"
+
+extern "C" {
+#include <sys/eventfd.h>
+}
+
+#include <cerrno>
+
+namespace k2 {
+
+    struct AsyncSession::Request
+    {
+        enum class Delivery
+        {
+            Future,
+            Callback,
+            Tag
+        };
+
+        Request() = default;
+
+        Request(const Operation operation, std::string device, const pid_t pid, const std::int64_t interval_ns) :
+                operation(operation), device(std::move(device)), pid(pid), interval_ns(interval_ns)
+        {}
+
+        std::atomic<Request *> next{nullptr};
+        Operation operation = Operation::RegisterTask;
+        std::string device;
+        pid_t pid = 0;
+        std::int64_t interval_ns = 0;
+        Delivery delivery = Delivery::Future;
+        std::promise<Result> promise;
+        Completion callback;
+        std::uint64_t tag = 0;
+    };
+
+    namespace {
+        void signal(const int fd)
+        {
+            const std::uint64_t one = 1;
+            while (write(fd, &one, sizeof(one)) < 0 && errno == EINTR) {
+            }
+        }
+    }
+
+    AsyncSession::AsyncSession() :
+            AsyncSession(Session())
+    {}
+
+    AsyncSession::AsyncSession(Session session) :
+            session(std::move(session)), stub(std::make_unique<Request>()), head(stub.get()), tail(stub.get())
+    {
+        openError = this->session.error().error;
+        if (openError) {
+            return;
+        }
+        wakeFd = eventfd(0, EFD_CLOEXEC);
+        completionFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wakeFd < 0 || completionFd < 0) {
+            openError = errno;
+            return;
+        }
+        worker = std::thread(&AsyncSession::run, this);
+    }
+
+    AsyncSession::~AsyncSession()
+    {
+        if (worker.joinable()) {
+            stopping.store(true);
+            signal(wakeFd);
+            worker.join();
+        }
+        if (wakeFd >= 0) {
+            close(wakeFd);
+        }
+        if (completionFd >= 0) {
+            close(completionFd);
+        }
+    }
+
+    std::future<Result> AsyncSession::registerTask(const std::string &device, const pid_t pid,
+                                                   const std::int64_t interval_ns)
+    {
+        return submitFuture(Operation::RegisterTask, device, pid, interval_ns);
+    }
+
+    void AsyncSession::registerTask(const std::string &device, const pid_t pid, const std::int64_t interval_ns,
+                                    Completion done)
+    {
+        submitCallback(Operation::RegisterTask, device, pid, interval_ns, std::move(done));
+    }
+
+    void AsyncSession::registerTask(const std::string &device, const pid_t pid, const std::int64_t interval_ns,
+                                    const std::uint64_t tag)
+    {
+        submitTag(Operation::RegisterTask, device, pid, interval_ns, tag);
+    }
+
+    std::future<Result> AsyncSession::unregisterTask(const std::string &device, const pid_t pid)
+    {
+        return submitFuture(Operation::UnregisterTask, device, pid, 0);
+    }
+
+    void AsyncSession::unregisterTask(const std::string &device, const pid_t pid, Completion done)
+    {
+        submitCallback(Operation::UnregisterTask, device, pid, 0, std::move(done));
+    }
+
+    void AsyncSession::unregisterTask(const std::string &device, const pid_t pid, const std::uint64_t tag)
+    {
+        submitTag(Operation::UnregisterTask, device, pid, 0, tag);
+    }
+
+    std::future<Result> AsyncSession::unregisterAllTasks(const std::string &device)
+    {
+        return submitFuture(Operation::UnregisterAllTasks, device, 0, 0);
+    }
+
+    void AsyncSession::unregisterAllTasks(const std::string &device, Completion done)
+    {
+        submitCallback(Operation::UnregisterAllTasks, device, 0, 0, std::move(done));
+    }
+
+    void AsyncSession::unregisterAllTasks(const std::string &device, const std::uint64_t tag)
+    {
+        submitTag(Operation::UnregisterAllTasks, device, 0, 0, tag);
+    }
+
+    std::future<Result> AsyncSession::updateInterval(const std::string &device, const pid_t pid,
+                                                     const std::int64_t interval_ns)
+    {
+        return submitFuture(Operation::UpdateInterval, device, pid, interval_ns);
+    }
+
+    void AsyncSession::updateInterval(const std::string &device, const pid_t pid, const std::int64_t interval_ns,
+                                      Completion done)
+    {
+        submitCallback(Operation::UpdateInterval, device, pid, interval_ns, std::move(done));
+    }
+
+    void AsyncSession::updateInterval(const std::string &device, const pid_t pid, const std::int64_t interval_ns,
+                                      const std::uint64_t tag)
+    {
+        submitTag(Operation::UpdateInterval, device, pid, interval_ns, tag);
+    }
+
+    std::size_t AsyncSession::reap(std::vector<AsyncCompletion> &ready)
+    {
+        if (completionFd < 0) {
+            return 0;
+        }
+        // Reset the eventfd before taking the completions, so one queued after the swap leaves it readable
+        std::uint64_t count;
+        while (read(completionFd, &count, sizeof(count)) < 0 && errno == EINTR) {
+        }
+        std::lock_guard<std::mutex> lock(completionMutex);
+        const std::size_t reaped = completions.size();
+        ready.insert(ready.end(), completions.begin(), completions.end());
+        completions.clear();
+        return reaped;
+    }
+
+    std::future<Result> AsyncSession::submitFuture(const Operation operation, const std::string &device,
+                                                   const pid_t pid, const std::int64_t interval_ns)
+    {
+        auto request = std::make_unique<Request>(operation, device, pid, interval_ns);
+        auto future = request->promise.get_future();
+        submit(std::move(request));
+        return future;
+    }
+
+    void AsyncSession::submitCallback(const Operation operation, const std::string &device, const pid_t pid,
+                                      const std::int64_t interval_ns, Completion done)
+    {
+        auto request = std::make_unique<Request>(operation, device, pid, interval_ns);
+        request->delivery = Request::Delivery::Callback;
+        request->callback = std::move(done);
+        submit(std::move(request));
+    }
+
+    void AsyncSession::submitTag(const Operation operation, const std::string &device, const pid_t pid,
+                                 const std::int64_t interval_ns, const std::uint64_t tag)
+    {
+        auto request = std::make_unique<Request>(operation, device, pid, interval_ns);
+        request->delivery = Request::Delivery::Tag;
+        request->tag = tag;
+        submit(std::move(request));
+    }
+
+    void AsyncSession::submit(std::unique_ptr<Request> request)
+    {
+        if (!worker.joinable()) {
+            complete(*request, Result{request->operation, openError});
+            return;
+        }
+        push(request.release());
+        if (sleeping.exchange(false)) {
+            signal(wakeFd);
+        }
+    }
+
+    void AsyncSession::push(Request *request)
+    {
+        request->next.store(nullptr, std::memory_order_relaxed);
+        Request *previous = head.exchange(request);
+        // Between the exchange and this store the worker sees the queue as busy, not empty
+        previous->next.store(request, std::memory_order_release);
+    }
+
+    AsyncSession::Request *AsyncSession::pop()
+    {
+        Request *first = tail;
+        Request *next = first->next.load(std::memory_order_acquire);
+        if (first == stub.get()) {
+            if (next == nullptr) {
+                return nullptr;
+            }
+            tail = next;
+            first = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next != nullptr) {
+            tail = next;
+            return first;
+        }
+        if (first != head.load()) {
+            return nullptr;
+        }
+        // first is the only request, queue the stub behind it so it can be unlinked
+        push(stub.get());
+        next = first->next.load(std::memory_order_acquire);
+        if (next != nullptr) {
+            tail = next;
+            return first;
+        }
+        return nullptr;
+    }
+
+    bool AsyncSession::empty() const
+    {
+        return tail == stub.get() && head.load() == stub.get();
+    }
+
+    void AsyncSession::run()
+    {
+        while (true) {
+            Request *request = pop();
+            if (request != nullptr) {
+                const Result result = execute(*request);
+                complete(*request, result);
+                delete request;
+                continue;
+            }
+            if (!empty()) {
+                // A producer is linking its request, it shows up within a few instructions
+                std::this_thread::yield();
+                continue;
+            }
+            if (stopping.load()) {
+                break;
+            }
+            sleeping.store(true);
+            if (empty() && !stopping.load()) {
+                std::uint64_t count;
+                while (read(wakeFd, &count, sizeof(count)) < 0 && errno == EINTR) {
+                }
+            }
+            sleeping.store(false);
+        }
+    }
+
+    Result AsyncSession::execute(const Request &request)
+    {
+        switch (request.operation) {
+            case Operation::RegisterTask:
+                return session.registerTask(request.device, request.pid, request.interval_ns);
+            case Operation::UnregisterTask:
+                return session.unregisterTask(request.device, request.pid);
+            case Operation::UnregisterAllTasks:
+                return session.unregisterAllTasks(request.device);
+            case Operation::UpdateInterval:
+                return session.updateInterval(request.device, request.pid, request.interval_ns);
+            default:
+                return Result{request.operation, EINVAL};
+        }
+    }
+
+    void AsyncSession::complete(Request &request, const Result &result)
+    {
+        switch (request.delivery) {
+            case Request::Delivery::Future:
+                request.promise.set_value(result);
+                break;
+            case Request::Delivery::Callback:
+                if (request.callback) {
+                    request.callback(result);
+                }
+                break;
+            case Request::Delivery::Tag: {
+                {
+                    std::lock_guard<std::mutex> lock(completionMutex);
+                    completions.push_back(AsyncCompletion{request.tag, result});
+                }
+                if (completionFd >= 0) {
+                    signal(completionFd);
+                }
+                break;
+            }
+        }
+    }
+}
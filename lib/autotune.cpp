@@ -0,0 +1,59 @@
+#include "libk2/autotune.hpp"
+
+#include <algorithm>
+
+namespace k2 {
+
+    IntervalTuner::IntervalTuner(const TunerOptions &options, const std::int64_t initialNs) :
+            options(options), current(std::clamp(initialNs, options.minIntervalNs, options.maxIntervalNs))
+    {}
+
+    std::int64_t IntervalTuner::clamp(const double interval) const
+    {
+        return std::clamp(static_cast<std::int64_t>(interval), options.minIntervalNs, options.maxIntervalNs);
+    }
+
+    bool IntervalTuner::converged() const
+    {
+        return goodNs != 0 && badNs != 0 &&
+               static_cast<double>(badNs - goodNs) <= options.resolution * static_cast<double>(goodNs);
+    }
+
+    std::int64_t IntervalTuner::update(const Histogram &latencies)
+    {
+        if (latencies.count() < options.minSamples) {
+            return current;
+        }
+        lastObserved = latencies.percentile(options.percentile);
+
+        if (lastObserved <= static_cast<std::uint64_t>(options.targetNs)) {
+            goodNs = current;
+            goodEpochs++;
+            if (badNs != 0 && badNs <= goodNs) {
+                badNs = 0;
+            }
+            if (badNs != 0 && goodEpochs >= options.probeEpochs) {
+                // Doubling the gap probes the old failing interval once, and widens further while it keeps passing
+                const double gap = std::max(static_cast<double>(badNs - goodNs),
+                                            options.resolution * static_cast<double>(goodNs));
+                badNs = clamp(static_cast<double>(badNs) + gap);
+                goodEpochs = 0;
+            }
+            if (badNs == 0) {
+                current = clamp(static_cast<double>(current) * options.growth);
+            } else if (!converged()) {
+                current = goodNs + (badNs - goodNs) / 2;
+            }
+            return current;
+        }
+
+        goodEpochs = 0;
+        badNs = current;
+        if (goodNs >= badNs) {
+            // The load grew, what was good before is not anymore
+            goodNs = 0;
+        }
+        current = goodNs != 0 ? goodNs : clamp(static_cast<double>(current) / options.growth);
+        return current;
+    }
+}
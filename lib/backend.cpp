@@ -0,0 +1,298 @@
+#include "libk2/backend.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+}
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+#include <k2.h>
+
+
+namespace k2 {
+
+    std::string k2IoschedDev()
+    {
+        const char *override = std::getenv("K2_IOSCHED_DEV");
+        if (override != nullptr && override[0] != '\0') {
+            return override;
+        }
+        return "/dev/k2-iosched";
+    }
+
+    int openDriver(const std::string &devName, int &fd)
+    {
+        int result = ::open(devName.c_str(), O_RDWR);
+        if (result < 0) {
+            return errno;
+        }
+        fd = result;
+        return EXIT_SUCCESS;
+    }
+
+    int closeDriver(const int fd)
+    {
+        int result = ::close(fd);
+        if (result < 0) {
+            return errno;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    IoctlBackend::IoctlBackend(std::string devName) :
+            devName(std::move(devName))
+    {}
+
+    IoctlBackend::~IoctlBackend()
+    {
+        if (fd >= 0) {
+            closeDriver(fd);
+        }
+    }
+
+    int IoctlBackend::open()
+    {
+        if (fd >= 0) {
+            return EBUSY;
+        }
+        return openDriver(devName, fd);
+    }
+
+    int IoctlBackend::close()
+    {
+        if (fd < 0) {
+            return EBADF;
+        }
+        const int ret = closeDriver(fd);
+        fd = -1;
+        return ret;
+    }
+
+    int IoctlBackend::ioctl(unsigned long request, struct k2_ioctl &io)
+    {
+        if (::ioctl(fd, request, &io) < 0) {
+            return errno;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    FakeDriver::FakeDriver(std::vector<std::string> devices, std::string version) :
+            version(std::move(version))
+    {
+        for (auto &device: devices) {
+            tasks[std::move(device)];
+        }
+    }
+
+    void FakeDriver::setLoaded(const bool loaded)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        this->loaded = loaded;
+    }
+
+    void FakeDriver::injectError(const Operation operation, const int error)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        injectedErrors[operation] = error;
+    }
+
+    std::optional<std::int64_t> FakeDriver::interval(const std::string &device, const pid_t pid) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto deviceIt = tasks.find(device);
+        if (deviceIt == tasks.end()) {
+            return std::nullopt;
+        }
+        const auto taskIt = deviceIt->second.find(pid);
+        if (taskIt == deviceIt->second.end()) {
+            return std::nullopt;
+        }
+        return taskIt->second;
+    }
+
+    std::size_t FakeDriver::taskCount(const std::string &device) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto deviceIt = tasks.find(device);
+        return deviceIt == tasks.end() ? 0 : deviceIt->second.size();
+    }
+
+    int FakeDriver::takeInjectedError(const Operation operation)
+    {
+        const auto it = injectedErrors.find(operation);
+        if (it == injectedErrors.end()) {
+            return 0;
+        }
+        const int error = it->second;
+        injectedErrors.erase(it);
+        return error;
+    }
+
+    int FakeDriver::open()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) {
+            return ENOENT;
+        }
+        return takeInjectedError(Operation::OpenDriver);
+    }
+
+    /**
+     * @brief Copies str into the driver's string parameter the way the module does, truncating if necessary
+     */
+    void copyStringParam(struct k2_ioctl &io, const std::string &str)
+    {
+        strncpy(io.string_param, str.c_str(), K2_IOCTL_CHAR_PARAM_LENGTH - 1);
+        io.string_param[K2_IOCTL_CHAR_PARAM_LENGTH - 1] = '\0';
+    }
+
+    int FakeDriver::ioctl(unsigned long request, struct k2_ioctl &io)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!loaded) {
+            return ENODEV;
+        }
+
+        switch (request) {
+            case K2_IOC_GET_VERSION: {
+                if (const int err = takeInjectedError(Operation::GetVersion)) {
+                    return err;
+                }
+                copyStringParam(io, version);
+                return EXIT_SUCCESS;
+            }
+            case K2_IOC_GET_DEVICES: {
+                if (const int err = takeInjectedError(Operation::GetActiveDevices)) {
+                    return err;
+                }
+                std::string devices;
+                for (const auto &device: tasks) {
+                    if (!devices.empty()) {
+                        devices += ' ';
+                    }
+                    devices += device.first;
+                }
+                copyStringParam(io, devices);
+                return EXIT_SUCCESS;
+            }
+            case K2_IOC_REGISTER_PERIODIC_TASK: {
+                if (const int err = takeInjectedError(Operation::RegisterTask)) {
+                    return err;
+                }
+                const auto deviceIt = tasks.find(std::string(io.blk_dev, strnlen(io.blk_dev,
+                                                                                  K2_IOCTL_BLK_DEV_NAME_LENGTH)));
+                if (deviceIt == tasks.end()) {
+                    return ENODEV;
+                }
+                if (io.task_pid <= 0 || io.interval_ns <= 0) {
+                    return EINVAL;
+                }
+                if (!deviceIt->second.emplace(io.task_pid, io.interval_ns).second) {
+                    return EEXIST;
+                }
+                return EXIT_SUCCESS;
+            }
+            case K2_IOC_UNREGISTER_PERIODIC_TASK: {
+                if (const int err = takeInjectedError(Operation::UnregisterTask)) {
+                    return err;
+                }
+                const auto deviceIt = tasks.find(std::string(io.blk_dev, strnlen(io.blk_dev,
+                                                                                  K2_IOCTL_BLK_DEV_NAME_LENGTH)));
+                if (deviceIt == tasks.end()) {
+                    return ENODEV;
+                }
+                if (deviceIt->second.erase(io.task_pid) == 0) {
+                    return EINVAL;
+                }
+                return EXIT_SUCCESS;
+            }
+#ifdef K2_IOC_UPDATE_PERIODIC_TASK
+            case K2_IOC_UPDATE_PERIODIC_TASK: {
+                if (const int err = takeInjectedError(Operation::UpdateInterval)) {
+                    return err;
+                }
+                const auto deviceIt = tasks.find(std::string(io.blk_dev, strnlen(io.blk_dev,
+                                                                                  K2_IOCTL_BLK_DEV_NAME_LENGTH)));
+                if (deviceIt == tasks.end()) {
+                    return ENODEV;
+                }
+                const auto taskIt = deviceIt->second.find(io.task_pid);
+                if (taskIt == deviceIt->second.end() || io.interval_ns <= 0) {
+                    return EINVAL;
+                }
+                taskIt->second = io.interval_ns;
+                return EXIT_SUCCESS;
+            }
+#endif
+            case K2_IOC_UNREGISTER_ALL_PERIODIC_TASKS: {
+                if (const int err = takeInjectedError(Operation::UnregisterAllTasks)) {
+                    return err;
+                }
+                const auto deviceIt = tasks.find(std::string(io.blk_dev, strnlen(io.blk_dev,
+                                                                                  K2_IOCTL_BLK_DEV_NAME_LENGTH)));
+                if (deviceIt == tasks.end()) {
+                    return ENODEV;
+                }
+                deviceIt->second.clear();
+                return EXIT_SUCCESS;
+            }
+            default:
+                return ENOTTY;
+        }
+    }
+
+    FakeBackend::FakeBackend(std::shared_ptr<FakeDriver> driver) :
+            driver(std::move(driver))
+    {}
+
+    int FakeBackend::open()
+    {
+        if (opened) {
+            return EBUSY;
+        }
+        const int ret = driver->open();
+        opened = ret == 0;
+        return ret;
+    }
+
+    int FakeBackend::close()
+    {
+        if (!opened) {
+            return EBADF;
+        }
+        opened = false;
+        return EXIT_SUCCESS;
+    }
+
+    int FakeBackend::ioctl(unsigned long request, struct k2_ioctl &io)
+    {
+        if (!opened) {
+            return EBADF;
+        }
+        return driver->ioctl(request, io);
+    }
+
+    BackendFactory &defaultBackendFactory()
+    {
+        static BackendFactory factory;
+        return factory;
+    }
+
+    void setDefaultBackend(BackendFactory factory)
+    {
+        defaultBackendFactory() = std::move(factory);
+    }
+
+    std::unique_ptr<Backend> makeDefaultBackend()
+    {
+        const BackendFactory &factory = defaultBackendFactory();
+        if (factory) {
+            return factory();
+        }
+        return std::make_unique<IoctlBackend>();
+    }
+}
@@ -0,0 +1,387 @@
+#include "libk2/blocktrace.hpp"
+
+extern "C" {
+#include <linux/perf_event.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+// See https://man7.org/linux/man-pages/man2/perf_event_open.2.html
+
+inline int perfEventOpenSyscall(struct perf_event_attr *attr, pid_t pid, int cpu, int groupFd, unsigned long flags)
+{
+    return static_cast<int>(syscall(SYS_perf_event_open, attr, pid, cpu, groupFd, flags));
+}
+
+namespace k2 {
+
+    namespace {
+        constexpr const char *tracepointNames[] = {"block_rq_insert", "block_rq_issue", "block_rq_complete"};
+
+        constexpr std::uint64_t sectorSize = 512;
+
+        /**
+         * @brief Reads the id and the field offsets of a block tracepoint from its tracefs format file
+         */
+        int readTracepoint(const std::string &root, const std::string &name, std::uint16_t &id,
+                           std::uint32_t &sectorOffset, std::uint32_t &nrSectorOffset, std::uint32_t &commOffset)
+        {
+            std::ifstream format(root + "/events/block/" + name + "/format");
+            if (!format) {
+                return ENOENT;
+            }
+
+            std::string line;
+            bool sector = false;
+            bool nrSector = false;
+            while (std::getline(format, line)) {
+                if (line.compare(0, 4, "ID: ") == 0) {
+                    id = static_cast<std::uint16_t>(std::stoul(line.substr(4)));
+                    continue;
+                }
+                // "\tfield:sector_t sector;\toffset:16;\tsize:8;\tsigned:0;"
+                const auto field = line.find("field:");
+                const auto nameEnd = line.find(';', field);
+                const auto offset = line.find("offset:", nameEnd);
+                if (field == std::string::npos || nameEnd == std::string::npos || offset == std::string::npos) {
+                    continue;
+                }
+                std::string fieldName = line.substr(field, nameEnd - field);
+                fieldName = fieldName.substr(fieldName.rfind(' ') + 1);
+                fieldName = fieldName.substr(0, fieldName.find('['));
+                const auto value = static_cast<std::uint32_t>(std::stoul(line.substr(offset + 7)));
+                if (fieldName == "sector") {
+                    sectorOffset = value;
+                    sector = true;
+                } else if (fieldName == "nr_sector") {
+                    nrSectorOffset = value;
+                    nrSector = true;
+                } else if (fieldName == "comm") {
+                    commOffset = value;
+                }
+            }
+            return id != 0 && sector && nrSector ? 0 : EPROTO;
+        }
+    }
+
+    std::string tracefsRoot()
+    {
+        struct stat st{};
+        for (const char *root: {"/sys/kernel/tracing", "/sys/kernel/debug/tracing"}) {
+            if (stat((std::string(root) + "/events").c_str(), &st) == 0) {
+                return root;
+            }
+        }
+        return {};
+    }
+
+    BlockTracer::BlockTracer(const DeviceId device, const unsigned ringPages) :
+            device(device), ringPages(ringPages)
+    {}
+
+    BlockTracer::~BlockTracer()
+    {
+        close();
+    }
+
+    int BlockTracer::open()
+    {
+        if (ringPages == 0 || (ringPages & (ringPages - 1)) != 0 || !isKernelEncodable(device)) {
+            return EINVAL;
+        }
+        const std::string root = tracefsRoot();
+        if (root.empty()) {
+            return ENOENT;
+        }
+        for (std::size_t i = 0; i < 3; i++) {
+            Tracepoint &tracepoint = tracepoints[i];
+            const int ret = readTracepoint(root, tracepointNames[i], tracepoint.id, tracepoint.sectorOffset,
+                                           tracepoint.nrSectorOffset, tracepoint.commOffset);
+            if (ret) {
+                return ret;
+            }
+        }
+
+        pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if (epollFd < 0) {
+            return errno;
+        }
+
+        // Filter in the kernel, only samples of the traced device reach the rings
+        const std::string filter = "dev == " + std::to_string(encodeKernelDev(device));
+
+        const int cpus = get_nprocs_conf();
+        for (int cpu = 0; cpu < cpus; cpu++) {
+            int leader = -1;
+            for (const Tracepoint &tracepoint: tracepoints) {
+                struct perf_event_attr attr{};
+                attr.size = sizeof(attr);
+                attr.type = PERF_TYPE_TRACEPOINT;
+                attr.config = tracepoint.id;
+                attr.sample_period = 1;
+                attr.sample_type = PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_RAW;
+                attr.disabled = 1;
+                attr.use_clockid = 1;
+                attr.clockid = CLOCK_MONOTONIC;
+                attr.watermark = 1;
+                attr.wakeup_watermark = static_cast<std::uint32_t>(ringPages * pageSize / 4);
+
+                const int fd = perfEventOpenSyscall(&attr, -1, cpu, -1, PERF_FLAG_FD_CLOEXEC);
+                if (fd < 0) {
+                    const int err = errno;
+                    if (err == ENODEV && leader < 0) {
+                        // Offline CPU
+                        break;
+                    }
+                    close();
+                    return err;
+                }
+                eventFds.push_back(fd);
+                if (ioctl(fd, PERF_EVENT_IOC_SET_FILTER, filter.c_str()) < 0) {
+                    const int err = errno;
+                    close();
+                    return err;
+                }
+
+                if (leader >= 0) {
+                    // All tracepoints of a CPU share one ring, so its samples stay in order
+                    if (ioctl(fd, PERF_EVENT_IOC_SET_OUTPUT, leader) < 0) {
+                        const int err = errno;
+                        close();
+                        return err;
+                    }
+                    continue;
+                }
+                leader = fd;
+                void *base = mmap(nullptr, (ringPages + 1) * pageSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+                if (base == MAP_FAILED) {
+                    const int err = errno;
+                    close();
+                    return err;
+                }
+                rings.push_back(Ring{fd, base});
+                struct epoll_event event{};
+                event.events = EPOLLIN;
+                event.data.fd = fd;
+                if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                    const int err = errno;
+                    close();
+                    return err;
+                }
+            }
+        }
+
+        for (const int fd: eventFds) {
+            if (ioctl(fd, PERF_EVENT_IOC_ENABLE, 0) < 0) {
+                const int err = errno;
+                close();
+                return err;
+            }
+        }
+        return 0;
+    }
+
+    void BlockTracer::close()
+    {
+        for (const Ring &ring: rings) {
+            munmap(ring.base, (ringPages + 1) * pageSize);
+        }
+        rings.clear();
+        for (const int fd: eventFds) {
+            ::close(fd);
+        }
+        eventFds.clear();
+        if (epollFd >= 0) {
+            ::close(epollFd);
+            epollFd = -1;
+        }
+    }
+
+    int BlockTracer::poll(const int timeoutMs)
+    {
+        if (epollFd < 0) {
+            return EBADF;
+        }
+
+        std::array<struct epoll_event, 16> events{};
+        if (epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), timeoutMs) < 0 && errno != EINTR) {
+            return errno;
+        }
+
+        // Completions that found no issue last time go first, the merge by time below puts them after their issue
+        samples.swap(early);
+        early.clear();
+        for (Ring &ring: rings) {
+            drain(ring);
+        }
+        // Each ring is ordered, but a request may be issued on one CPU and complete on another
+        std::stable_sort(samples.begin(), samples.end(), [](const Sample &a, const Sample &b) {
+            return a.time < b.time;
+        });
+        for (const Sample &sample: samples) {
+            process(sample);
+        }
+        samples.clear();
+        return 0;
+    }
+
+    void BlockTracer::drain(Ring &ring)
+    {
+        auto *meta = static_cast<struct perf_event_mmap_page *>(ring.base);
+        const char *data = static_cast<const char *>(ring.base) + pageSize;
+        const std::size_t size = ringPages * pageSize;
+
+        const std::uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+        std::uint64_t tail = meta->data_tail;
+        while (tail < head) {
+            const std::size_t offset = tail % size;
+            // Records are 8 byte aligned, so the header itself never wraps around
+            const auto *header = reinterpret_cast<const struct perf_event_header *>(data + offset);
+            const std::size_t recordSize = header->size;
+            if (recordSize == 0) {
+                break;
+            }
+
+            const char *record = data + offset;
+            if (offset + recordSize > size) {
+                // Only a record that wraps around the end of the ring is copied
+                scratch.resize(recordSize);
+                const std::size_t first = size - offset;
+                memcpy(scratch.data(), record, first);
+                memcpy(scratch.data() + first, data, recordSize - first);
+                record = scratch.data();
+            }
+
+            if (header->type == PERF_RECORD_SAMPLE) {
+                decode(record, recordSize);
+            } else if (header->type == PERF_RECORD_LOST && recordSize >= sizeof(*header) + 16) {
+                std::uint64_t lost;
+                memcpy(&lost, record + sizeof(*header) + 8, sizeof(lost));
+                lostSamples += lost;
+            }
+            tail += recordSize;
+        }
+        __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+    }
+
+    void BlockTracer::decode(const char *record, const std::size_t size)
+    {
+        // PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_RAW: u32 pid, tid; u64 time; u32 size; char data[size]
+        constexpr std::size_t pidOffset = sizeof(struct perf_event_header);
+        constexpr std::size_t timeOffset = pidOffset + 8;
+        constexpr std::size_t rawSizeOffset = timeOffset + 8;
+        constexpr std::size_t rawOffset = rawSizeOffset + 4;
+        if (size < rawOffset) {
+            return;
+        }
+
+        Sample sample{};
+        std::uint32_t rawSize;
+        memcpy(&sample.pid, record + pidOffset, sizeof(sample.pid));
+        memcpy(&sample.time, record + timeOffset, sizeof(sample.time));
+        memcpy(&rawSize, record + rawSizeOffset, sizeof(rawSize));
+        const char *raw = record + rawOffset;
+        if (rawSize < 2 || rawOffset + rawSize > size) {
+            return;
+        }
+
+        std::uint16_t type;
+        memcpy(&type, raw, sizeof(type));
+        std::size_t index = 0;
+        while (index < 3 && tracepoints[index].id != type) {
+            index++;
+        }
+        if (index == 3) {
+            return;
+        }
+        const Tracepoint &tracepoint = tracepoints[index];
+        if (tracepoint.sectorOffset + 8 > rawSize || tracepoint.nrSectorOffset + 4 > rawSize ||
+            (tracepoint.commOffset && tracepoint.commOffset + sizeof(sample.comm) > rawSize)) {
+            return;
+        }
+
+        sample.event = static_cast<Event>(index);
+        memcpy(&sample.sector, raw + tracepoint.sectorOffset, sizeof(sample.sector));
+        memcpy(&sample.nrSector, raw + tracepoint.nrSectorOffset, sizeof(sample.nrSector));
+        if (tracepoint.commOffset) {
+            memcpy(sample.comm, raw + tracepoint.commOffset, sizeof(sample.comm));
+            sample.comm[sizeof(sample.comm) - 1] = '\0';
+        }
+        samples.push_back(sample);
+    }
+
+    void BlockTracer::process(const Sample &sample)
+    {
+        // Flushes carry no data and no meaningful sector
+        if (sample.nrSector == 0) {
+            return;
+        }
+
+        switch (sample.event) {
+            case Event::Insert: {
+                Pending &request = pending[sample.sector];
+                request = Pending{};
+                request.insertNs = sample.time;
+                request.pid = sample.pid;
+                memcpy(request.comm, sample.comm, sizeof(request.comm));
+                break;
+            }
+            case Event::Issue: {
+                auto request = pending.find(sample.sector);
+                if (request == pending.end() || request->second.issueNs != 0) {
+                    // Bypassed the scheduler, the issuing task is the submitter
+                    Pending issued{};
+                    issued.pid = sample.pid;
+                    memcpy(issued.comm, sample.comm, sizeof(issued.comm));
+                    request = pending.insert_or_assign(sample.sector, issued).first;
+                }
+                request->second.issueNs = sample.time;
+                break;
+            }
+            case Event::Complete: {
+                auto request = pending.find(sample.sector);
+                if (request == pending.end() || request->second.issueNs == 0) {
+                    if (sample.retried) {
+                        unmatchedCompletions++;
+                    } else {
+                        early.push_back(sample);
+                        early.back().retried = true;
+                    }
+                    return;
+                }
+                const Pending &issued = request->second;
+                RequestStats &stats = perPid[issued.pid];
+                if (stats.comm.empty()) {
+                    stats.comm = issued.comm;
+                }
+                stats.requests++;
+                stats.bytes += static_cast<std::uint64_t>(sample.nrSector) * sectorSize;
+                if (issued.insertNs != 0 && issued.issueNs >= issued.insertNs) {
+                    stats.queue.record(issued.issueNs - issued.insertNs);
+                }
+                if (sample.time >= issued.issueNs) {
+                    stats.service.record(sample.time - issued.issueNs);
+                }
+                const std::uint64_t firstNs = issued.insertNs != 0 ? issued.insertNs : issued.issueNs;
+                if (sample.time >= firstNs) {
+                    stats.latency.record(sample.time - firstNs);
+                }
+                pending.erase(request);
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,128 @@
+#include "libk2/bufferpool.hpp"
+
+extern "C" {
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+namespace workload {
+
+    constexpr std::size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    inline std::size_t roundUp(const std::size_t value, const std::size_t multiple)
+    {
+        return (value + multiple - 1) / multiple * multiple;
+    }
+
+    BufferPool::~BufferPool()
+    {
+        reset();
+    }
+
+    int BufferPool::allocate(const BufferPoolOptions &options)
+    {
+        reset();
+        if (options.bufferSize == 0 || options.count == 0 || options.alignment == 0 ||
+            (options.alignment & (options.alignment - 1)) != 0) {
+            return EINVAL;
+        }
+
+        const auto pageSize = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        stride = roundUp(options.bufferSize, options.alignment);
+        // mmap is page aligned, larger alignments need some slack to align the first buffer
+        const std::size_t slack = options.alignment > pageSize ? options.alignment : 0;
+        mappingSize = roundUp(stride * options.count + slack, options.hugePages ? HUGE_PAGE_SIZE : pageSize);
+
+        const int visibility = options.shared ? MAP_SHARED : MAP_PRIVATE;
+        mapping = MAP_FAILED;
+        if (options.hugePages) {
+            mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE,
+                           visibility | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+            hugePages = mapping != MAP_FAILED;
+        }
+        if (mapping == MAP_FAILED) {
+            mapping = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, visibility | MAP_ANONYMOUS, -1, 0);
+            if (mapping == MAP_FAILED) {
+                const int err = errno;
+                mapping = nullptr;
+                return err;
+            }
+            if (options.hugePages) {
+                hugePages = madvise(mapping, mappingSize, MADV_HUGEPAGE) == 0;
+            }
+        }
+
+        // Touch every page now instead of on the first request
+        memset(mapping, 0, mappingSize);
+
+        if (options.lock) {
+            if (mlock(mapping, mappingSize) < 0) {
+                const int err = errno;
+                reset();
+                return err;
+            }
+            locked = true;
+        }
+
+        const auto address = reinterpret_cast<std::uintptr_t>(mapping);
+        base = reinterpret_cast<char *>(roundUp(address, options.alignment));
+        size = options.bufferSize;
+        bufferCount = options.count;
+        freeList.clear();
+        for (std::size_t i = bufferCount; i > 0; i--) {
+            freeList.push_back(static_cast<int>(i - 1));
+        }
+        return EXIT_SUCCESS;
+    }
+
+    void BufferPool::reset()
+    {
+        if (mapping != nullptr) {
+            if (locked) {
+                munlock(mapping, mappingSize);
+            }
+            munmap(mapping, mappingSize);
+        }
+        mapping = nullptr;
+        mappingSize = 0;
+        base = nullptr;
+        stride = 0;
+        size = 0;
+        bufferCount = 0;
+        hugePages = false;
+        locked = false;
+        freeList.clear();
+    }
+
+    std::vector<struct iovec> BufferPool::iovecs() const
+    {
+        std::vector<struct iovec> result;
+        result.reserve(bufferCount);
+        for (std::size_t i = 0; i < bufferCount; i++) {
+            result.push_back({buffer(i), size});
+        }
+        return result;
+    }
+
+    int BufferPool::acquire()
+    {
+        if (freeList.empty()) {
+            return -1;
+        }
+        const int index = freeList.back();
+        freeList.pop_back();
+        return index;
+    }
+
+    void BufferPool::release(const int index)
+    {
+        if (index >= 0 && static_cast<std::size_t>(index) < bufferCount) {
+            freeList.push_back(index);
+        }
+    }
+}
@@ -0,0 +1,580 @@
+#include "libk2/control.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+}
+
+#include <array>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+namespace k2 {
+
+    namespace {
+        /**
+         * @brief Requests longer than this are rejected, a line never gets close to it
+         */
+        constexpr std::size_t maxLineLength = 4096;
+
+        /**
+         * @brief Replies a client may leave unread before the server stops reading its requests
+         */
+        constexpr std::size_t maxPendingOutput = 64 * 1024;
+
+        constexpr int maxEvents = 64;
+
+        inline Result logged(const Operation operation, const int err, const std::string &device, const pid_t pid)
+        {
+            const Result result{operation, err};
+            if (detail::logEnabled()) {
+                detail::log(result, device, pid);
+            }
+            return result;
+        }
+
+        std::string reply(const int err)
+        {
+            return err ? "err " + std::to_string(err) : "ok";
+        }
+
+        std::string reply(const int err, const std::string &payload)
+        {
+            return err || payload.empty() ? reply(err) : "ok " + payload;
+        }
+    }
+
+    std::string k2ControlSocket()
+    {
+        const char *override = std::getenv("K2_CONTROL_SOCKET");
+        if (override != nullptr && override[0] != '\0') {
+            return override;
+        }
+        return "/run/k2-register-task.sock";
+    }
+
+    ControlServer::ControlServer(Session &session, std::string path) :
+            session(session), supervisor(session), socketPath(std::move(path))
+    {
+        supervisor.setExitHandler([this](const Result &, const std::string &device, const pid_t pid) {
+            forget(device, pid);
+        });
+    }
+
+    ControlServer::~ControlServer()
+    {
+        close();
+    }
+
+    int ControlServer::open()
+    {
+        struct sockaddr_un address{};
+        int ret = detail::unixSocketAddress(socketPath, address);
+        if (!ret) {
+            ret = supervisor.open();
+        }
+        if (ret) {
+            return ret;
+        }
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (listenFd < 0 || epollFd < 0 || stopFd < 0) {
+            ret = errno;
+            close();
+            return ret;
+        }
+
+        // Fails with EADDRINUSE instead of taking the socket over from a daemon that is still running
+        ret = detail::bindUnixSocket(listenFd, socketPath, boundSocket);
+        if (!ret && listen(listenFd, SOMAXCONN) < 0) {
+            ret = errno;
+        }
+        if (ret) {
+            close();
+            return ret;
+        }
+
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event) < 0) {
+            ret = errno;
+            close();
+            return ret;
+        }
+        event.data.fd = stopFd;
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, stopFd, &event) < 0) {
+            ret = errno;
+            close();
+            return ret;
+        }
+        event.data.fd = supervisor.fd();
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, supervisor.fd(), &event) < 0) {
+            ret = errno;
+            close();
+            return ret;
+        }
+        return 0;
+    }
+
+    int ControlServer::run()
+    {
+        if (epollFd < 0) {
+            return EBADF;
+        }
+
+        std::array<struct epoll_event, maxEvents> events{};
+        while (true) {
+            const int ready = epoll_wait(epollFd, events.data(), maxEvents, -1);
+            if (ready < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            for (int i = 0; i < ready; i++) {
+                const int fd = events[i].data.fd;
+                if (fd == stopFd) {
+                    std::uint64_t value;
+                    static_cast<void>(read(stopFd, &value, sizeof(value)));
+                    return 0;
+                }
+                if (fd == listenFd) {
+                    accept();
+                    continue;
+                }
+                if (fd == supervisor.fd()) {
+                    static_cast<void>(supervisor.poll(0));
+                    continue;
+                }
+
+                auto client = clients.find(fd);
+                if (client == clients.end()) {
+                    continue;
+                }
+                bool keep = true;
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    keep = receive(fd, client->second);
+                }
+                if (keep) {
+                    keep = send(fd, client->second);
+                }
+                if (!keep) {
+                    disconnect(fd);
+                }
+            }
+        }
+    }
+
+    void ControlServer::requestStop()
+    {
+        const std::uint64_t value = 1;
+        static_cast<void>(write(stopFd, &value, sizeof(value)));
+    }
+
+    void ControlServer::setRegistrationTable(RegistrationTable *registrationTable)
+    {
+        table = registrationTable;
+        for (const auto &task: tasks) {
+            publish(task.first.first, task.first.second, task.second);
+        }
+    }
+
+    void ControlServer::publish(const std::string &device, const pid_t pid, const std::int64_t interval)
+    {
+        if (table == nullptr) {
+            return;
+        }
+        // The task itself is registered, a full table only costs the lookups of readers
+        const int ret = table->set(device, pid, interval);
+        if (ret && detail::logEnabled()) {
+            detail::log(Result{Operation::RegisterTask, ret}, device, pid);
+        }
+    }
+
+    void ControlServer::forget(const std::string &device, const pid_t pid)
+    {
+        tasks.erase({device, pid});
+        if (table != nullptr) {
+            table->erase(device, pid);
+        }
+    }
+
+    void ControlServer::accept()
+    {
+        while (true) {
+            const int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                // EAGAIN once the backlog is drained, anything else only concerns the failed connection
+                return;
+            }
+            struct epoll_event event{};
+            event.events = EPOLLIN;
+            event.data.fd = fd;
+            if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) < 0) {
+                ::close(fd);
+                continue;
+            }
+            Client client;
+            client.events = event.events;
+            clients.emplace(fd, std::move(client));
+        }
+    }
+
+    bool ControlServer::receive(const int fd, Client &client)
+    {
+        char chunk[4096];
+        while (true) {
+            process(client);
+            // Buffered requests wait while replies pile up, so a client that does not read them cannot grow the
+            // buffers or keep the server busy; a partial line this long is no request at all
+            if (client.in.size() > maxLineLength) {
+                return client.in.find('\n') != std::string::npos;
+            }
+            if (client.out.size() >= maxPendingOutput) {
+                return true;
+            }
+            const ssize_t received = read(fd, chunk, sizeof(chunk));
+            if (received == 0) {
+                return false;
+            }
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+            }
+            client.in.append(chunk, static_cast<std::size_t>(received));
+        }
+    }
+
+    void ControlServer::process(Client &client)
+    {
+        std::size_t begin = 0;
+        std::size_t end;
+        while (client.out.size() < maxPendingOutput && (end = client.in.find('\n', begin)) != std::string::npos) {
+            client.out += handle(client.in.substr(begin, end - begin));
+            client.out += '\n';
+            begin = end + 1;
+        }
+        client.in.erase(0, begin);
+    }
+
+    bool ControlServer::send(const int fd, Client &client)
+    {
+        bool blocked = false;
+        while (!blocked) {
+            while (!client.out.empty()) {
+                const ssize_t sent = ::send(fd, client.out.data(), client.out.size(), MSG_NOSIGNAL);
+                if (sent < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                        return false;
+                    }
+                    blocked = true;
+                    break;
+                }
+                client.out.erase(0, static_cast<std::size_t>(sent));
+            }
+            // Requests buffered while the replies piled up are answered once the client caught up
+            if (blocked || client.in.find('\n') == std::string::npos) {
+                break;
+            }
+            process(client);
+        }
+
+        // Only wait for writability while replies are pending, a level triggered EPOLLOUT would spin otherwise, and
+        // only for requests while the replies stay below the limit
+        std::uint32_t events = 0;
+        if (client.out.size() < maxPendingOutput) {
+            events |= EPOLLIN;
+        }
+        if (!client.out.empty()) {
+            events |= EPOLLOUT;
+        }
+        if (events == client.events) {
+            return true;
+        }
+        client.events = events;
+        struct epoll_event event{};
+        event.events = events;
+        event.data.fd = fd;
+        return epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &event) == 0;
+    }
+
+    void ControlServer::disconnect(const int fd)
+    {
+        epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, nullptr);
+        ::close(fd);
+        clients.erase(fd);
+    }
+
+    void ControlServer::close()
+    {
+        for (const auto &client: clients) {
+            ::close(client.first);
+        }
+        clients.clear();
+        if (listenFd >= 0) {
+            ::close(listenFd);
+            detail::unlinkUnixSocket(socketPath, boundSocket);
+            listenFd = -1;
+        }
+        if (epollFd >= 0) {
+            ::close(epollFd);
+            epollFd = -1;
+        }
+        if (stopFd >= 0) {
+            ::close(stopFd);
+            stopFd = -1;
+        }
+    }
+
+    std::string ControlServer::handle(const std::string &line)
+    {
+        std::istringstream fields(line);
+        std::string command;
+        fields >> command;
+
+        std::string device;
+        pid_t pid = 0;
+        std::int64_t interval = 0;
+        if (command == "reg") {
+            if (!(fields >> device >> pid >> interval)) {
+                return reply(EINVAL);
+            }
+            const Result result = supervisor.registerTask(device, pid, interval);
+            if (result) {
+                tasks[{device, pid}] = interval;
+                publish(device, pid, interval);
+            }
+            return reply(result.error);
+        }
+        if (command == "unreg") {
+            if (!(fields >> device >> pid)) {
+                return reply(EINVAL);
+            }
+            const Result result = supervisor.unregisterTask(device, pid);
+            if (result) {
+                forget(device, pid);
+            }
+            return reply(result.error);
+        }
+        if (command == "unreg_all") {
+            if (!(fields >> device)) {
+                return reply(EINVAL);
+            }
+            const Result result = supervisor.unregisterAllTasks(device);
+            if (result) {
+                tasks.erase(tasks.lower_bound({device, std::numeric_limits<pid_t>::min()}),
+                            tasks.upper_bound({device, std::numeric_limits<pid_t>::max()}));
+                if (table != nullptr) {
+                    table->eraseDevice(device);
+                }
+            }
+            return reply(result.error);
+        }
+        if (command == "update") {
+            if (!(fields >> device >> pid >> interval)) {
+                return reply(EINVAL);
+            }
+            const Result result = session.updateInterval(device, pid, interval);
+            const auto task = tasks.find({device, pid});
+            if (task == tasks.end()) {
+                return reply(result.error);
+            }
+            if (result) {
+                task->second = interval;
+                publish(device, pid, interval);
+                return reply(0);
+            }
+            // A valid interval is only rejected with EINVAL for a task the driver does not know (anymore), and a
+            // failed restore leaves the task unregistered; otherwise it keeps its old interval
+            const bool lost = result.operation == Operation::RestoreTask || result.error == ENODEV ||
+                              (result.error == EINVAL && interval > 0);
+            if (lost) {
+                supervisor.unwatch(device, pid);
+                forget(device, pid);
+            }
+            return reply(result.error) + (result.operation == Operation::RestoreTask ? " lost" : "");
+        }
+        if (command == "list") {
+            std::string payload;
+            for (const auto &task: tasks) {
+                if (!payload.empty()) {
+                    payload += ' ';
+                }
+                payload += task.first.first + ':' + std::to_string(task.first.second) + ':' +
+                           std::to_string(task.second);
+            }
+            return reply(0, payload);
+        }
+        if (command == "version") {
+            std::string version;
+            const Result result = session.getVersion(version);
+            return reply(result.error, version);
+        }
+        if (command == "devices") {
+            std::string devices;
+            const Result result = session.getActiveDevices(devices);
+            return reply(result.error, devices);
+        }
+        return reply(EINVAL);
+    }
+
+    ControlClient::ControlClient(const std::string &path)
+    {
+        struct sockaddr_un address{};
+        connectError = detail::unixSocketAddress(path, address);
+        if (connectError) {
+            return;
+        }
+        fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0) {
+            connectError = errno;
+            return;
+        }
+        if (connect(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+            connectError = errno;
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    ControlClient::~ControlClient()
+    {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+
+    int ControlClient::request(const std::string &line, std::string &payload)
+    {
+        if (fd < 0) {
+            return connectError ? connectError : ENOTCONN;
+        }
+
+        const std::string message = line + '\n';
+        std::size_t offset = 0;
+        while (offset < message.size()) {
+            const ssize_t sent = ::send(fd, message.data() + offset, message.size() - offset, MSG_NOSIGNAL);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            offset += static_cast<std::size_t>(sent);
+        }
+
+        std::size_t end;
+        while ((end = buffer.find('\n')) == std::string::npos) {
+            char chunk[4096];
+            const ssize_t received = read(fd, chunk, sizeof(chunk));
+            if (received == 0) {
+                return ECONNRESET;
+            }
+            if (received < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return errno;
+            }
+            buffer.append(chunk, static_cast<std::size_t>(received));
+        }
+        const std::string response = buffer.substr(0, end);
+        buffer.erase(0, end + 1);
+
+        if (response.compare(0, 4, "err ") == 0) {
+            const int err = std::atoi(response.c_str() + 4);
+            const auto detail = response.find(' ', 4);
+            payload = detail != std::string::npos ? response.substr(detail + 1) : std::string{};
+            return err > 0 ? err : EPROTO;
+        }
+        if (response == "ok") {
+            payload.clear();
+            return 0;
+        }
+        if (response.compare(0, 3, "ok ") == 0) {
+            payload = response.substr(3);
+            return 0;
+        }
+        return EPROTO;
+    }
+
+    Result ControlClient::getVersion(std::string &version)
+    {
+        return logged(Operation::GetVersion, request("version", version), {}, 0);
+    }
+
+    Result ControlClient::getActiveDevices(std::string &devices)
+    {
+        return logged(Operation::GetActiveDevices, request("devices", devices), {}, 0);
+    }
+
+    Result ControlClient::registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns)
+    {
+        std::string payload;
+        const int ret = request("reg " + device + ' ' + std::to_string(pid) + ' ' + std::to_string(interval_ns),
+                                payload);
+        return logged(Operation::RegisterTask, ret, device, pid);
+    }
+
+    Result ControlClient::unregisterTask(const std::string &device, const pid_t pid)
+    {
+        std::string payload;
+        const int ret = request("unreg " + device + ' ' + std::to_string(pid), payload);
+        return logged(Operation::UnregisterTask, ret, device, pid);
+    }
+
+    Result ControlClient::unregisterAllTasks(const std::string &device)
+    {
+        std::string payload;
+        const int ret = request("unreg_all " + device, payload);
+        return logged(Operation::UnregisterAllTasks, ret, device, 0);
+    }
+
+    Result ControlClient::updateInterval(const std::string &device, const pid_t pid, std::int64_t interval_ns)
+    {
+        std::string payload;
+        const int ret = request("update " + device + ' ' + std::to_string(pid) + ' ' + std::to_string(interval_ns),
+                                payload);
+        // The daemon lost the task if it had to emulate the update and could not register the task again
+        return logged(ret && payload == "lost" ? Operation::RestoreTask : Operation::UpdateInterval, ret, device, pid);
+    }
+
+    Result ControlClient::listTasks(std::vector<TaskSpec> &tasks)
+    {
+        std::string payload;
+        int ret = request("list", payload);
+        if (ret == 0) {
+            tasks.clear();
+            std::istringstream entries(payload);
+            std::string entry;
+            while (entries >> entry) {
+                const auto first = entry.find(':');
+                const auto second = entry.rfind(':');
+                if (first == std::string::npos || first == second) {
+                    ret = EPROTO;
+                    break;
+                }
+                TaskSpec task;
+                task.device = entry.substr(0, first);
+                task.pid = static_cast<pid_t>(std::atol(entry.c_str() + first + 1));
+                task.interval_ns = std::atoll(entry.c_str() + second + 1);
+                tasks.push_back(std::move(task));
+            }
+        }
+        return logged(Operation::ListTasks, ret, {}, 0);
+    }
+}
@@ -0,0 +1,244 @@
+#include "libk2/deviceid.hpp"
+
+extern "C" {
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+
+namespace k2 {
+
+    // Compile time checks of the encoding, they document the layout the tracing scripts rely on
+    static_assert(encodeKernelDev(DeviceId{259, 0}) == 271581184, "nvme namespace 259:0");
+    static_assert(encodeKernelDev(DeviceId{8, 16}) == 8388624, "sdb is 8:16");
+    static_assert(decodeKernelDev(271581185) == DeviceId{259, 1});
+    static_assert(decodeKernelDev(encodeKernelDev(DeviceId{kernelMajorMax, kernelMinorMask})) ==
+                  DeviceId{kernelMajorMax, kernelMinorMask});
+    static_assert(encodeKernelDev(DeviceId{kernelMajorMax, kernelMinorMask}) == UINT32_MAX);
+    static_assert(!isKernelEncodable(DeviceId{kernelMajorMax + 1, 0}));
+    static_assert(!isKernelEncodable(DeviceId{0, kernelMinorMask + 1}));
+
+    constexpr DeviceId parsed(const std::string_view text)
+    {
+        DeviceId id{UINT32_MAX, UINT32_MAX};
+        return parseDeviceId(text, id) ? id : DeviceId{UINT32_MAX, UINT32_MAX};
+    }
+
+    constexpr bool rejects(const std::string_view text)
+    {
+        return parsed(text) == DeviceId{UINT32_MAX, UINT32_MAX};
+    }
+
+    static_assert(parsed("259:0") == DeviceId{259, 0});
+    static_assert(parsed("0:0") == DeviceId{0, 0});
+    static_assert(parsed("4095:1048575") == DeviceId{kernelMajorMax, kernelMinorMask});
+    static_assert(rejects("4096:0"), "major exceeds 12 bits");
+    static_assert(rejects("0:1048576"), "minor exceeds 20 bits");
+    static_assert(rejects("259"));
+    static_assert(rejects("259:"));
+    static_assert(rejects(":0"));
+    static_assert(rejects("259:0:1"));
+    static_assert(rejects(" 259:0"));
+    static_assert(rejects("259:0x"));
+    static_assert(rejects("-1:0"));
+    static_assert(rejects("99999999999:0"), "overflow");
+
+    dev_t toDevT(const DeviceId id)
+    {
+        return makedev(id.major, id.minor);
+    }
+
+    DeviceId fromDevT(const dev_t dev)
+    {
+        return DeviceId{static_cast<std::uint32_t>(major(dev)), static_cast<std::uint32_t>(minor(dev))};
+    }
+
+    std::string toString(const DeviceId id)
+    {
+        return std::to_string(id.major) + ":" + std::to_string(id.minor);
+    }
+
+    namespace {
+        bool isNumber(const std::string &text)
+        {
+            std::uint32_t value;
+            return parseDecimal(text, value);
+        }
+
+        /**
+         * @brief Looks up the kernel name of a device through the /sys/dev/block/<major>:<minor> link
+         */
+        int nameOf(const DeviceId id, const std::string &sysRoot, std::string &name)
+        {
+            char target[512];
+            const std::string link = sysRoot + "/dev/block/" + toString(id);
+            const ssize_t length = readlink(link.c_str(), target, sizeof(target) - 1);
+            if (length < 0) {
+                return errno == ENOENT ? ENODEV : errno;
+            }
+            const std::string path(target, static_cast<std::size_t>(length));
+            name = path.substr(path.rfind('/') + 1);
+            return 0;
+        }
+
+        /**
+         * @brief Looks up the device number of a kernel name through /sys/class/block/<name>/dev
+         */
+        int idOf(const std::string &name, const std::string &sysRoot, DeviceId &id)
+        {
+            if (name.empty() || name.find('/') != std::string::npos || name == "." || name == "..") {
+                return EINVAL;
+            }
+            std::ifstream in(sysRoot + "/class/block/" + name + "/dev");
+            std::string line;
+            if (!std::getline(in, line)) {
+                return ENODEV;
+            }
+            return parseDeviceId(line, id) ? 0 : EINVAL;
+        }
+    }
+
+    int resolveDevice(const std::string &identifier, BlockDevice &device, const std::string &sysRoot)
+    {
+        BlockDevice resolved;
+        int ret;
+        if (identifier.find(':') != std::string::npos) {
+            if (!parseDeviceId(identifier, resolved.id)) {
+                return EINVAL;
+            }
+            ret = nameOf(resolved.id, sysRoot, resolved.name);
+        } else if (isNumber(identifier)) {
+            std::uint32_t internal = 0;
+            static_cast<void>(parseDecimal(identifier, internal));
+            resolved.id = decodeKernelDev(internal);
+            ret = nameOf(resolved.id, sysRoot, resolved.name);
+        } else if (!identifier.empty() && identifier[0] == '/') {
+            struct stat st{};
+            if (stat(identifier.c_str(), &st) < 0) {
+                return errno == ENOENT ? ENODEV : errno;
+            }
+            if (!S_ISBLK(st.st_mode)) {
+                return ENOTBLK;
+            }
+            resolved.id = fromDevT(st.st_rdev);
+            ret = nameOf(resolved.id, sysRoot, resolved.name);
+        } else {
+            resolved.name = identifier;
+            ret = idOf(identifier, sysRoot, resolved.id);
+        }
+        if (ret == 0) {
+            device = std::move(resolved);
+        }
+        return ret;
+    }
+
+    std::string diskName(const std::string &name, const std::string &sysRoot)
+    {
+        // Partitions only show up in class/block, where their directory sits inside the one of the disk
+        const std::string entry = sysRoot + "/class/block/" + name;
+        if (name.empty() || name.find('/') != std::string::npos || access((entry + "/partition").c_str(), F_OK) != 0) {
+            return name;
+        }
+        char *disk = realpath((entry + "/..").c_str(), nullptr);
+        if (disk == nullptr) {
+            return name;
+        }
+        const std::string path(disk);
+        free(disk);
+        return path.substr(path.find_last_of('/') + 1);
+    }
+
+    int convertDeviceIds(std::istream &in, std::ostream &out, const DeviceIdFormat format, std::size_t &failedLine,
+                         const std::string &sysRoot)
+    {
+        failedLine = 0;
+        if (format == DeviceIdFormat::NA) {
+            return EINVAL;
+        }
+
+        std::string line;
+        std::string converted;
+        std::size_t lineNo = 0;
+        while (std::getline(in, line)) {
+            lineNo++;
+            if (!line.empty() && line.back() == '\r') {
+                line.pop_back();
+            }
+            if (line.empty()) {
+                continue;
+            }
+
+            // Numbers converted to numbers are the bulk of a trace filter, they never need sysfs
+            DeviceId id;
+            bool numeric = false;
+            if (format != DeviceIdFormat::Name) {
+                std::uint32_t internal;
+                if (parseDeviceId(line, id)) {
+                    numeric = true;
+                } else if (parseDecimal(line, internal)) {
+                    id = decodeKernelDev(internal);
+                    numeric = true;
+                }
+            }
+
+            std::string name;
+            if (!numeric) {
+                BlockDevice device;
+                const int ret = resolveDevice(line, device, sysRoot);
+                if (ret) {
+                    failedLine = lineNo;
+                    return ret;
+                }
+                id = device.id;
+                name = std::move(device.name);
+            }
+
+            switch (format) {
+                case DeviceIdFormat::Internal:
+                    converted = std::to_string(encodeKernelDev(id));
+                    break;
+                case DeviceIdFormat::Number:
+                    converted = toString(id);
+                    break;
+                default:
+                    converted = name;
+                    break;
+            }
+            converted += '\n';
+            out.write(converted.data(), static_cast<std::streamsize>(converted.size()));
+        }
+        return 0;
+    }
+
+    std::string toString(const DeviceIdFormat format)
+    {
+        switch (format) {
+            case DeviceIdFormat::Internal:
+                return "internal";
+            case DeviceIdFormat::Number:
+                return "number";
+            case DeviceIdFormat::Name:
+                return "name";
+            default:
+                return "N/A";
+        }
+    }
+
+    DeviceIdFormat deviceIdFormatToEnum(const std::string &name)
+    {
+        if (name == "internal") {
+            return DeviceIdFormat::Internal;
+        }
+        if (name == "number") {
+            return DeviceIdFormat::Number;
+        }
+        if (name == "name") {
+            return DeviceIdFormat::Name;
+        }
+        return DeviceIdFormat::NA;
+    }
+}
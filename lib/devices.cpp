@@ -0,0 +1,89 @@
+#include "libk2/devices.hpp"
+
+extern "C" {
+#include <sys/sysmacros.h>
+}
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+
+namespace k2 {
+
+    namespace {
+        std::atomic<std::uint64_t> &generationCounter()
+        {
+            static std::atomic<std::uint64_t> generation{1};
+            return generation;
+        }
+
+        dev_t readDeviceNumber(const std::string &device, const std::string &sysBlock)
+        {
+            std::ifstream in(sysBlock + "/" + device + "/dev");
+            unsigned major = 0;
+            unsigned minor = 0;
+            char separator = 0;
+            if (!(in >> major >> separator >> minor) || separator != ':') {
+                return 0;
+            }
+            return makedev(major, minor);
+        }
+    }
+
+    std::vector<DeviceInfo> parseDevices(const std::string &devices, const std::string &sysBlock)
+    {
+        std::vector<DeviceInfo> inventory;
+        std::size_t begin = 0;
+        while (begin < devices.size()) {
+            begin = devices.find_first_not_of(" \t\n,", begin);
+            if (begin == std::string::npos) {
+                break;
+            }
+            const auto end = std::min(devices.find_first_of(" \t\n,", begin), devices.size());
+
+            DeviceInfo info;
+            info.name = devices.substr(begin, end - begin);
+            info.dev = readDeviceNumber(info.name, sysBlock);
+            info.scheduler = activeScheduler(info.name, sysBlock);
+            inventory.push_back(std::move(info));
+            begin = end;
+        }
+        return inventory;
+    }
+
+    std::string activeScheduler(const std::string &device, const std::string &sysBlock)
+    {
+        std::ifstream in(sysBlock + "/" + device + "/queue/scheduler");
+        std::string line;
+        if (!std::getline(in, line)) {
+            return {};
+        }
+        // The active scheduler is the one in brackets, e.g. "none [k2] mq-deadline"
+        const auto begin = line.find('[');
+        const auto end = line.find(']');
+        if (begin == std::string::npos || end == std::string::npos || end < begin) {
+            return line;
+        }
+        return line.substr(begin + 1, end - begin - 1);
+    }
+
+    std::uint64_t deviceGeneration()
+    {
+        return generationCounter().load(std::memory_order_acquire);
+    }
+
+    void invalidateDevices()
+    {
+        generationCounter().fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    const DeviceInfo *DeviceCache::find(const std::string &name) const
+    {
+        for (const auto &device: devices) {
+            if (device.name == name) {
+                return &device;
+            }
+        }
+        return nullptr;
+    }
+}
@@ -0,0 +1,119 @@
+#include "libk2/histogram.hpp"
+
+#include <algorithm>
+
+namespace k2 {
+
+    Histogram::Histogram(const unsigned significantBits) :
+            subBucketBits(std::clamp(significantBits, 2U, 16U))
+    {
+        // One linear range for values below 2^bits, then half a range per additional power of two
+        counts.resize(bucketIndex(UINT64_MAX) + 1, 0);
+    }
+
+    std::size_t Histogram::bucketIndex(const std::uint64_t value) const
+    {
+        if (value < (std::uint64_t{1} << subBucketBits)) {
+            return value;
+        }
+        const unsigned msb = 63 - __builtin_clzll(value);
+        const unsigned shift = msb - subBucketBits + 1;
+        return (static_cast<std::size_t>(shift) << (subBucketBits - 1)) + (value >> shift);
+    }
+
+    std::uint64_t Histogram::bucketLowerBound(const std::size_t index) const
+    {
+        if (index < (std::size_t{1} << subBucketBits)) {
+            return index;
+        }
+        const std::size_t shift = (index >> (subBucketBits - 1)) - 1;
+        const std::uint64_t mantissa = index - (shift << (subBucketBits - 1));
+        return mantissa << shift;
+    }
+
+    std::uint64_t Histogram::bucketUpperBound(const std::size_t index) const
+    {
+        if (index + 1 >= counts.size()) {
+            return UINT64_MAX;
+        }
+        return bucketLowerBound(index + 1) - 1;
+    }
+
+    void Histogram::recordN(const std::uint64_t value, const std::uint64_t count)
+    {
+        counts[bucketIndex(value)] += count;
+        total += count;
+        sum += static_cast<long double>(value) * count;
+        minValue = std::min(minValue, value);
+        maxValue = std::max(maxValue, value);
+    }
+
+    void Histogram::merge(const Histogram &other)
+    {
+        if (other.subBucketBits != subBucketBits) {
+            return;
+        }
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        sum += other.sum;
+        minValue = std::min(minValue, other.minValue);
+        maxValue = std::max(maxValue, other.maxValue);
+    }
+
+    void Histogram::reset()
+    {
+        std::fill(counts.begin(), counts.end(), 0);
+        total = 0;
+        sum = 0;
+        minValue = UINT64_MAX;
+        maxValue = 0;
+    }
+
+    bool Histogram::restore(const std::vector<std::uint64_t> &buckets, const std::uint64_t min,
+                            const std::uint64_t max, const double sum)
+    {
+        if (buckets.size() != counts.size()) {
+            return false;
+        }
+        counts = buckets;
+        total = 0;
+        for (const auto count: counts) {
+            total += count;
+        }
+        this->sum = sum;
+        minValue = total ? min : UINT64_MAX;
+        maxValue = total ? max : 0;
+        return true;
+    }
+
+    std::uint64_t Histogram::min() const
+    {
+        return total ? minValue : 0;
+    }
+
+    double Histogram::mean() const
+    {
+        return total ? static_cast<double>(sum / total) : 0.0;
+    }
+
+    std::uint64_t Histogram::percentile(const double percentile) const
+    {
+        if (total == 0) {
+            return 0;
+        }
+        const double clamped = std::clamp(percentile, 0.0, 100.0);
+        auto rank = static_cast<std::uint64_t>(clamped / 100.0 * static_cast<double>(total) + 0.5);
+        rank = std::clamp<std::uint64_t>(rank, 1, total);
+
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) {
+                return std::min(bucketUpperBound(i), maxValue);
+            }
+        }
+        return maxValue;
+    }
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libk2/result.hpp"
+#include "libk2/session.hpp"
+
+namespace k2 {
+
+    /**
+     * @brief Called on the worker thread of an AsyncSession once an operation completed
+     */
+    using Completion = std::function<void(const Result &result)>;
+
+    /**
+     * @brief Result of an operation submitted with a tag, see AsyncSession::reap
+     */
+    struct AsyncCompletion
+    {
+        std::uint64_t tag = 0;
+        Result result{};
+    };
+
+    /**
+     * @brief Non-blocking front end of a Session
+     * @details Operations are queued in a lock-free multi producer, single consumer queue and return right away. A
+     * dedicated worker thread owns the session, and with it the persistent driver handle, and issues the ioctls in
+     * submission order. Each operation completes through one of three channels, picked per call:
+     * - a std::future returned by the overloads without a completion argument,
+     * - a Completion callback, which runs on the worker thread and must not block it,
+     * - a caller chosen tag, queued for reap and signalled through eventFd, so reactors can poll for completions
+     *   together with their other file descriptors.
+     *
+     * Submitting is safe from any number of threads. Destroying the session completes all queued operations first.
+     */
+    class AsyncSession
+    {
+    public:
+        /**
+         * @brief Opens the driver through the default backend, see setDefaultBackend
+         */
+        AsyncSession();
+
+        /**
+         * @brief Takes over a configured session, e.g. one with device validation enabled
+         */
+        explicit AsyncSession(Session session);
+
+        AsyncSession(const AsyncSession &other) = delete;
+
+        ~AsyncSession();
+
+        AsyncSession &operator=(const AsyncSession &other) = delete;
+
+        /**
+         * @return true if the driver device could be opened and the worker is running
+         */
+        [[nodiscard]] bool isOpen() const
+        { return openError == 0; }
+
+        /**
+         * @return The result of opening the driver device and setting up the worker
+         */
+        [[nodiscard]] Result error() const
+        { return Result{Operation::OpenDriver, openError}; }
+
+        std::future<Result> registerTask(const std::string &device, pid_t pid, std::int64_t interval_ns);
+
+        void registerTask(const std::string &device, pid_t pid, std::int64_t interval_ns, Completion done);
+
+        void registerTask(const std::string &device, pid_t pid, std::int64_t interval_ns, std::uint64_t tag);
+
+        std::future<Result> unregisterTask(const std::string &device, pid_t pid);
+
+        void unregisterTask(const std::string &device, pid_t pid, Completion done);
+
+        void unregisterTask(const std::string &device, pid_t pid, std::uint64_t tag);
+
+        std::future<Result> unregisterAllTasks(const std::string &device);
+
+        void unregisterAllTasks(const std::string &device, Completion done);
+
+        void unregisterAllTasks(const std::string &device, std::uint64_t tag);
+
+        std::future<Result> updateInterval(const std::string &device, pid_t pid, std::int64_t interval_ns);
+
+        void updateInterval(const std::string &device, pid_t pid, std::int64_t interval_ns, Completion done);
+
+        void updateInterval(const std::string &device, pid_t pid, std::int64_t interval_ns, std::uint64_t tag);
+
+        /**
+         * @brief Non-blocking eventfd that becomes readable when tagged completions are ready for reap
+         * @return The descriptor, owned by the session, or -1 if the session could not be set up
+         */
+        [[nodiscard]] int eventFd() const
+        { return completionFd; }
+
+        /**
+         * @brief Appends all tagged completions that are available to ready and resets eventFd, never blocks
+         * @return The number of completions appended
+         */
+        std::size_t reap(std::vector<AsyncCompletion> &ready);
+
+    private:
+        struct Request;
+
+        Session session;
+        int openError = 0;
+        int wakeFd = -1;
+        int completionFd = -1;
+        std::thread worker;
+        std::atomic<bool> stopping{false};
+        // Set while the worker waits on wakeFd, so producers only pay for the write when it sleeps
+        std::atomic<bool> sleeping{false};
+
+        // Intrusive Vyukov queue: producers swap themselves into head, the worker follows the links from tail
+        std::unique_ptr<Request> stub;
+        alignas(64) std::atomic<Request *> head;
+        alignas(64) Request *tail;
+
+        std::mutex completionMutex;
+        std::vector<AsyncCompletion> completions;
+
+        std::future<Result> submitFuture(Operation operation, const std::string &device, pid_t pid,
+                                         std::int64_t interval_ns);
+
+        void submitCallback(Operation operation, const std::string &device, pid_t pid, std::int64_t interval_ns,
+                            Completion done);
+
+        void submitTag(Operation operation, const std::string &device, pid_t pid, std::int64_t interval_ns,
+                       std::uint64_t tag);
+
+        void submit(std::unique_ptr<Request> request);
+
+        void push(Request *request);
+
+        /**
+         * @return The oldest request or nullptr if the queue is empty or a producer is halfway through a push
+         */
+        Request *pop();
+
+        [[nodiscard]] bool empty() const;
+
+        void run();
+
+        Result execute(const Request &request);
+
+        void complete(Request &request, const Result &result);
+    };
+}
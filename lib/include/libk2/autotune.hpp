@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+
+#include "libk2/histogram.hpp"
+
+namespace k2 {
+
+    struct TunerOptions
+    {
+        /**
+         * @brief Latency the chosen percentile of an epoch has to stay below, in ns
+         */
+        std::int64_t targetNs = 1000 * 1000;
+        double percentile = 99;
+        std::int64_t minIntervalNs = 100 * 1000;
+        std::int64_t maxIntervalNs = 1000 * 1000 * 1000;
+        /**
+         * @brief Epochs with fewer completions keep the interval, their percentiles are noise
+         */
+        std::uint64_t minSamples = 20;
+        /**
+         * @brief Factor by which the interval grows while no failing interval is known, and shrinks on a miss
+         * without a known good one
+         */
+        double growth = 2.0;
+        /**
+         * @brief Relative distance between the largest good and the smallest failing interval at which the search
+         * stops
+         */
+        double resolution = 0.05;
+        /**
+         * @brief Consecutive epochs meeting the target after which the failing bound is widened, so the tuner
+         * probes upwards again once the load dropped. Each probe of an unchanged load costs one missed epoch.
+         */
+        unsigned probeEpochs = 30;
+    };
+
+    /**
+     * @brief Closed-loop search for the largest task interval whose completion latencies still meet a target
+     * @details Feed the completion latencies of one epoch (e.g. one second) at a time. The tuner grows the interval
+     * geometrically until an epoch misses the target, then bisects between the largest interval that met it and the
+     * smallest one that did not. A miss falls back to the last good interval at once, so a violation lasts a
+     * single epoch. Both bounds are revised as the load changes.
+     */
+    class IntervalTuner
+    {
+    public:
+        IntervalTuner(const TunerOptions &options, const std::int64_t initialNs);
+
+        /**
+         * @brief Evaluates the latencies of the epoch run at interval() and picks the interval of the next one
+         * @return The new interval
+         */
+        std::int64_t update(const Histogram &latencies);
+
+        [[nodiscard]] std::int64_t interval() const
+        { return current; }
+
+        /**
+         * @return The largest interval known to meet the target, 0 if none is known
+         */
+        [[nodiscard]] std::int64_t good() const
+        { return goodNs; }
+
+        /**
+         * @return The smallest interval known to miss the target, 0 if none is known
+         */
+        [[nodiscard]] std::int64_t bad() const
+        { return badNs; }
+
+        /**
+         * @return The percentile of the last epoch that had enough samples, in ns
+         */
+        [[nodiscard]] std::uint64_t observed() const
+        { return lastObserved; }
+
+        [[nodiscard]] bool converged() const;
+
+    private:
+        const TunerOptions options;
+        std::int64_t current;
+        std::int64_t goodNs = 0;
+        std::int64_t badNs = 0;
+        unsigned goodEpochs = 0;
+        std::uint64_t lastObserved = 0;
+
+        [[nodiscard]] std::int64_t clamp(const double interval) const;
+    };
+}
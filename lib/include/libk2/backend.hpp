@@ -0,0 +1,135 @@
+#pragma once
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "libk2/result.hpp"
+
+struct k2_ioctl;
+
+namespace k2 {
+
+    /**
+     * @brief Path of the k2 driver control device
+     * @details May be overridden with the K2_IOSCHED_DEV environment variable, e.g. to point tools at a mock device
+     */
+    std::string k2IoschedDev();
+
+    /**
+     * @brief Transport between a Session and the k2 driver
+     * @details All methods return 0 on success or an errno value
+     */
+    class Backend
+    {
+    public:
+        virtual ~Backend() = default;
+
+        [[nodiscard]] virtual int open() = 0;
+
+        virtual int close() = 0;
+
+        [[nodiscard]] virtual int ioctl(unsigned long request, struct k2_ioctl &io) = 0;
+    };
+
+    /**
+     * @brief Talks to the k2 kernel module through its control device
+     */
+    class IoctlBackend : public Backend
+    {
+    protected:
+        const std::string devName;
+        int fd = -1;
+
+    public:
+        explicit IoctlBackend(std::string devName = k2IoschedDev());
+
+        ~IoctlBackend() override;
+
+        [[nodiscard]] int open() override;
+
+        int close() override;
+
+        [[nodiscard]] int ioctl(unsigned long request, struct k2_ioctl &io) override;
+    };
+
+    /**
+     * @brief In-process emulation of the k2 driver state
+     * @details Implements the semantics of K2_IOC_GET_VERSION, K2_IOC_GET_DEVICES, the (un)register ioctls and,
+     * if k2.h defines it, K2_IOC_UPDATE_PERIODIC_TASK, including their error cases, so libk2 can be exercised
+     * without the kernel module. Shared by all FakeBackends created for it and safe to use from multiple threads.
+     */
+    class FakeDriver
+    {
+    public:
+        explicit FakeDriver(std::vector<std::string> devices = {"nvme0n1"}, std::string version = "fake");
+
+        /**
+         * @brief Emulates loading or unloading the module, opening the driver fails with ENOENT while unloaded
+         */
+        void setLoaded(const bool loaded);
+
+        /**
+         * @brief Lets the next request of the given operation fail with error
+         */
+        void injectError(const Operation operation, const int error);
+
+        /**
+         * @return The interval of a registered task, empty if it is not registered
+         */
+        [[nodiscard]] std::optional<std::int64_t> interval(const std::string &device, const pid_t pid) const;
+
+        [[nodiscard]] std::size_t taskCount(const std::string &device) const;
+
+        [[nodiscard]] int open();
+
+        [[nodiscard]] int ioctl(unsigned long request, struct k2_ioctl &io);
+
+    private:
+        mutable std::mutex mutex;
+        const std::string version;
+        std::map<std::string, std::map<pid_t, std::int64_t>> tasks;
+        std::map<Operation, int> injectedErrors;
+        bool loaded = true;
+
+        int takeInjectedError(const Operation operation);
+    };
+
+    /**
+     * @brief Routes a Session's requests to a FakeDriver
+     */
+    class FakeBackend : public Backend
+    {
+    protected:
+        const std::shared_ptr<FakeDriver> driver;
+        bool opened = false;
+
+    public:
+        explicit FakeBackend(std::shared_ptr<FakeDriver> driver);
+
+        [[nodiscard]] int open() override;
+
+        int close() override;
+
+        [[nodiscard]] int ioctl(unsigned long request, struct k2_ioctl &io) override;
+    };
+
+    using BackendFactory = std::function<std::unique_ptr<Backend>()>;
+
+    /**
+     * @brief Replaces the backend used by default constructed Sessions and the free functions of libk2
+     * @details An empty factory restores the IoctlBackend. Not thread safe, call before issuing operations.
+     */
+    void setDefaultBackend(BackendFactory factory);
+
+    [[nodiscard]] std::unique_ptr<Backend> makeDefaultBackend();
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libk2/deviceid.hpp"
+#include "libk2/histogram.hpp"
+
+namespace k2 {
+
+    /**
+     * @brief Block layer latencies of the requests of one process
+     */
+    struct RequestStats
+    {
+        std::string comm;
+        std::uint64_t requests = 0;
+        std::uint64_t bytes = 0;
+        /**
+         * @brief Insertion into the I/O scheduler until dispatch to the driver in ns, only for requests that went
+         * through the scheduler
+         */
+        k2::Histogram queue;
+        /**
+         * @brief Dispatch to the driver until completion in ns
+         */
+        k2::Histogram service;
+        /**
+         * @brief Insertion, or dispatch for requests that bypassed the scheduler, until completion in ns
+         */
+        k2::Histogram latency;
+    };
+
+    /**
+     * @brief Online block layer latency tracer for one device
+     * @details Samples the block_rq_insert, block_rq_issue and block_rq_complete tracepoints through perf_event_open
+     * with one mmap'ed ring buffer per CPU, filtered in the kernel to the device. Samples are decoded in place in the
+     * rings, matched by sector and folded into per pid histograms, so nothing is written to disk. Requests are
+     * attributed to the process that inserted them, or issued them if they bypassed the scheduler.
+     * Needs CAP_PERFMON (or root) and tracefs.
+     */
+    class BlockTracer
+    {
+    public:
+        /**
+         * @param ringPages Data pages of each per CPU ring, must be a power of two
+         */
+        explicit BlockTracer(const DeviceId device, const unsigned ringPages = 64);
+
+        BlockTracer(const BlockTracer &other) = delete;
+
+        ~BlockTracer();
+
+        BlockTracer &operator=(const BlockTracer &other) = delete;
+
+        /**
+         * @brief Opens and enables the tracepoints on all online CPUs
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int open();
+
+        /**
+         * @brief Waits up to timeoutMs for samples and processes everything that is buffered
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int poll(const int timeoutMs);
+
+        [[nodiscard]] const std::unordered_map<pid_t, RequestStats> &stats() const
+        { return perPid; }
+
+        /**
+         * @brief Starts a new measurement epoch, requests in flight are still matched
+         */
+        void clearStats()
+        { perPid.clear(); }
+
+        /**
+         * @return Samples the kernel dropped because a ring was full
+         */
+        [[nodiscard]] std::uint64_t lost() const
+        { return lostSamples; }
+
+        /**
+         * @return Completions without a matching issue, e.g. of requests issued before tracing started
+         */
+        [[nodiscard]] std::uint64_t unmatched() const
+        { return unmatchedCompletions; }
+
+        [[nodiscard]] std::size_t inFlight() const
+        { return pending.size(); }
+
+    private:
+        enum class Event
+        {
+            Insert,
+            Issue,
+            Complete
+        };
+
+        struct Tracepoint
+        {
+            std::uint16_t id = 0;
+            std::uint32_t sectorOffset = 0;
+            std::uint32_t nrSectorOffset = 0;
+            /**
+             * @brief Offset of comm, 0 for tracepoints without it
+             */
+            std::uint32_t commOffset = 0;
+        };
+
+        struct Sample
+        {
+            std::uint64_t time;
+            std::uint64_t sector;
+            std::uint32_t nrSector;
+            pid_t pid;
+            Event event;
+            /**
+             * @brief A completion that already waited one poll for its issue, which may sit in a ring read later
+             */
+            bool retried;
+            char comm[16];
+        };
+
+        struct Pending
+        {
+            std::uint64_t insertNs = 0;
+            std::uint64_t issueNs = 0;
+            pid_t pid = 0;
+            char comm[16];
+        };
+
+        struct Ring
+        {
+            int fd = -1;
+            void *base = nullptr;
+        };
+
+        const DeviceId device;
+        const unsigned ringPages;
+        std::size_t pageSize = 0;
+        Tracepoint tracepoints[3];
+        std::vector<int> eventFds;
+        std::vector<Ring> rings;
+        int epollFd = -1;
+        std::vector<Sample> samples;
+        std::vector<Sample> early;
+        std::vector<char> scratch;
+        std::unordered_map<std::uint64_t, Pending> pending;
+        std::unordered_map<pid_t, RequestStats> perPid;
+        std::uint64_t lostSamples = 0;
+        std::uint64_t unmatchedCompletions = 0;
+
+        void drain(Ring &ring);
+
+        void decode(const char *record, const std::size_t size);
+
+        void process(const Sample &sample);
+
+        void close();
+    };
+
+    /**
+     * @return The tracefs mount point, empty if tracefs is not available
+     */
+    [[nodiscard]] std::string tracefsRoot();
+}
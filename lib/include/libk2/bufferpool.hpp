@@ -0,0 +1,95 @@
+#pragma once
+
+extern "C" {
+#include <sys/uio.h>
+}
+
+#include <cstddef>
+#include <vector>
+
+namespace workload {
+
+    struct BufferPoolOptions
+    {
+        std::size_t bufferSize = 0;
+        std::size_t count = 1;
+        /**
+         * @brief Alignment of every buffer, 4 KiB satisfies O_DIRECT on all common devices
+         */
+        std::size_t alignment = 4096;
+        /**
+         * @brief Back the pool with huge pages, falls back to transparent huge pages if none are reserved
+         */
+        bool hugePages = false;
+        /**
+         * @brief mlock the pool, so page faults on the buffers cannot show up in request latencies
+         */
+        bool lock = false;
+        /**
+         * @brief Map the pool shared, so forked processes use the same pages instead of copy-on-write copies
+         */
+        bool shared = false;
+    };
+
+    /**
+     * @brief Fixed set of aligned, pre-faulted I/O buffers carved out of one mapping and reused across requests
+     * @details Buffers are handed out by index, which doubles as the buffer index for io_uring registered buffers.
+     * acquire/release are not thread safe, threads sharing a pool should use fixed indices.
+     */
+    class BufferPool
+    {
+    public:
+        BufferPool() = default;
+
+        BufferPool(const BufferPool &other) = delete;
+
+        ~BufferPool();
+
+        BufferPool &operator=(const BufferPool &other) = delete;
+
+        /**
+         * @return 0 on success or an errno value, in which case the pool stays empty
+         */
+        [[nodiscard]] int allocate(const BufferPoolOptions &options);
+
+        /**
+         * @brief Unmaps all buffers, the pool can be allocated again afterwards
+         */
+        void reset();
+
+        [[nodiscard]] void *buffer(const std::size_t index) const
+        { return base + index * stride; }
+
+        [[nodiscard]] std::size_t count() const
+        { return bufferCount; }
+
+        [[nodiscard]] std::size_t bufferSize() const
+        { return size; }
+
+        [[nodiscard]] bool usesHugePages() const
+        { return hugePages; }
+
+        [[nodiscard]] bool isLocked() const
+        { return locked; }
+
+        [[nodiscard]] std::vector<struct iovec> iovecs() const;
+
+        /**
+         * @return The index of an unused buffer, -1 if all buffers are in use
+         */
+        [[nodiscard]] int acquire();
+
+        void release(const int index);
+
+    private:
+        void *mapping = nullptr;
+        std::size_t mappingSize = 0;
+        char *base = nullptr;
+        std::size_t stride = 0;
+        std::size_t size = 0;
+        std::size_t bufferCount = 0;
+        bool hugePages = false;
+        bool locked = false;
+        std::vector<int> freeList;
+    };
+}
@@ -0,0 +1,201 @@
+#pragma once
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "libk2/regtable.hpp"
+#include "libk2/result.hpp"
+#include "libk2/session.hpp"
+#include "libk2/supervisor.hpp"
+#include "libk2/unixsocket.hpp"
+
+namespace k2 {
+
+    /**
+     * @brief Path of the Unix domain socket of the k2-register-task daemon
+     * @details May be overridden with the K2_CONTROL_SOCKET environment variable
+     */
+    std::string k2ControlSocket();
+
+    /**
+     * @brief Serves k2 requests of local clients through one persistent driver session
+     * @details Clients send one request per line and receive one reply line per request, in order, so requests may be
+     * pipelined:
+     *
+     *     reg <device> <pid> <interval_ns>    ->  ok | err <errno>
+     *     unreg <device> <pid>                ->  ok | err <errno>
+     *     unreg_all <device>                  ->  ok | err <errno>
+     *     update <device> <pid> <interval_ns> ->  ok | err <errno> [lost]
+     *     list                                ->  ok [<device>:<pid>:<interval_ns> ...]
+     *     version                             ->  ok <version> | err <errno>
+     *     devices                             ->  ok [<device> ...] | err <errno>
+     *
+     * An update answered with "lost" unregistered the task and could not register it again. list reports the tasks
+     * registered through this server. Their processes are watched by a TaskSupervisor and unregistered once they
+     * exit, a task whose process does not exist is rejected with ESRCH. All clients are served by a single thread
+     * with an epoll loop, which also serializes the requests on the session.
+     */
+    class ControlServer
+    {
+    public:
+        ControlServer(Session &session, std::string path = k2ControlSocket());
+
+        ControlServer(const ControlServer &other) = delete;
+
+        ~ControlServer();
+
+        ControlServer &operator=(const ControlServer &other) = delete;
+
+        /**
+         * @brief Binds and listens on the socket path, replacing a stale socket file
+         * @return 0 on success or an errno value, EADDRINUSE if another daemon serves on the path
+         */
+        [[nodiscard]] int open();
+
+        /**
+         * @brief Serves clients until requestStop is called
+         * @return 0 after a requested stop or an errno value
+         */
+        [[nodiscard]] int run();
+
+        /**
+         * @brief Async signal safe request to return from run
+         */
+        void requestStop();
+
+        [[nodiscard]] const std::string &path() const
+        { return socketPath; }
+
+        /**
+         * @brief Publishes the tasks registered through this server in a shared registration table, nullptr to stop
+         * @details The table is filled with the current tasks and then kept in step with them, so monitoring agents
+         * can look up registrations without a round trip to the server.
+         */
+        void setRegistrationTable(RegistrationTable *table);
+
+        /**
+         * @brief Executes one request line and returns the reply line without the trailing newline
+         */
+        std::string handle(const std::string &line);
+
+    private:
+        struct Client
+        {
+            std::string in;
+            std::string out;
+            /**
+             * @brief epoll events the client is registered for
+             */
+            std::uint32_t events = 0;
+        };
+
+        Session &session;
+        TaskSupervisor supervisor;
+        const std::string socketPath;
+        int listenFd = -1;
+        BoundSocket boundSocket;
+        int epollFd = -1;
+        int stopFd = -1;
+        std::unordered_map<int, Client> clients;
+        std::map<std::pair<std::string, pid_t>, std::int64_t> tasks;
+        RegistrationTable *table = nullptr;
+
+        void accept();
+
+        /**
+         * @brief Writes a task to the registration table, if there is one
+         */
+        void publish(const std::string &device, pid_t pid, std::int64_t interval);
+
+        /**
+         * @brief Drops a task that is no longer registered from the task list and the registration table
+         */
+        void forget(const std::string &device, pid_t pid);
+
+        /**
+         * @return false if the client has to be disconnected
+         */
+        bool receive(const int fd, Client &client);
+
+        /**
+         * @brief Answers the complete requests in the input buffer, as long as the replies stay below the limit
+         */
+        void process(Client &client);
+
+        /**
+         * @return false if the client has to be disconnected
+         */
+        bool send(const int fd, Client &client);
+
+        void disconnect(const int fd);
+
+        void close();
+    };
+
+    /**
+     * @brief Issues k2 requests through a ControlServer instead of opening the driver
+     * @details Keeps one connection for all requests. Errors of the driver are reported with the errno the daemon
+     * received, errors of the connection with the errno of the failed socket call. Not thread safe, use one client per
+     * thread.
+     */
+    class ControlClient
+    {
+    public:
+        explicit ControlClient(const std::string &path = k2ControlSocket());
+
+        ControlClient(const ControlClient &other) = delete;
+
+        ~ControlClient();
+
+        ControlClient &operator=(const ControlClient &other) = delete;
+
+        /**
+         * @return true if the daemon socket could be connected
+         */
+        [[nodiscard]] bool isOpen() const
+        { return fd >= 0; }
+
+        /**
+         * @return The result of connecting to the daemon
+         */
+        [[nodiscard]] Result error() const
+        { return Result{Operation::Connect, connectError}; }
+
+        Result getVersion(std::string &version);
+
+        Result getActiveDevices(std::string &devices);
+
+        Result registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+
+        Result unregisterTask(const std::string &device, const pid_t pid);
+
+        Result unregisterAllTasks(const std::string &device);
+
+        Result updateInterval(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+
+        /**
+         * @brief Lists the tasks registered through the daemon
+         */
+        Result listTasks(std::vector<TaskSpec> &tasks);
+
+    private:
+        int fd = -1;
+        int connectError = 0;
+        std::string buffer;
+
+        /**
+         * @brief Sends one request line and waits for its reply
+         * @param payload Receives the reply after "ok ", or what follows the errno of an error reply
+         * @return 0 on success or an errno value
+         */
+        int request(const std::string &line, std::string &payload);
+    };
+}
@@ -0,0 +1,171 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+namespace k2 {
+
+    /**
+     * @brief Major and minor number of a block device
+     */
+    struct DeviceId
+    {
+        std::uint32_t major = 0;
+        std::uint32_t minor = 0;
+
+        constexpr bool operator==(const DeviceId &other) const
+        { return major == other.major && minor == other.minor; }
+
+        constexpr bool operator!=(const DeviceId &other) const
+        { return !(*this == other); }
+    };
+
+    /**
+     * @see kdev_t.h in the kernel headers, the kernel packs dev_t into 32 bits with a 12 bit major
+     */
+    constexpr unsigned kernelMinorBits = 20;
+    constexpr std::uint32_t kernelMinorMask = (1U << kernelMinorBits) - 1;
+    constexpr std::uint32_t kernelMajorMax = (1U << (32 - kernelMinorBits)) - 1;
+
+    /**
+     * @return true if the id fits into the kernel's internal dev_t
+     */
+    constexpr bool isKernelEncodable(const DeviceId id)
+    {
+        return id.major <= kernelMajorMax && id.minor <= kernelMinorMask;
+    }
+
+    /**
+     * @return The kernel's internal representation of id (MKDEV), as seen by tracepoints
+     */
+    constexpr std::uint32_t encodeKernelDev(const DeviceId id)
+    {
+        return (id.major << kernelMinorBits) | id.minor;
+    }
+
+    /**
+     * @brief Splits the kernel's internal dev_t (MAJOR and MINOR)
+     */
+    constexpr DeviceId decodeKernelDev(const std::uint32_t dev)
+    {
+        return DeviceId{dev >> kernelMinorBits, dev & kernelMinorMask};
+    }
+
+    /**
+     * @brief Parses an unsigned decimal number that must span all of text
+     * @return false on an empty string, any other character than a digit or an overflow of 32 bits
+     */
+    constexpr bool parseDecimal(const std::string_view text, std::uint32_t &value)
+    {
+        if (text.empty()) {
+            return false;
+        }
+        std::uint64_t result = 0;
+        for (const char c: text) {
+            if (c < '0' || c > '9') {
+                return false;
+            }
+            result = result * 10 + static_cast<std::uint64_t>(c - '0');
+            if (result > UINT32_MAX) {
+                return false;
+            }
+        }
+        value = static_cast<std::uint32_t>(result);
+        return true;
+    }
+
+    /**
+     * @brief Parses "<major>:<minor>" strictly, without surrounding whitespace
+     * @return false if text is malformed or the number does not fit the kernel's internal dev_t
+     */
+    constexpr bool parseDeviceId(const std::string_view text, DeviceId &id)
+    {
+        const auto colon = text.find(':');
+        if (colon == std::string_view::npos) {
+            return false;
+        }
+        DeviceId parsed;
+        if (!parseDecimal(text.substr(0, colon), parsed.major) || !parseDecimal(text.substr(colon + 1), parsed.minor) ||
+            !isKernelEncodable(parsed)) {
+            return false;
+        }
+        id = parsed;
+        return true;
+    }
+
+    /**
+     * @brief Conversion between DeviceId and the user space dev_t of the C library
+     */
+    [[nodiscard]] dev_t toDevT(const DeviceId id);
+
+    [[nodiscard]] DeviceId fromDevT(const dev_t dev);
+
+    [[nodiscard]] std::string toString(const DeviceId id);
+
+    /**
+     * @brief A block device found in sysfs
+     */
+    struct BlockDevice
+    {
+        /**
+         * @brief Kernel name, e.g. nvme0n1 or nvme0n1p2
+         */
+        std::string name;
+        DeviceId id;
+    };
+
+    /**
+     * @brief Finds the block device for a kernel name ("nvme0n1"), a device node ("/dev/nvme0n1"), a device number
+     * ("259:0") or the kernel's internal dev_t ("271581184")
+     * @return 0 on success, EINVAL for malformed input, ENOTBLK if a path is no block device, ENODEV if the device
+     * does not exist or another errno value
+     */
+    [[nodiscard]] int resolveDevice(const std::string &identifier, BlockDevice &device,
+                                    const std::string &sysRoot = "/sys");
+
+    /**
+     * @brief Maps the kernel name of a partition like nvme0n1p2 to its disk, which owns the hardware queues and is
+     * the device block layer tracepoints report
+     * @return The name of the disk, name itself if it is no partition or cannot be resolved
+     */
+    [[nodiscard]] std::string diskName(const std::string &name, const std::string &sysRoot = "/sys");
+
+    enum class DeviceIdFormat
+    {
+        /**
+         * @brief The kernel's internal dev_t as decimal number
+         */
+        Internal,
+        /**
+         * @brief major:minor
+         */
+        Number,
+        /**
+         * @brief Kernel name of the device
+         */
+        Name,
+        NA
+    };
+
+    /**
+     * @brief Converts one identifier per line from in to format on out
+     * @details Numeric input ("259:0" or an internal dev_t) converted to a numeric format is translated without
+     * touching the file system, which keeps large trace filters fast. Everything else is resolved through sysfs.
+     * Empty lines are skipped. Conversion stops at the first line that cannot be converted.
+     * @param failedLine Receives the number of the failed line, 0 if all lines were converted
+     * @return 0 on success or the errno value of the failed line, see resolveDevice
+     */
+    [[nodiscard]] int convertDeviceIds(std::istream &in, std::ostream &out, const DeviceIdFormat format,
+                                       std::size_t &failedLine, const std::string &sysRoot = "/sys");
+
+    [[nodiscard]] std::string toString(const DeviceIdFormat format);
+
+    [[nodiscard]] DeviceIdFormat deviceIdFormatToEnum(const std::string &name);
+}
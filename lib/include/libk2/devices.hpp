@@ -0,0 +1,81 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace k2 {
+
+    /**
+     * @brief A block device managed by k2
+     */
+    struct DeviceInfo
+    {
+        std::string name;
+        /**
+         * @brief Device number from /sys/block/<name>/dev, 0 if unknown
+         */
+        dev_t dev = 0;
+        /**
+         * @brief Active I/O scheduler of the device according to sysfs, empty if unknown
+         */
+        std::string scheduler;
+
+        /**
+         * @return false if sysfs shows that a different scheduler than k2 is active on the device
+         */
+        [[nodiscard]] bool k2Active() const
+        { return scheduler.empty() || scheduler == "k2"; }
+    };
+
+    /**
+     * @brief Parses the device list reported by the driver and completes it from sysfs
+     * @param devices Device names separated by whitespace or commas
+     */
+    [[nodiscard]] std::vector<DeviceInfo> parseDevices(const std::string &devices,
+                                                       const std::string &sysBlock = "/sys/block");
+
+    /**
+     * @return The active I/O scheduler of a block device, empty if it cannot be read
+     */
+    [[nodiscard]] std::string activeScheduler(const std::string &device, const std::string &sysBlock = "/sys/block");
+
+    /**
+     * @return The process wide generation of the device inventory, cached inventories of an older generation are stale
+     */
+    [[nodiscard]] std::uint64_t deviceGeneration();
+
+    /**
+     * @brief Marks the device inventories cached by all sessions of this process as stale
+     * @details Called by sessions when the driver rejects a device, and by applications that know the set of k2
+     * devices changed, e.g. after switching the scheduler of a disk
+     */
+    void invalidateDevices();
+
+    /**
+     * @brief Device inventory cached by a Session
+     */
+    struct DeviceCache
+    {
+        std::vector<DeviceInfo> devices;
+        std::uint64_t generation = 0;
+        std::chrono::steady_clock::time_point updated;
+        bool valid = false;
+        /**
+         * @brief Upper bound of the age of the inventory to notice devices that changed outside of this process
+         */
+        std::chrono::milliseconds ttl{1000};
+
+        [[nodiscard]] bool fresh() const
+        {
+            return valid && generation == deviceGeneration() && std::chrono::steady_clock::now() - updated < ttl;
+        }
+
+        [[nodiscard]] const DeviceInfo *find(const std::string &name) const;
+    };
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+namespace k2 {
+
+    /**
+     * @brief Log-linear latency histogram in the style of HdrHistogram
+     * @details Values are bucketed with a fixed number of significant bits, so the relative error of every reported
+     * value is bounded by 2^-(significantBits - 1) over the whole 64 bit range. Recording is a few integer operations
+     * and never allocates.
+     */
+    class Histogram
+    {
+    public:
+        /**
+         * @param significantBits Precision of the buckets, 8 bits bound the relative error to < 1%
+         */
+        explicit Histogram(const unsigned significantBits = 8);
+
+        void record(const std::uint64_t value)
+        { recordN(value, 1); }
+
+        void recordN(const std::uint64_t value, const std::uint64_t count);
+
+        /**
+         * @brief Adds all values recorded by other, which must use the same precision
+         */
+        void merge(const Histogram &other);
+
+        void reset();
+
+        /**
+         * @brief Replaces the content with buckets, extremes and sum saved from a histogram of the same precision
+         * @return false if buckets does not match the precision of this histogram
+         */
+        bool restore(const std::vector<std::uint64_t> &buckets, std::uint64_t min, std::uint64_t max, double sum);
+
+        [[nodiscard]] std::uint64_t count() const
+        { return total; }
+
+        [[nodiscard]] std::uint64_t min() const;
+
+        [[nodiscard]] std::uint64_t max() const
+        { return maxValue; }
+
+        [[nodiscard]] double mean() const;
+
+        /**
+         * @return Sum of all recorded values
+         */
+        [[nodiscard]] double valueSum() const
+        { return static_cast<double>(sum); }
+
+        /**
+         * @param percentile In the range [0, 100]
+         * @return The upper bound of the bucket that contains the given percentile, clamped to max()
+         */
+        [[nodiscard]] std::uint64_t percentile(const double percentile) const;
+
+        [[nodiscard]] unsigned significantBits() const
+        { return subBucketBits; }
+
+        [[nodiscard]] const std::vector<std::uint64_t> &buckets() const
+        { return counts; }
+
+        [[nodiscard]] std::size_t bucketIndex(const std::uint64_t value) const;
+
+        [[nodiscard]] std::uint64_t bucketLowerBound(const std::size_t index) const;
+
+        [[nodiscard]] std::uint64_t bucketUpperBound(const std::size_t index) const;
+
+    private:
+        unsigned subBucketBits;
+        std::vector<std::uint64_t> counts;
+        std::uint64_t total = 0;
+        std::uint64_t minValue = UINT64_MAX;
+        std::uint64_t maxValue = 0;
+        long double sum = 0;
+    };
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/uio.h>
+}
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace workload {
+
+    enum class IoDirection
+    {
+        Read,
+        Write
+    };
+
+    enum class EngineType
+    {
+        /**
+         * @brief Blocking pread/pwrite on an O_SYNC file descriptor
+         */
+        Sync,
+        /**
+         * @brief Blocking pread/pwrite on an O_DIRECT | O_SYNC file descriptor, buffers must be aligned
+         */
+        Direct,
+        /**
+         * @brief io_uring with up to queueDepth requests in flight
+         */
+        Uring,
+        NA
+    };
+
+    struct EngineOptions
+    {
+        EngineType type = EngineType::Sync;
+        /**
+         * @brief Maximum number of requests in flight, always 1 for the synchronous engines
+         */
+        unsigned queueDepth = 1;
+        /**
+         * @brief Open the target with O_DIRECT to bypass the page cache, implied by EngineType::Direct
+         */
+        bool direct = false;
+        /**
+         * @brief io_uring only: register the buffers passed to registerBuffers with the kernel
+         */
+        bool registeredBuffers = false;
+        /**
+         * @brief io_uring only: register the target file descriptor with the kernel
+         */
+        bool fixedFiles = false;
+    };
+
+    struct IoRequest
+    {
+        IoDirection direction = IoDirection::Write;
+        void *buffer = nullptr;
+        std::size_t length = 0;
+        off_t offset = 0;
+        /**
+         * @brief Index into the buffers passed to registerBuffers, -1 if the buffer is not registered
+         */
+        int bufferIndex = -1;
+        std::uint64_t userData = 0;
+    };
+
+    struct IoCompletion
+    {
+        std::uint64_t userData = 0;
+        /**
+         * @brief Number of bytes transferred or -errno
+         */
+        ssize_t result = 0;
+    };
+
+    /**
+     * @brief Uniform submission/completion interface over the different I/O paths of the workload tools
+     * @details Every engine reports completions through reap, so latencies measured between submit and reap are
+     * comparable across engines. Methods return 0 on success or an errno value.
+     */
+    class IoEngine
+    {
+    public:
+        virtual ~IoEngine() = default;
+
+        /**
+         * @param flags Additional open flags, the engine adds O_RDWR and its own synchronisation flags
+         */
+        [[nodiscard]] virtual int open(const std::string &path, int flags) = 0;
+
+        /**
+         * @brief Announces the buffers requests will use, so engines can pin them up front
+         */
+        [[nodiscard]] virtual int registerBuffers(const std::vector<struct iovec> &/*buffers*/)
+        { return 0; }
+
+        /**
+         * @brief Queues a request, fails with EAGAIN if queueDepth requests are already in flight
+         */
+        [[nodiscard]] virtual int submit(const IoRequest &request) = 0;
+
+        /**
+         * @brief Hands all queued requests to the kernel without waiting for completions
+         */
+        [[nodiscard]] virtual int flush()
+        { return 0; }
+
+        /**
+         * @brief Flushes queued requests and appends completions, waiting until at least minComplete are available
+         */
+        [[nodiscard]] virtual int reap(std::vector<IoCompletion> &completions, unsigned minComplete) = 0;
+
+        [[nodiscard]] virtual unsigned queueDepth() const = 0;
+
+        [[nodiscard]] virtual unsigned inFlight() const = 0;
+    };
+
+    [[nodiscard]] std::unique_ptr<IoEngine> makeEngine(const EngineOptions &options);
+
+    /**
+     * @return true for paths under /dev and for block devices elsewhere, targets that are never created and only
+     * written when asked to explicitly
+     */
+    [[nodiscard]] bool isDeviceTarget(const std::string &path);
+
+    [[nodiscard]] std::string toString(const EngineType type);
+
+    [[nodiscard]] EngineType engineTypeToEnum(const std::string &name);
+}
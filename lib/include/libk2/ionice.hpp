@@ -1,6 +1,10 @@
 #pragma once
 
+#include <cstdint>
+#include <ostream>
 #include <string>
+#include <string_view>
+#include <vector>
 
 namespace ionice {
 
@@ -26,6 +30,203 @@ namespace ionice {
         NA
     };
 
+    /**
+     * @see linux/ioprio.h, the class sits above a 13 bit data field whose low 3 bits are the level
+     */
+    constexpr unsigned ioPrioClassShift = 13;
+    constexpr std::uint16_t ioPrioClassMask = 0x07;
+    constexpr std::uint16_t ioPrioLevelMask = 0x07;
+
+    /**
+     * @details The enumerators of IoClass and IoLevel equal the kernel's IOPRIO_CLASS_* and levels, so converting is
+     * a range check. NA falls back to best-effort, level 4, the kernel default.
+     */
+    constexpr int ioClassToInt(const IoClass ioClass)
+    { return ioClass < IoClass::NA ? static_cast<int>(ioClass) : static_cast<int>(IoClass::BestEffort); }
+
+    constexpr int ioLevelToInt(const IoLevel ioLevel)
+    { return ioLevel < IoLevel::NA ? static_cast<int>(ioLevel) : static_cast<int>(IoLevel::L4); }
+
+    constexpr IoClass ioClassToEnum(const int cClass)
+    {
+        return cClass >= 0 && cClass < static_cast<int>(IoClass::NA) ? static_cast<IoClass>(cClass) : IoClass::NA;
+    }
+
+    constexpr IoLevel ioLevelToEnum(const int cLevel)
+    {
+        return cLevel >= 0 && cLevel < static_cast<int>(IoLevel::NA) ? static_cast<IoLevel>(cLevel) : IoLevel::NA;
+    }
+
+    constexpr std::string_view name(const IoClass ioClass)
+    {
+        constexpr std::string_view names[] = {"none", "realtime", "best-effort", "idle", "N/A"};
+        return names[ioClass < IoClass::NA ? static_cast<int>(ioClass) : static_cast<int>(IoClass::NA)];
+    }
+
+    constexpr std::string_view name(const IoLevel ioLevel)
+    {
+        constexpr std::string_view names[] = {"0", "1", "2", "3", "4", "5", "6", "7", "N/A"};
+        return names[ioLevel < IoLevel::NA ? static_cast<int>(ioLevel) : static_cast<int>(IoLevel::NA)];
+    }
+
+    constexpr IoClass ioClassToEnum(const std::string_view name)
+    {
+        for (int cClass = 0; cClass < static_cast<int>(IoClass::NA); cClass++) {
+            if (ionice::name(static_cast<IoClass>(cClass)) == name) {
+                return static_cast<IoClass>(cClass);
+            }
+        }
+        return IoClass::NA;
+    }
+
+    /**
+     * @brief An I/O priority encoded exactly like IOPRIO_PRIO_VALUE, ready to be passed to ioprio_set
+     * @details Converting between the encoding and class and level is shifting and masking only. A priority built
+     * from NA, or decoded from a value with an unknown class, is not valid() and is rejected by ioPrioSet.
+     */
+    class IoPrio
+    {
+    public:
+        constexpr IoPrio() = default;
+
+        constexpr IoPrio(const IoClass ioClass, const IoLevel ioLevel) :
+                encoded(ioClass < IoClass::NA && ioLevel < IoLevel::NA
+                        ? static_cast<std::uint16_t>(static_cast<unsigned>(ioClass) << ioPrioClassShift |
+                                                     static_cast<unsigned>(ioLevel))
+                        : invalid)
+        {}
+
+        /**
+         * @brief Decodes an ioprio_get value, priority hints in the upper data bits are dropped
+         */
+        static constexpr IoPrio fromValue(const int value)
+        {
+            IoPrio prio;
+            prio.encoded = value >= 0 ? static_cast<std::uint16_t>(value & (ioPrioClassMask << ioPrioClassShift |
+                                                                            ioPrioLevelMask))
+                                      : invalid;
+            return prio;
+        }
+
+        [[nodiscard]] constexpr std::uint16_t value() const
+        { return encoded; }
+
+        [[nodiscard]] constexpr IoClass ioClass() const
+        { return ioClassToEnum(encoded >> ioPrioClassShift & ioPrioClassMask); }
+
+        [[nodiscard]] constexpr IoLevel ioLevel() const
+        { return valid() ? static_cast<IoLevel>(encoded & ioPrioLevelMask) : IoLevel::NA; }
+
+        [[nodiscard]] constexpr bool valid() const
+        { return ioClass() != IoClass::NA; }
+
+        constexpr bool operator==(const IoPrio &other) const
+        { return encoded == other.encoded; }
+
+        constexpr bool operator!=(const IoPrio &other) const
+        { return !(*this == other); }
+
+    private:
+        static constexpr std::uint16_t invalid = ioPrioClassMask << ioPrioClassShift;
+
+        /**
+         * @brief Class none, level 0: no priority set, the kernel derives it from the CPU nice value
+         */
+        std::uint16_t encoded = 0;
+    };
+
+    /**
+     * @brief Parses "<class>[/<level>]" with the class by name or number, e.g. "realtime/0", "idle" or "2/4"
+     * @details The level defaults to 4
+     * @return The priority, not valid() if the text could not be parsed
+     */
+    constexpr IoPrio parseIoPrio(const std::string_view text)
+    {
+        const auto separator = text.find('/');
+        const std::string_view className = text.substr(0, separator);
+        IoClass ioClass = ioClassToEnum(className);
+        if (className.size() == 1 && className[0] >= '0' && className[0] <= '9') {
+            ioClass = ioClassToEnum(className[0] - '0');
+        }
+        IoLevel ioLevel = IoLevel::L4;
+        if (separator != std::string_view::npos) {
+            const std::string_view level = text.substr(separator + 1);
+            ioLevel = level.size() == 1 && level[0] >= '0' && level[0] <= '9' ? ioLevelToEnum(level[0] - '0')
+                                                                              : IoLevel::NA;
+        }
+        return {ioClass, ioLevel};
+    }
+
+    /**
+     * @brief What the id of an ioprio_set/ioprio_get call refers to
+     */
+    enum class Who
+    {
+        /**
+         * @brief A single thread, a pid is the id of the main thread
+         */
+        Process,
+        ProcessGroup,
+        User,
+        NA
+    };
+
+    /**
+     * @brief Kind of target of the bulk ioPrioSet
+     */
+    enum class TargetType
+    {
+        /**
+         * @brief A single thread, see Who::Process
+         */
+        Process,
+        /**
+         * @brief All threads of a process, listed from /proc/<pid>/task
+         */
+        Threads,
+        ProcessGroup,
+        User,
+        /**
+         * @brief All threads in a cgroup and its descendants
+         */
+        Cgroup,
+        NA
+    };
+
+    struct Target
+    {
+        TargetType type = TargetType::Process;
+        /**
+         * @brief pid, pgid or uid. For TargetType::Cgroup with an empty cgroup, the pid whose cgroup is used
+         */
+        int id = 0;
+        /**
+         * @brief Path for TargetType::Cgroup, either below cgroupRoot() or relative to the unified hierarchy as in
+         * /proc/<pid>/cgroup
+         */
+        std::string cgroup;
+    };
+
+    /**
+     * @brief One thread, process group or user a target expanded to
+     */
+    struct TargetResult
+    {
+        /**
+         * @brief Index of the target in the request
+         */
+        std::size_t target = 0;
+        Who who = Who::Process;
+        /**
+         * @brief The tid, pgid or uid, or the requested id if the target could not be expanded
+         */
+        int id = 0;
+        /**
+         * @brief 0 or the errno of the expansion or of the syscall
+         */
+        int error = 0;
+    };
+
 
     [[nodiscard]] int ioPrioSet(const pid_t pid, const IoClass ioClass, const IoLevel ioLevel);
 
@@ -35,16 +236,77 @@ namespace ionice {
 
     [[nodiscard]] int ioPrioGet(IoClass &ioClass, IoLevel &ioLevel);
 
+    /**
+     * @brief Sets an already encoded priority of a thread, the allocation free variant for hot paths
+     * @return 0 on success, EINVAL for a priority that is not valid() or the errno of the syscall
+     */
+    [[nodiscard]] int ioPrioSet(const pid_t pid, const IoPrio prio);
+
+    [[nodiscard]] int ioPrioGet(const pid_t pid, IoPrio &prio);
+
+    [[nodiscard]] int ioPrioSet(const Who who, const int id, const IoClass ioClass, const IoLevel ioLevel);
+
+    /**
+     * @details For a process group or user the kernel reports the highest priority of all its threads
+     */
+    [[nodiscard]] int ioPrioGet(const Who who, const int id, IoClass &ioClass, IoLevel &ioLevel);
+
+    /**
+     * @brief Expands the targets into the threads, process groups and users their priority applies to
+     * @details Threads are listed at the time of the call. A thread created later inherits the priority of the
+     * thread that created it, so threads spawned by already updated threads are covered. A target that cannot be
+     * expanded yields one result carrying the error.
+     */
+    [[nodiscard]] std::vector<TargetResult> expandTargets(const std::vector<Target> &targets);
+
+    /**
+     * @brief Applies one priority to all threads, process groups and users the targets expand to
+     * @details Every expanded id gets its own result. Threads that exited after they were listed report ESRCH.
+     * @return 0 if every result succeeded, otherwise the error of the first failed one
+     */
+    [[nodiscard]] int ioPrioSet(const std::vector<Target> &targets, const IoClass ioClass, const IoLevel ioLevel,
+                                std::vector<TargetResult> &results);
+
+    /**
+     * @brief Lists the thread ids of a process from /proc/<pid>/task
+     * @return 0 on success or an errno value
+     */
+    [[nodiscard]] int threadIds(const pid_t pid, std::vector<pid_t> &tids);
+
+    /**
+     * @brief Lists the thread ids in a cgroup and, if recursive, in all of its descendants
+     * @details Reads cgroup.threads on the unified hierarchy and tasks on v1 hierarchies
+     * @return 0 on success or an errno value
+     */
+    [[nodiscard]] int cgroupThreadIds(const std::string &cgroup, std::vector<pid_t> &tids, const bool recursive = true);
+
+    /**
+     * @brief Looks up the unified hierarchy cgroup of a process in /proc/<pid>/cgroup
+     * @return 0 on success or an errno value
+     */
+    [[nodiscard]] int cgroupOf(const pid_t pid, std::string &cgroup);
+
+    /**
+     * @return Mount point of the cgroup hierarchies, /sys/fs/cgroup unless overridden by K2_CGROUP_ROOT
+     */
+    [[nodiscard]] std::string cgroupRoot();
+
     [[nodiscard]] std::string toString(const IoClass ioClass);
 
     [[nodiscard]] std::string toString(const IoLevel ioLevel);
 
-    int ioClassToInt(const ionice::IoClass ioClass);
+    [[nodiscard]] std::string toString(const Who who);
+
+    [[nodiscard]] std::string toString(const TargetType type);
 
-    int ioLevelToInt(const ionice::IoLevel ioLevel);
+    /**
+     * @return "<class>/<level>", which parseIoPrio reads back
+     */
+    [[nodiscard]] std::string toString(const IoPrio prio);
 
-    ionice::IoLevel ioLevelToEnum(const int cLevel);
+    ionice::TargetType targetTypeToEnum(const std::string &name);
 }
 
 std::ostream& operator<<(std::ostream& os, const ionice::IoClass ioClass);
 std::ostream& operator<<(std::ostream& os, const ionice::IoLevel ioLevel);
+std::ostream& operator<<(std::ostream& os, const ionice::IoPrio prio);
@@ -6,16 +6,26 @@ extern "C" {
 
 #include <string>
 
+#include "libk2/result.hpp"
+#include "libk2/session.hpp"
+
 namespace k2 {
 
-    std::string getVersion();
+    Result getVersion(std::string &version);
 
-    std::string getActiveDevices();
+    Result getActiveDevices(std::string &devices);
 
-    void registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+    Result getDevices(std::vector<DeviceInfo> &devices);
 
-    void unregisterTask(const std::string &device, const pid_t pid);
+    Result registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns);
 
-    void unregisterAllTasks(const std::string &device);
-}
+    Result unregisterTask(const std::string &device, const pid_t pid);
+
+    Result unregisterAllTasks(const std::string &device);
 
+    Result updateInterval(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+
+    std::vector<Result> registerTasks(const std::vector<TaskSpec> &specs);
+
+    std::vector<Result> unregisterTasks(const std::vector<TaskSpec> &specs);
+}
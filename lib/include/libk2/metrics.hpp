@@ -0,0 +1,186 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libk2/histogram.hpp"
+#include "libk2/result.hpp"
+#include "libk2/unixsocket.hpp"
+
+namespace k2 {
+
+    /**
+     * @brief Turns recording of driver operation metrics on or off, off by default
+     * @details While enabled every ioctl a Session issues is counted and timed in a shard of the calling thread, so
+     * recording never contends with other threads. Can be toggled at any time.
+     */
+    void setMetricsEnabled(bool enabled);
+
+    /**
+     * @brief Upper bounds in ns of the buckets of exported latency histograms, from 1 us to 10 s in 1-2-5 steps
+     */
+    [[nodiscard]] const std::vector<std::int64_t> &metricsBucketBoundsNs();
+
+    /**
+     * @brief Totals of one ioctl type over all threads since the process started
+     */
+    struct IoctlMetrics
+    {
+        Operation operation = Operation::OpenDriver;
+        std::uint64_t calls = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t latencySumNs = 0;
+        /**
+         * @brief Non-cumulative counts per bucket of metricsBucketBoundsNs, plus a last one for slower calls
+         */
+        std::vector<std::uint64_t> buckets;
+    };
+
+    /**
+     * @return One entry per ioctl type that was issued at least once
+     */
+    [[nodiscard]] std::vector<IoctlMetrics> ioctlMetrics();
+
+    /**
+     * @return Tasks this process registered per device and has not unregistered yet
+     */
+    [[nodiscard]] std::map<std::string, std::int64_t> registeredTaskMetrics();
+
+    /**
+     * @return A label pair for MetricsWriter with the value escaped, e.g. device="nvme0n1"
+     */
+    [[nodiscard]] std::string metricsLabel(const char *name, const std::string &value);
+
+    /**
+     * @brief Appends metrics in the Prometheus text exposition format to a caller owned buffer
+     * @details Numbers are formatted on the stack, so rendering into a reused buffer does not allocate once the
+     * buffer reached its working size.
+     */
+    class MetricsWriter
+    {
+    public:
+        explicit MetricsWriter(std::string &out) :
+                out(out)
+        {}
+
+        /**
+         * @brief Writes the HELP and TYPE lines that precede the samples of a metric family
+         * @param type counter, gauge or histogram
+         */
+        void family(const char *name, const char *type, const char *help);
+
+        /**
+         * @param labels Rendered label pairs without braces, e.g. device="nvme0n1", may be empty
+         */
+        void sample(const char *name, const std::string &labels, double value);
+
+        void sample(const char *name, const std::string &labels, std::uint64_t value);
+
+        /**
+         * @brief Writes the buckets, sum and count of a latency histogram recorded in ns as seconds
+         * @details Buckets follow metricsBucketBoundsNs. A bucket of the histogram is counted below a bound if its
+         * lower end is, so counts are exact within the precision of the histogram.
+         */
+        void histogram(const char *name, const std::string &labels, const Histogram &histogram);
+
+        /**
+         * @brief Writes a histogram given as non-cumulative counts per bucket of metricsBucketBoundsNs
+         * @param buckets One count per bound plus a last one for larger values
+         */
+        void histogram(const char *name, const std::string &labels, const std::uint64_t *buckets, double sumNs,
+                       std::uint64_t count);
+
+    private:
+        std::string &out;
+
+        void labelled(const char *name, const char *suffix, const std::string &labels, const char *extra);
+
+        void value(double value);
+
+        void value(std::uint64_t value);
+    };
+
+    /**
+     * @brief Called at scrape time to append further metric families, e.g. the request latencies of a workload
+     */
+    using MetricsSource = std::function<void(MetricsWriter &writer)>;
+
+    /**
+     * @return An id for removeMetricsSource
+     */
+    int addMetricsSource(MetricsSource source);
+
+    /**
+     * @brief Removes a source, it is not called anymore once this returns
+     */
+    void removeMetricsSource(int id);
+
+    /**
+     * @brief Replaces out with the libk2 metrics followed by those of all sources
+     */
+    void renderMetrics(std::string &out);
+
+    /**
+     * @brief Serves renderMetrics over HTTP for Prometheus style scrapers
+     * @details Listens on a Unix domain socket if the address contains a '/', otherwise on TCP at host:port, where
+     * the host defaults to 127.0.0.1. An existing socket file is only replaced if no server answers on it. Every GET
+     * of /metrics or / is answered with the current metrics, connections are served one at a time by a background
+     * thread that reuses its buffers.
+     */
+    class MetricsServer
+    {
+    public:
+        explicit MetricsServer(std::string address);
+
+        MetricsServer(const MetricsServer &other) = delete;
+
+        ~MetricsServer();
+
+        MetricsServer &operator=(const MetricsServer &other) = delete;
+
+        /**
+         * @brief Binds the address and starts serving
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int start();
+
+        void stop();
+
+        [[nodiscard]] const std::string &address() const
+        { return listenAddress; }
+
+    private:
+        const std::string listenAddress;
+        int listenFd = -1;
+        BoundSocket boundSocket;
+        int stopFd = -1;
+        std::thread thread;
+        std::string request;
+        std::string body;
+        std::string response;
+
+        void serve();
+
+        void answer(int fd);
+
+        void close();
+    };
+
+    namespace detail {
+        [[nodiscard]] bool metricsEnabled();
+
+        /**
+         * @brief Counts and times one ioctl in the shard of the calling thread
+         */
+        void recordIoctl(Operation operation, int error, std::int64_t latencyNs);
+
+        /**
+         * @brief Keeps the registered task gauges in step with the result of a task operation
+         */
+        void recordTasks(const Result &result, const std::string &device);
+    }
+}
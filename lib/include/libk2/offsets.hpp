@@ -0,0 +1,149 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace workload {
+
+    enum class OffsetPattern
+    {
+        /**
+         * @brief One block after the other, wrapping around at the end of the range
+         */
+        Sequential,
+        /**
+         * @brief Every block of the range is equally likely
+         */
+        Uniform,
+        /**
+         * @brief Few blocks get most of the requests, block popularity follows a Zipf distribution
+         */
+        Zipfian,
+        /**
+         * @brief A hot region at the start of the range gets a fixed share of the requests, the rest is uniform
+         */
+        HotCold,
+        NA
+    };
+
+    /**
+     * @brief Shape of the offsets a stream issues requests to, the range itself is given to OffsetGenerator
+     */
+    struct OffsetOptions
+    {
+        OffsetPattern pattern = OffsetPattern::Sequential;
+        /**
+         * @brief Skew of OffsetPattern::Zipfian, larger is more skewed. 0.99 is the YCSB default
+         */
+        double zipfTheta = 0.99;
+        /**
+         * @brief OffsetPattern::HotCold: size of the hot region in percent of the range
+         */
+        unsigned hotRangePercent = 20;
+        /**
+         * @brief OffsetPattern::HotCold: share of the requests that go to the hot region in percent
+         */
+        unsigned hotAccessPercent = 80;
+    };
+
+    /**
+     * @brief Minimal xorshift generator, fast enough to be called for every request
+     */
+    class XorShift
+    {
+        std::uint64_t state;
+
+    public:
+        explicit XorShift(std::uint64_t seed) :
+                state(seed ? seed : 0x9e3779b97f4a7c15ULL)
+        {}
+
+        std::uint64_t next()
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            return state;
+        }
+
+        /**
+         * @return A uniformly distributed double in [0, 1)
+         */
+        double nextDouble()
+        { return static_cast<double>(next() >> 11) * 0x1.0p-53; }
+    };
+
+    /**
+     * @brief Produces block aligned request offsets within [start, start + size) following an OffsetPattern
+     * @details Random patterns pick whole blocks, so offsets stay aligned for O_DIRECT if start is. Zipfian ranks are
+     * drawn by rejection inversion in constant time independent of the range size and then scattered over the range
+     * by a fixed permutation, so the popular blocks are not all adjacent.
+     */
+    class OffsetGenerator
+    {
+    public:
+        OffsetGenerator() = default;
+
+        /**
+         * @param size Length of the range in bytes, 0 for sequential requests until the end of the target. Random
+         * patterns need a size of at least one block
+         */
+        OffsetGenerator(const OffsetOptions &options, std::uint64_t start, std::uint64_t size, std::size_t blockSize,
+                        std::uint64_t seed);
+
+        /**
+         * @return false if a random pattern has no room for a single block
+         */
+        [[nodiscard]] bool valid() const;
+
+        [[nodiscard]] off_t next();
+
+        /**
+         * @brief Continues sequential requests at the start of the range, e.g. after hitting the end of the target
+         */
+        void restart()
+        { position = 0; }
+
+        [[nodiscard]] std::uint64_t blocks() const
+        { return blockCount; }
+
+    private:
+        [[nodiscard]] std::uint64_t zipfRank();
+
+        OffsetOptions options;
+        std::uint64_t start = 0;
+        std::uint64_t size = 0;
+        std::size_t blockSize = 4096;
+        std::uint64_t blockCount = 0;
+        std::uint64_t position = 0;
+        XorShift random{0};
+
+        double hIntegralX1 = 0;
+        double hIntegralN = 0;
+        double zipfS = 0;
+        std::uint64_t scatter = 1;
+    };
+
+    /**
+     * @brief Looks up the size of a block device or regular file
+     * @return 0 on success or an errno value
+     */
+    [[nodiscard]] int targetSize(const std::string &path, std::uint64_t &bytes);
+
+    /**
+     * @brief Sets up a generator for a target, random patterns without a size cover the target from start to its end
+     * @return 0 on success, EINVAL if the range holds no block or the errno of looking up the target size
+     */
+    [[nodiscard]] int makeOffsetGenerator(const std::string &path, const OffsetOptions &options, std::uint64_t start,
+                                          std::uint64_t size, std::size_t blockSize, std::uint64_t seed,
+                                          OffsetGenerator &generator);
+
+    [[nodiscard]] std::string toString(const OffsetPattern pattern);
+
+    [[nodiscard]] OffsetPattern offsetPatternToEnum(const std::string &name);
+}
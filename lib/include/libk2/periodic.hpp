@@ -0,0 +1,129 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "libk2/histogram.hpp"
+
+namespace workload {
+
+    enum class WaitMode
+    {
+        /**
+         * @brief clock_nanosleep with TIMER_ABSTIME
+         */
+        Sleep,
+        /**
+         * @brief Blocking read of an absolute CLOCK_MONOTONIC timerfd
+         */
+        TimerFd,
+        NA
+    };
+
+    struct PeriodicOptions
+    {
+        std::int64_t periodNs = 10 * 1000 * 1000;
+        WaitMode wait = WaitMode::Sleep;
+        /**
+         * @brief Wake up this many ns early and busy poll the clock until the release, 0 to disable
+         */
+        std::int64_t spinNs = 0;
+        /**
+         * @brief Drop releases that are already a full period late instead of issuing them back to back
+         */
+        bool skipMissed = false;
+    };
+
+    struct PeriodicStats
+    {
+        /**
+         * @brief Actual minus scheduled release time of every period in ns
+         */
+        k2::Histogram releaseJitter;
+        /**
+         * @brief Completion time relative to the scheduled release of every completed period in ns, a value above
+         * the period is a missed deadline
+         */
+        k2::Histogram completion;
+        /**
+         * @brief How far completions that missed their deadline overshot it in ns
+         */
+        k2::Histogram lateness;
+        std::uint64_t periods = 0;
+        /**
+         * @brief Periods whose work completed after their deadline
+         */
+        std::uint64_t overruns = 0;
+        /**
+         * @brief Releases dropped because they were already a full period late
+         */
+        std::uint64_t skipped = 0;
+    };
+
+    /**
+     * @brief Open loop issuer that releases work at absolute, strictly periodic deadlines
+     * @details Release i is scheduled at start + i * period no matter how long the work of earlier periods took, so
+     * the issue rate matches the period instead of drifting by the service time. The deadline of a period is the
+     * next release. Late completions are counted as overruns rather than being absorbed by a relative sleep.
+     */
+    class PeriodicIssuer
+    {
+    public:
+        explicit PeriodicIssuer(const PeriodicOptions &options);
+
+        PeriodicIssuer(const PeriodicIssuer &other) = delete;
+
+        ~PeriodicIssuer();
+
+        PeriodicIssuer &operator=(const PeriodicIssuer &other) = delete;
+
+        /**
+         * @brief Resets the statistics and schedules the first release one period from now
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int start();
+
+        /**
+         * @brief Blocks until the next release and records its jitter
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int waitNext();
+
+        /**
+         * @brief Marks the work of the current period as completed at the given time
+         */
+        void complete(const std::int64_t completionNs);
+
+        void complete()
+        { complete(nowNs()); }
+
+        /**
+         * @return Scheduled release of the current period in ns on CLOCK_MONOTONIC
+         */
+        [[nodiscard]] std::int64_t releaseNs() const
+        { return release; }
+
+        /**
+         * @return Deadline of the current period in ns on CLOCK_MONOTONIC
+         */
+        [[nodiscard]] std::int64_t deadlineNs() const
+        { return release + options.periodNs; }
+
+        [[nodiscard]] const PeriodicStats &stats() const
+        { return periodicStats; }
+
+        [[nodiscard]] static std::int64_t nowNs();
+
+    private:
+        [[nodiscard]] int waitUntil(const std::int64_t wakeNs);
+
+        const PeriodicOptions options;
+        PeriodicStats periodicStats;
+        std::int64_t release = 0;
+        int timerFd = -1;
+    };
+
+    [[nodiscard]] std::string toString(const WaitMode mode);
+
+    [[nodiscard]] WaitMode waitModeToEnum(const std::string &name);
+}
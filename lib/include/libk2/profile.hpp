@@ -0,0 +1,159 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+#include "libk2/ioengine.hpp"
+#include "libk2/ionice.hpp"
+#include "libk2/offsets.hpp"
+#include "libk2/periodic.hpp"
+#include "libk2/workerpool.hpp"
+
+namespace workload {
+
+    enum class JobRole
+    {
+        /**
+         * @brief Periodic real-time requests whose latencies are measured, see PeriodicIssuer
+         */
+        Foreground,
+        /**
+         * @brief Throughput load that runs as fast as its rate limits allow, see WorkerPool
+         */
+        Background,
+        NA
+    };
+
+    /**
+     * @brief A number of identical jobs described by one section of a profile
+     */
+    struct JobGroup
+    {
+        std::string name;
+        JobRole role = JobRole::Background;
+        unsigned jobs = 1;
+        /**
+         * @brief Whether background jobs run as threads or processes, foreground jobs always run as threads
+         */
+        StreamKind kind = StreamKind::Thread;
+        /**
+         * @brief Block device names (nvme0n1) or paths to devices or regular files, jobs are spread over them round
+         * robin
+         */
+        std::vector<std::string> devices;
+        EngineOptions engine;
+        std::size_t blockSize = 64 * 1024;
+        /**
+         * @brief NA until set, parseProfile turns it into Write for regular files but insists on an explicit pattern
+         * for block devices
+         */
+        IoPattern pattern = IoPattern::NA;
+        unsigned readPercent = 50;
+        /**
+         * @brief Range of every target the jobs work on, see StreamConfig
+         */
+        std::uint64_t offset = 0;
+        std::uint64_t size = 0;
+        OffsetOptions offsets;
+        bool setIoPrio = false;
+        ionice::IoPrio ioPrio{ionice::IoClass::BestEffort, ionice::IoLevel::L4};
+        /**
+         * @brief Foreground only: register every job with k2 for the device with intervalNs
+         */
+        bool registerWithK2 = false;
+        /**
+         * @brief Foreground only: period of the requests
+         */
+        PeriodicOptions periodic;
+        /**
+         * @brief Background only: upper bounds of the issue rate per job, 0 for unlimited
+         */
+        double iops = 0;
+        double mbps = 0;
+        std::chrono::microseconds thinkTime{0};
+        /**
+         * @brief CPUs the jobs are pinned to round robin, empty to leave the affinity untouched
+         */
+        std::vector<int> cpus;
+        /**
+         * @brief Foreground only: periods to run, 0 to run for the duration
+         */
+        std::size_t iterations = 0;
+        /**
+         * @brief How long the group runs after the start, 0 for as long as the profile runs
+         */
+        std::chrono::milliseconds duration{0};
+    };
+
+    /**
+     * @brief A reproducible mix of foreground and background job groups
+     */
+    struct Profile
+    {
+        std::string name;
+        /**
+         * @brief Run time of the whole profile, 0 to run until all foreground groups finished
+         */
+        std::chrono::milliseconds duration{0};
+        std::vector<JobGroup> groups;
+    };
+
+    /**
+     * @brief Reads a profile in INI format
+     * @details Every section except [global] describes one job group named after the section. Keys set in [global]
+     * are defaults for the groups that follow it, except name and duration, which describe the profile itself.
+     * Lines starting with '#' or ';' are comments.
+     *
+     *     [global]
+     *     name = nvme-mixed
+     *     device = nvme0n1
+     *     duration = 30s
+     *
+     *     [realtime]
+     *     role = foreground
+     *     pattern = read
+     *     block_size = 64k
+     *     interval = 10ms
+     *     k2 = yes
+     *     ioprio = realtime/0
+     *
+     *     [writers]
+     *     jobs = 3
+     *     pattern = write
+     *     mode = process
+     *     block_size = 4m
+     *     ioprio = best-effort/4
+     *     mbps = 200
+     *
+     * Group keys: role (foreground, background), jobs, mode (thread, process), device (comma separated), engine
+     * (sync, direct, io_uring), queue_depth, direct, registered_buffers, fixed_files, block_size, pattern (read,
+     * write, mixed), read_percent, offset, size, offsets (sequential, uniform, zipfian, hotcold), zipf_theta,
+     * hot_range_percent, hot_access_percent, ioprio (see ionice::parseIoPrio), k2, interval, wait (sleep, timerfd),
+     * spin, skip_missed, iops, mbps, think_time, cpus (a CPU list like 0-3,8), iterations and duration. Sizes take an
+     * optional k, m or g suffix, times need one of ns, us, ms or s. Groups that work on block devices need a pattern,
+     * on regular files it defaults to write.
+     * @param failedLine Receives the line that could not be parsed, 0 if the profile as a whole is invalid
+     * @return 0 on success or EINVAL
+     */
+    [[nodiscard]] int parseProfile(std::istream &in, Profile &profile, std::size_t &failedLine);
+
+    /**
+     * @return 0 on success, EINVAL for an invalid profile or the errno of opening the file
+     */
+    [[nodiscard]] int loadProfile(const std::string &path, Profile &profile, std::size_t &failedLine);
+
+    /**
+     * @brief Checks a profile that was built in code instead of parsed
+     * @details A profile needs at least one group, foreground groups need a period and the run has to end, either
+     * through the profile duration or through every foreground group's iterations or duration
+     * @return 0 or EINVAL
+     */
+    [[nodiscard]] int validateProfile(const Profile &profile);
+
+    [[nodiscard]] std::string toString(const JobRole role);
+
+    [[nodiscard]] JobRole jobRoleToEnum(const std::string &name);
+}
@@ -0,0 +1,191 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+#include <unistd.h>
+}
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace k2 {
+
+    /**
+     * @brief Path of the shared registration table published by the k2-register-task daemon
+     * @details May be overridden with the K2_REGISTRATION_TABLE environment variable
+     */
+    std::string k2RegistrationTablePath();
+
+    /**
+     * @brief Longest device name a registration table stores, longer names are rejected with ENAMETOOLONG
+     */
+    constexpr std::size_t registrationDeviceLength = 39;
+
+    /**
+     * @brief One {device, pid} -> interval entry of the table, exactly one cache line
+     * @details Every slot is its own seqlock: the writer makes sequence odd, updates the fields and makes it even
+     * again, readers retry if sequence was odd or changed while they copied the fields. All fields are atomics, so
+     * the concurrent accesses are well defined across processes, and relaxed loads compile to plain moves.
+     */
+    struct alignas(64) RegistrationSlot
+    {
+        enum State : std::uint32_t
+        {
+            Empty = 0,
+            Used = 1,
+            /**
+             * @brief Removed entry, lookups continue probing past it
+             */
+            Removed = 2
+        };
+
+        std::atomic<std::uint32_t> sequence;
+        std::atomic<std::uint32_t> state;
+        std::atomic<std::int32_t> pid;
+        std::uint32_t reserved;
+        std::atomic<std::int64_t> interval_ns;
+        /**
+         * @brief NUL padded device name, compared as whole words
+         */
+        std::atomic<std::uint64_t> device[5];
+    };
+
+    static_assert(sizeof(RegistrationSlot) == 64, "RegistrationSlot has to fill exactly one cache line");
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free, "Shared slots need address free atomics");
+
+    /**
+     * @brief Start of the table file, followed by the slots
+     */
+    struct alignas(64) RegistrationTableHeader
+    {
+        char magic[8];
+        std::uint32_t version;
+        /**
+         * @brief Number of slots, a power of two
+         */
+        std::uint32_t capacity;
+        std::int32_t writerPid;
+        std::uint32_t reserved;
+        /**
+         * @brief Incremented after every change, lets readers detect that anything changed since they last looked
+         */
+        std::atomic<std::uint64_t> generation;
+        std::atomic<std::uint64_t> entries;
+    };
+
+    /**
+     * @brief Writer side of a registration table in shared memory
+     * @details Open addressing with linear probing over cache line sized slots, so a lookup usually touches the
+     * header and a single slot. Removed entries leave tombstones that later insertions on the same probe path reuse,
+     * and tombstones right in front of an empty slot become empty again, so pid churn cannot slowly turn every slot
+     * into a tombstone and make misses probe the whole table. There must be only one writer per table, which is not
+     * thread safe; the k2-register-task daemon keeps its table in step with the tasks it registered. The file is
+     * removed again when the table is destroyed.
+     */
+    class RegistrationTable
+    {
+    public:
+        /**
+         * @param capacity Number of slots, rounded up to a power of two. Lookups stay short up to about 3/4 load
+         */
+        explicit RegistrationTable(std::string path = k2RegistrationTablePath(), std::size_t capacity = 4096);
+
+        RegistrationTable(const RegistrationTable &other) = delete;
+
+        ~RegistrationTable();
+
+        RegistrationTable &operator=(const RegistrationTable &other) = delete;
+
+        /**
+         * @brief Creates or replaces the table file and maps it
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int open();
+
+        /**
+         * @brief Inserts a task or updates its interval
+         * @return 0 on success, ENAMETOOLONG for device names the slots cannot hold, ENOSPC if the table is full
+         */
+        [[nodiscard]] int set(const std::string &device, pid_t pid, std::int64_t interval_ns);
+
+        /**
+         * @return 0 on success or ENOENT if the task is not in the table
+         */
+        int erase(const std::string &device, pid_t pid);
+
+        /**
+         * @brief Removes all tasks of a device
+         */
+        void eraseDevice(const std::string &device);
+
+        [[nodiscard]] std::size_t size() const;
+
+        [[nodiscard]] const std::string &path() const
+        { return tablePath; }
+
+    private:
+        const std::string tablePath;
+        const std::size_t capacity;
+        RegistrationTableHeader *header = nullptr;
+        RegistrationSlot *slots = nullptr;
+        std::size_t mappingSize = 0;
+        dev_t fileDevice = 0;
+        ino_t fileInode = 0;
+
+        void write(RegistrationSlot &slot, std::uint32_t state, pid_t pid, std::int64_t interval_ns,
+                   const std::uint64_t *device);
+
+        /**
+         * @brief Empties the tombstone at index and those before it if the next slot is empty
+         */
+        void reclaim(std::size_t index);
+
+        void close();
+    };
+
+    /**
+     * @brief Read-only view of a registration table, usable from any number of threads and processes
+     * @details Lookups neither lock nor enter the kernel, they only read the mapping.
+     */
+    class RegistrationTableReader
+    {
+    public:
+        RegistrationTableReader() = default;
+
+        RegistrationTableReader(const RegistrationTableReader &other) = delete;
+
+        ~RegistrationTableReader();
+
+        RegistrationTableReader &operator=(const RegistrationTableReader &other) = delete;
+
+        /**
+         * @return 0 on success, EINVAL if the file is no registration table or the errno of mapping it
+         */
+        [[nodiscard]] int open(const std::string &path = k2RegistrationTablePath());
+
+        /**
+         * @param interval_ns Receives the interval of the task if it is registered
+         * @return 0 if the task is registered, ENOENT if it is not, EAGAIN if a slot stayed locked by a writer
+         * that probably died while updating it
+         */
+        [[nodiscard]] int lookup(const std::string &device, pid_t pid, std::int64_t &interval_ns) const;
+
+        /**
+         * @return Changes of the table so far, 0 if it is not open
+         */
+        [[nodiscard]] std::uint64_t generation() const;
+
+        /**
+         * @return Number of registered tasks
+         */
+        [[nodiscard]] std::size_t size() const;
+
+    private:
+        const RegistrationTableHeader *header = nullptr;
+        const RegistrationSlot *slots = nullptr;
+        std::size_t mask = 0;
+        std::size_t mappingSize = 0;
+    };
+}
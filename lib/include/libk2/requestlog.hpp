@@ -0,0 +1,227 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libk2/histogram.hpp"
+
+namespace workload {
+
+    /**
+     * @brief One completed request, as stored in the rings and in trace files
+     */
+    struct RequestRecord
+    {
+        /**
+         * @brief Submission and completion time in ns on CLOCK_MONOTONIC
+         */
+        std::int64_t submitNs = 0;
+        std::int64_t completeNs = 0;
+        std::uint64_t offset = 0;
+        std::uint32_t length = 0;
+        /**
+         * @brief Bytes transferred or -errno
+         */
+        std::int32_t result = 0;
+        /**
+         * @brief Thread that issued the request
+         */
+        std::int32_t pid = 0;
+        /**
+         * @brief Stream or job index the ring was attached with
+         */
+        std::uint16_t stream = 0;
+        /**
+         * @brief 0 for reads, 1 for writes
+         */
+        std::uint8_t direction = 0;
+        std::uint8_t reserved = 0;
+    };
+
+    static_assert(sizeof(RequestRecord) == 40, "RequestRecord is part of the trace file format");
+
+    /**
+     * @brief Bounded single producer, single consumer ring of RequestRecords
+     * @details The producer only touches its own head index and a cached copy of the tail, so a push is a copy and a
+     * release store as long as the ring has room. A full ring drops the record instead of blocking the I/O loop.
+     */
+    class RequestRing
+    {
+    public:
+        /**
+         * @param capacity Rounded up to a power of two
+         */
+        RequestRing(std::size_t capacity, std::uint16_t stream);
+
+        RequestRing(const RequestRing &other) = delete;
+
+        RequestRing &operator=(const RequestRing &other) = delete;
+
+        /**
+         * @brief Producer side, appends a record
+         * @return false if the ring was full and the record was dropped
+         */
+        bool push(const RequestRecord &record)
+        {
+            const std::uint64_t head = headIndex.load(std::memory_order_relaxed);
+            if (head - cachedTail > mask) {
+                cachedTail = tailIndex.load(std::memory_order_acquire);
+                if (head - cachedTail > mask) {
+                    droppedCount.store(droppedCount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                    return false;
+                }
+            }
+            records[head & mask] = record;
+            headIndex.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Consumer side, hands every available record to consume in order
+         * @return The number of records consumed
+         */
+        template<typename Consumer>
+        std::size_t drain(Consumer &&consume)
+        {
+            const std::uint64_t tail = tailIndex.load(std::memory_order_relaxed);
+            const std::uint64_t head = headIndex.load(std::memory_order_acquire);
+            for (std::uint64_t i = tail; i != head; i++) {
+                consume(records[i & mask]);
+            }
+            tailIndex.store(head, std::memory_order_release);
+            return static_cast<std::size_t>(head - tail);
+        }
+
+        [[nodiscard]] std::uint16_t stream() const
+        { return ringStream; }
+
+        [[nodiscard]] std::uint64_t dropped() const
+        { return droppedCount.load(std::memory_order_relaxed); }
+
+    private:
+        std::unique_ptr<RequestRecord[]> records;
+        std::uint64_t mask;
+        const std::uint16_t ringStream;
+        // Producer and consumer indices on their own cache lines
+        alignas(64) std::atomic<std::uint64_t> headIndex{0};
+        std::uint64_t cachedTail = 0;
+        std::atomic<std::uint64_t> droppedCount{0};
+        alignas(64) std::atomic<std::uint64_t> tailIndex{0};
+    };
+
+    struct CollectorOptions
+    {
+        /**
+         * @brief Records per ring, the collector has to drain a ring before it fills up
+         */
+        std::size_t ringCapacity = 1 << 16;
+        std::chrono::milliseconds interval{10};
+        /**
+         * @brief Also write every record to this binary trace file, empty for histograms only
+         */
+        std::string tracePath;
+        /**
+         * @brief Also hands every drained batch of records to this function, called on the collector thread. A
+         * non-zero return is an errno value that ends further calls
+         */
+        std::function<int(const RequestRecord *records, std::size_t count)> sink;
+    };
+
+    /**
+     * @brief Drains the RequestRings of any number of I/O threads into latency histograms and an optional trace file
+     * @details Threads attach once on their cold path and then only push into their own ring. The collector thread
+     * wakes up every interval, so the I/O threads never wait for it or for the trace file. Rings live in the memory
+     * of this process, process streams cannot attach.
+     */
+    class RequestCollector
+    {
+    public:
+        explicit RequestCollector(CollectorOptions options = {});
+
+        RequestCollector(const RequestCollector &other) = delete;
+
+        ~RequestCollector();
+
+        RequestCollector &operator=(const RequestCollector &other) = delete;
+
+        /**
+         * @brief Opens the trace file if one is configured and starts the collector thread
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int start();
+
+        /**
+         * @brief Drains all rings a last time and stops the collector thread, rings stay valid until destruction
+         */
+        void stop();
+
+        /**
+         * @brief Creates a ring for the calling thread, thread safe
+         */
+        [[nodiscard]] RequestRing *attach(std::uint16_t stream);
+
+        /**
+         * @return Time from submission to completion of all successful requests in ns, read after stop
+         */
+        [[nodiscard]] const k2::Histogram &latency() const
+        { return totalLatency; }
+
+        /**
+         * @return Latencies of the requests of one stream, empty for unknown streams
+         */
+        [[nodiscard]] k2::Histogram streamLatency(std::uint16_t stream) const;
+
+        [[nodiscard]] std::uint64_t collected() const
+        { return collectedCount; }
+
+        /**
+         * @return Records lost because a ring was full
+         */
+        [[nodiscard]] std::uint64_t dropped() const;
+
+        /**
+         * @return The first error writing the trace file or of the sink, 0 if there was none
+         */
+        [[nodiscard]] int traceError() const
+        { return writeError; }
+
+    private:
+        void collect();
+
+        void drainAll();
+
+        const CollectorOptions options;
+        mutable std::mutex mutex;
+        std::condition_variable wake;
+        std::vector<std::unique_ptr<RequestRing>> rings;
+        std::thread thread;
+        bool running = false;
+        bool stopping = false;
+
+        k2::Histogram totalLatency;
+        std::map<std::uint16_t, k2::Histogram> streamLatencies;
+        std::uint64_t collectedCount = 0;
+        std::vector<RequestRecord> batch;
+        int traceFd = -1;
+        int writeError = 0;
+    };
+
+    /**
+     * @brief Reads a trace file written by RequestCollector
+     * @return 0 on success, EINVAL if the file is no request trace or the errno of reading it
+     */
+    [[nodiscard]] int readRequestTrace(const std::string &path, std::vector<RequestRecord> &records);
+}
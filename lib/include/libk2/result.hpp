@@ -0,0 +1,79 @@
+#pragma once
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace k2 {
+
+    enum class Operation
+    {
+        OpenDriver,
+        CloseDriver,
+        GetVersion,
+        GetActiveDevices,
+        RegisterTask,
+        UnregisterTask,
+        UnregisterAllTasks,
+        UpdateInterval,
+        /**
+         * @brief Registering a task again after an emulated interval update failed, the task is lost if it fails
+         */
+        RestoreTask,
+        ListTasks,
+        Connect
+    };
+
+    /**
+     * @brief Outcome of a single driver operation
+     */
+    struct Result
+    {
+        Operation operation;
+        /**
+         * @brief errno of the failed operation, 0 on success
+         */
+        int error = 0;
+
+        [[nodiscard]] bool ok() const
+        { return error == 0; }
+
+        explicit operator bool() const
+        { return ok(); }
+    };
+
+    /**
+     * @brief Receives the result of every driver operation together with the device and pid it targeted
+     * @details device is empty and pid is 0 for operations that do not refer to them
+     */
+    using LogSink = std::function<void(const Result &result, const std::string &device, const pid_t pid)>;
+
+    /**
+     * @brief Installs a sink that is called after every driver operation, pass an empty sink to disable logging
+     * @details Logging is disabled by default, so the library performs no I/O of its own. Not thread safe, install
+     * the sink before issuing operations from multiple threads.
+     */
+    void setLogSink(LogSink sink);
+
+    /**
+     * @return A sink that prints successes to out and failures to err
+     */
+    [[nodiscard]] LogSink streamLogSink(std::ostream &out, std::ostream &err);
+
+    [[nodiscard]] std::string toString(const Operation operation);
+
+    [[nodiscard]] std::string toString(const Result &result);
+
+    namespace detail {
+        [[nodiscard]] bool logEnabled();
+
+        void log(const Result &result, const std::string &device, const pid_t pid);
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, const k2::Operation operation);
+std::ostream &operator<<(std::ostream &os, const k2::Result &result);
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+#include "libk2/histogram.hpp"
+#include "libk2/requestlog.hpp"
+
+namespace workload {
+
+    /**
+     * @brief Start of every result file
+     * @details A result file is this header followed by sections. Every section is a ResultSectionHeader and a
+     * payload padded to 8 bytes, so a mapped file can be walked without copying and RequestRecords in it are
+     * naturally aligned. All values are in host byte order.
+     */
+    struct ResultFileHeader
+    {
+        char magic[8] = {'K', '2', 'R', 'E', 'S', 'U', 'L', 'T'};
+        std::uint32_t version = 1;
+        std::uint32_t headerSize = sizeof(ResultFileHeader);
+    };
+
+    enum class ResultSection : std::uint32_t
+    {
+        /**
+         * @brief Label, profile name, timing and the configuration text of the run, first in every file
+         */
+        Run = 1,
+        /**
+         * @brief Summary and latency histogram of one job group
+         */
+        Group = 2,
+        /**
+         * @brief A batch of RequestRecords, there can be any number of these
+         */
+        Records = 3
+    };
+
+    struct ResultSectionHeader
+    {
+        ResultSection type = ResultSection::Run;
+        std::uint32_t reserved = 0;
+        /**
+         * @brief Payload bytes following this header, without padding
+         */
+        std::uint64_t size = 0;
+    };
+
+    struct RunInfo
+    {
+        std::string label;
+        std::string profile;
+        /**
+         * @brief Free form description of the configuration, e.g. the profile file or the command line
+         */
+        std::string config;
+        /**
+         * @brief Start of the run in ns since the epoch
+         */
+        std::int64_t startTimeNs = 0;
+        std::int64_t wallTimeNs = 0;
+    };
+
+    struct GroupSummary
+    {
+        std::string name;
+        /**
+         * @brief Index of the group, the stream of its RequestRecords
+         */
+        std::uint16_t index = 0;
+        bool foreground = false;
+        std::uint32_t jobs = 0;
+        std::uint64_t blockSize = 0;
+        std::int64_t intervalNs = 0;
+        std::uint64_t requests = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t errors = 0;
+        std::uint64_t deadlineMisses = 0;
+        std::uint64_t periods = 0;
+        std::uint64_t overruns = 0;
+        std::int64_t wallTimeNs = 0;
+        k2::Histogram latency;
+    };
+
+    /**
+     * @brief Writes a result file section by section
+     * @details Methods are thread safe, so records can be written from a RequestCollector sink while the run is in
+     * progress and the group summaries once it ended.
+     */
+    class ResultWriter
+    {
+    public:
+        ResultWriter() = default;
+
+        ResultWriter(const ResultWriter &other) = delete;
+
+        ~ResultWriter();
+
+        ResultWriter &operator=(const ResultWriter &other) = delete;
+
+        /**
+         * @brief Creates the file and writes the file header and the run section
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int open(const std::string &path, const RunInfo &run);
+
+        [[nodiscard]] int writeRecords(const RequestRecord *records, std::size_t count);
+
+        [[nodiscard]] int writeGroup(const GroupSummary &group);
+
+        /**
+         * @brief Updates the wall time of the run section, which is only known once the run ended
+         */
+        [[nodiscard]] int setWallTime(std::int64_t wallTimeNs);
+
+        /**
+         * @return 0 if every write since open succeeded, otherwise the first error
+         */
+        [[nodiscard]] int close();
+
+    private:
+        [[nodiscard]] int writeSection(ResultSection type, const void *payload, std::size_t size);
+
+        std::mutex mutex;
+        int fd = -1;
+        int error = 0;
+    };
+
+    /**
+     * @brief Maps a result file and walks its sections in order
+     * @details Sections already processed can be released, so even multi-gigabyte record sections are streamed
+     * through a bounded amount of memory.
+     */
+    class ResultReader
+    {
+    public:
+        struct Section
+        {
+            ResultSection type = ResultSection::Run;
+            const unsigned char *data = nullptr;
+            std::size_t size = 0;
+        };
+
+        ResultReader() = default;
+
+        ResultReader(const ResultReader &other) = delete;
+
+        ~ResultReader();
+
+        ResultReader &operator=(const ResultReader &other) = delete;
+
+        /**
+         * @return 0 on success, EINVAL if the file is no result file or the errno of mapping it
+         */
+        [[nodiscard]] int open(const std::string &path);
+
+        /**
+         * @return false at the end of the file or at a truncated section
+         */
+        bool next(Section &section);
+
+        /**
+         * @brief Drops the pages of everything before the current position from memory
+         */
+        void release();
+
+        /**
+         * @return Parsed run section, EINVAL for a malformed one
+         */
+        [[nodiscard]] static int parseRun(const Section &section, RunInfo &run);
+
+        [[nodiscard]] static int parseGroup(const Section &section, GroupSummary &group);
+
+        [[nodiscard]] static const RequestRecord *records(const Section &section, std::size_t &count);
+
+    private:
+        const unsigned char *mapping = nullptr;
+        std::size_t mappingSize = 0;
+        std::size_t position = 0;
+        std::size_t released = 0;
+    };
+
+    /**
+     * @return value as a quoted JSON string, with quotes, backslashes and control characters escaped
+     */
+    [[nodiscard]] std::string jsonString(const std::string &value);
+
+    /**
+     * @return value as a CSV field after RFC 4180, quoted with doubled quotes if it holds a comma, quote or line break
+     */
+    [[nodiscard]] std::string csvField(const std::string &value);
+}
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "libk2/histogram.hpp"
+#include "libk2/periodic.hpp"
+#include "libk2/profile.hpp"
+#include "libk2/requestlog.hpp"
+#include "libk2/workerpool.hpp"
+
+namespace workload {
+
+    /**
+     * @brief Measurements of one job group, summed over its jobs
+     */
+    struct GroupResult
+    {
+        /**
+         * @brief Foreground only: time from submission to completion of every request in ns
+         */
+        k2::Histogram latency;
+        /**
+         * @brief Foreground only: release jitter and completion times of all periods of all jobs
+         */
+        PeriodicStats periodic;
+        std::uint64_t requests = 0;
+        std::uint64_t bytes = 0;
+        std::uint64_t errors = 0;
+        /**
+         * @brief Foreground only: requests that completed after the next release
+         */
+        std::uint64_t deadlineMisses = 0;
+        /**
+         * @brief Foreground only: jobs that were registered with k2
+         */
+        unsigned registered = 0;
+        /**
+         * @brief How long the group ran in ns
+         */
+        std::int64_t wallTimeNs = 0;
+    };
+
+    /**
+     * @brief Executes a profile: starts all groups together, runs them for their durations and collects results
+     * @details Background groups run in one WorkerPool each. Every foreground job is a thread with its own engine,
+     * buffers and PeriodicIssuer that is registered with k2 by its thread id if the group asks for it, directly or
+     * through the k2-register-task daemon. All jobs open their targets before the first one is released.
+     */
+    class ProfileRunner
+    {
+    public:
+        explicit ProfileRunner(Profile profile);
+
+        ProfileRunner(const ProfileRunner &other) = delete;
+
+        ~ProfileRunner();
+
+        ProfileRunner &operator=(const ProfileRunner &other) = delete;
+
+        /**
+         * @brief Registers foreground jobs through the k2-register-task daemon on this socket instead of the driver
+         */
+        void setK2Socket(std::string socket)
+        { k2Socket = std::move(socket); }
+
+        /**
+         * @brief Logs every request of the foreground jobs and background thread jobs, with the group index as stream
+         * @param requestCollector Started by the caller, must outlive run
+         */
+        void setCollector(RequestCollector *requestCollector)
+        { collector = requestCollector; }
+
+        /**
+         * @brief Runs the profile to completion or until requestStop
+         * @return 0 on success or an errno value, e.g. if a job could not open its target
+         */
+        [[nodiscard]] int run();
+
+        /**
+         * @brief Async signal safe request to end the run early, results cover what ran so far
+         */
+        void requestStop();
+
+        [[nodiscard]] const Profile &profile() const
+        { return runProfile; }
+
+        /**
+         * @return One result per group of the profile, in the same order
+         */
+        [[nodiscard]] const std::vector<GroupResult> &results() const
+        { return groupResults; }
+
+        [[nodiscard]] std::int64_t wallTimeNs() const
+        { return runTimeNs; }
+
+    private:
+        struct Job;
+
+        const Profile runProfile;
+        std::optional<std::string> k2Socket;
+        RequestCollector *collector = nullptr;
+        std::vector<GroupResult> groupResults;
+        std::vector<std::unique_ptr<WorkerPool>> pools;
+        std::atomic<bool> stop{false};
+        std::int64_t runTimeNs = 0;
+
+        void runForeground(const JobGroup &group, Job &job);
+    };
+}
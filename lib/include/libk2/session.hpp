@@ -0,0 +1,178 @@
+#pragma once
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "libk2/backend.hpp"
+#include "libk2/devices.hpp"
+#include "libk2/result.hpp"
+
+struct k2_ioctl;
+
+namespace k2 {
+
+    /**
+     * @brief One entry of a batched (un)registration
+     */
+    struct TaskSpec
+    {
+        std::string device;
+        pid_t pid = 0;
+        std::int64_t interval_ns = 0;
+    };
+
+    /**
+     * @brief Persistent handle to the k2 driver
+     * @details Opens the driver once and reuses a single set of ioctl buffers for all operations issued through it,
+     * so callers that talk to k2 frequently do not pay for open/close and heap allocations on every request.
+     * A session is not thread safe, use one session per thread.
+     */
+    class Session
+    {
+    public:
+        /**
+         * @brief Opens the driver through the default backend, see setDefaultBackend
+         */
+        Session();
+
+        /**
+         * @brief Opens the driver control device devName through an IoctlBackend
+         */
+        explicit Session(const std::string &devName);
+
+        explicit Session(std::unique_ptr<Backend> backend);
+
+        Session(const Session &other) = delete;
+
+        Session(Session &&other) noexcept;
+
+        ~Session();
+
+        Session &operator=(const Session &other) = delete;
+
+        Session &operator=(Session &&other) noexcept;
+
+        /**
+         * @return true if the driver device could be opened
+         */
+        [[nodiscard]] bool isOpen() const;
+
+        /**
+         * @return The result of opening the driver device
+         */
+        [[nodiscard]] Result error() const;
+
+        Result getVersion(std::string &version);
+
+        Result getActiveDevices(std::string &devices);
+
+        /**
+         * @brief Returns the devices managed by k2
+         * @details The inventory is parsed once and cached in the session until it is older than the TTL or a
+         * session of this process saw a device disappear, see invalidateDevices
+         */
+        Result getDevices(std::vector<DeviceInfo> &devices);
+
+        /**
+         * @brief Looks up a single device in the cached inventory
+         * @return ENODEV if k2 does not manage the device
+         */
+        Result findDevice(const std::string &name, DeviceInfo &info);
+
+        /**
+         * @param ttl Maximum age of the cached inventory, 0 to query the driver every time
+         */
+        void setDeviceCacheTtl(const std::chrono::milliseconds ttl)
+        { deviceCache.ttl = ttl; }
+
+        /**
+         * @brief Lets registerTask(s) reject devices that are not in the cached inventory with ENODEV before they
+         * reach the driver
+         * @details Only a device missing from the cache costs an extra ioctl to refresh it, so invalid requests
+         * are turned away locally without adding a round trip to valid ones
+         */
+        void setValidateDevices(const bool validate)
+        { validateDevices = validate; }
+
+        Result registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+
+        Result unregisterTask(const std::string &device, const pid_t pid);
+
+        Result unregisterAllTasks(const std::string &device);
+
+        /**
+         * @brief Changes the interval of a registered task in place
+         * @details Uses the driver's update ioctl where the module provides one. Otherwise the task is unregistered
+         * and registered again with the new interval while holding the task lock shared by all sessions of the
+         * process, so no other libk2 operation of this process observes or modifies the task in between. Other
+         * processes are not locked out, and the task is unprotected for the duration of the second ioctl.
+         * If the driver rejects the new interval, the task is registered again with the interval this process
+         * registered it with, and the failed result of UpdateInterval reports the rejection.
+         * @return EINVAL for a non-positive interval. A task that is not registered fails with the errno the
+         * driver's update or, when emulating, unregister ioctl reports for it, EINVAL with the k2 module and ENODEV
+         * if the device is gone; nothing is changed then. A failed result of Operation::RestoreTask means the task is
+         * no longer registered: the new interval was rejected and the old one was unknown to this process or rejected
+         * as well.
+         */
+        Result updateInterval(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+
+        /**
+         * @return false once the driver turned out not to support updating intervals natively
+         */
+        [[nodiscard]] bool nativeUpdate() const
+        { return updateIoctl; }
+
+        /**
+         * @brief Registers all tasks through this session's driver handle
+         * @return One result per entry of specs, in the same order
+         */
+        std::vector<Result> registerTasks(const std::vector<TaskSpec> &specs);
+
+        /**
+         * @brief Unregisters all tasks through this session's driver handle, interval_ns of the specs is ignored
+         * @return One result per entry of specs, in the same order
+         */
+        std::vector<Result> unregisterTasks(const std::vector<TaskSpec> &specs);
+
+    private:
+        struct IoctlBuffers;
+
+        std::unique_ptr<Backend> backend;
+        int openError = 0;
+        std::unique_ptr<IoctlBuffers> buffers;
+        DeviceCache deviceCache;
+        bool validateDevices = false;
+        bool updateIoctl = false;
+
+        void close();
+
+        /**
+         * @brief Issues one ioctl through the backend, counted and timed as operation if metrics are enabled
+         */
+        int issue(Operation operation, unsigned long request, struct k2_ioctl &io);
+
+        /**
+         * @brief Registers a task again with its previous interval after an emulated update failed halfway
+         * @return UpdateInterval if the task is registered again, RestoreTask if it is lost
+         */
+        Operation restore(const std::string &device, pid_t pid, struct k2_ioctl &io);
+
+        struct k2_ioctl &prepare(const std::string &device);
+
+        /**
+         * @return 0 once the cached inventory is fresh or an errno value
+         */
+        int refreshDevices();
+
+        /**
+         * @return 0 if the device is in the inventory, refreshing a stale one first, or an errno value
+         */
+        int checkDevice(const std::string &device);
+    };
+}
@@ -0,0 +1,115 @@
+#pragma once
+
+extern "C" {
+#include <unistd.h>
+}
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "libk2/result.hpp"
+#include "libk2/session.hpp"
+
+namespace k2 {
+
+    /**
+     * @brief Unregisters tasks from k2 as soon as their process exits
+     * @details Every watched pid is tracked through a pidfd, and all pidfds sit in one epoll set, so a process exit
+     * costs one hash lookup and the unregistrations of that pid no matter how many tasks are watched. Each watched pid
+     * holds one file descriptor, raise RLIMIT_NOFILE to watch thousands of tasks.
+     * The supervisor does not spawn a thread. Either call poll from a loop, or add fd() to an existing event loop
+     * and call poll(0) whenever it becomes readable. Like the session it uses, it is not thread safe.
+     */
+    class TaskSupervisor
+    {
+    public:
+        /**
+         * @brief Called for every task that was unregistered because its process exited
+         */
+        using ExitHandler = std::function<void(const Result &result, const std::string &device, const pid_t pid)>;
+
+        explicit TaskSupervisor(Session &session);
+
+        TaskSupervisor(const TaskSupervisor &other) = delete;
+
+        /**
+         * @brief Stops watching, tasks stay registered
+         */
+        ~TaskSupervisor();
+
+        TaskSupervisor &operator=(const TaskSupervisor &other) = delete;
+
+        /**
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int open();
+
+        /**
+         * @return The epoll file descriptor, readable while exited processes are pending
+         */
+        [[nodiscard]] int fd() const
+        { return epollFd; }
+
+        void setExitHandler(ExitHandler handler)
+        { exitHandler = std::move(handler); }
+
+        /**
+         * @brief Registers a task and watches its process
+         * @details Fails with ESRCH and leaves the task unregistered if the process does not exist (anymore)
+         */
+        Result registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns);
+
+        /**
+         * @brief Unregisters a task and stops watching it, a task the driver failed to unregister stays watched
+         */
+        Result unregisterTask(const std::string &device, const pid_t pid);
+
+        /**
+         * @brief Unregisters all tasks of a device and stops watching them
+         */
+        Result unregisterAllTasks(const std::string &device);
+
+        /**
+         * @brief Watches a task that was registered elsewhere
+         * @return 0 on success or an errno value, ESRCH if the process does not exist
+         */
+        [[nodiscard]] int watch(const std::string &device, const pid_t pid);
+
+        /**
+         * @brief Stops watching a task without unregistering it
+         */
+        void unwatch(const std::string &device, const pid_t pid);
+
+        /**
+         * @brief Waits up to timeoutMs (-1 for ever, 0 to not block) for processes to exit and unregisters their tasks
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int poll(const int timeoutMs);
+
+        /**
+         * @return The number of watched processes
+         */
+        [[nodiscard]] std::size_t size() const
+        { return watches.size(); }
+
+    private:
+        struct Watch
+        {
+            int pidFd = -1;
+            /**
+             * @brief A process may run periodic tasks on several devices, usually just one
+             */
+            std::vector<std::string> devices;
+        };
+
+        Session &session;
+        int epollFd = -1;
+        std::unordered_map<pid_t, Watch> watches;
+        ExitHandler exitHandler;
+
+        void remove(std::unordered_map<pid_t, Watch>::iterator watch);
+    };
+}
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace k2 {
+
+    /**
+     * @brief One online CPU as seen by sysfs
+     */
+    struct CpuInfo
+    {
+        int id = -1;
+        /**
+         * @brief core_id within the package, -1 if unknown
+         */
+        int core = -1;
+        int package = -1;
+        /**
+         * @brief NUMA node, 0 on systems without NUMA information
+         */
+        int node = 0;
+        /**
+         * @brief SMT threads of the same physical core including this CPU, ascending
+         */
+        std::vector<int> siblings;
+        /**
+         * @brief Excluded from scheduler load balancing with isolcpus
+         */
+        bool isolated = false;
+        /**
+         * @brief Part of the affinity mask of this process, e.g. of its cpuset
+         */
+        bool allowed = true;
+    };
+
+    struct CpuTopology
+    {
+        /**
+         * @brief Online CPUs ordered by id
+         */
+        std::vector<CpuInfo> cpus;
+
+        /**
+         * @return The CPU with this id, nullptr if it is not online
+         */
+        [[nodiscard]] const CpuInfo *find(int id) const;
+
+        /**
+         * @return Number of distinct NUMA nodes of the online CPUs
+         */
+        [[nodiscard]] std::size_t nodes() const;
+    };
+
+    /**
+     * @brief Where the blk-mq hardware queues of a block device and their interrupts live
+     */
+    struct DeviceTopology
+    {
+        /**
+         * @brief Name of the disk, that of its parent for a partition
+         */
+        std::string name;
+        /**
+         * @brief NUMA node the device is attached to, -1 if unknown
+         */
+        int node = -1;
+        /**
+         * @brief CPUs that submit to each hardware queue (hctx), empty for devices without blk-mq
+         */
+        std::vector<std::vector<int>> queues;
+        /**
+         * @brief CPUs that receive completion interrupts of the device, empty if they cannot be determined
+         */
+        std::vector<int> irqCpus;
+
+        /**
+         * @return Index of the hardware queue the CPU submits to, -1 if unknown
+         */
+        [[nodiscard]] int queueOf(int cpu) const;
+
+        [[nodiscard]] bool handlesIrqs(int cpu) const;
+
+        /**
+         * @return true if nothing was found about the device, e.g. because it is no block device
+         */
+        [[nodiscard]] bool empty() const;
+    };
+
+    /**
+     * @brief Reads the online CPUs, their SMT siblings, NUMA nodes and isolation from sysfs
+     * @param sysSystem Usually /sys/devices/system, may point at a copy for tests
+     */
+    [[nodiscard]] CpuTopology readCpuTopology(const std::string &sysSystem = "/sys/devices/system");
+
+    /**
+     * @brief Reads the hardware queue mapping, NUMA node and interrupt CPUs of a block device
+     * @details Partitions are resolved to their disk through the class/block directory next to sysBlock. Interrupt
+     * CPUs are the effective affinities of the MSI vectors of the PCI device behind the disk, which needs the irq
+     * directories of procfs to be readable.
+     */
+    [[nodiscard]] DeviceTopology readDeviceTopology(const std::string &device,
+                                                    const std::string &sysBlock = "/sys/block",
+                                                    const std::string &procIrq = "/proc/irq");
+
+    enum class PlacementPolicy
+    {
+        /**
+         * @brief The real-time task on the first allowed CPU, background load round robin over the others
+         */
+        Sequential,
+        /**
+         * @brief The real-time task on a device local CPU that handles its own completions and has no loaded SMT
+         * sibling, background load on the remaining cores of the device node first
+         */
+        Local,
+        /**
+         * @brief Like Local, but background load goes to the other NUMA nodes first, so its completions do not
+         * contend with those of the real-time task
+         */
+        Remote,
+        NA
+    };
+
+    [[nodiscard]] std::string toString(PlacementPolicy policy);
+
+    [[nodiscard]] PlacementPolicy placementPolicyToEnum(const std::string &name);
+
+    struct Placement
+    {
+        /**
+         * @brief CPU to pin the real-time task to, -1 if there is none
+         */
+        int realtimeCpu = -1;
+        /**
+         * @brief CPUs to pin background workers to round robin, best first; empty leaves them unpinned
+         */
+        std::vector<int> backgroundCpus;
+    };
+
+    /**
+     * @brief Chooses CPUs for one real-time task and background workers on a device
+     * @details Only allowed CPUs are used. With Local and Remote, isolated CPUs are preferred for the real-time task
+     * and never handed to background workers. CPUs that share the hardware queue of the real-time CPU only get
+     * background load if no other CPU is left, and its SMT siblings only if not even those are left.
+     */
+    [[nodiscard]] Placement placeWorkers(const CpuTopology &topology, const DeviceTopology &device,
+                                         PlacementPolicy policy);
+
+    /**
+     * @brief Parses a kernel CPU list like "0-3,8,10-11", also tolerating the ", " separators of blk-mq
+     * @details CPUs keep the order of the list, repeated ones are dropped
+     * @return false on malformed input, including a trailing comma, and for CPUs at or above CPU_SETSIZE
+     */
+    bool parseCpuList(const std::string &list, std::vector<int> &cpus);
+
+    /**
+     * @return A compact CPU list like "0-3,8"
+     */
+    [[nodiscard]] std::string formatCpuList(const std::vector<int> &cpus);
+}
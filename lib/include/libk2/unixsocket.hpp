@@ -0,0 +1,43 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+#include <sys/un.h>
+}
+
+#include <string>
+
+namespace k2 {
+
+    /**
+     * @brief Identity of the socket file a server bound, so it only ever removes its own
+     */
+    struct BoundSocket
+    {
+        dev_t device = 0;
+        ino_t inode = 0;
+    };
+
+    namespace detail {
+        /**
+         * @brief Fills a Unix domain socket address
+         * @return 0 on success or ENAMETOOLONG if the path is empty or does not fit
+         */
+        [[nodiscard]] int unixSocketAddress(const std::string &path, struct sockaddr_un &address);
+
+        /**
+         * @brief Binds fd to a Unix domain socket path, replacing only a socket file whose server is gone
+         * @details An existing socket that refuses connections is left behind by a server that did not shut down
+         * cleanly and is removed. A socket with a live server makes this fail with EADDRINUSE, any other kind of file
+         * with EEXIST, and neither is touched.
+         * @param bound Receives the identity of the new socket file for unlinkUnixSocket
+         * @return 0 on success or an errno value
+         */
+        [[nodiscard]] int bindUnixSocket(int fd, const std::string &path, BoundSocket &bound);
+
+        /**
+         * @brief Removes the socket file bound by bindUnixSocket, unless another server replaced it since
+         */
+        void unlinkUnixSocket(const std::string &path, BoundSocket &bound);
+    }
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+extern "C" {
+#include <sys/types.h>
+}
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "libk2/bufferpool.hpp"
+#include "libk2/ioengine.hpp"
+#include "libk2/ionice.hpp"
+#include "libk2/offsets.hpp"
+#include "libk2/requestlog.hpp"
+
+namespace workload {
+
+    enum class StreamKind
+    {
+        Thread,
+        Process
+    };
+
+    enum class IoPattern
+    {
+        Read,
+        Write,
+        Mixed,
+        NA
+    };
+
+    /**
+     * @brief Configuration of one background I/O stream
+     */
+    struct StreamConfig
+    {
+        std::string name;
+        StreamKind kind = StreamKind::Thread;
+        std::string path;
+        EngineOptions engine;
+        std::size_t blockSize = 4 * 1024 * 1024;
+        IoPattern pattern = IoPattern::Write;
+        /**
+         * @brief Share of reads in percent for IoPattern::Mixed
+         */
+        unsigned readPercent = 50;
+        /**
+         * @brief Start of the range of the target the stream works on in bytes
+         */
+        std::uint64_t offset = 0;
+        /**
+         * @brief Length of the range in bytes, 0 for everything from offset to the end of the target
+         */
+        std::uint64_t size = 0;
+        OffsetOptions offsets;
+        bool setIoPrio = false;
+        ionice::IoClass ioClass = ionice::IoClass::BestEffort;
+        ionice::IoLevel ioLevel = ionice::IoLevel::L4;
+        /**
+         * @brief CPU to pin the stream to, -1 to leave the affinity untouched
+         */
+        int cpu = -1;
+        /**
+         * @brief Upper bounds of the issue rate, 0 for unlimited. If both are set the lower resulting rate applies
+         */
+        double targetIops = 0;
+        double targetMBps = 0;
+        /**
+         * @brief Pause after every reaped batch of completions
+         */
+        std::chrono::microseconds thinkTime{0};
+        /**
+         * @brief Thread streams log every completed request to this collector as collectorStream, if set
+         */
+        RequestCollector *collector = nullptr;
+        std::uint16_t collectorStream = 0;
+    };
+
+    struct StreamStats
+    {
+        std::atomic<std::uint64_t> requests{0};
+        std::atomic<std::uint64_t> bytes{0};
+        std::atomic<std::uint64_t> errors{0};
+    };
+
+    /**
+     * @brief Runs a set of background I/O streams as threads and/or processes
+     * @details All streams share one pool of aligned buffers and are released together by a start barrier once
+     * every stream has opened its target, so runs start reproducibly. Control state and statistics live in a shared
+     * mapping, so process streams report back the same way thread streams do.
+     */
+    class WorkerPool
+    {
+    public:
+        explicit WorkerPool(std::vector<StreamConfig> streams);
+
+        WorkerPool(const WorkerPool &other) = delete;
+
+        ~WorkerPool();
+
+        WorkerPool &operator=(const WorkerPool &other) = delete;
+
+        /**
+         * @brief Spawns all streams and returns once all of them are running
+         * @return 0 on success or an errno value, in which case all streams are stopped again
+         */
+        [[nodiscard]] int start();
+
+        /**
+         * @brief Asks all streams to finish their in flight requests and waits for them
+         */
+        void stop();
+
+        /**
+         * @brief Async signal safe request to stop, also terminates process streams
+         */
+        void requestStop();
+
+        [[nodiscard]] const std::vector<StreamConfig> &streams() const
+        { return configs; }
+
+        [[nodiscard]] const StreamStats &stats(const std::size_t index) const;
+
+        /**
+         * @return The pids of all process streams
+         */
+        [[nodiscard]] const std::vector<pid_t> &pids() const
+        { return processPids; }
+
+        struct SharedState;
+
+    private:
+        const std::vector<StreamConfig> configs;
+        SharedState *shared = nullptr;
+        std::size_t sharedSize = 0;
+        BufferPool buffers;
+        std::vector<std::thread> threads;
+        std::vector<pid_t> processPids;
+        bool running = false;
+    };
+
+    [[nodiscard]] std::string toString(const IoPattern pattern);
+
+    [[nodiscard]] IoPattern ioPatternToEnum(const std::string &name);
+}
@@ -0,0 +1,388 @@
+#include "libk2/ioengine.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+// liburing is not a dependency, the few io_uring syscalls are issued directly
+// See https://kernel.dk/io_uring.pdf
+
+inline int ioUringSetupSyscall(unsigned entries, struct io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+inline int ioUringEnterSyscall(int ringFd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd, toSubmit, minComplete, flags, nullptr, 0));
+}
+
+inline int ioUringRegisterSyscall(int ringFd, unsigned opcode, const void *arg, unsigned nrArgs)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, ringFd, opcode, arg, nrArgs));
+}
+
+namespace workload {
+
+    /**
+     * @brief Blocking pread/pwrite, the request is complete when submit returns
+     */
+    class SyncEngine : public IoEngine
+    {
+    protected:
+        const bool direct;
+        int fd = -1;
+        std::vector<IoCompletion> pending;
+
+    public:
+        explicit SyncEngine(const bool direct) :
+                direct(direct)
+        {
+            pending.reserve(1);
+        }
+
+        ~SyncEngine() override
+        {
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        int open(const std::string &path, int flags) override
+        {
+            flags |= O_RDWR | O_SYNC;
+            if (direct) {
+                flags |= O_DIRECT;
+            }
+            fd = ::open(path.c_str(), flags, 0644);
+            if (fd < 0) {
+                return errno;
+            }
+            return EXIT_SUCCESS;
+        }
+
+        int submit(const IoRequest &request) override
+        {
+            if (!pending.empty()) {
+                return EAGAIN;
+            }
+            ssize_t ret;
+            do {
+                ret = request.direction == IoDirection::Write ?
+                      pwrite(fd, request.buffer, request.length, request.offset) :
+                      pread(fd, request.buffer, request.length, request.offset);
+            } while (ret < 0 && errno == EINTR);
+            pending.push_back(IoCompletion{request.userData, ret < 0 ? -errno : ret});
+            return EXIT_SUCCESS;
+        }
+
+        int reap(std::vector<IoCompletion> &completions, unsigned /*minComplete*/) override
+        {
+            completions.insert(completions.end(), pending.begin(), pending.end());
+            pending.clear();
+            return EXIT_SUCCESS;
+        }
+
+        unsigned queueDepth() const override
+        { return 1; }
+
+        unsigned inFlight() const override
+        { return static_cast<unsigned>(pending.size()); }
+    };
+
+    /**
+     * @brief io_uring engine operating directly on the mmap'ed submission and completion rings
+     */
+    class UringEngine : public IoEngine
+    {
+    protected:
+        const EngineOptions options;
+        int ringFd = -1;
+        int fd = -1;
+        bool buffersRegistered = false;
+
+        void *sqRing = MAP_FAILED;
+        void *cqRing = MAP_FAILED;
+        std::size_t sqRingSize = 0;
+        std::size_t cqRingSize = 0;
+        struct io_uring_sqe *sqes = static_cast<struct io_uring_sqe *>(MAP_FAILED);
+        std::size_t sqesSize = 0;
+
+        unsigned *sqHead = nullptr;
+        unsigned *sqTail = nullptr;
+        unsigned sqMask = 0;
+        unsigned *sqArray = nullptr;
+        unsigned *cqHead = nullptr;
+        unsigned *cqTail = nullptr;
+        unsigned cqMask = 0;
+        struct io_uring_cqe *cqes = nullptr;
+
+        unsigned queued = 0;
+        unsigned inflight = 0;
+
+        int setup()
+        {
+            struct io_uring_params params{};
+            ringFd = ioUringSetupSyscall(options.queueDepth, &params);
+            if (ringFd < 0) {
+                return errno;
+            }
+
+            sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+            cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+            const bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+            if (singleMmap) {
+                sqRingSize = cqRingSize = std::max(sqRingSize, cqRingSize);
+            }
+
+            sqRing = mmap(nullptr, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                          IORING_OFF_SQ_RING);
+            if (sqRing == MAP_FAILED) {
+                return errno;
+            }
+            if (singleMmap) {
+                cqRing = sqRing;
+            } else {
+                cqRing = mmap(nullptr, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                              IORING_OFF_CQ_RING);
+                if (cqRing == MAP_FAILED) {
+                    return errno;
+                }
+            }
+            sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+            sqes = static_cast<struct io_uring_sqe *>(
+                    mmap(nullptr, sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd,
+                         IORING_OFF_SQES));
+            if (sqes == MAP_FAILED) {
+                return errno;
+            }
+
+            auto *sq = static_cast<char *>(sqRing);
+            sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+            sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+            sqMask = *reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+            sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+
+            auto *cq = static_cast<char *>(cqRing);
+            cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+            cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+            cqMask = *reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+            cqes = reinterpret_cast<struct io_uring_cqe *>(cq + params.cq_off.cqes);
+            return EXIT_SUCCESS;
+        }
+
+        int enter(unsigned minComplete)
+        {
+            while (queued > 0 || minComplete > 0) {
+                const unsigned flags = minComplete > 0 ? IORING_ENTER_GETEVENTS : 0;
+                const int ret = ioUringEnterSyscall(ringFd, queued, minComplete, flags);
+                if (ret < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno;
+                }
+                // The kernel consumes queued entries in order, if it took none it dropped them or considers the
+                // submission ring inconsistent, and asking again would never make progress
+                if (ret == 0 && queued > 0) {
+                    return EIO;
+                }
+                queued -= std::min<unsigned>(queued, ret);
+                if (queued == 0) {
+                    break;
+                }
+            }
+            return EXIT_SUCCESS;
+        }
+
+    public:
+        explicit UringEngine(const EngineOptions &options) :
+                options(options)
+        {}
+
+        ~UringEngine() override
+        {
+            if (sqes != MAP_FAILED) {
+                munmap(sqes, sqesSize);
+            }
+            if (cqRing != MAP_FAILED && cqRing != sqRing) {
+                munmap(cqRing, cqRingSize);
+            }
+            if (sqRing != MAP_FAILED) {
+                munmap(sqRing, sqRingSize);
+            }
+            if (ringFd >= 0) {
+                close(ringFd);
+            }
+            if (fd >= 0) {
+                close(fd);
+            }
+        }
+
+        int open(const std::string &path, int flags) override
+        {
+            int ret = setup();
+            if (ret) {
+                return ret;
+            }
+            flags |= O_RDWR | O_SYNC;
+            if (options.direct) {
+                flags |= O_DIRECT;
+            }
+            fd = ::open(path.c_str(), flags, 0644);
+            if (fd < 0) {
+                return errno;
+            }
+            if (options.fixedFiles) {
+                if (ioUringRegisterSyscall(ringFd, IORING_REGISTER_FILES, &fd, 1) < 0) {
+                    return errno;
+                }
+            }
+            return EXIT_SUCCESS;
+        }
+
+        int registerBuffers(const std::vector<struct iovec> &buffers) override
+        {
+            if (!options.registeredBuffers || buffers.empty()) {
+                return EXIT_SUCCESS;
+            }
+            if (ioUringRegisterSyscall(ringFd, IORING_REGISTER_BUFFERS, buffers.data(),
+                                       static_cast<unsigned>(buffers.size())) < 0) {
+                return errno;
+            }
+            buffersRegistered = true;
+            return EXIT_SUCCESS;
+        }
+
+        int submit(const IoRequest &request) override
+        {
+            if (inflight >= options.queueDepth) {
+                return EAGAIN;
+            }
+            const unsigned tail = *sqTail;
+            const unsigned index = tail & sqMask;
+            struct io_uring_sqe *sqe = &sqes[index];
+            memset(sqe, 0, sizeof(*sqe));
+
+            const bool fixedBuffer = buffersRegistered && request.bufferIndex >= 0;
+            if (request.direction == IoDirection::Write) {
+                sqe->opcode = fixedBuffer ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+            } else {
+                sqe->opcode = fixedBuffer ? IORING_OP_READ_FIXED : IORING_OP_READ;
+            }
+            if (fixedBuffer) {
+                sqe->buf_index = static_cast<__u16>(request.bufferIndex);
+            }
+            if (options.fixedFiles) {
+                sqe->fd = 0;
+                sqe->flags |= IOSQE_FIXED_FILE;
+            } else {
+                sqe->fd = fd;
+            }
+            sqe->addr = reinterpret_cast<__u64>(request.buffer);
+            sqe->len = static_cast<__u32>(request.length);
+            sqe->off = static_cast<__u64>(request.offset);
+            sqe->user_data = request.userData;
+
+            sqArray[index] = index;
+            __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+            queued++;
+            inflight++;
+            return EXIT_SUCCESS;
+        }
+
+        int flush() override
+        {
+            return enter(0);
+        }
+
+        int reap(std::vector<IoCompletion> &completions, unsigned minComplete) override
+        {
+            minComplete = std::min(minComplete, inflight);
+            unsigned head = *cqHead;
+            unsigned available = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE) - head;
+            if (queued > 0 || available < minComplete) {
+                int ret = enter(available < minComplete ? minComplete - available : 0);
+                if (ret) {
+                    return ret;
+                }
+            }
+
+            const unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++) {
+                const struct io_uring_cqe &cqe = cqes[head & cqMask];
+                completions.push_back(IoCompletion{cqe.user_data, cqe.res});
+                inflight--;
+            }
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            return EXIT_SUCCESS;
+        }
+
+        unsigned queueDepth() const override
+        { return options.queueDepth; }
+
+        unsigned inFlight() const override
+        { return inflight; }
+    };
+
+    std::unique_ptr<IoEngine> makeEngine(const EngineOptions &options)
+    {
+        switch (options.type) {
+            case EngineType::Sync:
+                return std::make_unique<SyncEngine>(options.direct);
+            case EngineType::Direct:
+                return std::make_unique<SyncEngine>(true);
+            case EngineType::Uring: {
+                EngineOptions uringOptions = options;
+                uringOptions.queueDepth = std::max(uringOptions.queueDepth, 1U);
+                return std::make_unique<UringEngine>(uringOptions);
+            }
+            default:
+                return nullptr;
+        }
+    }
+
+    bool isDeviceTarget(const std::string &path)
+    {
+        struct stat st{};
+        return path.compare(0, 5, "/dev/") == 0 || (stat(path.c_str(), &st) == 0 && S_ISBLK(st.st_mode));
+    }
+
+    std::string toString(const EngineType type)
+    {
+        switch (type) {
+            case EngineType::Sync:
+                return "sync";
+            case EngineType::Direct:
+                return "direct";
+            case EngineType::Uring:
+                return "io_uring";
+            default:
+                return "N/A";
+        }
+    }
+
+    EngineType engineTypeToEnum(const std::string &name)
+    {
+        if (name == "sync") {
+            return EngineType::Sync;
+        }
+        if (name == "direct") {
+            return EngineType::Direct;
+        }
+        if (name == "io_uring" || name == "uring") {
+            return EngineType::Uring;
+        }
+        return EngineType::NA;
+    }
+}
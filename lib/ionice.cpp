@@ -1,13 +1,43 @@
 #include "libk2/ionice.hpp"
 
 extern "C" {
+#include <dirent.h>
 #include <unistd.h>
 #include <linux/ioprio.h>
 #include <sys/syscall.h>
 }
 
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+
 // See https://www.kernel.org/doc/html/latest/block/ioprio.html
 
+namespace ionice {
+    static_assert(ioClassToInt(IoClass::None) == IOPRIO_CLASS_NONE && ioClassToInt(IoClass::RealTime) == IOPRIO_CLASS_RT
+                  && ioClassToInt(IoClass::BestEffort) == IOPRIO_CLASS_BE
+                  && ioClassToInt(IoClass::Idle) == IOPRIO_CLASS_IDLE, "IoClass mirrors IOPRIO_CLASS_*");
+    static_assert(ioClassToInt(IoClass::NA) == IOPRIO_CLASS_BE && ioLevelToInt(IoLevel::NA) == 4);
+    static_assert(ioPrioClassShift == IOPRIO_CLASS_SHIFT);
+    static_assert(IoPrio(IoClass::RealTime, IoLevel::L0).value() == IOPRIO_PRIO_VALUE(IOPRIO_CLASS_RT, 0));
+    static_assert(IoPrio(IoClass::BestEffort, IoLevel::L4).value() == IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 4));
+    static_assert(IoPrio(IoClass::Idle, IoLevel::L7).value() == IOPRIO_PRIO_VALUE(IOPRIO_CLASS_IDLE, 7));
+    static_assert(IoPrio().value() == 0 && IoPrio().ioClass() == IoClass::None, "default is no priority set");
+    static_assert(!IoPrio(IoClass::NA, IoLevel::L0).valid() && !IoPrio(IoClass::Idle, IoLevel::NA).valid());
+    static_assert(IoPrio::fromValue(IOPRIO_PRIO_VALUE(IOPRIO_CLASS_BE, 3)) == IoPrio(IoClass::BestEffort, IoLevel::L3));
+    static_assert(IoPrio::fromValue(IOPRIO_PRIO_VALUE(IOPRIO_CLASS_RT, 2) | 1 << 3).ioLevel() == IoLevel::L2,
+                  "priority hints are dropped");
+    static_assert(!IoPrio::fromValue(7 << IOPRIO_CLASS_SHIFT).valid() && !IoPrio::fromValue(-1).valid());
+    static_assert(ioLevelToEnum(7) == IoLevel::L7 && ioLevelToEnum(8) == IoLevel::NA);
+    static_assert(ioClassToEnum(3) == IoClass::Idle && ioClassToEnum(-1) == IoClass::NA);
+    static_assert(ioClassToEnum("best-effort") == IoClass::BestEffort && ioClassToEnum("be") == IoClass::NA);
+    static_assert(name(IoClass::RealTime) == "realtime" && name(IoLevel::L5) == "5" && name(IoClass::NA) == "N/A");
+    static_assert(parseIoPrio("realtime/0") == IoPrio(IoClass::RealTime, IoLevel::L0));
+    static_assert(parseIoPrio("idle") == IoPrio(IoClass::Idle, IoLevel::L4));
+    static_assert(parseIoPrio("2/7") == IoPrio(IoClass::BestEffort, IoLevel::L7));
+    static_assert(!parseIoPrio("best-effort/8").valid() && !parseIoPrio("fast/1").valid() && !parseIoPrio("").valid());
+}
+
 inline long ioPrioSetSyscall(int which, int who, int ioprio)
 {
     return syscall(SYS_ioprio_set, which, who, ioprio);
@@ -18,114 +48,83 @@ inline long ioPrioGetSyscall(int which, int who)
     return syscall(SYS_ioprio_get, which, who);
 }
 
-std::string ionice::toString(const IoLevel ioLevel)
-{
-    switch (ioLevel) {
-        case IoLevel::L0:
-            return "0";
-        case IoLevel::L1:
-            return "1";
-        case IoLevel::L2:
-            return "2";
-        case IoLevel::L3:
-            return "3";
-        case IoLevel::L4:
-            return "4";
-        case IoLevel::L5:
-            return "5";
-        case IoLevel::L6:
-            return "6";
-        case IoLevel::L7:
-            return "7";
-        default:
-            return "N/A";
+namespace {
+    int whoToInt(const ionice::Who who)
+    {
+        switch (who) {
+            case ionice::Who::Process:
+                return IOPRIO_WHO_PROCESS;
+            case ionice::Who::ProcessGroup:
+                return IOPRIO_WHO_PGRP;
+            case ionice::Who::User:
+                return IOPRIO_WHO_USER;
+            default:
+                return -1;
+        }
     }
-}
 
-ionice::IoClass ioClasstoEnum(const int cClass)
-{
-    switch (cClass) {
-        case IOPRIO_CLASS_NONE:
-            return ionice::IoClass::None;
-        case IOPRIO_CLASS_RT:
-            return ionice::IoClass::RealTime;
-        case IOPRIO_CLASS_BE:
-            return ionice::IoClass::BestEffort;
-        case IOPRIO_CLASS_IDLE:
-            return ionice::IoClass::Idle;
-        default:
-            return ionice::IoClass::NA;
-    }
-}
-
-ionice::IoLevel ionice::ioLevelToEnum(const int cLevel)
-{
-    switch (cLevel) {
-        case 0:
-            return ionice::IoLevel::L0;
-        case 1:
-            return ionice::IoLevel::L1;
-        case 2:
-            return ionice::IoLevel::L2;
-        case 3:
-            return ionice::IoLevel::L3;
-        case 4:
-            return ionice::IoLevel::L4;
-        case 5:
-            return ionice::IoLevel::L5;
-        case 6:
-            return ionice::IoLevel::L6;
-        case 7:
-            return ionice::IoLevel::L7;
-        default:
-            return ionice::IoLevel::NA;
+    /**
+     * @brief Calls visit with the name of every entry of a directory except . and ..
+     * @return 0 on success or an errno value
+     */
+    template<typename Visitor>
+    int forEachEntry(const std::string &path, Visitor visit)
+    {
+        DIR *dir = opendir(path.c_str());
+        if (dir == nullptr) {
+            return errno;
+        }
+        while (const dirent *entry = readdir(dir)) {
+            const std::string name = entry->d_name;
+            if (name != "." && name != "..") {
+                visit(name, entry->d_type);
+            }
+        }
+        closedir(dir);
+        return 0;
     }
-}
 
-int ionice::ioClassToInt(const ionice::IoClass ioClass)
-{
-    switch (ioClass) {
-        case ionice::IoClass::None:
-            return IOPRIO_CLASS_NONE;
-        case ionice::IoClass::RealTime:
-            return IOPRIO_CLASS_RT;
-        case ionice::IoClass::BestEffort:
-            return IOPRIO_CLASS_BE;
-        case ionice::IoClass::Idle:
-            return IOPRIO_CLASS_IDLE;
-        default:
-            return IOPRIO_CLASS_BE;
+    int readIds(const std::string &path, std::vector<pid_t> &ids)
+    {
+        errno = 0;
+        std::ifstream in(path);
+        if (!in) {
+            return errno ? errno : ENOENT;
+        }
+        pid_t id;
+        while (in >> id) {
+            ids.push_back(id);
+        }
+        return 0;
     }
-}
 
-int ionice::ioLevelToInt(const ionice::IoLevel ioLevel)
-{
-    switch (ioLevel) {
-        case ionice::IoLevel::L0:
-            return 0;
-        case ionice::IoLevel::L1:
-            return 1;
-        case ionice::IoLevel::L2:
-            return 2;
-        case ionice::IoLevel::L3:
-            return 3;
-        case ionice::IoLevel::L4:
-            return 4;
-        case ionice::IoLevel::L5:
-            return 5;
-        case ionice::IoLevel::L6:
-            return 6;
-        case ionice::IoLevel::L7:
-            return 7;
-        default:
-            return 4;
+    int collectCgroupThreads(const std::string &path, std::vector<pid_t> &tids, const bool recursive)
+    {
+        // The unified hierarchy lists threads in cgroup.threads, v1 hierarchies in tasks
+        int ret = readIds(path + "/cgroup.threads", tids);
+        if (ret == ENOENT) {
+            ret = readIds(path + "/tasks", tids);
+        }
+        if (ret || !recursive) {
+            return ret;
+        }
+        int childError = 0;
+        ret = forEachEntry(path, [&](const std::string &name, const unsigned char type) {
+            if (type == DT_DIR) {
+                const int err = collectCgroupThreads(path + "/" + name, tids, true);
+                // A child cgroup removed while walking is not an error
+                if (err && err != ENOENT && !childError) {
+                    childError = err;
+                }
+            }
+        });
+        return ret ? ret : childError;
     }
 }
 
 int ionice::ioPrioSet(const pid_t pid, const IoClass ioClass, const IoLevel ioLevel)
 {
-    ioPrioSetSyscall(IOPRIO_WHO_PROCESS, pid, IOPRIO_PRIO_VALUE(ioClassToInt(ioClass), ioLevelToInt(ioLevel)));
-    return errno;
+    return ioPrioSet(Who::Process, pid, ioClass, ioLevel);
 }
 
 int ionice::ioPrioSet(const IoClass ioClass, const IoLevel ioLevel)
@@ -134,37 +133,239 @@ int ionice::ioPrioSet(const IoClass ioClass, const IoLevel ioLevel)
 }
 
 int ionice::ioPrioGet(const pid_t pid, IoClass &ioClass, IoLevel &ioLevel)
+{
+    return ioPrioGet(Who::Process, pid, ioClass, ioLevel);
+}
+
+int ionice::ioPrioGet(IoClass &ioClass, IoLevel &ioLevel)
+{
+    return ioPrioGet(getpid(), ioClass, ioLevel);
+}
+
+int ionice::ioPrioSet(const pid_t pid, const IoPrio prio)
+{
+    if (!prio.valid()) {
+        return EINVAL;
+    }
+    // errno is only meaningful if the call failed, it may be left over from an earlier call otherwise
+    if (ioPrioSetSyscall(IOPRIO_WHO_PROCESS, pid, prio.value()) < 0) {
+        return errno;
+    }
+    return 0;
+}
+
+int ionice::ioPrioGet(const pid_t pid, IoPrio &prio)
 {
     const long ioPrio = ioPrioGetSyscall(IOPRIO_WHO_PROCESS, pid);
-    if (errno) {
+    if (ioPrio < 0) {
         return errno;
     }
-    ioClass = ioClasstoEnum(IOPRIO_PRIO_CLASS(ioPrio));
-    ioLevel = ioLevelToEnum(IOPRIO_PRIO_DATA(ioPrio));
+    prio = IoPrio::fromValue(static_cast<int>(ioPrio));
     return 0;
 }
 
-int ionice::ioPrioGet(IoClass &ioClass, IoLevel &ioLevel)
+int ionice::ioPrioSet(const Who who, const int id, const IoClass ioClass, const IoLevel ioLevel)
 {
-    return ioPrioGet(getpid(), ioClass, ioLevel);
+    const int which = whoToInt(who);
+    const IoPrio prio(ioClass, ioLevel);
+    if (which < 0 || !prio.valid()) {
+        return EINVAL;
+    }
+    if (ioPrioSetSyscall(which, id, prio.value()) < 0) {
+        return errno;
+    }
+    return 0;
 }
 
-std::string ionice::toString(const IoClass ioClass)
+int ionice::ioPrioGet(const Who who, const int id, IoClass &ioClass, IoLevel &ioLevel)
+{
+    const int which = whoToInt(who);
+    if (which < 0) {
+        return EINVAL;
+    }
+    const long ioPrio = ioPrioGetSyscall(which, id);
+    if (ioPrio < 0) {
+        return errno;
+    }
+    const IoPrio prio = IoPrio::fromValue(static_cast<int>(ioPrio));
+    ioClass = prio.ioClass();
+    ioLevel = prio.ioLevel();
+    return 0;
+}
+
+std::vector<ionice::TargetResult> ionice::expandTargets(const std::vector<Target> &targets)
+{
+    std::vector<TargetResult> results;
+    std::vector<pid_t> tids;
+    for (std::size_t i = 0; i < targets.size(); i++) {
+        const Target &target = targets[i];
+        int ret = 0;
+        tids.clear();
+        switch (target.type) {
+            case TargetType::Process:
+                results.push_back({i, Who::Process, target.id, 0});
+                continue;
+            case TargetType::ProcessGroup:
+                results.push_back({i, Who::ProcessGroup, target.id, 0});
+                continue;
+            case TargetType::User:
+                results.push_back({i, Who::User, target.id, 0});
+                continue;
+            case TargetType::Threads:
+                ret = threadIds(target.id, tids);
+                break;
+            case TargetType::Cgroup:
+                if (target.cgroup.empty()) {
+                    std::string cgroup;
+                    ret = cgroupOf(target.id, cgroup);
+                    if (!ret) {
+                        ret = cgroupThreadIds(cgroup, tids);
+                    }
+                } else {
+                    ret = cgroupThreadIds(target.cgroup, tids);
+                }
+                break;
+            default:
+                ret = EINVAL;
+                break;
+        }
+        if (ret) {
+            results.push_back({i, Who::Process, target.id, ret});
+            continue;
+        }
+        for (const pid_t tid: tids) {
+            results.push_back({i, Who::Process, tid, 0});
+        }
+    }
+    return results;
+}
+
+int ionice::ioPrioSet(const std::vector<Target> &targets, const IoClass ioClass, const IoLevel ioLevel,
+                      std::vector<TargetResult> &results)
+{
+    results = expandTargets(targets);
+    int firstError = 0;
+    for (auto &result: results) {
+        if (!result.error) {
+            result.error = ioPrioSet(result.who, result.id, ioClass, ioLevel);
+        }
+        if (result.error && !firstError) {
+            firstError = result.error;
+        }
+    }
+    return firstError;
+}
+
+int ionice::threadIds(const pid_t pid, std::vector<pid_t> &tids)
+{
+    return forEachEntry("/proc/" + std::to_string(pid) + "/task", [&tids](const std::string &name, unsigned char) {
+        tids.push_back(static_cast<pid_t>(std::strtol(name.c_str(), nullptr, 10)));
+    });
+}
+
+int ionice::cgroupThreadIds(const std::string &cgroup, std::vector<pid_t> &tids, const bool recursive)
+{
+    std::string root = cgroupRoot();
+    std::string path = cgroup;
+    if (path.compare(0, root.size(), root) != 0) {
+        // Hybrid setups mount the unified hierarchy below the v1 controllers
+        if (access((root + "/cgroup.controllers").c_str(), F_OK) != 0 &&
+            access((root + "/unified").c_str(), F_OK) == 0) {
+            root += "/unified";
+        }
+        path = root + (path.empty() || path[0] != '/' ? "/" : "") + path;
+    }
+    return collectCgroupThreads(path, tids, recursive);
+}
+
+int ionice::cgroupOf(const pid_t pid, std::string &cgroup)
+{
+    errno = 0;
+    std::ifstream in("/proc/" + std::to_string(pid) + "/cgroup");
+    if (!in) {
+        return errno ? errno : ESRCH;
+    }
+    // The unified hierarchy has the id 0 and no controllers: "0::/system.slice/foo.service"
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.compare(0, 3, "0::") == 0) {
+            cgroup = line.substr(3);
+            return 0;
+        }
+    }
+    return ENOENT;
+}
+
+std::string ionice::cgroupRoot()
+{
+    const char *override = std::getenv("K2_CGROUP_ROOT");
+    if (override != nullptr && override[0] != '\0') {
+        return override;
+    }
+    return "/sys/fs/cgroup";
+}
+
+ionice::TargetType ionice::targetTypeToEnum(const std::string &name)
 {
-    switch (ioClass) {
-        case IoClass::None:
-            return "none";
-        case IoClass::RealTime:
-            return "realtime";
-        case IoClass::BestEffort:
-            return "best-effort";
-        case IoClass::Idle:
-            return "idle";
+    for (const auto type: {TargetType::Process, TargetType::Threads, TargetType::ProcessGroup, TargetType::User,
+                           TargetType::Cgroup}) {
+        if (toString(type) == name) {
+            return type;
+        }
+    }
+    return TargetType::NA;
+}
+
+std::string ionice::toString(const Who who)
+{
+    switch (who) {
+        case Who::Process:
+            return "process";
+        case Who::ProcessGroup:
+            return "pgrp";
+        case Who::User:
+            return "user";
+        default:
+            return "N/A";
+    }
+}
+
+std::string ionice::toString(const TargetType type)
+{
+    switch (type) {
+        case TargetType::Process:
+            return "process";
+        case TargetType::Threads:
+            return "threads";
+        case TargetType::ProcessGroup:
+            return "pgrp";
+        case TargetType::User:
+            return "user";
+        case TargetType::Cgroup:
+            return "cgroup";
         default:
             return "N/A";
     }
 }
 
+std::string ionice::toString(const IoClass ioClass)
+{
+    return std::string(name(ioClass));
+}
+
+std::string ionice::toString(const IoLevel ioLevel)
+{
+    return std::string(name(ioLevel));
+}
+
+std::string ionice::toString(const IoPrio prio)
+{
+    std::string text(name(prio.ioClass()));
+    text += '/';
+    text += name(prio.ioLevel());
+    return text;
+}
+
 std::ostream& operator<<(std::ostream& os, ionice::IoClass ioClass){
     os << ionice::toString(ioClass);
     return os;
@@ -173,4 +374,9 @@ std::ostream& operator<<(std::ostream& os, ionice::IoClass ioClass){
 std::ostream& operator<<(std::ostream& os, ionice::IoLevel ioLevel) {
     os << ionice::toString(ioLevel);
     return os;
+}
+
+std::ostream& operator<<(std::ostream& os, ionice::IoPrio prio) {
+    os << ionice::name(prio.ioClass()) << '/' << ionice::name(prio.ioLevel());
+    return os;
 }
\ No newline at end of file
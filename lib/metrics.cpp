@@ -0,0 +1,612 @@
+#include "libk2/metrics.hpp"
+
+extern "C" {
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <mutex>
+
+namespace k2 {
+
+    namespace {
+        constexpr std::size_t operationCount = static_cast<std::size_t>(Operation::Connect) + 1;
+
+        constexpr std::size_t boundCount = 22;
+
+        constexpr std::array<std::int64_t, boundCount> boundsNs = {
+                1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000,
+                1000000, 2000000, 5000000, 10000000, 20000000, 50000000, 100000000, 200000000, 500000000,
+                1000000000, 2000000000, 5000000000, 10000000000};
+
+        constexpr std::array<const char *, boundCount + 1> boundLabels = {
+                "le=\"0.000001\"", "le=\"0.000002\"", "le=\"0.000005\"", "le=\"0.00001\"", "le=\"0.00002\"",
+                "le=\"0.00005\"", "le=\"0.0001\"", "le=\"0.0002\"", "le=\"0.0005\"", "le=\"0.001\"", "le=\"0.002\"",
+                "le=\"0.005\"", "le=\"0.01\"", "le=\"0.02\"", "le=\"0.05\"", "le=\"0.1\"", "le=\"0.2\"", "le=\"0.5\"",
+                "le=\"1\"", "le=\"2\"", "le=\"5\"", "le=\"10\"", "le=\"+Inf\""};
+
+        /**
+         * @brief Counter with a single writer, so an increment needs no read-modify-write instruction
+         */
+        class Counter
+        {
+        public:
+            void add(const std::uint64_t n)
+            { count.store(count.load(std::memory_order_relaxed) + n, std::memory_order_relaxed); }
+
+            [[nodiscard]] std::uint64_t get() const
+            { return count.load(std::memory_order_relaxed); }
+
+        private:
+            std::atomic<std::uint64_t> count{0};
+        };
+
+        struct IoctlCounters
+        {
+            Counter calls;
+            Counter errors;
+            Counter latencySumNs;
+            std::array<Counter, boundCount + 1> buckets;
+        };
+
+        /**
+         * @brief Counters of one thread, on their own cache lines
+         */
+        struct alignas(64) Shard
+        {
+            std::array<IoctlCounters, operationCount> ioctls;
+        };
+
+        /**
+         * @brief All shards ever handed out
+         * @details Shards are never freed, so counters stay monotonic after their thread exits. A shard is adopted
+         * by the next new thread instead, which bounds the memory to the peak number of threads.
+         */
+        struct ShardRegistry
+        {
+            std::mutex mutex;
+            std::vector<std::unique_ptr<Shard>> shards;
+            std::vector<Shard *> unused;
+        };
+
+        ShardRegistry &shardRegistry()
+        {
+            static ShardRegistry registry;
+            return registry;
+        }
+
+        struct ShardHandle
+        {
+            Shard *shard = nullptr;
+
+            ~ShardHandle()
+            {
+                if (shard != nullptr) {
+                    ShardRegistry &registry = shardRegistry();
+                    std::lock_guard<std::mutex> lock(registry.mutex);
+                    registry.unused.push_back(shard);
+                }
+            }
+        };
+
+        Shard &localShard()
+        {
+            thread_local ShardHandle handle;
+            if (handle.shard == nullptr) {
+                ShardRegistry &registry = shardRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                if (registry.unused.empty()) {
+                    registry.shards.push_back(std::make_unique<Shard>());
+                    handle.shard = registry.shards.back().get();
+                } else {
+                    handle.shard = registry.unused.back();
+                    registry.unused.pop_back();
+                }
+            }
+            return *handle.shard;
+        }
+
+        std::atomic<bool> &enabledFlag()
+        {
+            static std::atomic<bool> enabled{false};
+            return enabled;
+        }
+
+        struct TaskGauges
+        {
+            std::mutex mutex;
+            std::map<std::string, std::int64_t> devices;
+        };
+
+        TaskGauges &taskGauges()
+        {
+            static TaskGauges gauges;
+            return gauges;
+        }
+
+        struct SourceRegistry
+        {
+            std::mutex mutex;
+            int nextId = 1;
+            std::map<int, MetricsSource> sources;
+        };
+
+        SourceRegistry &sourceRegistry()
+        {
+            static SourceRegistry registry;
+            return registry;
+        }
+
+        struct IoctlTotals
+        {
+            std::uint64_t calls = 0;
+            std::uint64_t errors = 0;
+            std::uint64_t latencySumNs = 0;
+            std::array<std::uint64_t, boundCount + 1> buckets{};
+        };
+
+        void aggregate(std::array<IoctlTotals, operationCount> &totals)
+        {
+            ShardRegistry &registry = shardRegistry();
+            std::lock_guard<std::mutex> lock(registry.mutex);
+            for (const auto &shard: registry.shards) {
+                for (std::size_t op = 0; op < operationCount; op++) {
+                    const IoctlCounters &counters = shard->ioctls[op];
+                    totals[op].calls += counters.calls.get();
+                    totals[op].errors += counters.errors.get();
+                    totals[op].latencySumNs += counters.latencySumNs.get();
+                    for (std::size_t b = 0; b <= boundCount; b++) {
+                        totals[op].buckets[b] += counters.buckets[b].get();
+                    }
+                }
+            }
+        }
+
+        const char *ioctlName(const Operation operation)
+        {
+            switch (operation) {
+                case Operation::GetVersion:
+                    return "K2_IOC_GET_VERSION";
+                case Operation::GetActiveDevices:
+                    return "K2_IOC_GET_DEVICES";
+                case Operation::RegisterTask:
+                    return "K2_IOC_REGISTER_PERIODIC_TASK";
+                case Operation::UnregisterTask:
+                    return "K2_IOC_UNREGISTER_PERIODIC_TASK";
+                case Operation::UnregisterAllTasks:
+                    return "K2_IOC_UNREGISTER_ALL_PERIODIC_TASKS";
+                case Operation::UpdateInterval:
+                    return "K2_IOC_UPDATE_PERIODIC_TASK";
+                default:
+                    return "other";
+            }
+        }
+
+        std::size_t boundIndex(const std::int64_t valueNs)
+        {
+            return static_cast<std::size_t>(std::lower_bound(boundsNs.begin(), boundsNs.end(), valueNs) -
+                                            boundsNs.begin());
+        }
+
+        int writeAll(const int fd, const char *data, std::size_t size)
+        {
+            while (size > 0) {
+                const ssize_t written = send(fd, data, size, MSG_NOSIGNAL);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno;
+                }
+                data += written;
+                size -= static_cast<std::size_t>(written);
+            }
+            return 0;
+        }
+    }
+
+    void setMetricsEnabled(const bool enabled)
+    {
+        enabledFlag().store(enabled, std::memory_order_relaxed);
+    }
+
+    const std::vector<std::int64_t> &metricsBucketBoundsNs()
+    {
+        static const std::vector<std::int64_t> bounds(boundsNs.begin(), boundsNs.end());
+        return bounds;
+    }
+
+    std::vector<IoctlMetrics> ioctlMetrics()
+    {
+        std::array<IoctlTotals, operationCount> totals{};
+        aggregate(totals);
+        std::vector<IoctlMetrics> metrics;
+        for (std::size_t op = 0; op < operationCount; op++) {
+            if (totals[op].calls == 0) {
+                continue;
+            }
+            IoctlMetrics entry;
+            entry.operation = static_cast<Operation>(op);
+            entry.calls = totals[op].calls;
+            entry.errors = totals[op].errors;
+            entry.latencySumNs = totals[op].latencySumNs;
+            entry.buckets.assign(totals[op].buckets.begin(), totals[op].buckets.end());
+            metrics.push_back(std::move(entry));
+        }
+        return metrics;
+    }
+
+    std::map<std::string, std::int64_t> registeredTaskMetrics()
+    {
+        TaskGauges &gauges = taskGauges();
+        std::lock_guard<std::mutex> lock(gauges.mutex);
+        return gauges.devices;
+    }
+
+    std::string metricsLabel(const char *name, const std::string &value)
+    {
+        std::string label = name;
+        label += "=\"";
+        for (const char c: value) {
+            if (c == '\\' || c == '"') {
+                label += '\\';
+                label += c;
+            } else if (c == '\n') {
+                label += "\\n";
+            } else {
+                label += c;
+            }
+        }
+        label += '"';
+        return label;
+    }
+
+    void MetricsWriter::family(const char *name, const char *type, const char *help)
+    {
+        out += "# HELP ";
+        out += name;
+        out += ' ';
+        out += help;
+        out += "\n# TYPE ";
+        out += name;
+        out += ' ';
+        out += type;
+        out += '\n';
+    }
+
+    void MetricsWriter::sample(const char *name, const std::string &labels, const double sampleValue)
+    {
+        labelled(name, "", labels, nullptr);
+        value(sampleValue);
+    }
+
+    void MetricsWriter::sample(const char *name, const std::string &labels, const std::uint64_t sampleValue)
+    {
+        labelled(name, "", labels, nullptr);
+        value(sampleValue);
+    }
+
+    void MetricsWriter::histogram(const char *name, const std::string &labels, const Histogram &histogram)
+    {
+        std::array<std::uint64_t, boundCount + 1> buckets{};
+        const auto &counts = histogram.buckets();
+        for (std::size_t i = 0; i < counts.size(); i++) {
+            if (counts[i]) {
+                buckets[boundIndex(static_cast<std::int64_t>(histogram.bucketLowerBound(i)))] += counts[i];
+            }
+        }
+        this->histogram(name, labels, buckets.data(), histogram.valueSum(), histogram.count());
+    }
+
+    void MetricsWriter::histogram(const char *name, const std::string &labels, const std::uint64_t *buckets,
+                                  const double sumNs, const std::uint64_t count)
+    {
+        std::uint64_t cumulative = 0;
+        for (std::size_t b = 0; b <= boundCount; b++) {
+            cumulative += buckets[b];
+            labelled(name, "_bucket", labels, boundLabels[b]);
+            value(cumulative);
+        }
+        labelled(name, "_sum", labels, nullptr);
+        value(sumNs / 1e9);
+        labelled(name, "_count", labels, nullptr);
+        value(count);
+    }
+
+    void MetricsWriter::labelled(const char *name, const char *suffix, const std::string &labels, const char *extra)
+    {
+        out += name;
+        out += suffix;
+        if (!labels.empty() || extra != nullptr) {
+            out += '{';
+            out += labels;
+            if (extra != nullptr) {
+                if (!labels.empty()) {
+                    out += ',';
+                }
+                out += extra;
+            }
+            out += '}';
+        }
+        out += ' ';
+    }
+
+    void MetricsWriter::value(const double sampleValue)
+    {
+        char buffer[32];
+        const int length = snprintf(buffer, sizeof(buffer), "%.9g\n", sampleValue);
+        out.append(buffer, static_cast<std::size_t>(std::max(length, 0)));
+    }
+
+    void MetricsWriter::value(const std::uint64_t sampleValue)
+    {
+        char buffer[32];
+        const int length = snprintf(buffer, sizeof(buffer), "%" PRIu64 "\n", sampleValue);
+        out.append(buffer, static_cast<std::size_t>(std::max(length, 0)));
+    }
+
+    int addMetricsSource(MetricsSource source)
+    {
+        SourceRegistry &registry = sourceRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        const int id = registry.nextId++;
+        registry.sources.emplace(id, std::move(source));
+        return id;
+    }
+
+    void removeMetricsSource(const int id)
+    {
+        SourceRegistry &registry = sourceRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        registry.sources.erase(id);
+    }
+
+    void renderMetrics(std::string &out)
+    {
+        out.clear();
+        MetricsWriter writer(out);
+
+        std::array<IoctlTotals, operationCount> totals{};
+        aggregate(totals);
+        static const auto labels = [] {
+            std::array<std::string, operationCount> ioctlLabels;
+            for (std::size_t op = 0; op < operationCount; op++) {
+                ioctlLabels[op] = metricsLabel("ioctl", ioctlName(static_cast<Operation>(op)));
+            }
+            return ioctlLabels;
+        }();
+
+        writer.family("k2_ioctl_requests_total", "counter", "Driver ioctls issued by this process.");
+        for (std::size_t op = 0; op < operationCount; op++) {
+            if (totals[op].calls) {
+                writer.sample("k2_ioctl_requests_total", labels[op], totals[op].calls);
+            }
+        }
+        writer.family("k2_ioctl_errors_total", "counter", "Driver ioctls that failed.");
+        for (std::size_t op = 0; op < operationCount; op++) {
+            if (totals[op].calls) {
+                writer.sample("k2_ioctl_errors_total", labels[op], totals[op].errors);
+            }
+        }
+        writer.family("k2_ioctl_duration_seconds", "histogram", "Time spent in driver ioctls.");
+        for (std::size_t op = 0; op < operationCount; op++) {
+            if (totals[op].calls) {
+                writer.histogram("k2_ioctl_duration_seconds", labels[op], totals[op].buckets.data(),
+                                 static_cast<double>(totals[op].latencySumNs), totals[op].calls);
+            }
+        }
+
+        writer.family("k2_registered_tasks", "gauge", "Tasks registered by this process per device.");
+        {
+            TaskGauges &gauges = taskGauges();
+            std::lock_guard<std::mutex> lock(gauges.mutex);
+            for (const auto &[device, tasks]: gauges.devices) {
+                writer.sample("k2_registered_tasks", metricsLabel("device", device), static_cast<double>(tasks));
+            }
+        }
+
+        SourceRegistry &registry = sourceRegistry();
+        std::lock_guard<std::mutex> lock(registry.mutex);
+        for (const auto &[id, source]: registry.sources) {
+            source(writer);
+        }
+    }
+
+    bool detail::metricsEnabled()
+    {
+        return enabledFlag().load(std::memory_order_relaxed);
+    }
+
+    void detail::recordIoctl(const Operation operation, const int error, const std::int64_t latencyNs)
+    {
+        IoctlCounters &counters = localShard().ioctls[static_cast<std::size_t>(operation)];
+        counters.calls.add(1);
+        if (error) {
+            counters.errors.add(1);
+        }
+        counters.latencySumNs.add(static_cast<std::uint64_t>(std::max<std::int64_t>(latencyNs, 0)));
+        counters.buckets[boundIndex(latencyNs)].add(1);
+    }
+
+    void detail::recordTasks(const Result &result, const std::string &device)
+    {
+        // A failed restore is the one failure that changes the registered tasks
+        if (!result.ok() && result.operation != Operation::RestoreTask) {
+            return;
+        }
+        TaskGauges &gauges = taskGauges();
+        std::lock_guard<std::mutex> lock(gauges.mutex);
+        switch (result.operation) {
+            case Operation::RegisterTask:
+                gauges.devices[device]++;
+                break;
+            case Operation::UnregisterTask:
+            case Operation::RestoreTask:
+                gauges.devices[device]--;
+                break;
+            case Operation::UnregisterAllTasks:
+                gauges.devices[device] = 0;
+                break;
+            default:
+                break;
+        }
+    }
+
+    MetricsServer::MetricsServer(std::string address) :
+            listenAddress(std::move(address))
+    {}
+
+    MetricsServer::~MetricsServer()
+    {
+        stop();
+    }
+
+    int MetricsServer::start()
+    {
+        if (thread.joinable()) {
+            return EBUSY;
+        }
+        int ret = 0;
+        if (listenAddress.find('/') != std::string::npos) {
+            listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            ret = listenFd < 0 ? errno : detail::bindUnixSocket(listenFd, listenAddress, boundSocket);
+        } else {
+            const auto colon = listenAddress.rfind(':');
+            std::string host = colon == std::string::npos ? "" : listenAddress.substr(0, colon);
+            const std::string port = colon == std::string::npos ? listenAddress : listenAddress.substr(colon + 1);
+            if (host.empty() || host == "localhost") {
+                host = "127.0.0.1";
+            }
+            struct sockaddr_in address{};
+            address.sin_family = AF_INET;
+            char *end = nullptr;
+            const unsigned long portNumber = strtoul(port.c_str(), &end, 10);
+            if (port.empty() || *end != '\0' || portNumber > 65535 ||
+                inet_pton(AF_INET, host.c_str(), &address.sin_addr) != 1) {
+                return EINVAL;
+            }
+            address.sin_port = htons(static_cast<std::uint16_t>(portNumber));
+            listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            const int reuse = 1;
+            if (listenFd < 0 || setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse)) < 0 ||
+                bind(listenFd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0) {
+                ret = errno;
+            }
+        }
+        if (!ret && listen(listenFd, 16) < 0) {
+            ret = errno;
+        }
+        if (!ret) {
+            stopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            ret = stopFd < 0 ? errno : 0;
+        }
+        if (ret) {
+            close();
+            return ret;
+        }
+        thread = std::thread(&MetricsServer::serve, this);
+        return 0;
+    }
+
+    void MetricsServer::stop()
+    {
+        if (thread.joinable()) {
+            const std::uint64_t value = 1;
+            static_cast<void>(write(stopFd, &value, sizeof(value)));
+            thread.join();
+        }
+        close();
+    }
+
+    void MetricsServer::close()
+    {
+        if (listenFd >= 0) {
+            ::close(listenFd);
+            listenFd = -1;
+            detail::unlinkUnixSocket(listenAddress, boundSocket);
+        }
+        if (stopFd >= 0) {
+            ::close(stopFd);
+            stopFd = -1;
+        }
+    }
+
+    void MetricsServer::serve()
+    {
+        struct pollfd fds[2] = {{listenFd, POLLIN, 0}, {stopFd, POLLIN, 0}};
+        while (true) {
+            if (poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return;
+            }
+            if (fds[1].revents) {
+                return;
+            }
+            if (fds[0].revents & POLLIN) {
+                const int fd = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+                if (fd >= 0) {
+                    // A stalled scraper must not block the next one for long
+                    const struct timeval timeout{1, 0};
+                    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+                    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+                    answer(fd);
+                    ::close(fd);
+                }
+            }
+        }
+    }
+
+    void MetricsServer::answer(const int fd)
+    {
+        constexpr std::size_t maxRequest = 8192;
+        request.clear();
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.find("\n\n") == std::string::npos) {
+            const ssize_t size = recv(fd, buffer, sizeof(buffer), 0);
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            if (size <= 0 || request.size() + static_cast<std::size_t>(size) > maxRequest) {
+                return;
+            }
+            request.append(buffer, static_cast<std::size_t>(size));
+        }
+
+        const char *status = "200 OK";
+        const auto pathStart = request.find(' ');
+        const auto pathEnd = pathStart == std::string::npos ? pathStart
+                                                            : request.find_first_of(" ?\r\n", pathStart + 1);
+        if (request.compare(0, 4, "GET ") != 0 || pathEnd == std::string::npos) {
+            status = "405 Method Not Allowed";
+            body = "Only GET is supported\n";
+        } else if (request.compare(4, pathEnd - 4, "/metrics") != 0 && request.compare(4, pathEnd - 4, "/") != 0) {
+            status = "404 Not Found";
+            body = "Metrics are served at /metrics\n";
+        } else {
+            renderMetrics(body);
+        }
+
+        char header[160];
+        const int length = snprintf(header, sizeof(header),
+                                    "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\n"
+                                    "Content-Length: %zu\r\nConnection: close\r\n\r\n", status, body.size());
+        response.assign(header, static_cast<std::size_t>(std::max(length, 0)));
+        response += body;
+        static_cast<void>(writeAll(fd, response.data(), response.size()));
+    }
+}
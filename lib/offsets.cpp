@@ -0,0 +1,193 @@
+#include "libk2/offsets.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <numeric>
+
+namespace workload {
+
+    namespace {
+        /**
+         * @brief log1p(x) / x, continuous at 0
+         */
+        double helper1(const double x)
+        {
+            return std::abs(x) > 1e-8 ? std::log1p(x) / x : 1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+        }
+
+        /**
+         * @brief expm1(x) / x, continuous at 0
+         */
+        double helper2(const double x)
+        {
+            return std::abs(x) > 1e-8 ? std::expm1(x) / x : 1 + x * 0.5 * (1 + x * (1.0 / 3) * (1 + 0.25 * x));
+        }
+
+        double h(const double x, const double s)
+        {
+            return std::exp(-s * std::log(x));
+        }
+
+        double hIntegral(const double x, const double s)
+        {
+            const double logX = std::log(x);
+            return helper2((1 - s) * logX) * logX;
+        }
+
+        double hIntegralInverse(const double x, const double s)
+        {
+            return std::exp(helper1(std::max(x * (1 - s), -1.0)) * x);
+        }
+    }
+
+    OffsetGenerator::OffsetGenerator(const OffsetOptions &options, const std::uint64_t start,
+                                     const std::uint64_t size, const std::size_t blockSize, const std::uint64_t seed) :
+            options(options), start(start), size(size), blockSize(std::max<std::size_t>(blockSize, 1)),
+            blockCount(size / this->blockSize), random(seed)
+    {
+        if (options.pattern == OffsetPattern::Zipfian && blockCount > 0) {
+            // Rejection inversion sampling, W. Hörmann and G. Derflinger, ACM TOMACS 6(3), 1996
+            const double s = std::max(options.zipfTheta, 1e-6);
+            const double n = static_cast<double>(blockCount);
+            hIntegralX1 = hIntegral(1.5, s) - 1;
+            hIntegralN = hIntegral(n + 0.5, s);
+            zipfS = 2 - hIntegralInverse(hIntegral(2.5, s) - h(2, s), s);
+
+            // Any multiplier coprime to the block count makes rank * multiplier mod blocks a permutation
+            scatter = 0x9e3779b97f4a7c15ULL % blockCount;
+            while (std::gcd(scatter, blockCount) != 1) {
+                scatter = (scatter + 1) % blockCount;
+            }
+        }
+    }
+
+    bool OffsetGenerator::valid() const
+    {
+        return options.pattern == OffsetPattern::Sequential ? true : blockCount > 0;
+    }
+
+    std::uint64_t OffsetGenerator::zipfRank()
+    {
+        const double s = std::max(options.zipfTheta, 1e-6);
+        while (true) {
+            const double u = hIntegralN + random.nextDouble() * (hIntegralX1 - hIntegralN);
+            const double x = hIntegralInverse(u, s);
+            const auto k = static_cast<std::uint64_t>(std::clamp(x + 0.5, 1.0, static_cast<double>(blockCount)));
+            if (static_cast<double>(k) - x <= zipfS || u >= hIntegral(static_cast<double>(k) + 0.5, s) - h(k, s)) {
+                return k - 1;
+            }
+        }
+    }
+
+    off_t OffsetGenerator::next()
+    {
+        std::uint64_t block = 0;
+        switch (options.pattern) {
+            case OffsetPattern::Uniform:
+                block = random.next() % blockCount;
+                break;
+            case OffsetPattern::Zipfian:
+                block = static_cast<std::uint64_t>(static_cast<unsigned __int128>(zipfRank()) * scatter % blockCount);
+                break;
+            case OffsetPattern::HotCold: {
+                const std::uint64_t hot = std::clamp<std::uint64_t>(blockCount * options.hotRangePercent / 100, 1,
+                                                                    blockCount);
+                if (hot == blockCount || random.next() % 100 < options.hotAccessPercent) {
+                    block = random.next() % hot;
+                } else {
+                    block = hot + random.next() % (blockCount - hot);
+                }
+                break;
+            }
+            default: {
+                if (size && position + blockSize > size) {
+                    position = 0;
+                }
+                const std::uint64_t offset = start + position;
+                position += blockSize;
+                return static_cast<off_t>(offset);
+            }
+        }
+        return static_cast<off_t>(start + block * blockSize);
+    }
+
+    int targetSize(const std::string &path, std::uint64_t &bytes)
+    {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno;
+        }
+        int ret = 0;
+        struct stat st{};
+        if (fstat(fd, &st) < 0) {
+            ret = errno;
+        } else if (S_ISBLK(st.st_mode)) {
+            ret = ioctl(fd, BLKGETSIZE64, &bytes) < 0 ? errno : 0;
+        } else {
+            bytes = static_cast<std::uint64_t>(st.st_size);
+        }
+        close(fd);
+        return ret;
+    }
+
+    int makeOffsetGenerator(const std::string &path, const OffsetOptions &options, const std::uint64_t start,
+                            std::uint64_t size, const std::size_t blockSize, const std::uint64_t seed,
+                            OffsetGenerator &generator)
+    {
+        if (options.pattern == OffsetPattern::NA) {
+            return EINVAL;
+        }
+        if (size == 0 && options.pattern != OffsetPattern::Sequential) {
+            std::uint64_t total = 0;
+            const int ret = targetSize(path, total);
+            if (ret) {
+                return ret;
+            }
+            size = total > start ? total - start : 0;
+        }
+        generator = OffsetGenerator(options, start, size, blockSize, seed);
+        return generator.valid() ? 0 : EINVAL;
+    }
+
+    std::string toString(const OffsetPattern pattern)
+    {
+        switch (pattern) {
+            case OffsetPattern::Sequential:
+                return "sequential";
+            case OffsetPattern::Uniform:
+                return "uniform";
+            case OffsetPattern::Zipfian:
+                return "zipfian";
+            case OffsetPattern::HotCold:
+                return "hotcold";
+            default:
+                return "N/A";
+        }
+    }
+
+    OffsetPattern offsetPatternToEnum(const std::string &name)
+    {
+        if (name == "sequential") {
+            return OffsetPattern::Sequential;
+        }
+        if (name == "uniform" || name == "random") {
+            return OffsetPattern::Uniform;
+        }
+        if (name == "zipfian" || name == "zipf") {
+            return OffsetPattern::Zipfian;
+        }
+        if (name == "hotcold") {
+            return OffsetPattern::HotCold;
+        }
+        return OffsetPattern::NA;
+    }
+}
@@ -0,0 +1,140 @@
+#include "libk2/periodic.hpp"
+
+extern "C" {
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+
+namespace workload {
+
+    inline struct timespec toTimespec(const std::int64_t ns)
+    {
+        struct timespec ts{};
+        ts.tv_sec = ns / 1000000000;
+        ts.tv_nsec = ns % 1000000000;
+        return ts;
+    }
+
+    PeriodicIssuer::PeriodicIssuer(const PeriodicOptions &options) :
+            options(options)
+    {}
+
+    PeriodicIssuer::~PeriodicIssuer()
+    {
+        if (timerFd >= 0) {
+            ::close(timerFd);
+        }
+    }
+
+    std::int64_t PeriodicIssuer::nowNs()
+    {
+        struct timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    int PeriodicIssuer::start()
+    {
+        if (options.periodNs <= 0 || options.spinNs < 0 || options.wait == WaitMode::NA) {
+            return EINVAL;
+        }
+        if (options.wait == WaitMode::TimerFd && timerFd < 0) {
+            timerFd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+            if (timerFd < 0) {
+                return errno;
+            }
+        }
+        periodicStats = PeriodicStats();
+        release = nowNs();
+        return 0;
+    }
+
+    int PeriodicIssuer::waitUntil(const std::int64_t wakeNs)
+    {
+        const struct timespec wake = toTimespec(wakeNs);
+        if (options.wait == WaitMode::TimerFd) {
+            struct itimerspec timer{};
+            timer.it_value = wake;
+            if (timerfd_settime(timerFd, TFD_TIMER_ABSTIME, &timer, nullptr) < 0) {
+                return errno;
+            }
+            std::uint64_t expirations;
+            while (read(timerFd, &expirations, sizeof(expirations)) < 0) {
+                if (errno != EINTR) {
+                    return errno;
+                }
+            }
+            return 0;
+        }
+
+        int ret;
+        while ((ret = clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr)) == EINTR) {}
+        return ret;
+    }
+
+    int PeriodicIssuer::waitNext()
+    {
+        release += options.periodNs;
+
+        std::int64_t now = nowNs();
+        if (options.skipMissed && now - release >= options.periodNs) {
+            const std::int64_t missed = (now - release) / options.periodNs;
+            release += missed * options.periodNs;
+            periodicStats.skipped += static_cast<std::uint64_t>(missed);
+        }
+
+        if (now < release) {
+            const std::int64_t wakeNs = release - options.spinNs;
+            if (now < wakeNs) {
+                const int ret = waitUntil(wakeNs);
+                if (ret) {
+                    return ret;
+                }
+            }
+            // Busy poll the tail, a sleeping thread is woken up late by the timer slack and the scheduler
+            do {
+                now = nowNs();
+            } while (now < release);
+        }
+
+        periodicStats.releaseJitter.record(static_cast<std::uint64_t>(now - release));
+        periodicStats.periods++;
+        return 0;
+    }
+
+    void PeriodicIssuer::complete(const std::int64_t completionNs)
+    {
+        periodicStats.completion.record(static_cast<std::uint64_t>(std::max<std::int64_t>(completionNs - release, 0)));
+        if (completionNs > deadlineNs()) {
+            periodicStats.overruns++;
+            periodicStats.lateness.record(static_cast<std::uint64_t>(completionNs - deadlineNs()));
+        }
+    }
+
+    std::string toString(const WaitMode mode)
+    {
+        switch (mode) {
+            case WaitMode::Sleep:
+                return "sleep";
+            case WaitMode::TimerFd:
+                return "timerfd";
+            default:
+                return "N/A";
+        }
+    }
+
+    WaitMode waitModeToEnum(const std::string &name)
+    {
+        if (name == "sleep") {
+            return WaitMode::Sleep;
+        }
+        if (name == "timerfd") {
+            return WaitMode::TimerFd;
+        }
+        return WaitMode::NA;
+    }
+}
@@ -0,0 +1,405 @@
+#include "libk2/profile.hpp"
+#include "libk2/topology.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <fstream>
+
+namespace workload {
+
+    namespace {
+        std::string trim(const std::string &text)
+        {
+            const auto first = text.find_first_not_of(" \t\r");
+            if (first == std::string::npos) {
+                return {};
+            }
+            const auto last = text.find_last_not_of(" \t\r");
+            return text.substr(first, last - first + 1);
+        }
+
+        bool parseUnsigned(const std::string &value, std::uint64_t &number)
+        {
+            if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos) {
+                return false;
+            }
+            errno = 0;
+            number = std::strtoull(value.c_str(), nullptr, 10);
+            return errno == 0;
+        }
+
+        bool parseBool(const std::string &value, bool &flag)
+        {
+            if (value == "1" || value == "true" || value == "yes" || value == "on") {
+                flag = true;
+                return true;
+            }
+            if (value == "0" || value == "false" || value == "no" || value == "off") {
+                flag = false;
+                return true;
+            }
+            return false;
+        }
+
+        bool parseDouble(const std::string &value, double &number)
+        {
+            char *end = nullptr;
+            errno = 0;
+            number = std::strtod(value.c_str(), &end);
+            return !value.empty() && errno == 0 && *end == '\0' && number >= 0;
+        }
+
+        /**
+         * @brief Parses bytes with an optional binary k, m or g suffix
+         */
+        bool parseSize(const std::string &value, std::uint64_t &bytes)
+        {
+            if (value.empty()) {
+                return false;
+            }
+            unsigned shift = 0;
+            switch (value.back()) {
+                case 'k':
+                case 'K':
+                    shift = 10;
+                    break;
+                case 'm':
+                case 'M':
+                    shift = 20;
+                    break;
+                case 'g':
+                case 'G':
+                    shift = 30;
+                    break;
+                default:
+                    break;
+            }
+            if (!parseUnsigned(shift ? value.substr(0, value.size() - 1) : value, bytes)) {
+                return false;
+            }
+            bytes <<= shift;
+            return true;
+        }
+
+        /**
+         * @brief Parses a time with a mandatory ns, us, ms or s suffix into ns
+         */
+        bool parseTime(const std::string &value, std::int64_t &ns)
+        {
+            const auto unit = value.find_first_not_of("0123456789");
+            std::uint64_t number = 0;
+            if (unit == std::string::npos || !parseUnsigned(value.substr(0, unit), number)) {
+                return false;
+            }
+            const std::string suffix = value.substr(unit);
+            std::int64_t scale;
+            if (suffix == "ns") {
+                scale = 1;
+            } else if (suffix == "us") {
+                scale = 1000;
+            } else if (suffix == "ms") {
+                scale = 1000 * 1000;
+            } else if (suffix == "s") {
+                scale = 1000 * 1000 * 1000;
+            } else {
+                return false;
+            }
+            ns = static_cast<std::int64_t>(number) * scale;
+            return true;
+        }
+
+        /**
+         * @return false for an unknown key or an invalid value
+         */
+        bool applyGroupKey(JobGroup &group, const std::string &key, const std::string &value)
+        {
+            std::uint64_t number = 0;
+            std::int64_t ns = 0;
+            if (key == "role") {
+                group.role = jobRoleToEnum(value);
+                return group.role != JobRole::NA;
+            }
+            if (key == "jobs") {
+                if (!parseUnsigned(value, number) || number == 0) {
+                    return false;
+                }
+                group.jobs = static_cast<unsigned>(number);
+                return true;
+            }
+            if (key == "mode") {
+                if (value != "thread" && value != "process") {
+                    return false;
+                }
+                group.kind = value == "thread" ? StreamKind::Thread : StreamKind::Process;
+                return true;
+            }
+            if (key == "device") {
+                group.devices.clear();
+                std::size_t begin = 0;
+                while (begin <= value.size()) {
+                    const auto end = std::min(value.find(',', begin), value.size());
+                    group.devices.push_back(trim(value.substr(begin, end - begin)));
+                    if (group.devices.back().empty()) {
+                        return false;
+                    }
+                    begin = end + 1;
+                }
+                return true;
+            }
+            if (key == "engine") {
+                group.engine.type = engineTypeToEnum(value);
+                return group.engine.type != EngineType::NA;
+            }
+            if (key == "queue_depth") {
+                if (!parseUnsigned(value, number) || number == 0) {
+                    return false;
+                }
+                group.engine.queueDepth = static_cast<unsigned>(number);
+                return true;
+            }
+            if (key == "direct") {
+                return parseBool(value, group.engine.direct);
+            }
+            if (key == "registered_buffers") {
+                return parseBool(value, group.engine.registeredBuffers);
+            }
+            if (key == "fixed_files") {
+                return parseBool(value, group.engine.fixedFiles);
+            }
+            if (key == "block_size") {
+                if (!parseSize(value, number) || number == 0) {
+                    return false;
+                }
+                group.blockSize = number;
+                return true;
+            }
+            if (key == "pattern") {
+                group.pattern = ioPatternToEnum(value);
+                return group.pattern != IoPattern::NA;
+            }
+            if (key == "read_percent") {
+                if (!parseUnsigned(value, number) || number > 100) {
+                    return false;
+                }
+                group.readPercent = static_cast<unsigned>(number);
+                return true;
+            }
+            if (key == "offset") {
+                return parseSize(value, group.offset);
+            }
+            if (key == "size") {
+                return parseSize(value, group.size);
+            }
+            if (key == "offsets") {
+                group.offsets.pattern = offsetPatternToEnum(value);
+                return group.offsets.pattern != OffsetPattern::NA;
+            }
+            if (key == "zipf_theta") {
+                return parseDouble(value, group.offsets.zipfTheta) && group.offsets.zipfTheta > 0;
+            }
+            if (key == "hot_range_percent" || key == "hot_access_percent") {
+                if (!parseUnsigned(value, number) || number > 100) {
+                    return false;
+                }
+                (key == "hot_range_percent" ? group.offsets.hotRangePercent : group.offsets.hotAccessPercent) =
+                        static_cast<unsigned>(number);
+                return true;
+            }
+            if (key == "ioprio") {
+                group.ioPrio = ionice::parseIoPrio(value);
+                group.setIoPrio = true;
+                return group.ioPrio.valid();
+            }
+            if (key == "k2") {
+                return parseBool(value, group.registerWithK2);
+            }
+            if (key == "interval") {
+                if (!parseTime(value, ns) || ns == 0) {
+                    return false;
+                }
+                group.periodic.periodNs = ns;
+                return true;
+            }
+            if (key == "wait") {
+                group.periodic.wait = waitModeToEnum(value);
+                return group.periodic.wait != WaitMode::NA;
+            }
+            if (key == "spin") {
+                return parseTime(value, group.periodic.spinNs);
+            }
+            if (key == "skip_missed") {
+                return parseBool(value, group.periodic.skipMissed);
+            }
+            if (key == "iops") {
+                return parseDouble(value, group.iops);
+            }
+            if (key == "mbps") {
+                return parseDouble(value, group.mbps);
+            }
+            if (key == "think_time") {
+                if (!parseTime(value, ns)) {
+                    return false;
+                }
+                group.thinkTime = std::chrono::microseconds(ns / 1000);
+                return true;
+            }
+            if (key == "cpus") {
+                return k2::parseCpuList(value, group.cpus);
+            }
+            if (key == "iterations") {
+                if (!parseUnsigned(value, number)) {
+                    return false;
+                }
+                group.iterations = number;
+                return true;
+            }
+            if (key == "duration") {
+                if (!parseTime(value, ns)) {
+                    return false;
+                }
+                group.duration = std::chrono::milliseconds(ns / (1000 * 1000));
+                return true;
+            }
+            return false;
+        }
+    }
+
+    int parseProfile(std::istream &in, Profile &profile, std::size_t &failedLine)
+    {
+        profile = Profile{};
+        JobGroup defaults;
+        JobGroup *group = nullptr;
+        bool global = false;
+        std::string line;
+        std::size_t lineNo = 0;
+
+        failedLine = 0;
+        while (std::getline(in, line)) {
+            lineNo++;
+            line = trim(line);
+            if (line.empty() || line[0] == '#' || line[0] == ';') {
+                continue;
+            }
+
+            if (line.front() == '[') {
+                const std::string section = trim(line.substr(1, line.size() - 1 - (line.back() == ']')));
+                if (line.back() != ']' || section.empty()) {
+                    failedLine = lineNo;
+                    return EINVAL;
+                }
+                global = section == "global";
+                group = nullptr;
+                if (!global) {
+                    profile.groups.push_back(defaults);
+                    group = &profile.groups.back();
+                    group->name = section;
+                }
+                continue;
+            }
+
+            const auto separator = line.find('=');
+            if (separator == std::string::npos || (!global && group == nullptr)) {
+                failedLine = lineNo;
+                return EINVAL;
+            }
+            const std::string key = trim(line.substr(0, separator));
+            const std::string value = trim(line.substr(separator + 1));
+
+            bool valid;
+            if (global && key == "name") {
+                profile.name = value;
+                valid = true;
+            } else if (global && key == "duration") {
+                std::int64_t ns = 0;
+                valid = parseTime(value, ns);
+                profile.duration = std::chrono::milliseconds(ns / (1000 * 1000));
+            } else {
+                valid = applyGroupKey(global ? defaults : *group, key, value);
+            }
+            if (!valid) {
+                failedLine = lineNo;
+                return EINVAL;
+            }
+        }
+        if (in.bad()) {
+            return EIO;
+        }
+        // Writing is only a sensible default for files, a forgotten pattern must not overwrite a disk
+        for (auto &job: profile.groups) {
+            if (job.pattern != IoPattern::NA) {
+                continue;
+            }
+            const bool device = std::any_of(job.devices.begin(), job.devices.end(), [](const std::string &target) {
+                return target.find('/') == std::string::npos || isDeviceTarget(target);
+            });
+            if (device) {
+                return EINVAL;
+            }
+            job.pattern = IoPattern::Write;
+        }
+        return validateProfile(profile);
+    }
+
+    int loadProfile(const std::string &path, Profile &profile, std::size_t &failedLine)
+    {
+        failedLine = 0;
+        errno = 0;
+        std::ifstream in(path);
+        if (!in) {
+            return errno ? errno : ENOENT;
+        }
+        return parseProfile(in, profile, failedLine);
+    }
+
+    int validateProfile(const Profile &profile)
+    {
+        if (profile.groups.empty()) {
+            return EINVAL;
+        }
+        bool bounded = true;
+        for (const auto &group: profile.groups) {
+            if (group.devices.empty() || group.jobs == 0 || group.blockSize == 0 || group.role == JobRole::NA ||
+                group.pattern == IoPattern::NA) {
+                return EINVAL;
+            }
+            if (group.role == JobRole::Foreground) {
+                if (group.periodic.periodNs <= 0) {
+                    return EINVAL;
+                }
+                bounded = bounded && (group.iterations > 0 || group.duration.count() > 0);
+            }
+        }
+        // Background load alone never finishes
+        const bool foreground = std::any_of(profile.groups.begin(), profile.groups.end(), [](const JobGroup &group) {
+            return group.role == JobRole::Foreground;
+        });
+        if (profile.duration.count() == 0 && (!foreground || !bounded)) {
+            return EINVAL;
+        }
+        return 0;
+    }
+
+    std::string toString(const JobRole role)
+    {
+        switch (role) {
+            case JobRole::Foreground:
+                return "foreground";
+            case JobRole::Background:
+                return "background";
+            default:
+                return "N/A";
+        }
+    }
+
+    JobRole jobRoleToEnum(const std::string &name)
+    {
+        if (name == "foreground") {
+            return JobRole::Foreground;
+        }
+        if (name == "background") {
+            return JobRole::Background;
+        }
+        return JobRole::NA;
+    }
+}
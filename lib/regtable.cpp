@@ -0,0 +1,387 @@
+#include "libk2/regtable.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+}
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace k2 {
+
+    namespace {
+        constexpr char tableMagic[8] = {'K', '2', 'R', 'E', 'G', 'T', 'A', 'B'};
+
+        constexpr std::uint32_t tableVersion = 1;
+
+        constexpr std::size_t deviceWords = 5;
+
+        /**
+         * @brief Reads of a slot that stays odd for this long belong to a writer that died halfway through an update
+         */
+        constexpr unsigned maxSpins = 1u << 20;
+
+        /**
+         * @return false if the name does not fit into a slot
+         */
+        bool packDevice(const std::string &device, std::uint64_t (&words)[deviceWords])
+        {
+            if (device.size() > registrationDeviceLength) {
+                return false;
+            }
+            char name[deviceWords * sizeof(std::uint64_t)] = {};
+            memcpy(name, device.data(), device.size());
+            memcpy(words, name, sizeof(name));
+            return true;
+        }
+
+        std::size_t slotHash(const std::uint64_t (&words)[deviceWords], const pid_t pid)
+        {
+            std::uint64_t hash = static_cast<std::uint64_t>(static_cast<std::uint32_t>(pid)) * 0x9e3779b97f4a7c15;
+            for (const std::uint64_t word: words) {
+                hash ^= word;
+                hash *= 0xff51afd7ed558ccd;
+                hash ^= hash >> 33;
+            }
+            return static_cast<std::size_t>(hash);
+        }
+
+        bool sameDevice(const RegistrationSlot &slot, const std::uint64_t (&words)[deviceWords])
+        {
+            for (std::size_t w = 0; w < deviceWords; w++) {
+                if (slot.device[w].load(std::memory_order_relaxed) != words[w]) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        std::size_t tableSize(const std::size_t capacity)
+        {
+            return sizeof(RegistrationTableHeader) + capacity * sizeof(RegistrationSlot);
+        }
+    }
+
+    std::string k2RegistrationTablePath()
+    {
+        const char *override = std::getenv("K2_REGISTRATION_TABLE");
+        if (override != nullptr && override[0] != '\0') {
+            return override;
+        }
+        return "/dev/shm/k2-registrations";
+    }
+
+    RegistrationTable::RegistrationTable(std::string path, const std::size_t capacity) :
+            tablePath(std::move(path)), capacity([capacity] {
+                std::size_t size = 1;
+                while (size < capacity) {
+                    size <<= 1;
+                }
+                return size;
+            }())
+    {}
+
+    RegistrationTable::~RegistrationTable()
+    {
+        close();
+    }
+
+    int RegistrationTable::open()
+    {
+        if (header != nullptr) {
+            return EBUSY;
+        }
+        // The table is built under a temporary name and renamed into place, so readers never map a half
+        // initialized table and a stale one of a previous daemon is replaced atomically. The directory is usually
+        // world writable, the name must not exist yet so nobody can plant a file or symlink for us to overwrite.
+        std::string temporary;
+        int fd = -1;
+        for (unsigned attempt = 0; fd < 0; attempt++) {
+            temporary = tablePath + "." + std::to_string(getpid()) + "." + std::to_string(attempt);
+            fd = ::open(temporary.c_str(), O_RDWR | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0644);
+            if (fd < 0 && (errno != EEXIST || attempt == 100)) {
+                return errno;
+            }
+        }
+        // The mode passed to open is subject to the umask, readers in other processes need to open the table
+        if (fchmod(fd, 0644) < 0) {
+            const int ret = errno;
+            ::close(fd);
+            unlink(temporary.c_str());
+            return ret;
+        }
+        mappingSize = tableSize(capacity);
+        int ret = 0;
+        void *map = MAP_FAILED;
+        struct stat st{};
+        if (fstat(fd, &st) < 0 || ftruncate(fd, static_cast<off_t>(mappingSize)) < 0) {
+            ret = errno;
+        } else {
+            map = mmap(nullptr, mappingSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            ret = map == MAP_FAILED ? errno : 0;
+            fileDevice = st.st_dev;
+            fileInode = st.st_ino;
+        }
+        ::close(fd);
+        if (ret) {
+            unlink(temporary.c_str());
+            return ret;
+        }
+
+        // The file starts out zeroed, which is an empty, even slot everywhere
+        header = static_cast<RegistrationTableHeader *>(map);
+        slots = reinterpret_cast<RegistrationSlot *>(static_cast<char *>(map) + sizeof(RegistrationTableHeader));
+        memcpy(header->magic, tableMagic, sizeof(tableMagic));
+        header->version = tableVersion;
+        header->capacity = static_cast<std::uint32_t>(capacity);
+        header->writerPid = getpid();
+
+        if (rename(temporary.c_str(), tablePath.c_str()) < 0) {
+            ret = errno;
+            unlink(temporary.c_str());
+            munmap(map, mappingSize);
+            header = nullptr;
+            slots = nullptr;
+            return ret;
+        }
+        return 0;
+    }
+
+    int RegistrationTable::set(const std::string &device, const pid_t pid, const std::int64_t interval_ns)
+    {
+        std::uint64_t words[deviceWords];
+        if (header == nullptr) {
+            return EBADF;
+        }
+        if (!packDevice(device, words)) {
+            return ENAMETOOLONG;
+        }
+        const std::size_t mask = capacity - 1;
+        const std::size_t hash = slotHash(words, pid);
+        RegistrationSlot *free = nullptr;
+        for (std::size_t i = 0; i < capacity; i++) {
+            RegistrationSlot &slot = slots[(hash + i) & mask];
+            const std::uint32_t state = slot.state.load(std::memory_order_relaxed);
+            if (state == RegistrationSlot::Used) {
+                if (slot.pid.load(std::memory_order_relaxed) == pid && sameDevice(slot, words)) {
+                    write(slot, RegistrationSlot::Used, pid, interval_ns, words);
+                    return 0;
+                }
+                continue;
+            }
+            if (free == nullptr) {
+                free = &slot;
+            }
+            if (state == RegistrationSlot::Empty) {
+                break;
+            }
+        }
+        if (free == nullptr) {
+            return ENOSPC;
+        }
+        write(*free, RegistrationSlot::Used, pid, interval_ns, words);
+        header->entries.fetch_add(1, std::memory_order_relaxed);
+        return 0;
+    }
+
+    int RegistrationTable::erase(const std::string &device, const pid_t pid)
+    {
+        std::uint64_t words[deviceWords];
+        if (header == nullptr || !packDevice(device, words)) {
+            return ENOENT;
+        }
+        const std::size_t mask = capacity - 1;
+        const std::size_t hash = slotHash(words, pid);
+        for (std::size_t i = 0; i < capacity; i++) {
+            RegistrationSlot &slot = slots[(hash + i) & mask];
+            const std::uint32_t state = slot.state.load(std::memory_order_relaxed);
+            if (state == RegistrationSlot::Empty) {
+                break;
+            }
+            if (state == RegistrationSlot::Used && slot.pid.load(std::memory_order_relaxed) == pid &&
+                sameDevice(slot, words)) {
+                write(slot, RegistrationSlot::Removed, pid, 0, words);
+                header->entries.fetch_sub(1, std::memory_order_relaxed);
+                reclaim((hash + i) & mask);
+                return 0;
+            }
+        }
+        return ENOENT;
+    }
+
+    void RegistrationTable::eraseDevice(const std::string &device)
+    {
+        std::uint64_t words[deviceWords];
+        if (header == nullptr || !packDevice(device, words)) {
+            return;
+        }
+        for (std::size_t i = 0; i < capacity; i++) {
+            RegistrationSlot &slot = slots[i];
+            if (slot.state.load(std::memory_order_relaxed) == RegistrationSlot::Used && sameDevice(slot, words)) {
+                write(slot, RegistrationSlot::Removed, slot.pid.load(std::memory_order_relaxed), 0, words);
+                header->entries.fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        for (std::size_t i = 0; i < capacity; i++) {
+            if (slots[i].state.load(std::memory_order_relaxed) == RegistrationSlot::Removed) {
+                reclaim(i);
+            }
+        }
+    }
+
+    void RegistrationTable::reclaim(const std::size_t index)
+    {
+        // Insertions take the first free slot of their probe path, so no used entry sits behind an empty slot on
+        // its path. Behind a tombstone followed by an empty slot there is none either, and lookups that now stop
+        // earlier at it still find every entry
+        const std::size_t mask = capacity - 1;
+        if (slots[(index + 1) & mask].state.load(std::memory_order_relaxed) != RegistrationSlot::Empty) {
+            return;
+        }
+        const std::uint64_t none[deviceWords] = {};
+        for (std::size_t i = 0; i < capacity; i++) {
+            RegistrationSlot &slot = slots[(index - i) & mask];
+            if (slot.state.load(std::memory_order_relaxed) != RegistrationSlot::Removed) {
+                break;
+            }
+            write(slot, RegistrationSlot::Empty, 0, 0, none);
+        }
+    }
+
+    std::size_t RegistrationTable::size() const
+    {
+        return header != nullptr ? header->entries.load(std::memory_order_relaxed) : 0;
+    }
+
+    void RegistrationTable::write(RegistrationSlot &slot, const std::uint32_t state, const pid_t pid,
+                                  const std::int64_t interval_ns, const std::uint64_t *device)
+    {
+        const std::uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+        slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        slot.state.store(state, std::memory_order_relaxed);
+        slot.pid.store(pid, std::memory_order_relaxed);
+        slot.interval_ns.store(interval_ns, std::memory_order_relaxed);
+        for (std::size_t w = 0; w < deviceWords; w++) {
+            slot.device[w].store(device[w], std::memory_order_relaxed);
+        }
+        slot.sequence.store(sequence + 2, std::memory_order_release);
+        header->generation.fetch_add(1, std::memory_order_release);
+    }
+
+    void RegistrationTable::close()
+    {
+        if (header == nullptr) {
+            return;
+        }
+        // Only remove the file if it is still ours, a newer daemon may have replaced it
+        struct stat current{};
+        if (stat(tablePath.c_str(), &current) == 0 && current.st_dev == fileDevice && current.st_ino == fileInode) {
+            unlink(tablePath.c_str());
+        }
+        munmap(header, mappingSize);
+        header = nullptr;
+        slots = nullptr;
+    }
+
+    RegistrationTableReader::~RegistrationTableReader()
+    {
+        if (header != nullptr) {
+            munmap(const_cast<RegistrationTableHeader *>(header), mappingSize);
+        }
+    }
+
+    int RegistrationTableReader::open(const std::string &path)
+    {
+        if (header != nullptr) {
+            return EBUSY;
+        }
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) < 0) {
+            const int ret = errno;
+            ::close(fd);
+            return ret;
+        }
+        const auto size = static_cast<std::size_t>(st.st_size);
+        if (size < sizeof(RegistrationTableHeader)) {
+            ::close(fd);
+            return EINVAL;
+        }
+        void *map = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        const int ret = map == MAP_FAILED ? errno : 0;
+        ::close(fd);
+        if (ret) {
+            return ret;
+        }
+        const auto *table = static_cast<const RegistrationTableHeader *>(map);
+        const std::size_t capacity = table->capacity;
+        if (memcmp(table->magic, tableMagic, sizeof(tableMagic)) != 0 || table->version != tableVersion ||
+            capacity == 0 || (capacity & (capacity - 1)) != 0 || size < tableSize(capacity)) {
+            munmap(map, size);
+            return EINVAL;
+        }
+        header = table;
+        slots = reinterpret_cast<const RegistrationSlot *>(static_cast<const char *>(map) +
+                                                           sizeof(RegistrationTableHeader));
+        mask = capacity - 1;
+        mappingSize = size;
+        return 0;
+    }
+
+    int RegistrationTableReader::lookup(const std::string &device, const pid_t pid, std::int64_t &interval_ns) const
+    {
+        std::uint64_t words[deviceWords];
+        if (header == nullptr || !packDevice(device, words)) {
+            return ENOENT;
+        }
+        const std::size_t hash = slotHash(words, pid);
+        for (std::size_t i = 0; i <= mask; i++) {
+            const RegistrationSlot &slot = slots[(hash + i) & mask];
+            std::uint32_t state;
+            bool match;
+            std::int64_t interval;
+            unsigned spins = 0;
+            while (true) {
+                const std::uint32_t sequence = slot.sequence.load(std::memory_order_acquire);
+                if (sequence & 1) {
+                    if (++spins > maxSpins) {
+                        return EAGAIN;
+                    }
+                    continue;
+                }
+                state = slot.state.load(std::memory_order_relaxed);
+                match = slot.pid.load(std::memory_order_relaxed) == pid && sameDevice(slot, words);
+                interval = slot.interval_ns.load(std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == sequence) {
+                    break;
+                }
+            }
+            if (state == RegistrationSlot::Empty) {
+                return ENOENT;
+            }
+            if (state == RegistrationSlot::Used && match) {
+                interval_ns = interval;
+                return 0;
+            }
+        }
+        return ENOENT;
+    }
+
+    std::uint64_t RegistrationTableReader::generation() const
+    {
+        return header != nullptr ? header->generation.load(std::memory_order_acquire) : 0;
+    }
+
+    std::size_t RegistrationTableReader::size() const
+    {
+        return header != nullptr ? header->entries.load(std::memory_order_relaxed) : 0;
+    }
+}
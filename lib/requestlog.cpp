@@ -0,0 +1,199 @@
+#include "libk2/requestlog.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+
+namespace workload {
+
+    namespace {
+        /**
+         * @brief Start of every trace file, followed by the records
+         */
+        struct TraceHeader
+        {
+            char magic[8] = {'K', '2', 'R', 'E', 'Q', 'S', '\0', '\0'};
+            std::uint32_t version = 1;
+            std::uint32_t recordSize = sizeof(RequestRecord);
+        };
+
+        int writeAll(const int fd, const void *data, std::size_t size)
+        {
+            const auto *bytes = static_cast<const char *>(data);
+            while (size > 0) {
+                const ssize_t written = write(fd, bytes, size);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno;
+                }
+                bytes += written;
+                size -= static_cast<std::size_t>(written);
+            }
+            return 0;
+        }
+    }
+
+    RequestRing::RequestRing(const std::size_t capacity, const std::uint16_t stream) :
+            ringStream(stream)
+    {
+        std::size_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        records = std::make_unique<RequestRecord[]>(size);
+        mask = size - 1;
+    }
+
+    RequestCollector::RequestCollector(CollectorOptions options) :
+            options(std::move(options))
+    {}
+
+    RequestCollector::~RequestCollector()
+    {
+        stop();
+    }
+
+    int RequestCollector::start()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (running) {
+            return EBUSY;
+        }
+        if (!options.tracePath.empty()) {
+            traceFd = open(options.tracePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (traceFd < 0) {
+                return errno;
+            }
+            const TraceHeader header;
+            writeError = writeAll(traceFd, &header, sizeof(header));
+            if (writeError) {
+                close(traceFd);
+                traceFd = -1;
+                return writeError;
+            }
+        }
+        running = true;
+        stopping = false;
+        thread = std::thread(&RequestCollector::collect, this);
+        return 0;
+    }
+
+    void RequestCollector::stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!running) {
+                return;
+            }
+            stopping = true;
+            wake.notify_all();
+        }
+        thread.join();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        drainAll();
+        running = false;
+        if (traceFd >= 0) {
+            if (close(traceFd) < 0 && !writeError) {
+                writeError = errno;
+            }
+            traceFd = -1;
+        }
+    }
+
+    RequestRing *RequestCollector::attach(const std::uint16_t stream)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        rings.push_back(std::make_unique<RequestRing>(options.ringCapacity, stream));
+        return rings.back().get();
+    }
+
+    k2::Histogram RequestCollector::streamLatency(const std::uint16_t stream) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        const auto it = streamLatencies.find(stream);
+        return it == streamLatencies.end() ? k2::Histogram() : it->second;
+    }
+
+    std::uint64_t RequestCollector::dropped() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::uint64_t count = 0;
+        for (const auto &ring: rings) {
+            count += ring->dropped();
+        }
+        return count;
+    }
+
+    void RequestCollector::collect()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (!stopping) {
+            wake.wait_for(lock, options.interval, [this] { return stopping; });
+            drainAll();
+        }
+    }
+
+    void RequestCollector::drainAll()
+    {
+        for (const auto &ring: rings) {
+            k2::Histogram &stream = streamLatencies[ring->stream()];
+            batch.clear();
+            collectedCount += ring->drain([&](const RequestRecord &record) {
+                if (record.result >= 0) {
+                    const auto latency = static_cast<std::uint64_t>(record.completeNs - record.submitNs);
+                    totalLatency.record(latency);
+                    stream.record(latency);
+                }
+                if (traceFd >= 0 || options.sink) {
+                    batch.push_back(record);
+                }
+            });
+            if (traceFd >= 0 && !batch.empty() && !writeError) {
+                writeError = writeAll(traceFd, batch.data(), batch.size() * sizeof(RequestRecord));
+            }
+            if (options.sink && !batch.empty() && !writeError) {
+                writeError = options.sink(batch.data(), batch.size());
+            }
+        }
+    }
+
+    int readRequestTrace(const std::string &path, std::vector<RequestRecord> &records)
+    {
+        records.clear();
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno;
+        }
+        int ret = 0;
+        TraceHeader header;
+        const TraceHeader expected;
+        if (read(fd, &header, sizeof(header)) != static_cast<ssize_t>(sizeof(header)) ||
+            std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version || header.recordSize != expected.recordSize) {
+            ret = EINVAL;
+        }
+        std::vector<RequestRecord> chunk(4096);
+        while (!ret) {
+            const ssize_t size = read(fd, chunk.data(), chunk.size() * sizeof(RequestRecord));
+            if (size < 0) {
+                ret = errno == EINTR ? 0 : errno;
+                continue;
+            }
+            // A trailing partial record is what a crashed writer leaves behind, it is skipped
+            const auto count = static_cast<std::size_t>(size) / sizeof(RequestRecord);
+            records.insert(records.end(), chunk.begin(), chunk.begin() + static_cast<std::ptrdiff_t>(count));
+            if (count < chunk.size()) {
+                break;
+            }
+        }
+        close(fd);
+        return ret;
+    }
+}
@@ -0,0 +1,95 @@
+#include "libk2/result.hpp"
+
+#include <cstring>
+
+namespace k2 {
+
+    LogSink &logSink()
+    {
+        static LogSink sink;
+        return sink;
+    }
+
+    void setLogSink(LogSink sink)
+    {
+        logSink() = std::move(sink);
+    }
+
+    bool detail::logEnabled()
+    {
+        return static_cast<bool>(logSink());
+    }
+
+    void detail::log(const Result &result, const std::string &device, const pid_t pid)
+    {
+        const LogSink &sink = logSink();
+        if (sink) {
+            sink(result, device, pid);
+        }
+    }
+
+    LogSink streamLogSink(std::ostream &out, std::ostream &err)
+    {
+        return [&out, &err](const Result &result, const std::string &device, const pid_t pid) {
+            std::ostream &os = result ? out : err;
+            os << result;
+            if (!device.empty()) {
+                os << " for " << device;
+            }
+            if (pid) {
+                os << " (pid " << pid << ")";
+            }
+            os << std::endl;
+        };
+    }
+
+    std::string toString(const Operation operation)
+    {
+        switch (operation) {
+            case Operation::OpenDriver:
+                return "open driver";
+            case Operation::CloseDriver:
+                return "close driver";
+            case Operation::GetVersion:
+                return "get version";
+            case Operation::GetActiveDevices:
+                return "get active devices";
+            case Operation::RegisterTask:
+                return "register periodic task";
+            case Operation::UnregisterTask:
+                return "unregister periodic task";
+            case Operation::UnregisterAllTasks:
+                return "unregister all periodic tasks";
+            case Operation::UpdateInterval:
+                return "update periodic task interval";
+            case Operation::RestoreTask:
+                return "restore periodic task";
+            case Operation::ListTasks:
+                return "list periodic tasks";
+            case Operation::Connect:
+                return "connect to daemon";
+            default:
+                return "N/A";
+        }
+    }
+
+    std::string toString(const Result &result)
+    {
+        if (result) {
+            return toString(result.operation) + " succeeded";
+        }
+        return toString(result.operation) + " failed: " + strerror(result.error);
+    }
+}
+
+std::ostream &operator<<(std::ostream &os, const k2::Operation operation)
+{
+    os << k2::toString(operation);
+    return os;
+}
+
+std::ostream &operator<<(std::ostream &os, const k2::Result &result)
+{
+    os << k2::toString(result);
+    return os;
+}
@@ -0,0 +1,378 @@
+#include "libk2/results.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace workload {
+
+    namespace {
+        struct RunHeader
+        {
+            std::int64_t startTimeNs;
+            std::int64_t wallTimeNs;
+            std::uint32_t labelSize;
+            std::uint32_t profileSize;
+            std::uint32_t configSize;
+            std::uint32_t reserved;
+        };
+
+        /**
+         * @brief Followed by the name and the non-empty histogram buckets as pairs of index and count
+         */
+        struct GroupHeader
+        {
+            std::uint64_t blockSize;
+            std::int64_t intervalNs;
+            std::uint64_t requests;
+            std::uint64_t bytes;
+            std::uint64_t errors;
+            std::uint64_t deadlineMisses;
+            std::uint64_t periods;
+            std::uint64_t overruns;
+            std::int64_t wallTimeNs;
+            std::uint64_t latencyMin;
+            std::uint64_t latencyMax;
+            double latencySum;
+            std::uint32_t jobs;
+            std::uint16_t index;
+            std::uint8_t foreground;
+            std::uint8_t histogramBits;
+            std::uint32_t nameSize;
+            std::uint32_t bucketCount;
+        };
+
+        constexpr std::size_t padding(const std::size_t size)
+        {
+            return (8 - size % 8) % 8;
+        }
+
+        void append(std::vector<unsigned char> &buffer, const void *data, const std::size_t size)
+        {
+            const auto *bytes = static_cast<const unsigned char *>(data);
+            buffer.insert(buffer.end(), bytes, bytes + size);
+        }
+
+        int writeAll(const int fd, struct iovec *iov, int count)
+        {
+            while (count > 0) {
+                ssize_t written = writev(fd, iov, count);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return errno;
+                }
+                while (count > 0 && static_cast<std::size_t>(written) >= iov->iov_len) {
+                    written -= static_cast<ssize_t>(iov->iov_len);
+                    iov++;
+                    count--;
+                }
+                if (count > 0) {
+                    iov->iov_base = static_cast<char *>(iov->iov_base) + written;
+                    iov->iov_len -= static_cast<std::size_t>(written);
+                }
+            }
+            return 0;
+        }
+    }
+
+    ResultWriter::~ResultWriter()
+    {
+        static_cast<void>(close());
+    }
+
+    int ResultWriter::open(const std::string &path, const RunInfo &run)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (fd >= 0) {
+                return EBUSY;
+            }
+            fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd < 0) {
+                return errno;
+            }
+            error = 0;
+            ResultFileHeader header;
+            struct iovec iov{&header, sizeof(header)};
+            error = writeAll(fd, &iov, 1);
+            if (error) {
+                return error;
+            }
+        }
+
+        const RunHeader header{run.startTimeNs, run.wallTimeNs, static_cast<std::uint32_t>(run.label.size()),
+                               static_cast<std::uint32_t>(run.profile.size()),
+                               static_cast<std::uint32_t>(run.config.size()), 0};
+        std::vector<unsigned char> payload;
+        append(payload, &header, sizeof(header));
+        append(payload, run.label.data(), run.label.size());
+        append(payload, run.profile.data(), run.profile.size());
+        append(payload, run.config.data(), run.config.size());
+        return writeSection(ResultSection::Run, payload.data(), payload.size());
+    }
+
+    int ResultWriter::writeRecords(const RequestRecord *records, const std::size_t count)
+    {
+        return count ? writeSection(ResultSection::Records, records, count * sizeof(RequestRecord)) : 0;
+    }
+
+    int ResultWriter::writeGroup(const GroupSummary &group)
+    {
+        const auto &buckets = group.latency.buckets();
+        std::vector<std::uint64_t> pairs;
+        for (std::size_t i = 0; i < buckets.size(); i++) {
+            if (buckets[i]) {
+                pairs.push_back(i);
+                pairs.push_back(buckets[i]);
+            }
+        }
+        const GroupHeader header{group.blockSize, group.intervalNs, group.requests, group.bytes, group.errors,
+                                 group.deadlineMisses, group.periods, group.overruns, group.wallTimeNs,
+                                 group.latency.min(), group.latency.max(), group.latency.valueSum(), group.jobs,
+                                 group.index, group.foreground,
+                                 static_cast<std::uint8_t>(group.latency.significantBits()),
+                                 static_cast<std::uint32_t>(group.name.size()),
+                                 static_cast<std::uint32_t>(pairs.size() / 2)};
+        std::vector<unsigned char> payload;
+        append(payload, &header, sizeof(header));
+        append(payload, group.name.data(), group.name.size());
+        payload.resize(payload.size() + padding(group.name.size()), 0);
+        append(payload, pairs.data(), pairs.size() * sizeof(std::uint64_t));
+        return writeSection(ResultSection::Group, payload.data(), payload.size());
+    }
+
+    int ResultWriter::setWallTime(const std::int64_t wallTimeNs)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) {
+            return EBADF;
+        }
+        const off_t offset = sizeof(ResultFileHeader) + sizeof(ResultSectionHeader) + offsetof(RunHeader, wallTimeNs);
+        if (pwrite(fd, &wallTimeNs, sizeof(wallTimeNs), offset) != static_cast<ssize_t>(sizeof(wallTimeNs)) &&
+            !error) {
+            error = errno ? errno : EIO;
+        }
+        return error;
+    }
+
+    int ResultWriter::writeSection(const ResultSection type, const void *payload, const std::size_t size)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) {
+            return EBADF;
+        }
+        if (error) {
+            return error;
+        }
+        ResultSectionHeader header;
+        header.type = type;
+        header.size = size;
+        static const char zeros[8] = {};
+        struct iovec iov[3] = {{&header, sizeof(header)},
+                               {const_cast<void *>(payload), size},
+                               {const_cast<char *>(zeros), padding(size)}};
+        error = writeAll(fd, iov, 3);
+        return error;
+    }
+
+    int ResultWriter::close()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (fd < 0) {
+            return error;
+        }
+        if (::close(fd) < 0 && !error) {
+            error = errno;
+        }
+        fd = -1;
+        return error;
+    }
+
+    ResultReader::~ResultReader()
+    {
+        if (mapping != nullptr) {
+            munmap(const_cast<unsigned char *>(mapping), mappingSize);
+        }
+    }
+
+    int ResultReader::open(const std::string &path)
+    {
+        const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return errno;
+        }
+        struct stat st{};
+        if (fstat(fd, &st) < 0) {
+            const int ret = errno;
+            ::close(fd);
+            return ret;
+        }
+        mappingSize = static_cast<std::size_t>(st.st_size);
+        if (mappingSize < sizeof(ResultFileHeader)) {
+            ::close(fd);
+            return EINVAL;
+        }
+        void *map = mmap(nullptr, mappingSize, PROT_READ, MAP_PRIVATE, fd, 0);
+        const int ret = map == MAP_FAILED ? errno : 0;
+        ::close(fd);
+        if (ret) {
+            return ret;
+        }
+        mapping = static_cast<const unsigned char *>(map);
+        madvise(map, mappingSize, MADV_SEQUENTIAL);
+
+        ResultFileHeader header;
+        const ResultFileHeader expected;
+        std::memcpy(&header, mapping, sizeof(header));
+        if (std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version || header.headerSize < sizeof(ResultFileHeader)) {
+            return EINVAL;
+        }
+        position = header.headerSize;
+        return 0;
+    }
+
+    bool ResultReader::next(Section &section)
+    {
+        if (mapping == nullptr || position + sizeof(ResultSectionHeader) > mappingSize) {
+            return false;
+        }
+        ResultSectionHeader header;
+        std::memcpy(&header, mapping + position, sizeof(header));
+        const std::size_t start = position + sizeof(header);
+        if (header.size > mappingSize - start) {
+            return false;
+        }
+        section.type = header.type;
+        section.data = mapping + start;
+        section.size = header.size;
+        position = start + header.size + padding(header.size);
+        return true;
+    }
+
+    void ResultReader::release()
+    {
+        const auto page = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+        const std::size_t end = position / page * page;
+        if (end > released) {
+            madvise(const_cast<unsigned char *>(mapping) + released, end - released, MADV_DONTNEED);
+            released = end;
+        }
+    }
+
+    int ResultReader::parseRun(const Section &section, RunInfo &run)
+    {
+        RunHeader header{};
+        if (section.type != ResultSection::Run || section.size < sizeof(header)) {
+            return EINVAL;
+        }
+        std::memcpy(&header, section.data, sizeof(header));
+        const std::size_t strings = std::size_t{header.labelSize} + header.profileSize + header.configSize;
+        if (section.size < sizeof(header) + strings) {
+            return EINVAL;
+        }
+        const auto *text = reinterpret_cast<const char *>(section.data + sizeof(header));
+        run.startTimeNs = header.startTimeNs;
+        run.wallTimeNs = header.wallTimeNs;
+        run.label.assign(text, header.labelSize);
+        run.profile.assign(text + header.labelSize, header.profileSize);
+        run.config.assign(text + header.labelSize + header.profileSize, header.configSize);
+        return 0;
+    }
+
+    int ResultReader::parseGroup(const Section &section, GroupSummary &group)
+    {
+        GroupHeader header{};
+        if (section.type != ResultSection::Group || section.size < sizeof(header)) {
+            return EINVAL;
+        }
+        std::memcpy(&header, section.data, sizeof(header));
+        const std::size_t nameEnd = sizeof(header) + header.nameSize + padding(header.nameSize);
+        if (section.size < nameEnd + std::size_t{header.bucketCount} * 2 * sizeof(std::uint64_t)) {
+            return EINVAL;
+        }
+        group.name.assign(reinterpret_cast<const char *>(section.data + sizeof(header)), header.nameSize);
+        group.index = header.index;
+        group.foreground = header.foreground != 0;
+        group.jobs = header.jobs;
+        group.blockSize = header.blockSize;
+        group.intervalNs = header.intervalNs;
+        group.requests = header.requests;
+        group.bytes = header.bytes;
+        group.errors = header.errors;
+        group.deadlineMisses = header.deadlineMisses;
+        group.periods = header.periods;
+        group.overruns = header.overruns;
+        group.wallTimeNs = header.wallTimeNs;
+
+        group.latency = k2::Histogram(header.histogramBits);
+        std::vector<std::uint64_t> buckets(group.latency.buckets().size(), 0);
+        for (std::uint32_t i = 0; i < header.bucketCount; i++) {
+            std::uint64_t pair[2];
+            std::memcpy(pair, section.data + nameEnd + i * sizeof(pair), sizeof(pair));
+            if (pair[0] >= buckets.size()) {
+                return EINVAL;
+            }
+            buckets[pair[0]] = pair[1];
+        }
+        return group.latency.restore(buckets, header.latencyMin, header.latencyMax, header.latencySum) ? 0 : EINVAL;
+    }
+
+    const RequestRecord *ResultReader::records(const Section &section, std::size_t &count)
+    {
+        count = section.type == ResultSection::Records ? section.size / sizeof(RequestRecord) : 0;
+        return count ? reinterpret_cast<const RequestRecord *>(section.data) : nullptr;
+    }
+
+    std::string jsonString(const std::string &value)
+    {
+        static constexpr char hex[] = "0123456789abcdef";
+        std::string json = "\"";
+        for (const char c: value) {
+            const auto byte = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                json += '\\';
+                json += c;
+            } else if (c == '\n') {
+                json += "\\n";
+            } else if (c == '\t') {
+                json += "\\t";
+            } else if (byte < 0x20) {
+                json += "\\u00";
+                json += hex[byte >> 4];
+                json += hex[byte & 0xf];
+            } else {
+                json += c;
+            }
+        }
+        json += '"';
+        return json;
+    }
+
+    std::string csvField(const std::string &value)
+    {
+        if (value.find_first_of(",\"\r\n") == std::string::npos) {
+            return value;
+        }
+        std::string field = "\"";
+        for (const char c: value) {
+            if (c == '"') {
+                field += '"';
+            }
+            field += c;
+        }
+        field += '"';
+        return field;
+    }
+}
@@ -0,0 +1,409 @@
+#include "libk2/runner.hpp"
+
+#include "libk2/control.hpp"
+#include "libk2/session.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace workload {
+
+    namespace {
+        std::string devicePath(const std::string &device)
+        {
+            return device.find('/') == std::string::npos ? "/dev/" + device : device;
+        }
+
+        std::string deviceName(const std::string &device)
+        {
+            return device.substr(device.find_last_of('/') + 1);
+        }
+
+        void mergePeriodic(PeriodicStats &into, const PeriodicStats &stats)
+        {
+            into.releaseJitter.merge(stats.releaseJitter);
+            into.completion.merge(stats.completion);
+            into.lateness.merge(stats.lateness);
+            into.periods += stats.periods;
+            into.overruns += stats.overruns;
+            into.skipped += stats.skipped;
+        }
+
+        /**
+         * @brief Releases all foreground jobs at once after each of them opened its target
+         */
+        class StartGate
+        {
+        public:
+            explicit StartGate(const std::size_t jobs) :
+                    pending(jobs)
+            {}
+
+            /**
+             * @return false if the run was aborted before the gate opened
+             */
+            bool arriveAndWait()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                pending--;
+                changed.notify_all();
+                changed.wait(lock, [this] { return opened || aborted; });
+                return !aborted;
+            }
+
+            void waitForAll()
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                changed.wait(lock, [this] { return pending == 0; });
+            }
+
+            void open(const bool abort)
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                opened = !abort;
+                aborted = abort;
+                changed.notify_all();
+            }
+
+        private:
+            std::mutex mutex;
+            std::condition_variable changed;
+            std::size_t pending;
+            bool opened = false;
+            bool aborted = false;
+        };
+
+        /**
+         * @brief Registers or unregisters a task with k2, through the daemon if a socket is given
+         */
+        template<typename Operation>
+        k2::Result withK2(const std::optional<std::string> &socket, const Operation &operation)
+        {
+            if (socket) {
+                k2::ControlClient client(*socket);
+                return client.isOpen() ? operation(client) : client.error();
+            }
+            k2::Session session;
+            return session.isOpen() ? operation(session) : session.error();
+        }
+    }
+
+    struct ProfileRunner::Job
+    {
+        std::size_t group = 0;
+        std::size_t index = 0;
+        StartGate *gate = nullptr;
+        std::int64_t deadlineNs = 0;
+        GroupResult result;
+        int error = 0;
+        std::atomic<bool> done{false};
+    };
+
+    ProfileRunner::ProfileRunner(Profile profile) :
+            runProfile(std::move(profile)), groupResults(runProfile.groups.size())
+    {}
+
+    ProfileRunner::~ProfileRunner()
+    {
+        for (auto &pool: pools) {
+            if (pool) {
+                pool->stop();
+            }
+        }
+    }
+
+    void ProfileRunner::requestStop()
+    {
+        stop.store(true);
+    }
+
+    void ProfileRunner::runForeground(const JobGroup &group, Job &job)
+    {
+        const std::string name = group.name + "-" + std::to_string(job.index);
+        prctl(PR_SET_NAME, name.c_str());
+        if (!group.cpus.empty()) {
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            CPU_SET(group.cpus[job.index % group.cpus.size()], &mask);
+            sched_setaffinity(0, sizeof(mask), &mask);
+        }
+        const auto tid = static_cast<pid_t>(syscall(SYS_gettid));
+        if (group.setIoPrio) {
+            job.error = ionice::ioPrioSet(tid, group.ioPrio);
+        }
+
+        EngineOptions options = group.engine;
+        options.queueDepth = options.type == EngineType::Uring ? std::max(options.queueDepth, 1U) : 1;
+        auto engine = makeEngine(options);
+        BufferPool pool;
+        OffsetGenerator offsets;
+        const std::string &device = group.devices[job.index % group.devices.size()];
+        if (!job.error) {
+            // A misspelled device name must fail with ENOENT instead of creating a file in /dev
+            const std::string path = devicePath(device);
+            const bool create = group.pattern != IoPattern::Read && !isDeviceTarget(path);
+            job.error = engine ? engine->open(path, create ? O_CREAT : 0) : EINVAL;
+        }
+        if (!job.error) {
+            job.error = makeOffsetGenerator(devicePath(device), group.offsets, group.offset, group.size,
+                                            group.blockSize, 0x9e3779b97f4a7c15ULL ^ (job.group << 16 | job.index),
+                                            offsets);
+        }
+        if (!job.error) {
+            BufferPoolOptions poolOptions;
+            poolOptions.bufferSize = group.blockSize;
+            poolOptions.count = engine->queueDepth();
+            job.error = pool.allocate(poolOptions);
+        }
+        if (!job.error) {
+            job.error = engine->registerBuffers(pool.iovecs());
+        }
+
+        const std::string k2Device = deviceName(device);
+        if (!job.error && group.registerWithK2) {
+            const k2::Result result = withK2(k2Socket, [&](auto &handle) {
+                return handle.registerTask(k2Device, tid, group.periodic.periodNs);
+            });
+            job.result.registered = result.ok();
+            job.error = result.error;
+        }
+
+        if (job.gate->arriveAndWait() && !job.error) {
+            PeriodicIssuer issuer(group.periodic);
+            job.error = issuer.start();
+
+            const unsigned requestsPerPeriod = engine->queueDepth();
+            std::vector<RequestRecord> records(requestsPerPeriod);
+            RequestRing *ring = collector ? collector->attach(static_cast<std::uint16_t>(job.group)) : nullptr;
+            std::vector<IoCompletion> completions;
+            completions.reserve(requestsPerPeriod);
+            XorShift random(0x2545f4914f6cdd1dULL ^ (job.group << 16 | job.index));
+
+            const std::int64_t start = PeriodicIssuer::nowNs();
+            for (std::size_t i = 0; !job.error && (group.iterations == 0 || i < group.iterations); i++) {
+                if (stop.load(std::memory_order_relaxed) || (job.deadlineNs && issuer.deadlineNs() > job.deadlineNs)) {
+                    break;
+                }
+                job.error = issuer.waitNext();
+                if (job.error) {
+                    break;
+                }
+
+                for (unsigned slot = 0; slot < requestsPerPeriod; slot++) {
+                    IoRequest request;
+                    request.direction = group.pattern == IoPattern::Write ? IoDirection::Write : IoDirection::Read;
+                    if (group.pattern == IoPattern::Mixed) {
+                        request.direction = random.next() % 100 < group.readPercent ? IoDirection::Read
+                                                                                       : IoDirection::Write;
+                    }
+                    request.buffer = pool.buffer(slot);
+                    request.length = group.blockSize;
+                    request.offset = offsets.next();
+                    request.bufferIndex = static_cast<int>(slot);
+                    request.userData = slot;
+                    records[slot].offset = static_cast<std::uint64_t>(request.offset);
+                    records[slot].length = static_cast<std::uint32_t>(request.length);
+                    records[slot].direction = request.direction == IoDirection::Write;
+                    records[slot].submitNs = PeriodicIssuer::nowNs();
+                    if (engine->submit(request)) {
+                        job.result.errors++;
+                    }
+                }
+
+                std::int64_t complete = PeriodicIssuer::nowNs();
+                while (engine->inFlight() > 0) {
+                    completions.clear();
+                    if (engine->reap(completions, 1)) {
+                        job.result.errors += engine->inFlight();
+                        break;
+                    }
+                    complete = PeriodicIssuer::nowNs();
+                    for (const auto &completion: completions) {
+                        RequestRecord &record = records[completion.userData];
+                        if (ring) {
+                            record.completeNs = complete;
+                            record.result = static_cast<std::int32_t>(completion.result);
+                            record.pid = tid;
+                            record.stream = static_cast<std::uint16_t>(job.group);
+                            ring->push(record);
+                        }
+                        if (completion.result == -ENOSPC || completion.result == 0) {
+                            // End of the device or of a regular file that is read, start over again
+                            offsets.restart();
+                        } else if (completion.result < 0) {
+                            job.result.errors++;
+                        } else {
+                            job.result.requests++;
+                            job.result.bytes += static_cast<std::uint64_t>(completion.result);
+                            job.result.latency.record(complete - record.submitNs);
+                        }
+                        if (complete > issuer.deadlineNs()) {
+                            job.result.deadlineMisses++;
+                        }
+                    }
+                }
+                issuer.complete(complete);
+            }
+            job.result.wallTimeNs = PeriodicIssuer::nowNs() - start;
+            job.result.periodic = issuer.stats();
+        }
+
+        if (job.result.registered) {
+            const k2::Result result = withK2(k2Socket, [&](auto &handle) {
+                return handle.unregisterTask(k2Device, tid);
+            });
+            if (!result && !job.error) {
+                job.error = result.error;
+            }
+        }
+        job.done.store(true);
+    }
+
+    int ProfileRunner::run()
+    {
+        int ret = validateProfile(runProfile);
+        if (ret) {
+            return ret;
+        }
+        stop.store(false);
+        groupResults.assign(runProfile.groups.size(), GroupResult());
+
+        // Background groups first, so the foreground starts into the full load
+        pools.clear();
+        pools.resize(runProfile.groups.size());
+        for (std::size_t g = 0; g < runProfile.groups.size() && !ret; g++) {
+            const JobGroup &group = runProfile.groups[g];
+            if (group.role != JobRole::Background) {
+                continue;
+            }
+            std::vector<StreamConfig> streams;
+            for (unsigned i = 0; i < group.jobs; i++) {
+                StreamConfig stream;
+                stream.name = group.name + "-" + std::to_string(i);
+                stream.kind = group.kind;
+                stream.path = devicePath(group.devices[i % group.devices.size()]);
+                stream.engine = group.engine;
+                stream.blockSize = group.blockSize;
+                stream.pattern = group.pattern;
+                stream.readPercent = group.readPercent;
+                stream.offset = group.offset;
+                stream.size = group.size;
+                stream.offsets = group.offsets;
+                stream.setIoPrio = group.setIoPrio;
+                stream.ioClass = group.ioPrio.ioClass();
+                stream.ioLevel = group.ioPrio.ioLevel();
+                stream.cpu = group.cpus.empty() ? -1 : group.cpus[i % group.cpus.size()];
+                stream.targetIops = group.iops;
+                stream.targetMBps = group.mbps;
+                stream.thinkTime = group.thinkTime;
+                stream.collector = collector;
+                stream.collectorStream = static_cast<std::uint16_t>(g);
+                streams.push_back(std::move(stream));
+            }
+            pools[g] = std::make_unique<WorkerPool>(std::move(streams));
+            ret = pools[g]->start();
+        }
+
+        std::vector<std::unique_ptr<Job>> jobs;
+        for (std::size_t g = 0; g < runProfile.groups.size(); g++) {
+            const JobGroup &group = runProfile.groups[g];
+            for (unsigned i = 0; group.role == JobRole::Foreground && i < group.jobs; i++) {
+                jobs.push_back(std::make_unique<Job>());
+                jobs.back()->group = g;
+                jobs.back()->index = i;
+            }
+        }
+
+        const std::int64_t start = PeriodicIssuer::nowNs();
+        const std::int64_t end = runProfile.duration.count() ? start + runProfile.duration.count() * 1000000 : 0;
+        auto groupEnd = [&](const JobGroup &group) {
+            const std::int64_t own = group.duration.count() ? start + group.duration.count() * 1000000 : 0;
+            return own && end ? std::min(own, end) : std::max(own, end);
+        };
+
+        StartGate gate(jobs.size());
+        std::vector<std::thread> threads;
+        if (!ret) {
+            for (auto &job: jobs) {
+                job->gate = &gate;
+                job->deadlineNs = groupEnd(runProfile.groups[job->group]);
+                threads.emplace_back([this, &job] { runForeground(runProfile.groups[job->group], *job); });
+            }
+            gate.waitForAll();
+            for (const auto &job: jobs) {
+                if (job->error && !ret) {
+                    ret = job->error;
+                }
+            }
+            gate.open(ret != 0);
+        }
+
+        // Wait for the foreground, the profile duration and the durations of the background groups
+        while (!ret && !stop.load()) {
+            const std::int64_t now = PeriodicIssuer::nowNs();
+            bool running = false;
+            for (std::size_t g = 0; g < pools.size(); g++) {
+                const std::int64_t stopAt = groupEnd(runProfile.groups[g]);
+                if (pools[g] && stopAt && now >= stopAt && groupResults[g].wallTimeNs == 0) {
+                    pools[g]->stop();
+                    groupResults[g].wallTimeNs = now - start;
+                }
+            }
+            for (const auto &job: jobs) {
+                running = running || !job->done.load();
+            }
+            if ((end && now >= end) || (!end && !running)) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        stop.store(true);
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        runTimeNs = PeriodicIssuer::nowNs() - start;
+
+        for (std::size_t g = 0; g < pools.size(); g++) {
+            if (!pools[g]) {
+                continue;
+            }
+            pools[g]->stop();
+            GroupResult &result = groupResults[g];
+            if (result.wallTimeNs == 0) {
+                result.wallTimeNs = runTimeNs;
+            }
+            for (std::size_t i = 0; i < pools[g]->streams().size(); i++) {
+                const StreamStats &stats = pools[g]->stats(i);
+                result.requests += stats.requests.load();
+                result.bytes += stats.bytes.load();
+                result.errors += stats.errors.load();
+            }
+        }
+        for (const auto &job: jobs) {
+            GroupResult &result = groupResults[job->group];
+            result.latency.merge(job->result.latency);
+            mergePeriodic(result.periodic, job->result.periodic);
+            result.requests += job->result.requests;
+            result.bytes += job->result.bytes;
+            result.errors += job->result.errors;
+            result.deadlineMisses += job->result.deadlineMisses;
+            result.registered += job->result.registered;
+            result.wallTimeNs = std::max(result.wallTimeNs, job->result.wallTimeNs);
+            if (job->error && !ret) {
+                ret = job->error;
+            }
+        }
+        return ret;
+    }
+}
@@ -0,0 +1,389 @@
+#include "libk2/session.hpp"
+#include "libk2/metrics.hpp"
+
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <mutex>
+
+#include <k2.h>
+
+
+namespace k2 {
+
+    /**
+     * @brief Builds the result of an ioctl return value and hands it to the log sink, if one is installed
+     */
+    inline Result finish(const Operation operation, const int err, const std::string &device, const pid_t pid)
+    {
+        const Result result{operation, err};
+        if (detail::logEnabled()) {
+            detail::log(result, device, pid);
+        }
+        if (detail::metricsEnabled()) {
+            detail::recordTasks(result, device);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Serializes the task operations of all sessions of the process, so an emulated interval update is atomic
+     * to the other libk2 users within this process. Other processes still reach the driver in between.
+     */
+    std::mutex &taskMutex()
+    {
+        static std::mutex mutex;
+        return mutex;
+    }
+
+    /**
+     * @brief Intervals of the tasks registered by this process, guarded by taskMutex
+     * @details The driver cannot report the interval of a task, an emulated update needs it to register the task
+     * again if the new interval is rejected
+     */
+    std::map<std::pair<std::string, pid_t>, std::int64_t> &taskIntervals()
+    {
+        static std::map<std::pair<std::string, pid_t>, std::int64_t> intervals;
+        return intervals;
+    }
+
+    struct Session::IoctlBuffers
+    {
+        struct k2_ioctl io{};
+        char dev[K2_IOCTL_BLK_DEV_NAME_LENGTH]{};
+        char charParam[K2_IOCTL_CHAR_PARAM_LENGTH]{};
+    };
+
+    Session::Session() :
+            Session(makeDefaultBackend())
+    {}
+
+    Session::Session(const std::string &devName) :
+            Session(std::make_unique<IoctlBackend>(devName))
+    {}
+
+    Session::Session(std::unique_ptr<Backend> backend) :
+            backend(std::move(backend)), buffers(std::make_unique<IoctlBuffers>())
+    {
+#ifdef K2_IOC_UPDATE_PERIODIC_TASK
+        updateIoctl = true;
+#endif
+        openError = this->backend->open();
+        if (detail::logEnabled()) {
+            detail::log(Result{Operation::OpenDriver, openError}, {}, 0);
+        }
+    }
+
+    Session::Session(Session &&other) noexcept:
+            backend(std::move(other.backend)), openError(other.openError), buffers(std::move(other.buffers)),
+            deviceCache(std::move(other.deviceCache)), validateDevices(other.validateDevices),
+            updateIoctl(other.updateIoctl)
+    {}
+
+    Session::~Session()
+    {
+        close();
+    }
+
+    Session &Session::operator=(Session &&other) noexcept
+    {
+        if (this != &other) {
+            close();
+            backend = std::move(other.backend);
+            openError = other.openError;
+            buffers = std::move(other.buffers);
+            deviceCache = std::move(other.deviceCache);
+            validateDevices = other.validateDevices;
+            updateIoctl = other.updateIoctl;
+        }
+        return *this;
+    }
+
+    void Session::close()
+    {
+        if (isOpen()) {
+            const int ret = backend->close();
+            if (ret && detail::logEnabled()) {
+                detail::log(Result{Operation::CloseDriver, ret}, {}, 0);
+            }
+        }
+    }
+
+    bool Session::isOpen() const
+    {
+        return backend && openError == 0;
+    }
+
+    Result Session::error() const
+    {
+        return Result{Operation::OpenDriver, openError};
+    }
+
+    int Session::issue(const Operation operation, const unsigned long request, struct k2_ioctl &io)
+    {
+        if (!detail::metricsEnabled()) {
+            return backend->ioctl(request, io);
+        }
+        const auto start = std::chrono::steady_clock::now();
+        const int ret = backend->ioctl(request, io);
+        const auto end = std::chrono::steady_clock::now();
+        detail::recordIoctl(operation, ret, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        return ret;
+    }
+
+    struct k2_ioctl &Session::prepare(const std::string &device)
+    {
+        struct k2_ioctl &io = buffers->io;
+        memset(&io, 0, sizeof(io));
+
+        strncpy(buffers->dev, device.c_str(), K2_IOCTL_BLK_DEV_NAME_LENGTH - 1);
+        buffers->charParam[0] = '\0';
+        io.string_param = buffers->charParam;
+        io.blk_dev = buffers->dev;
+        return io;
+    }
+
+    Result Session::getVersion(std::string &version)
+    {
+        struct k2_ioctl &io = prepare({});
+
+        int ret = issue(Operation::GetVersion, K2_IOC_GET_VERSION, io);
+        if (ret == 0) {
+            version = io.string_param;
+        }
+        return finish(Operation::GetVersion, ret, {}, 0);
+    }
+
+    Result Session::getActiveDevices(std::string &devices)
+    {
+        struct k2_ioctl &io = prepare({});
+
+        int ret = issue(Operation::GetActiveDevices, K2_IOC_GET_DEVICES, io);
+        if (ret == 0) {
+            devices = io.string_param;
+        }
+        return finish(Operation::GetActiveDevices, ret, {}, 0);
+    }
+
+    int Session::refreshDevices()
+    {
+        if (deviceCache.fresh()) {
+            return 0;
+        }
+        // Read the generation first, an invalidation while the driver is queried makes the result stale right away
+        const std::uint64_t generation = deviceGeneration();
+        struct k2_ioctl &io = prepare({});
+        int ret = issue(Operation::GetActiveDevices, K2_IOC_GET_DEVICES, io);
+        if (ret) {
+            deviceCache.valid = false;
+            return ret;
+        }
+        deviceCache.devices = parseDevices(io.string_param);
+        deviceCache.generation = generation;
+        deviceCache.updated = std::chrono::steady_clock::now();
+        deviceCache.valid = true;
+        return 0;
+    }
+
+    int Session::checkDevice(const std::string &device)
+    {
+        int ret = refreshDevices();
+        if (ret == 0 && deviceCache.find(device) == nullptr) {
+            // The inventory may predate the device, look again unless it was just read
+            if (deviceCache.updated < std::chrono::steady_clock::now() - std::chrono::milliseconds(1)) {
+                deviceCache.valid = false;
+                ret = refreshDevices();
+            }
+            if (ret == 0 && deviceCache.find(device) == nullptr) {
+                ret = ENODEV;
+            }
+        }
+        return ret;
+    }
+
+    Result Session::getDevices(std::vector<DeviceInfo> &devices)
+    {
+        int ret = refreshDevices();
+        if (ret == 0) {
+            devices = deviceCache.devices;
+        }
+        return finish(Operation::GetActiveDevices, ret, {}, 0);
+    }
+
+    Result Session::findDevice(const std::string &name, DeviceInfo &info)
+    {
+        int ret = refreshDevices();
+        if (ret == 0) {
+            const DeviceInfo *device = deviceCache.find(name);
+            if (device != nullptr) {
+                info = *device;
+            } else {
+                ret = ENODEV;
+            }
+        }
+        return finish(Operation::GetActiveDevices, ret, name, 0);
+    }
+
+    Result Session::registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns)
+    {
+        if (validateDevices) {
+            if (const int ret = checkDevice(device)) {
+                return finish(Operation::RegisterTask, ret, device, pid);
+            }
+        }
+        struct k2_ioctl &io = prepare(device);
+        io.interval_ns = interval_ns;
+        io.task_pid = pid;
+
+        std::lock_guard<std::mutex> lock(taskMutex());
+        int ret = issue(Operation::RegisterTask, K2_IOC_REGISTER_PERIODIC_TASK, io);
+        if (ret == 0) {
+            taskIntervals()[{device, pid}] = interval_ns;
+        } else if (ret == ENODEV) {
+            invalidateDevices();
+        }
+        return finish(Operation::RegisterTask, ret, device, pid);
+    }
+
+    Result Session::unregisterTask(const std::string &device, const pid_t pid)
+    {
+        struct k2_ioctl &io = prepare(device);
+        io.task_pid = pid;
+
+        std::lock_guard<std::mutex> lock(taskMutex());
+        int ret = issue(Operation::UnregisterTask, K2_IOC_UNREGISTER_PERIODIC_TASK, io);
+        if (ret == 0) {
+            taskIntervals().erase({device, pid});
+        }
+        return finish(Operation::UnregisterTask, ret, device, pid);
+    }
+
+    Result Session::unregisterAllTasks(const std::string &device)
+    {
+        struct k2_ioctl &io = prepare(device);
+
+        std::lock_guard<std::mutex> lock(taskMutex());
+        int ret = issue(Operation::UnregisterAllTasks, K2_IOC_UNREGISTER_ALL_PERIODIC_TASKS, io);
+        if (ret == 0) {
+            auto &intervals = taskIntervals();
+            intervals.erase(intervals.lower_bound({device, std::numeric_limits<pid_t>::min()}),
+                            intervals.upper_bound({device, std::numeric_limits<pid_t>::max()}));
+        }
+        return finish(Operation::UnregisterAllTasks, ret, device, 0);
+    }
+
+    Result Session::updateInterval(const std::string &device, const pid_t pid, std::int64_t interval_ns)
+    {
+        // Rejected up front, so the emulation never unregisters a task it cannot register again
+        if (interval_ns <= 0) {
+            return finish(Operation::UpdateInterval, EINVAL, device, pid);
+        }
+        struct k2_ioctl &io = prepare(device);
+        io.interval_ns = interval_ns;
+        io.task_pid = pid;
+
+        std::lock_guard<std::mutex> lock(taskMutex());
+        int ret = ENOTTY;
+#ifdef K2_IOC_UPDATE_PERIODIC_TASK
+        if (updateIoctl) {
+            ret = issue(Operation::UpdateInterval, K2_IOC_UPDATE_PERIODIC_TASK, io);
+            // Modules built before the ioctl existed reject it
+            updateIoctl = ret != ENOTTY;
+        }
+#endif
+        Operation operation = Operation::UpdateInterval;
+        if (ret == ENOTTY) {
+            ret = issue(Operation::UnregisterTask, K2_IOC_UNREGISTER_PERIODIC_TASK, io);
+            if (ret == 0) {
+                ret = issue(Operation::RegisterTask, K2_IOC_REGISTER_PERIODIC_TASK, io);
+                if (ret) {
+                    operation = restore(device, pid, io);
+                }
+            }
+        }
+        if (ret == 0) {
+            taskIntervals()[{device, pid}] = interval_ns;
+        } else if (ret == ENODEV) {
+            invalidateDevices();
+        }
+        return finish(operation, ret, device, pid);
+    }
+
+    Operation Session::restore(const std::string &device, const pid_t pid, struct k2_ioctl &io)
+    {
+        auto &intervals = taskIntervals();
+        const auto previous = intervals.find({device, pid});
+        if (previous != intervals.end()) {
+            io.interval_ns = previous->second;
+            if (issue(Operation::RegisterTask, K2_IOC_REGISTER_PERIODIC_TASK, io) == 0) {
+                return Operation::UpdateInterval;
+            }
+            intervals.erase(previous);
+        }
+        return Operation::RestoreTask;
+    }
+
+    std::vector<Result> Session::registerTasks(const std::vector<TaskSpec> &specs)
+    {
+        std::vector<Result> results;
+        results.reserve(specs.size());
+        const std::string *lastDevice = nullptr;
+        struct k2_ioctl &io = buffers->io;
+
+        std::lock_guard<std::mutex> lock(taskMutex());
+        for (const TaskSpec &spec: specs) {
+            if (validateDevices && (lastDevice == nullptr || *lastDevice != spec.device)) {
+                if (const int ret = checkDevice(spec.device)) {
+                    results.push_back(finish(Operation::RegisterTask, ret, spec.device, spec.pid));
+                    // The refresh used the ioctl buffers
+                    lastDevice = nullptr;
+                    continue;
+                }
+                lastDevice = nullptr;
+            }
+            // Consecutive entries usually target the same disk, only rewrite the name buffer when it changes
+            if (lastDevice == nullptr || *lastDevice != spec.device) {
+                prepare(spec.device);
+                lastDevice = &spec.device;
+            }
+            io.interval_ns = spec.interval_ns;
+            io.task_pid = spec.pid;
+
+            int ret = issue(Operation::RegisterTask, K2_IOC_REGISTER_PERIODIC_TASK, io);
+            if (ret == 0) {
+                taskIntervals()[{spec.device, spec.pid}] = spec.interval_ns;
+            } else if (ret == ENODEV) {
+                invalidateDevices();
+            }
+            results.push_back(finish(Operation::RegisterTask, ret, spec.device, spec.pid));
+        }
+        return results;
+    }
+
+    std::vector<Result> Session::unregisterTasks(const std::vector<TaskSpec> &specs)
+    {
+        std::vector<Result> results;
+        results.reserve(specs.size());
+        const std::string *lastDevice = nullptr;
+        struct k2_ioctl &io = buffers->io;
+
+        std::lock_guard<std::mutex> lock(taskMutex());
+        for (const TaskSpec &spec: specs) {
+            if (lastDevice == nullptr || *lastDevice != spec.device) {
+                prepare(spec.device);
+                lastDevice = &spec.device;
+            }
+            io.interval_ns = 0;
+            io.task_pid = spec.pid;
+
+            int ret = issue(Operation::UnregisterTask, K2_IOC_UNREGISTER_PERIODIC_TASK, io);
+            if (ret == 0) {
+                taskIntervals().erase({spec.device, spec.pid});
+            }
+            results.push_back(finish(Operation::UnregisterTask, ret, spec.device, spec.pid));
+        }
+        return results;
+    }
+}
@@ -0,0 +1,188 @@
+#include "libk2/supervisor.hpp"
+
+extern "C" {
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+}
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+// See https://man7.org/linux/man-pages/man2/pidfd_open.2.html, a pidfd becomes readable once the process exits
+
+inline int pidFdOpenSyscall(pid_t pid)
+{
+    return static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+}
+
+namespace k2 {
+
+    namespace {
+        constexpr int maxEvents = 64;
+    }
+
+    TaskSupervisor::TaskSupervisor(Session &session) :
+            session(session)
+    {}
+
+    TaskSupervisor::~TaskSupervisor()
+    {
+        for (const auto &watch: watches) {
+            close(watch.second.pidFd);
+        }
+        if (epollFd >= 0) {
+            close(epollFd);
+        }
+    }
+
+    int TaskSupervisor::open()
+    {
+        if (epollFd >= 0) {
+            return 0;
+        }
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        return epollFd < 0 ? errno : 0;
+    }
+
+    int TaskSupervisor::watch(const std::string &device, const pid_t pid)
+    {
+        if (epollFd < 0) {
+            return EBADF;
+        }
+
+        auto existing = watches.find(pid);
+        if (existing != watches.end()) {
+            auto &devices = existing->second.devices;
+            if (std::find(devices.begin(), devices.end(), device) == devices.end()) {
+                devices.push_back(device);
+            }
+            return 0;
+        }
+
+        const int pidFd = pidFdOpenSyscall(pid);
+        if (pidFd < 0) {
+            return errno;
+        }
+        struct epoll_event event{};
+        event.events = EPOLLIN;
+        event.data.u64 = static_cast<std::uint64_t>(pid);
+        if (epoll_ctl(epollFd, EPOLL_CTL_ADD, pidFd, &event) < 0) {
+            const int err = errno;
+            close(pidFd);
+            return err;
+        }
+        watches.emplace(pid, Watch{pidFd, {device}});
+        return 0;
+    }
+
+    void TaskSupervisor::unwatch(const std::string &device, const pid_t pid)
+    {
+        auto watch = watches.find(pid);
+        if (watch == watches.end()) {
+            return;
+        }
+        auto &devices = watch->second.devices;
+        devices.erase(std::remove(devices.begin(), devices.end(), device), devices.end());
+        if (devices.empty()) {
+            remove(watch);
+        }
+    }
+
+    void TaskSupervisor::remove(std::unordered_map<pid_t, Watch>::iterator watch)
+    {
+        // Closing the last reference to the pidfd also drops it from the epoll set
+        close(watch->second.pidFd);
+        watches.erase(watch);
+    }
+
+    Result TaskSupervisor::registerTask(const std::string &device, const pid_t pid, std::int64_t interval_ns)
+    {
+        // The pidfd pins the process before it is registered, so a pid that is reused in between cannot leave the
+        // watch on another process than the registration. A pidfd of a process that already exited is readable.
+        const auto existing = watches.find(pid);
+        const bool watched = existing != watches.end() &&
+                             std::find(existing->second.devices.begin(), existing->second.devices.end(), device) !=
+                             existing->second.devices.end();
+        int err = watch(device, pid);
+        if (!err) {
+            struct pollfd exited{watches.at(pid).pidFd, POLLIN, 0};
+            err = ::poll(&exited, 1, 0) > 0 ? ESRCH : 0;
+        }
+        if (err) {
+            if (!watched) {
+                unwatch(device, pid);
+            }
+            return Result{Operation::RegisterTask, err};
+        }
+
+        const Result result = session.registerTask(device, pid, interval_ns);
+        if (!result && !watched) {
+            unwatch(device, pid);
+        }
+        return result;
+    }
+
+    Result TaskSupervisor::unregisterTask(const std::string &device, const pid_t pid)
+    {
+        const Result result = session.unregisterTask(device, pid);
+        // A task the driver still has must stay watched, or its exit would never be cleaned up
+        if (result) {
+            unwatch(device, pid);
+        }
+        return result;
+    }
+
+    Result TaskSupervisor::unregisterAllTasks(const std::string &device)
+    {
+        const Result result = session.unregisterAllTasks(device);
+        if (result) {
+            for (auto watch = watches.begin(); watch != watches.end();) {
+                auto &devices = watch->second.devices;
+                devices.erase(std::remove(devices.begin(), devices.end(), device), devices.end());
+                if (devices.empty()) {
+                    close(watch->second.pidFd);
+                    watch = watches.erase(watch);
+                } else {
+                    ++watch;
+                }
+            }
+        }
+        return result;
+    }
+
+    int TaskSupervisor::poll(const int timeoutMs)
+    {
+        if (epollFd < 0) {
+            return EBADF;
+        }
+
+        std::array<struct epoll_event, maxEvents> events{};
+        const int ready = epoll_wait(epollFd, events.data(), maxEvents, timeoutMs);
+        if (ready < 0) {
+            return errno == EINTR ? 0 : errno;
+        }
+        for (int i = 0; i < ready; i++) {
+            const auto pid = static_cast<pid_t>(events[i].data.u64);
+            auto watch = watches.find(pid);
+            if (watch == watches.end()) {
+                continue;
+            }
+            // The handler may call back into the supervisor, so the watch is gone before it runs
+            const std::vector<std::string> devices = std::move(watch->second.devices);
+            remove(watch);
+            for (const auto &device: devices) {
+                const Result result = session.unregisterTask(device, pid);
+                if (exitHandler) {
+                    exitHandler(result, device, pid);
+                }
+            }
+        }
+        return 0;
+    }
+}
@@ -0,0 +1,367 @@
+#include "libk2/topology.hpp"
+#include "libk2/deviceid.hpp"
+
+extern "C" {
+#include <dirent.h>
+#include <sched.h>
+#include <sys/sysinfo.h>
+}
+
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <fstream>
+#include <map>
+#include <set>
+
+namespace k2 {
+
+    namespace {
+        bool readLine(const std::string &path, std::string &line)
+        {
+            std::ifstream in(path);
+            return static_cast<bool>(std::getline(in, line));
+        }
+
+        int readInt(const std::string &path, const int fallback)
+        {
+            std::ifstream in(path);
+            int value = fallback;
+            return in >> value ? value : fallback;
+        }
+
+        bool readCpuListFile(const std::string &path, std::vector<int> &cpus)
+        {
+            std::string line;
+            return readLine(path, line) && parseCpuList(line, cpus);
+        }
+
+        /**
+         * @brief Calls visit with the number of every entry of a directory named prefix followed by digits
+         */
+        template<typename Visitor>
+        void forEachNumbered(const std::string &path, const std::string &prefix, Visitor visit)
+        {
+            DIR *dir = opendir(path.c_str());
+            if (dir == nullptr) {
+                return;
+            }
+            while (const dirent *entry = readdir(dir)) {
+                const std::string name = entry->d_name;
+                if (name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+                    std::all_of(name.begin() + static_cast<std::ptrdiff_t>(prefix.size()), name.end(),
+                                [](const unsigned char c) { return std::isdigit(c); })) {
+                    visit(std::stoi(name.substr(prefix.size())));
+                }
+            }
+            closedir(dir);
+        }
+
+        bool contains(const std::vector<int> &cpus, const int cpu)
+        {
+            return std::find(cpus.begin(), cpus.end(), cpu) != cpus.end();
+        }
+    }
+
+    const CpuInfo *CpuTopology::find(const int id) const
+    {
+        const auto cpu = std::find_if(cpus.begin(), cpus.end(), [id](const CpuInfo &info) { return info.id == id; });
+        return cpu != cpus.end() ? &*cpu : nullptr;
+    }
+
+    std::size_t CpuTopology::nodes() const
+    {
+        std::set<int> nodes;
+        for (const auto &cpu: cpus) {
+            nodes.insert(cpu.node);
+        }
+        return nodes.size();
+    }
+
+    int DeviceTopology::queueOf(const int cpu) const
+    {
+        for (std::size_t queue = 0; queue < queues.size(); queue++) {
+            if (contains(queues[queue], cpu)) {
+                return static_cast<int>(queue);
+            }
+        }
+        return -1;
+    }
+
+    bool DeviceTopology::handlesIrqs(const int cpu) const
+    {
+        return contains(irqCpus, cpu);
+    }
+
+    bool DeviceTopology::empty() const
+    {
+        return node < 0 && queues.empty() && irqCpus.empty();
+    }
+
+    CpuTopology readCpuTopology(const std::string &sysSystem)
+    {
+        std::vector<int> online;
+        if (!readCpuListFile(sysSystem + "/cpu/online", online) || online.empty()) {
+            online.clear();
+            for (int cpu = 0; cpu < get_nprocs_conf(); cpu++) {
+                online.push_back(cpu);
+            }
+        }
+        std::vector<int> isolated;
+        readCpuListFile(sysSystem + "/cpu/isolated", isolated);
+
+        std::map<int, int> nodeOf;
+        forEachNumbered(sysSystem + "/node", "node", [&](const int node) {
+            std::vector<int> cpus;
+            if (readCpuListFile(sysSystem + "/node/node" + std::to_string(node) + "/cpulist", cpus)) {
+                for (const int cpu: cpus) {
+                    nodeOf[cpu] = node;
+                }
+            }
+        });
+
+        cpu_set_t mask;
+        CPU_ZERO(&mask);
+        const bool haveMask = sched_getaffinity(0, sizeof(mask), &mask) == 0;
+
+        CpuTopology topology;
+        for (const int id: online) {
+            const std::string base = sysSystem + "/cpu/cpu" + std::to_string(id) + "/topology/";
+            CpuInfo cpu;
+            cpu.id = id;
+            cpu.core = readInt(base + "core_id", -1);
+            cpu.package = readInt(base + "physical_package_id", -1);
+            const auto node = nodeOf.find(id);
+            cpu.node = node != nodeOf.end() ? node->second : 0;
+            if (!readCpuListFile(base + "thread_siblings_list", cpu.siblings) || !contains(cpu.siblings, id)) {
+                cpu.siblings = {id};
+            }
+            cpu.isolated = contains(isolated, id);
+            cpu.allowed = !haveMask || (id < CPU_SETSIZE && CPU_ISSET(id, &mask));
+            topology.cpus.push_back(std::move(cpu));
+        }
+        std::sort(topology.cpus.begin(), topology.cpus.end(),
+                  [](const CpuInfo &a, const CpuInfo &b) { return a.id < b.id; });
+        return topology;
+    }
+
+    DeviceTopology readDeviceTopology(const std::string &device, const std::string &sysBlock,
+                                      const std::string &procIrq)
+    {
+        DeviceTopology topology;
+        topology.name = diskName(device, sysBlock.substr(0, sysBlock.find_last_of('/')));
+        const std::string base = sysBlock + "/" + topology.name;
+
+        // The disk's device is the controller, for NVMe and virtio the PCI function sits one level further up and
+        // controllers may report -1 where the PCI function knows its node
+        topology.node = readInt(base + "/device/numa_node", -1);
+        if (topology.node < 0) {
+            topology.node = readInt(base + "/device/device/numa_node", -1);
+        }
+
+        std::vector<int> queues;
+        forEachNumbered(base + "/mq", "", [&](const int queue) { queues.push_back(queue); });
+        std::sort(queues.begin(), queues.end());
+        for (const int queue: queues) {
+            std::vector<int> cpus;
+            readCpuListFile(base + "/mq/" + std::to_string(queue) + "/cpu_list", cpus);
+            topology.queues.push_back(std::move(cpus));
+        }
+
+        std::set<int> irqCpus;
+        forEachNumbered(base + "/device/device/msi_irqs", "", [&](const int irq) {
+            const std::string irqBase = procIrq + "/" + std::to_string(irq);
+            std::vector<int> cpus;
+            if (readCpuListFile(irqBase + "/effective_affinity_list", cpus) ||
+                readCpuListFile(irqBase + "/smp_affinity_list", cpus)) {
+                irqCpus.insert(cpus.begin(), cpus.end());
+            }
+        });
+        topology.irqCpus.assign(irqCpus.begin(), irqCpus.end());
+        return topology;
+    }
+
+    std::string toString(const PlacementPolicy policy)
+    {
+        switch (policy) {
+            case PlacementPolicy::Sequential:
+                return "sequential";
+            case PlacementPolicy::Local:
+                return "local";
+            case PlacementPolicy::Remote:
+                return "remote";
+            default:
+                return "N/A";
+        }
+    }
+
+    PlacementPolicy placementPolicyToEnum(const std::string &name)
+    {
+        if (name == "sequential") {
+            return PlacementPolicy::Sequential;
+        }
+        if (name == "local") {
+            return PlacementPolicy::Local;
+        }
+        if (name == "remote") {
+            return PlacementPolicy::Remote;
+        }
+        return PlacementPolicy::NA;
+    }
+
+    Placement placeWorkers(const CpuTopology &topology, const DeviceTopology &device, const PlacementPolicy policy)
+    {
+        Placement placement;
+        std::vector<const CpuInfo *> allowed;
+        for (const auto &cpu: topology.cpus) {
+            if (cpu.allowed) {
+                allowed.push_back(&cpu);
+            }
+        }
+        if (allowed.empty()) {
+            return placement;
+        }
+
+        if (policy != PlacementPolicy::Local && policy != PlacementPolicy::Remote) {
+            placement.realtimeCpu = allowed.front()->id;
+            for (std::size_t i = 1; i < allowed.size(); i++) {
+                placement.backgroundCpus.push_back(allowed[i]->id);
+            }
+            return placement;
+        }
+
+        const auto local = [&device](const CpuInfo &cpu) { return device.node < 0 || cpu.node == device.node; };
+
+        // Criteria in falling importance; a CPU that takes its own completion interrupts spares the real-time task
+        // the IPI from another CPU, and CPU 0 usually carries most housekeeping interrupts and timers
+        const CpuInfo *realtime = nullptr;
+        int bestScore = -1;
+        for (const CpuInfo *cpu: allowed) {
+            const int queue = device.queueOf(cpu->id);
+            const int score = (cpu->isolated ? 16 : 0) + (local(*cpu) ? 8 : 0) + (device.handlesIrqs(cpu->id) ? 4 : 0) +
+                              (queue >= 0 && device.queues[queue].size() == 1 ? 2 : 0) + (cpu->id != 0 ? 1 : 0);
+            if (score > bestScore) {
+                bestScore = score;
+                realtime = cpu;
+            }
+        }
+        placement.realtimeCpu = realtime->id;
+
+        // Background requests submitted on the hardware queue of the real-time task queue up in front of its
+        // requests, and its SMT siblings share its core; both are only used if there is nothing else. Among the others
+        // lower ranks come first: the node preference of the policy, then one thread per physical core.
+        const int realtimeQueue = device.queueOf(realtime->id);
+        std::vector<std::pair<int, int>> candidates;
+        std::vector<std::pair<int, int>> sameQueue;
+        std::vector<std::pair<int, int>> siblings;
+        for (const CpuInfo *cpu: allowed) {
+            if (cpu->isolated || cpu == realtime) {
+                continue;
+            }
+            const bool remote = !local(*cpu);
+            const int rank = ((policy == PlacementPolicy::Remote) != remote ? 4 : 0) +
+                             (cpu->siblings.front() != cpu->id ? 2 : 0);
+            if (contains(realtime->siblings, cpu->id)) {
+                siblings.emplace_back(rank, cpu->id);
+            } else if (realtimeQueue >= 0 && device.queueOf(cpu->id) == realtimeQueue) {
+                sameQueue.emplace_back(rank, cpu->id);
+            } else {
+                candidates.emplace_back(rank, cpu->id);
+            }
+        }
+        if (candidates.empty()) {
+            candidates = std::move(sameQueue);
+        }
+        if (candidates.empty()) {
+            candidates = std::move(siblings);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        for (const auto &candidate: candidates) {
+            placement.backgroundCpus.push_back(candidate.second);
+        }
+        return placement;
+    }
+
+    bool parseCpuList(const std::string &list, std::vector<int> &cpus)
+    {
+        cpus.clear();
+        std::bitset<CPU_SETSIZE> seen;
+        std::size_t pos = 0;
+        const auto skipSpaces = [&]() {
+            while (pos < list.size() && std::isspace(static_cast<unsigned char>(list[pos]))) {
+                pos++;
+            }
+        };
+        const auto number = [&](int &value) {
+            skipSpaces();
+            const std::size_t begin = pos;
+            while (pos < list.size() && std::isdigit(static_cast<unsigned char>(list[pos]))) {
+                pos++;
+            }
+            if (pos == begin || pos - begin > 6) {
+                return false;
+            }
+            value = std::stoi(list.substr(begin, pos - begin));
+            if (value >= CPU_SETSIZE) {
+                return false;
+            }
+            skipSpaces();
+            return true;
+        };
+
+        skipSpaces();
+        while (pos < list.size()) {
+            int first = 0;
+            if (!number(first)) {
+                return false;
+            }
+            int last = first;
+            if (pos < list.size() && list[pos] == '-') {
+                pos++;
+                if (!number(last) || last < first) {
+                    return false;
+                }
+            }
+            for (int cpu = first; cpu <= last; cpu++) {
+                if (!seen.test(static_cast<std::size_t>(cpu))) {
+                    seen.set(static_cast<std::size_t>(cpu));
+                    cpus.push_back(cpu);
+                }
+            }
+            if (pos < list.size()) {
+                if (list[pos] != ',') {
+                    return false;
+                }
+                pos++;
+                skipSpaces();
+                if (pos == list.size()) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::string formatCpuList(const std::vector<int> &cpus)
+    {
+        std::vector<int> sorted(cpus);
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+        std::string list;
+        for (std::size_t i = 0; i < sorted.size();) {
+            std::size_t j = i;
+            while (j + 1 < sorted.size() && sorted[j + 1] == sorted[j] + 1) {
+                j++;
+            }
+            if (!list.empty()) {
+                list += ',';
+            }
+            list += std::to_string(sorted[i]);
+            if (j > i) {
+                list += (j == i + 1 ? "," : "-") + std::to_string(sorted[j]);
+            }
+            i = j + 1;
+        }
+        return list;
+    }
+}
@@ -0,0 +1,87 @@
+#include "libk2/unixsocket.hpp"
+
+extern "C" {
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+}
+
+#include <cerrno>
+#include <cstring>
+
+namespace k2 {
+
+    namespace {
+        /**
+         * @return 0 if a server accepts connections on the path, otherwise the errno of connecting
+         */
+        int probe(const struct sockaddr_un &address)
+        {
+            const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            if (fd < 0) {
+                return errno;
+            }
+            const int ret = connect(fd, reinterpret_cast<const struct sockaddr *>(&address), sizeof(address)) < 0
+                            ? errno : 0;
+            ::close(fd);
+            return ret;
+        }
+    }
+
+    int detail::unixSocketAddress(const std::string &path, struct sockaddr_un &address)
+    {
+        if (path.empty() || path.size() >= sizeof(address.sun_path)) {
+            return ENAMETOOLONG;
+        }
+        memset(&address, 0, sizeof(address));
+        address.sun_family = AF_UNIX;
+        memcpy(address.sun_path, path.c_str(), path.size());
+        return 0;
+    }
+
+    int detail::bindUnixSocket(const int fd, const std::string &path, BoundSocket &bound)
+    {
+        struct sockaddr_un address{};
+        int ret = unixSocketAddress(path, address);
+        if (ret) {
+            return ret;
+        }
+
+        struct stat st{};
+        if (lstat(path.c_str(), &st) == 0) {
+            if (!S_ISSOCK(st.st_mode)) {
+                return EEXIST;
+            }
+            ret = probe(address);
+            if (ret == 0) {
+                return EADDRINUSE;
+            }
+            if (ret != ECONNREFUSED && ret != ENOENT) {
+                return ret;
+            }
+            // Left behind by a server that did not shut down cleanly, it would make bind fail
+            if (unlink(path.c_str()) < 0 && errno != ENOENT) {
+                return errno;
+            }
+        }
+
+        if (bind(fd, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) < 0 ||
+            lstat(path.c_str(), &st) < 0) {
+            return errno;
+        }
+        bound.device = st.st_dev;
+        bound.inode = st.st_ino;
+        return 0;
+    }
+
+    void detail::unlinkUnixSocket(const std::string &path, BoundSocket &bound)
+    {
+        struct stat st{};
+        if (bound.inode != 0 && lstat(path.c_str(), &st) == 0 && st.st_dev == bound.device &&
+            st.st_ino == bound.inode) {
+            unlink(path.c_str());
+        }
+        bound = BoundSocket{};
+    }
+}
@@ -0,0 +1,420 @@
+#include "libk2/workerpool.hpp"
+
+extern "C" {
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+}
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <ctime>
+#include <new>
+
+inline long futexSyscall(std::atomic<std::uint32_t> *word, int op, std::uint32_t value)
+{
+    return syscall(SYS_futex, reinterpret_cast<std::uint32_t *>(word), op, value, nullptr, nullptr, 0);
+}
+
+namespace workload {
+
+    /**
+     * @brief Control block shared between the coordinator and all streams, followed by one StreamStats per stream
+     * @details Lives in a MAP_SHARED mapping, the futex on go is deliberately not process private
+     */
+    struct alignas(64) WorkerPool::SharedState
+    {
+        std::atomic<std::uint32_t> ready{0};
+        std::atomic<std::uint32_t> failed{0};
+        std::atomic<int> error{0};
+        std::atomic<std::uint32_t> go{0};
+        std::atomic<bool> stop{false};
+
+        StreamStats *stats()
+        { return reinterpret_cast<StreamStats *>(this + 1); }
+    };
+
+    inline void sleepUntil(const struct timespec &deadline)
+    {
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr) == EINTR) {}
+    }
+
+    inline void addNs(struct timespec &ts, const std::int64_t ns)
+    {
+        ts.tv_nsec += ns % 1000000000;
+        ts.tv_sec += ns / 1000000000;
+        if (ts.tv_nsec >= 1000000000) {
+            ts.tv_nsec -= 1000000000;
+            ts.tv_sec++;
+        }
+    }
+
+    inline std::int64_t monotonicNs()
+    {
+        struct timespec now{};
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<std::int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    inline bool before(const struct timespec &a, const struct timespec &b)
+    {
+        return a.tv_sec < b.tv_sec || (a.tv_sec == b.tv_sec && a.tv_nsec < b.tv_nsec);
+    }
+
+    /**
+     * @return The minimum distance between two submissions of a stream in ns, 0 if it is not rate limited
+     */
+    std::int64_t issueIntervalNs(const StreamConfig &config)
+    {
+        double interval = 0;
+        if (config.targetIops > 0) {
+            interval = 1e9 / config.targetIops;
+        }
+        if (config.targetMBps > 0) {
+            interval = std::max(interval, static_cast<double>(config.blockSize) * 1e3 / config.targetMBps);
+        }
+        return static_cast<std::int64_t>(interval);
+    }
+
+    unsigned effectiveQueueDepth(const StreamConfig &config)
+    {
+        return config.engine.type == EngineType::Uring ? std::max(config.engine.queueDepth, 1U) : 1;
+    }
+
+    /**
+     * @brief Body of one stream, shared by thread and process streams
+     */
+    void runStream(const StreamConfig &config, const std::size_t index, const BufferPool &buffers,
+                   WorkerPool::SharedState &shared)
+    {
+        StreamStats &stats = shared.stats()[index];
+
+        const std::string name = config.name.empty() ? "k2-stream-" + std::to_string(index) : config.name;
+        prctl(PR_SET_NAME, name.c_str());
+
+        if (config.cpu >= 0) {
+            cpu_set_t mask;
+            CPU_ZERO(&mask);
+            CPU_SET(config.cpu, &mask);
+            sched_setaffinity(0, sizeof(mask), &mask);
+        }
+
+        if (config.setIoPrio) {
+            // ioprio_set applies to a single thread when given a tid, a failure leaves the inherited priority
+            const auto tid = static_cast<pid_t>(syscall(SYS_gettid));
+            static_cast<void>(ionice::ioPrioSet(tid, ionice::IoPrio(config.ioClass, config.ioLevel)));
+        }
+
+        EngineOptions options = config.engine;
+        options.queueDepth = effectiveQueueDepth(config);
+        auto engine = makeEngine(options);
+        const bool create = config.pattern != IoPattern::Read && !isDeviceTarget(config.path);
+        int err = engine ? engine->open(config.path, create ? O_CREAT : 0) : EINVAL;
+        if (!err) {
+            err = engine->registerBuffers(buffers.iovecs());
+        }
+        OffsetGenerator offsets;
+        if (!err) {
+            err = makeOffsetGenerator(config.path, config.offsets, config.offset, config.size, config.blockSize,
+                                      static_cast<std::uint64_t>(index + 1) * 0x2545f4914f6cdd1dULL, offsets);
+        }
+        if (err) {
+            int expected = 0;
+            shared.error.compare_exchange_strong(expected, err);
+            shared.failed.fetch_add(1);
+            return;
+        }
+        shared.ready.fetch_add(1);
+
+        while (shared.go.load() == 0) {
+            futexSyscall(&shared.go, FUTEX_WAIT, 0);
+        }
+
+        const unsigned queueDepth = engine->queueDepth();
+        std::vector<unsigned> freeSlots;
+        for (unsigned i = queueDepth; i > 0; i--) {
+            freeSlots.push_back(i - 1);
+        }
+        std::vector<IoCompletion> completions;
+        completions.reserve(queueDepth);
+        std::vector<std::size_t> lengths(queueDepth, 0);
+        RequestRing *ring = config.kind == StreamKind::Thread && config.collector
+                            ? config.collector->attach(config.collectorStream) : nullptr;
+        std::vector<RequestRecord> pending(ring ? queueDepth : 0);
+        const auto tid = static_cast<std::int32_t>(syscall(SYS_gettid));
+
+        XorShift random(static_cast<std::uint64_t>(index + 1) * 0x2545f4914f6cdd1dULL ^ static_cast<std::uint64_t>(
+                std::chrono::steady_clock::now().time_since_epoch().count()));
+        const std::int64_t intervalNs = issueIntervalNs(config);
+        struct timespec nextIssue{};
+        clock_gettime(CLOCK_MONOTONIC, &nextIssue);
+
+        while (!shared.stop.load(std::memory_order_relaxed)) {
+            while (!freeSlots.empty() && !shared.stop.load(std::memory_order_relaxed)) {
+                if (intervalNs > 0) {
+                    struct timespec now{};
+                    clock_gettime(CLOCK_MONOTONIC, &now);
+                    if (before(now, nextIssue)) {
+                        if (engine->inFlight() > 0) {
+                            break;
+                        }
+                        sleepUntil(nextIssue);
+                    }
+                    addNs(nextIssue, intervalNs);
+                }
+
+                const unsigned slot = freeSlots.back();
+                IoRequest request;
+                switch (config.pattern) {
+                    case IoPattern::Read:
+                        request.direction = IoDirection::Read;
+                        break;
+                    case IoPattern::Mixed:
+                        request.direction = random.next() % 100 < config.readPercent ? IoDirection::Read
+                                                                                        : IoDirection::Write;
+                        break;
+                    default:
+                        request.direction = IoDirection::Write;
+                        break;
+                }
+                request.buffer = buffers.buffer(slot);
+                request.length = config.blockSize;
+                request.offset = offsets.next();
+                request.bufferIndex = static_cast<int>(slot);
+                request.userData = slot;
+                if (ring) {
+                    pending[slot].submitNs = monotonicNs();
+                    pending[slot].offset = static_cast<std::uint64_t>(request.offset);
+                    pending[slot].length = static_cast<std::uint32_t>(request.length);
+                    pending[slot].direction = request.direction == IoDirection::Write;
+                }
+                if (engine->submit(request)) {
+                    break;
+                }
+                lengths[slot] = config.blockSize;
+                freeSlots.pop_back();
+            }
+
+            if (engine->inFlight() == 0) {
+                continue;
+            }
+            completions.clear();
+            if (engine->reap(completions, 1)) {
+                stats.errors.fetch_add(engine->inFlight(), std::memory_order_relaxed);
+                break;
+            }
+            const std::int64_t completeNs = ring ? monotonicNs() : 0;
+            for (const auto &completion: completions) {
+                freeSlots.push_back(static_cast<unsigned>(completion.userData));
+                if (ring) {
+                    RequestRecord &record = pending[completion.userData];
+                    record.completeNs = completeNs;
+                    record.result = static_cast<std::int32_t>(completion.result);
+                    record.pid = tid;
+                    record.stream = config.collectorStream;
+                    ring->push(record);
+                }
+                if (completion.result == -ENOSPC || completion.result == 0) {
+                    // End of the device or of a regular file that is read, start over again
+                    offsets.restart();
+                } else if (completion.result < 0) {
+                    stats.errors.fetch_add(1, std::memory_order_relaxed);
+                } else {
+                    stats.requests.fetch_add(1, std::memory_order_relaxed);
+                    stats.bytes.fetch_add(static_cast<std::uint64_t>(completion.result), std::memory_order_relaxed);
+                }
+            }
+            if (config.thinkTime.count() > 0) {
+                std::this_thread::sleep_for(config.thinkTime);
+            }
+        }
+
+        // Let in flight requests finish before the buffers go away
+        while (engine->inFlight() > 0) {
+            completions.clear();
+            if (engine->reap(completions, engine->inFlight())) {
+                break;
+            }
+        }
+    }
+
+    WorkerPool::WorkerPool(std::vector<StreamConfig> streams) :
+            configs(std::move(streams))
+    {
+        sharedSize = sizeof(SharedState) + configs.size() * sizeof(StreamStats);
+        void *mapping = mmap(nullptr, sharedSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if (mapping != MAP_FAILED) {
+            shared = new(mapping) SharedState();
+            for (std::size_t i = 0; i < configs.size(); i++) {
+                new(&shared->stats()[i]) StreamStats();
+            }
+        }
+    }
+
+    WorkerPool::~WorkerPool()
+    {
+        stop();
+        if (shared != nullptr) {
+            for (std::size_t i = 0; i < configs.size(); i++) {
+                shared->stats()[i].~StreamStats();
+            }
+            shared->~SharedState();
+            munmap(shared, sharedSize);
+        }
+    }
+
+    int WorkerPool::start()
+    {
+        if (running) {
+            return EBUSY;
+        }
+        if (shared == nullptr) {
+            return ENOMEM;
+        }
+        shared->ready.store(0);
+        shared->failed.store(0);
+        shared->error.store(0);
+        shared->go.store(0);
+        shared->stop.store(false);
+
+        // One buffer per in flight request of the deepest stream, sized for the largest requests
+        BufferPoolOptions poolOptions;
+        for (const auto &config: configs) {
+            poolOptions.bufferSize = std::max(poolOptions.bufferSize, config.blockSize);
+            poolOptions.count = std::max<std::size_t>(poolOptions.count, effectiveQueueDepth(config));
+            poolOptions.shared = poolOptions.shared || config.kind == StreamKind::Process;
+        }
+        if (!configs.empty()) {
+            const int err = buffers.allocate(poolOptions);
+            if (err) {
+                return err;
+            }
+        }
+
+        running = true;
+        for (std::size_t i = 0; i < configs.size(); i++) {
+            if (configs[i].kind == StreamKind::Thread) {
+                threads.emplace_back(runStream, std::cref(configs[i]), i, std::cref(buffers), std::ref(*shared));
+                continue;
+            }
+            const pid_t pid = fork();
+            if (pid < 0) {
+                const int err = errno;
+                int expected = 0;
+                shared->error.compare_exchange_strong(expected, err);
+                shared->failed.fetch_add(1);
+            } else if (pid == 0) {
+                std::signal(SIGINT, SIG_DFL);
+                std::signal(SIGTERM, SIG_DFL);
+                runStream(configs[i], i, buffers, *shared);
+                _exit(0);
+            } else {
+                processPids.push_back(pid);
+            }
+        }
+
+        // A process stream that dies before it reported, e.g. killed by the OOM killer, would be waited for forever;
+        // streams only exit before the start on failure, so a reaped one fails the start
+        while (shared->ready.load() + shared->failed.load() < configs.size()) {
+            for (auto pid = processPids.begin(); pid != processPids.end(); ++pid) {
+                int stat;
+                if (waitpid(*pid, &stat, WNOHANG) == *pid) {
+                    int expected = 0;
+                    shared->error.compare_exchange_strong(expected, ECHILD);
+                    shared->failed.fetch_add(1);
+                    processPids.erase(pid);
+                    break;
+                }
+            }
+            if (shared->failed.load() > 0) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+        }
+        if (shared->failed.load() > 0) {
+            const int err = shared->error.load();
+            stop();
+            return err;
+        }
+
+        shared->go.store(1);
+        futexSyscall(&shared->go, FUTEX_WAKE, INT_MAX);
+        return EXIT_SUCCESS;
+    }
+
+    void WorkerPool::requestStop()
+    {
+        if (shared == nullptr) {
+            return;
+        }
+        shared->stop.store(true);
+        shared->go.store(1);
+        futexSyscall(&shared->go, FUTEX_WAKE, INT_MAX);
+        for (const pid_t pid: processPids) {
+            kill(pid, SIGTERM);
+        }
+    }
+
+    void WorkerPool::stop()
+    {
+        if (!running) {
+            return;
+        }
+        shared->stop.store(true);
+        shared->go.store(1);
+        futexSyscall(&shared->go, FUTEX_WAKE, INT_MAX);
+
+        for (auto &thread: threads) {
+            thread.join();
+        }
+        threads.clear();
+        for (const pid_t pid: processPids) {
+            int stat;
+            while (waitpid(pid, &stat, 0) < 0 && errno == EINTR) {}
+        }
+        processPids.clear();
+        buffers.reset();
+        running = false;
+    }
+
+    const StreamStats &WorkerPool::stats(const std::size_t index) const
+    {
+        return shared->stats()[index];
+    }
+
+    std::string toString(const IoPattern pattern)
+    {
+        switch (pattern) {
+            case IoPattern::Read:
+                return "read";
+            case IoPattern::Write:
+                return "write";
+            case IoPattern::Mixed:
+                return "mixed";
+            default:
+                return "N/A";
+        }
+    }
+
+    IoPattern ioPatternToEnum(const std::string &name)
+    {
+        if (name == "read") {
+            return IoPattern::Read;
+        }
+        if (name == "write") {
+            return IoPattern::Write;
+        }
+        if (name == "mixed") {
+            return IoPattern::Mixed;
+        }
+        return IoPattern::NA;
+    }
+}
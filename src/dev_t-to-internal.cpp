@@ -1,49 +1,69 @@
-#include <iostream>
-
-/**
- * @see kdev_t.h in the kernel headers
- */
-#define MINORBITS	20
-#define MINORMASK	((1U << MINORBITS) - 1)
+#include "libk2/deviceid.hpp"
 
-#define MAJOR(dev)	((unsigned int) ((dev) >> MINORBITS))
-#define MINOR(dev)	((unsigned int) ((dev) & MINORMASK))
-#define MKDEV(ma,mi)	(((ma) << MINORBITS) | (mi))
+#include <argparse/argparse.hpp>
 
+#include <cstring>
+#include <iostream>
+#include <sstream>
 
 /**
- * @brief Small helper tool that translates major:minor device numbers to the internal u32 representation in the kernel
- * @details Used to filter requests captured by lttng for the device that is benchmarked and limits trace file size
+ * @brief Small helper tool that translates block device identifiers to the internal u32 dev_t representation in the
+ * kernel, or back
+ * @details Used to filter requests captured by lttng for the device that is benchmarked and limits trace file size.
+ * Accepts kernel names (nvme0n1), device nodes (/dev/nvme0n1), major:minor numbers (259:0) and internal dev_t
+ * values. Without identifiers on the command line, one identifier per line is read from stdin.
  */
-int main(int argc, char** argv)
+int main(int argc, char **argv)
 {
-  if (argc != 2) {
-    std::cerr << "Expected 1 parameter, received " << argc - 1 << std::endl;
-    return 1;
-  }
+    argparse::ArgumentParser program("dev_t-to-internal", "0.2");
 
-  std::string dev_t = argv[1];
+    program.add_argument("identifiers")
+            .remaining()
+            .help("device identifiers to convert, read from stdin if none are given");
 
-  std::string majorString;
-  std::string minorString;
+    program.add_argument("--format", "-f")
+            .default_value(std::string{"internal"})
+            .help("output format: internal, number (major:minor) or name");
 
-  bool finishedMajor = false;
-  for (const auto& it : dev_t) {
-    if (it == ':') {
-      finishedMajor = true;
-    } else {
-      if (finishedMajor) {
-        minorString += it;
-      } else {
-        majorString += it;
-      }
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
     }
-  }
 
-  std::uint32_t major = std::stoul(majorString);
-  std::uint32_t minor = std::stoul(minorString);
+    const auto format = k2::deviceIdFormatToEnum(program.get<std::string>("--format"));
+    if (format == k2::DeviceIdFormat::NA) {
+        std::cerr << "Unknown format " << program.get<std::string>("--format") << std::endl;
+        return 1;
+    }
 
-  std::cout << MKDEV(major, minor) << std::endl;
+    std::size_t failedLine = 0;
+    int ret;
+    std::string failed;
+    const auto identifiers = program.present<std::vector<std::string>>("identifiers");
+    if (identifiers && !identifiers->empty()) {
+        std::ostringstream lines;
+        for (const auto &identifier: *identifiers) {
+            lines << identifier << '\n';
+        }
+        std::istringstream in(lines.str());
+        ret = k2::convertDeviceIds(in, std::cout, format, failedLine);
+        if (ret) {
+            failed = (*identifiers)[failedLine - 1];
+        }
+    } else {
+        std::ios::sync_with_stdio(false);
+        ret = k2::convertDeviceIds(std::cin, std::cout, format, failedLine);
+        failed = "line " + std::to_string(failedLine);
+    }
+    std::cout.flush();
 
-  return 0;
-}
\ No newline at end of file
+    if (ret) {
+        std::cerr << "Could not convert " << failed << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+    return 0;
+}
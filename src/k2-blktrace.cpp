@@ -0,0 +1,160 @@
+#include "libk2/blocktrace.hpp"
+#include "libk2/control.hpp"
+#include "libk2/deviceid.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <set>
+
+volatile std::sig_atomic_t stopTracing = false;
+
+void stopSignalHandler(int signal)
+{
+    stopTracing = true;
+}
+
+void printLatencies(const char *name, const k2::Histogram &h)
+{
+    if (h.count() == 0) {
+        std::cout << " " << name << " -";
+        return;
+    }
+    std::cout << " " << name << " p50 " << h.percentile(50) / 1000.0 << " p99 " << h.percentile(99) / 1000.0
+              << " max " << h.max() / 1000.0;
+}
+
+/**
+ * @brief Traces the block layer latencies of one device per process, without writing a trace file
+ * @details Replaces recording an lttng trace filtered with dev_t-to-internal and analyzing it offline. With --socket
+ * the tasks registered through the k2-register-task daemon are marked, so real-time tasks and background load can
+ * be told apart.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-blktrace", "0.1");
+
+    program.add_argument("--device", "-d")
+            .required()
+            .help("device to trace: name (nvme0n1), node (/dev/nvme0n1) or major:minor (259:0), a partition is traced "
+                  "as its whole disk");
+
+    program.add_argument("--duration", "-t")
+            .scan<'i', unsigned>()
+            .default_value(0U)
+            .help("trace for this many seconds, 0 to trace until interrupted");
+
+    program.add_argument("--pages")
+            .scan<'i', unsigned>()
+            .default_value(64U)
+            .help("pages of every per CPU ring buffer, a power of two");
+
+    program.add_argument("--socket", "-s")
+            .help("mark the tasks registered through the k2-register-task daemon on this socket");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto identifier = program.get<std::string>("--device");
+    k2::BlockDevice device;
+    int ret = k2::resolveDevice(identifier, device);
+    if (ret) {
+        std::cerr << "Could not resolve " << identifier << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+    // Block tracepoints report the disk, a filter on a partition would never match
+    const std::string disk = k2::diskName(device.name);
+    if (disk != device.name) {
+        const std::string partition = device.name;
+        ret = k2::resolveDevice(disk, device);
+        if (ret) {
+            std::cerr << "Could not resolve the disk of " << partition << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+        std::cerr << partition << " is a partition, tracing all of " << disk << std::endl;
+    }
+
+    k2::BlockTracer tracer(device.id, program.get<unsigned>("--pages"));
+    ret = tracer.open();
+    if (ret) {
+        std::cerr << "Could not trace " << device.name << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+
+    std::signal(SIGINT, stopSignalHandler);
+    std::signal(SIGTERM, stopSignalHandler);
+    std::cerr << "Tracing " << device.name << " (" << k2::toString(device.id) << ")"
+              << ", interrupt to stop" << std::endl;
+
+    const auto duration = std::chrono::seconds(program.get<unsigned>("--duration"));
+    const auto start = std::chrono::steady_clock::now();
+    while (!stopTracing && (duration.count() == 0 || std::chrono::steady_clock::now() - start < duration)) {
+        ret = tracer.poll(100);
+        if (ret) {
+            std::cerr << "Tracing failed: " << strerror(ret) << std::endl;
+            return 1;
+        }
+    }
+    // Pick up what is still buffered
+    static_cast<void>(tracer.poll(0));
+    static_cast<void>(tracer.poll(0));
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    std::set<pid_t> k2Pids;
+    if (const auto socket = program.present<std::string>("--socket")) {
+        k2::ControlClient client(*socket);
+        std::vector<k2::TaskSpec> tasks;
+        const k2::Result result = client.isOpen() ? client.listTasks(tasks) : client.error();
+        if (!result) {
+            std::cerr << result << std::endl;
+        }
+        for (const auto &task: tasks) {
+            if (task.device == device.name) {
+                k2Pids.insert(task.pid);
+            }
+        }
+    }
+
+    std::vector<std::pair<pid_t, const k2::RequestStats *>> rows;
+    k2::RequestStats total;
+    for (const auto &entry: tracer.stats()) {
+        rows.emplace_back(entry.first, &entry.second);
+        total.requests += entry.second.requests;
+        total.bytes += entry.second.bytes;
+        total.queue.merge(entry.second.queue);
+        total.service.merge(entry.second.service);
+    }
+    std::sort(rows.begin(), rows.end(), [](const auto &a, const auto &b) {
+        return a.second->requests > b.second->requests;
+    });
+
+    std::cout << "Block layer latencies [us] of " << device.name << " over " << seconds << " s" << std::endl;
+    for (const auto &row: rows) {
+        const k2::RequestStats &stats = *row.second;
+        std::cout << (k2Pids.count(row.first) ? "k2 " : "   ") << row.first << " " << stats.comm << ": "
+                  << stats.requests << " requests, " << stats.bytes / (1024.0 * 1024.0) / seconds << " MiB/s,";
+        printLatencies("queue", stats.queue);
+        std::cout << ",";
+        printLatencies("service", stats.service);
+        std::cout << std::endl;
+    }
+    std::cout << "   total: " << total.requests << " requests, " << total.bytes / (1024.0 * 1024.0) / seconds
+              << " MiB/s,";
+    printLatencies("queue", total.queue);
+    std::cout << ",";
+    printLatencies("service", total.service);
+    std::cout << std::endl;
+    std::cout << "   " << tracer.lost() << " samples lost, " << tracer.unmatched() << " completions unmatched, "
+              << tracer.inFlight() << " requests in flight" << std::endl;
+    return 0;
+}
@@ -0,0 +1,226 @@
+#include "libk2/results.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <vector>
+
+/**
+ * @brief What one result file says about one job group
+ */
+struct GroupStats
+{
+    workload::GroupSummary summary;
+    bool summarized = false;
+    /**
+     * @brief Latencies and volume recomputed from the request records of the group
+     */
+    k2::Histogram recordLatency;
+    std::uint64_t recordBytes = 0;
+
+    [[nodiscard]] const k2::Histogram &latency() const
+    { return summary.latency.count() ? summary.latency : recordLatency; }
+
+    [[nodiscard]] double megabytesPerSecond() const
+    {
+        const auto bytes = summary.bytes ? summary.bytes : recordBytes;
+        return summary.wallTimeNs ? static_cast<double>(bytes) * 1000.0 / summary.wallTimeNs : 0.0;
+    }
+
+    /**
+     * @return Requests that completed after their deadline in percent of all requests
+     */
+    [[nodiscard]] double missRate() const
+    { return summary.requests ? 100.0 * summary.deadlineMisses / summary.requests : 0.0; }
+};
+
+struct RunStats
+{
+    std::string path;
+    workload::RunInfo run;
+    std::vector<GroupStats> groups;
+    std::uint64_t records = 0;
+};
+
+/**
+ * @brief Streams a result file section by section, so memory use does not depend on the number of records
+ */
+int loadRun(const std::string &path, RunStats &stats)
+{
+    workload::ResultReader reader;
+    int ret = reader.open(path);
+    if (ret) {
+        return ret;
+    }
+    stats.path = path;
+    std::map<std::uint16_t, GroupStats> groups;
+    workload::ResultReader::Section section;
+    while (!ret && reader.next(section)) {
+        switch (section.type) {
+            case workload::ResultSection::Run:
+                ret = workload::ResultReader::parseRun(section, stats.run);
+                break;
+            case workload::ResultSection::Group: {
+                workload::GroupSummary summary;
+                ret = workload::ResultReader::parseGroup(section, summary);
+                GroupStats &group = groups[summary.index];
+                group.summary = std::move(summary);
+                group.summarized = true;
+                break;
+            }
+            case workload::ResultSection::Records: {
+                std::size_t count = 0;
+                const auto *records = workload::ResultReader::records(section, count);
+                for (std::size_t i = 0; i < count; i++) {
+                    GroupStats &group = groups[records[i].stream];
+                    if (records[i].result >= 0) {
+                        group.recordLatency.record(
+                                static_cast<std::uint64_t>(records[i].completeNs - records[i].submitNs));
+                        group.recordBytes += static_cast<std::uint64_t>(records[i].result);
+                    }
+                }
+                stats.records += count;
+                break;
+            }
+            default:
+                // Sections of newer writers are skipped
+                break;
+        }
+        reader.release();
+    }
+    for (auto &[index, group]: groups) {
+        if (group.summarized) {
+            stats.groups.push_back(std::move(group));
+        }
+    }
+    return ret;
+}
+
+/**
+ * @return Relative change from baseline to candidate in percent, 0 if there is no baseline
+ */
+double delta(const double baseline, const double candidate)
+{
+    return baseline != 0 ? (candidate - baseline) * 100.0 / baseline : 0.0;
+}
+
+void printRow(const std::string &group, const std::string &metric, const double baseline, const double candidate,
+              const double change, const bool regression)
+{
+    std::cout << std::left << std::setw(16) << group << std::setw(14) << metric << std::right << std::fixed
+              << std::setprecision(2) << std::setw(14) << baseline << std::setw(14) << candidate << std::setw(10)
+              << std::showpos << change << std::noshowpos << (regression ? "  REGRESSION" : "") << std::endl;
+}
+
+/**
+ * @brief Compares benchmark result files written by k2-profile --result
+ * @details The first file is the baseline, every further file is compared against it group by group: latency
+ * percentiles, deadline miss rate and throughput. Latencies of groups without a stored histogram, e.g. background
+ * groups, are recomputed from the request records. Exits with 2 if any candidate regressed beyond the thresholds.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-compare", "0.1");
+
+    program.add_argument("results")
+            .remaining()
+            .help("result files, the first one is the baseline");
+
+    program.add_argument("--threshold", "-t")
+            .scan<'g', double>()
+            .default_value(10.0)
+            .help("flag latency increases and throughput drops beyond this many percent");
+
+    program.add_argument("--miss-threshold")
+            .scan<'g', double>()
+            .default_value(1.0)
+            .help("flag deadline miss rates that grow by more than this many percentage points");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto paths = program.present<std::vector<std::string>>("results").value_or(std::vector<std::string>{});
+    if (paths.size() < 2) {
+        std::cerr << "A baseline and at least one result file to compare are required" << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+    const double threshold = program.get<double>("--threshold");
+    const double missThreshold = program.get<double>("--miss-threshold");
+
+    RunStats baseline;
+    int ret = loadRun(paths[0], baseline);
+    if (ret) {
+        std::cerr << "Could not read " << paths[0] << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+
+    bool regressed = false;
+    for (std::size_t i = 1; i < paths.size(); i++) {
+        RunStats candidate;
+        ret = loadRun(paths[i], candidate);
+        if (ret) {
+            std::cerr << "Could not read " << paths[i] << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+
+        std::cout << "Baseline  " << baseline.path << " (" << baseline.run.label << ", " << baseline.run.profile
+                  << ", " << baseline.records << " records)" << std::endl;
+        std::cout << "Candidate " << candidate.path << " (" << candidate.run.label << ", " << candidate.run.profile
+                  << ", " << candidate.records << " records)" << std::endl;
+        std::cout << std::left << std::setw(16) << "group" << std::setw(14) << "metric" << std::right
+                  << std::setw(14) << "baseline" << std::setw(14) << "candidate" << std::setw(10) << "delta %"
+                  << std::endl;
+
+        for (const auto &base: baseline.groups) {
+            const GroupStats *match = nullptr;
+            for (const auto &group: candidate.groups) {
+                if (group.summary.name == base.summary.name) {
+                    match = &group;
+                }
+            }
+            if (match == nullptr) {
+                std::cout << std::left << std::setw(16) << base.summary.name << "missing in candidate"
+                          << std::endl;
+                continue;
+            }
+
+            for (const double percentile: {50.0, 99.0, 99.9}) {
+                if (base.latency().count() == 0 || match->latency().count() == 0) {
+                    break;
+                }
+                const double before = base.latency().percentile(percentile) / 1000.0;
+                const double after = match->latency().percentile(percentile) / 1000.0;
+                const double change = delta(before, after);
+                const bool regression = change > threshold;
+                std::ostringstream metric;
+                metric << "p" << percentile << " [us]";
+                printRow(base.summary.name, metric.str(), before, after, change, regression);
+                regressed = regressed || regression;
+            }
+            if (base.summary.foreground) {
+                const bool regression = match->missRate() - base.missRate() > missThreshold;
+                printRow(base.summary.name, "misses [%]", base.missRate(), match->missRate(),
+                         delta(base.missRate(), match->missRate()), regression);
+                regressed = regressed || regression;
+            }
+            const double change = delta(base.megabytesPerSecond(), match->megabytesPerSecond());
+            const bool regression = -change > threshold;
+            printRow(base.summary.name, "MB/s", base.megabytesPerSecond(), match->megabytesPerSecond(), change,
+                     regression);
+            regressed = regressed || regression;
+        }
+        std::cout << std::endl;
+    }
+    return regressed ? 2 : 0;
+}
@@ -1,8 +1,10 @@
 #include <array>
 #include <iostream>
+#include <fstream>
 #include <csignal>
 #include <cstring>
 #include <thread>
+#include <vector>
 
 using namespace std::chrono_literals;
 
@@ -14,8 +16,21 @@ extern "C" {
 #include <sched.h>
 }
 
+#include <argparse/argparse.hpp>
+
 #include "libk2/libk2.hpp"
+#include "libk2/control.hpp"
+#include "libk2/bufferpool.hpp"
+#include "libk2/histogram.hpp"
+#include "libk2/ioengine.hpp"
+#include "libk2/offsets.hpp"
 #include "libk2/ionice.hpp"
+#include "libk2/metrics.hpp"
+#include "libk2/periodic.hpp"
+#include "libk2/requestlog.hpp"
+#include "libk2/results.hpp"
+#include "libk2/topology.hpp"
+#include "libk2/workerpool.hpp"
 
 void assignThisProcessToCore(int coreId) {
     cpu_set_t mask;
@@ -24,20 +39,104 @@ void assignThisProcessToCore(int coreId) {
     sched_setaffinity(0, sizeof(mask), &mask);
 }
 
+enum class OutputFormat {
+    Human,
+    Json,
+    Csv
+};
+
+struct BenchmarkConfig {
+    std::string label;
+    std::string device;
+    std::string path;
+    std::size_t blockSize = 64 * 1024;
+    std::size_t backgroundBlockSize = 4 * 1024 * 1024;
+    std::int64_t intervalNs = 10 * 1000 * 1000; // Like k2 paper
+    std::size_t iterations = 512;
+    std::size_t backgroundProcesses = 3;
+    workload::StreamKind backgroundKind = workload::StreamKind::Process;
+    workload::IoPattern backgroundPattern = workload::IoPattern::Write;
+    unsigned backgroundReadPercent = 50;
+    double backgroundIops = 0;
+    double backgroundMBps = 0;
+    ionice::IoClass backgroundClass = ionice::IoClass::RealTime;
+    ionice::IoLevel backgroundLevel = ionice::IoLevel::L1;
+    std::vector<int> backgroundCpus;
+    k2::PlacementPolicy placement = k2::PlacementPolicy::Local;
+    bool placementFallback = false;
+    int realtimeCpu = -1;
+    std::uint64_t size = 0;
+    std::vector<std::string> backgroundPaths;
+    std::uint64_t backgroundOffset = 0;
+    workload::OffsetOptions backgroundOffsets;
+    workload::EngineOptions engine;
+    unsigned rtQueueDepth = 1;
+    workload::WaitMode wait = workload::WaitMode::Sleep;
+    std::int64_t spinNs = 0;
+    bool skipMissed = false;
+    std::chrono::microseconds backgroundThinkTime = 2ms;
+    bool hugePages = false;
+    bool lockBuffers = false;
+    bool registerWithK2 = true;
+    std::optional<std::string> k2Socket;
+    std::optional<std::string> tracePath;
+    std::optional<std::string> metricsAddress;
+    OutputFormat output = OutputFormat::Human;
+};
+
+struct BenchmarkResult {
+    k2::Histogram latency;
+    workload::PeriodicStats periodic;
+    std::uint64_t deadlineMisses = 0;
+    std::uint64_t errors = 0;
+    std::int64_t wallTimeNs = 0;
+    std::uint64_t backgroundRequests = 0;
+    std::uint64_t backgroundBytes = 0;
+    std::uint64_t backgroundErrors = 0;
+    bool registered = false;
+    std::string scheduler;
+};
+
 // Global variables <3
-const std::string disk("nvme0n1");
-int fd = 0;
-void *buffer = nullptr;
-constexpr std::size_t NUM_BACKGROUND_PROCESSES = 3;
-std::array<pid_t, NUM_BACKGROUND_PROCESSES> backgroundProcessPids;
-bool childTerminate = false;
+BenchmarkConfig config;
+std::unique_ptr<workload::WorkerPool> backgroundPool;
+std::unique_ptr<workload::RequestCollector> requestCollector;
+std::unique_ptr<k2::MetricsServer> metricsServer;
+int metricsSource = 0;
+volatile std::sig_atomic_t registeredWithK2 = false;
+
+
+/**
+ * @brief Registers through the k2-register-task daemon if a socket is configured, which then also unregisters the
+ * task if this process dies without cleaning up
+ */
+k2::Result registerWithK2(const pid_t pid) {
+    if (config.k2Socket) {
+        k2::ControlClient client(*config.k2Socket);
+        return client.isOpen() ? client.registerTask(config.device, pid, config.intervalNs) : client.error();
+    }
+    return k2::registerTask(config.device, pid, config.intervalNs);
+}
 
+k2::Result unregisterWithK2(const pid_t pid) {
+    if (config.k2Socket) {
+        k2::ControlClient client(*config.k2Socket);
+        return client.isOpen() ? client.unregisterTask(config.device, pid) : client.error();
+    }
+    return k2::unregisterTask(config.device, pid);
+}
 
 void terminate() {
     std::cerr << "Process terminating gracefully" << std::endl;
-    k2::unregisterAllTasks(disk);
-    if (buffer != nullptr) {
-        free(buffer);
+    if (backgroundPool) {
+        backgroundPool->requestStop();
+    }
+    // Only drop our own registration, other tasks on the device belong to other tenants
+    if (registeredWithK2) {
+        const k2::Result result = unregisterWithK2(getpid());
+        if (!result) {
+            std::cerr << result << std::endl;
+        }
     }
     exit(-1);
 }
@@ -46,140 +145,734 @@ void mainSignalHandler(int signal) {
     terminate();
 }
 
-void childSignalHandler(int signal) {
-    childTerminate = true;
+/**
+ * @return The offset of the next request of size bs, wrapping around to the start of the target once the configured
+ * size is reached
+ */
+off_t nextOffset(off_t &offset, std::size_t bs) {
+    if (config.size && offset + bs > config.size) {
+        offset = 0;
+    }
+    const off_t current = offset;
+    offset += static_cast<off_t>(bs);
+    return current;
 }
 
-void backgroundLoad(std::size_t index) {
-    std::signal(SIGINT, childSignalHandler);
-    std::signal(SIGTERM, childSignalHandler);
-
-    // Set own process name work background tasks
-    std::string processName = "k2-app-" + std::to_string(index);
-    prctl(PR_SET_NAME, processName.c_str());
+/**
+ * @brief Creates an engine of the configured type with queueDepth slots, backed by one pool buffer of size bs each
+ */
+std::unique_ptr<workload::IoEngine> openEngine(unsigned queueDepth, std::size_t bs, workload::BufferPool &pool,
+                                               bool lock) {
+    workload::EngineOptions options = config.engine;
+    options.queueDepth = options.type == workload::EngineType::Uring ? std::max(queueDepth, 1U) : 1;
+    auto engine = workload::makeEngine(options);
+    if (!engine) {
+        std::cerr << "Unsupported I/O engine" << std::endl;
+        return nullptr;
+    }
+    int err = engine->open(config.path, workload::isDeviceTarget(config.path) ? 0 : O_CREAT);
+    if (err) {
+        std::cerr << "Could not open " << config.path << " with " << workload::toString(options.type) << ": "
+                  << strerror(err) << std::endl;
+        return nullptr;
+    }
 
-    // Set the first worker to best effort scheduling, the rest to realtime scheduling of different priority value
-    int err = ionice::ioPrioSet(ionice::IoClass::RealTime, ionice::IoLevel::L1);
+    workload::BufferPoolOptions poolOptions;
+    poolOptions.bufferSize = bs;
+    poolOptions.count = engine->queueDepth();
+    poolOptions.hugePages = config.hugePages;
+    poolOptions.lock = lock;
+    err = pool.allocate(poolOptions);
+    if (err) {
+        std::cerr << "Could not allocate " << (lock ? "locked " : "") << "buffers: " << strerror(err) << std::endl;
+        return nullptr;
+    }
+    err = engine->registerBuffers(pool.iovecs());
     if (err) {
-        std::cerr << "Could not set background task priority: " << strerror(err) << std::endl;
+        std::cerr << "Could not register buffers: " << strerror(err) << std::endl;
+        return nullptr;
+    }
+    return engine;
+}
+
+/**
+ * @return One background stream per configured process or thread, pinned round robin to config.backgroundCpus
+ */
+std::vector<workload::StreamConfig> backgroundStreams() {
+    std::vector<workload::StreamConfig> streams;
+    for (std::size_t i = 0; i < config.backgroundProcesses; i++) {
+        workload::StreamConfig stream;
+        stream.name = "k2-app-" + std::to_string(i);
+        stream.kind = config.backgroundKind;
+        stream.path = config.backgroundPaths.empty() ? config.path
+                                                     : config.backgroundPaths[i % config.backgroundPaths.size()];
+        stream.engine = config.engine;
+        stream.blockSize = config.backgroundBlockSize;
+        stream.pattern = config.backgroundPattern;
+        stream.readPercent = config.backgroundReadPercent;
+        stream.offset = config.backgroundOffset;
+        stream.size = config.size;
+        stream.offsets = config.backgroundOffsets;
+        stream.setIoPrio = true;
+        stream.ioClass = config.backgroundClass;
+        stream.ioLevel = config.backgroundLevel;
+        if (!config.backgroundCpus.empty()) {
+            stream.cpu = config.backgroundCpus[i % config.backgroundCpus.size()];
+        }
+        stream.targetIops = config.backgroundIops;
+        stream.targetMBps = config.backgroundMBps;
+        stream.thinkTime = config.backgroundThinkTime;
+        stream.collector = requestCollector.get();
+        stream.collectorStream = static_cast<std::uint16_t>(i + 1);
+        streams.push_back(std::move(stream));
     }
-    assignThisProcessToCore((index % (std::thread::hardware_concurrency() - 1)) + 1);
+    return streams;
+}
 
-    ionice::IoClass ioClass;
-    ionice::IoLevel ioLevel;
-    err = ioPrioGet(ioClass, ioLevel);
-    if (!err) {
-        std::cout << "New prio class: " << ioClass << ", level: " << ioLevel << std::endl;
+/**
+ * @brief Publishes the request latencies of the real-time task (stream 0) and the background thread streams
+ */
+void writeWorkloadMetrics(k2::MetricsWriter &writer) {
+    writer.family("k2_workload_request_duration_seconds", "histogram", "Completion latency of workload requests.");
+    writer.histogram("k2_workload_request_duration_seconds",
+                     k2::metricsLabel("stream", "realtime") + "," + k2::metricsLabel("role", "foreground"),
+                     requestCollector->streamLatency(0));
+    for (std::size_t i = 0; i < config.backgroundProcesses; i++) {
+        writer.histogram("k2_workload_request_duration_seconds",
+                         k2::metricsLabel("stream", "k2-app-" + std::to_string(i)) + "," +
+                         k2::metricsLabel("role", "background"),
+                         requestCollector->streamLatency(static_cast<std::uint16_t>(i + 1)));
     }
+    writer.family("k2_workload_requests_dropped_total", "counter", "Requests the collector could not keep up with.");
+    writer.sample("k2_workload_requests_dropped_total", {}, requestCollector->dropped());
+}
 
-    const std::size_t bs = 1024 << 12; // 4M
-    void *childBuffer = malloc(bs);
-    memset(childBuffer, 0, bs);
-    ssize_t ret = 0;
+/**
+ * @return The path of a block device name like nvme0n1, paths are returned as they are
+ */
+std::string devicePath(const std::string &device) {
+    return device.find('/') == std::string::npos ? "/dev/" + device : device;
+}
 
-    goto newRun;
+/**
+ * @brief Chooses the CPU of the real-time task and, unless given explicitly, those of the background streams from
+ * the CPU topology and the hardware queues of the device
+ * @details Without any topology of the device, local and remote would only pretend to know better, so the placement
+ * falls back to sequential.
+ */
+void placeWorkers() {
+    const auto device = k2::readDeviceTopology(config.device);
+    if (config.placement != k2::PlacementPolicy::Sequential && device.empty()) {
+        std::cerr << "No topology found for " << config.device << ", falling back to sequential placement"
+                  << std::endl;
+        config.placement = k2::PlacementPolicy::Sequential;
+        config.placementFallback = true;
+    }
+    const auto placement = k2::placeWorkers(k2::readCpuTopology(), device, config.placement);
+    config.realtimeCpu = placement.realtimeCpu;
+    if (config.backgroundCpus.empty()) {
+        config.backgroundCpus = placement.backgroundCpus;
+    }
+}
 
-    reRun:
-    close(fd);
+/**
+ * @brief Issues config.iterations periods of requests at absolute deadlines and records the latency of each request
+ * @details The loop is open: release i happens at start + i * interval regardless of how long earlier periods took,
+ * so the issue rate matches the interval registered with k2. A request completing after the next release missed its
+ * deadline.
+ */
+void realtimeLoad(BenchmarkResult &result) {
+    workload::BufferPool pool;
+    auto engine = openEngine(config.rtQueueDepth, config.blockSize, pool, config.lockBuffers);
+    if (!engine) {
+        terminate();
+    }
 
-    newRun:
-    int f = open(("/dev/" + disk).c_str(), O_RDWR | O_SYNC);
-    if (f < 0) {
-        std::cout << "Could not open raw device file" << std::endl;
-    } else {
-        while (!childTerminate) {
-            ret = write(f, childBuffer, bs);
-            if (ret < 0) {
-                if (errno == ENOSPC) {
-                    // We reached the end of the test device, start over again
-                    std::cerr << "Background process " << index << ": Device full, restarting" << std::endl;
-                    goto reRun;
+    workload::PeriodicOptions options;
+    options.periodNs = config.intervalNs;
+    options.wait = config.wait;
+    options.spinNs = config.spinNs;
+    options.skipMissed = config.skipMissed;
+    workload::PeriodicIssuer issuer(options);
+    int ret = issuer.start();
+    if (ret) {
+        std::cerr << "Could not start periodic issuer: " << strerror(ret) << std::endl;
+        terminate();
+    }
+
+    const unsigned requestsPerPeriod = engine->queueDepth();
+    std::vector<workload::RequestRecord> records(requestsPerPeriod);
+    workload::RequestRing *ring = requestCollector ? requestCollector->attach(0) : nullptr;
+    const auto pid = static_cast<std::int32_t>(getpid());
+    std::vector<workload::IoCompletion> completions;
+    completions.reserve(requestsPerPeriod);
+    off_t offset = 0;
+
+    const auto start = workload::PeriodicIssuer::nowNs();
+    for (std::size_t i = 0; i < config.iterations; i++) {
+        ret = issuer.waitNext();
+        if (ret) {
+            std::cerr << "Waiting for the next period failed: " << strerror(ret) << std::endl;
+            terminate();
+        }
+
+        for (unsigned slot = 0; slot < requestsPerPeriod; slot++) {
+            workload::IoRequest request;
+            request.buffer = pool.buffer(slot);
+            request.length = config.blockSize;
+            request.offset = nextOffset(offset, config.blockSize);
+            request.bufferIndex = static_cast<int>(slot);
+            request.userData = slot;
+            records[slot].offset = static_cast<std::uint64_t>(request.offset);
+            records[slot].length = static_cast<std::uint32_t>(request.length);
+            records[slot].direction = 1;
+            records[slot].submitNs = workload::PeriodicIssuer::nowNs();
+            if (engine->submit(request)) {
+                result.errors++;
+            }
+        }
+
+        std::int64_t complete = workload::PeriodicIssuer::nowNs();
+        while (engine->inFlight() > 0) {
+            completions.clear();
+            if (engine->reap(completions, 1)) {
+                result.errors += engine->inFlight();
+                break;
+            }
+            complete = workload::PeriodicIssuer::nowNs();
+            for (const auto &completion: completions) {
+                workload::RequestRecord &record = records[completion.userData];
+                if (ring) {
+                    record.completeNs = complete;
+                    record.result = static_cast<std::int32_t>(completion.result);
+                    record.pid = pid;
+                    ring->push(record);
+                }
+                if (completion.result < 0) {
+                    result.errors++;
+                    if (completion.result == -ENOSPC) {
+                        offset = 0;
+                    }
+                } else {
+                    result.latency.record(complete - record.submitNs);
+                }
+                if (complete > issuer.deadlineNs()) {
+                    result.deadlineMisses++;
                 }
-                std::cerr << "Error on child write " << ret << " " << std::strerror(errno) << std::endl;
-                exit(errno);
             }
-            std::this_thread::sleep_for(2ms);
         }
+        issuer.complete(complete);
     }
-    close(fd);
-    free(childBuffer);
+    result.wallTimeNs = workload::PeriodicIssuer::nowNs() - start;
+    result.periodic = issuer.stats();
+
+    engine.reset();
+}
+
+void printHuman(const BenchmarkResult &result) {
+    const auto &h = result.latency;
+    std::cout << "Run " << (config.label.empty() ? "<unlabeled>" : config.label) << " on " << config.path
+              << " (scheduler " << (result.scheduler.empty() ? "n/a" : result.scheduler)
+              << ", k2 " << (result.registered ? "registered" : "not registered") << ")" << std::endl;
+    std::cout << "  requests:        " << h.count() << " x " << (config.blockSize >> 10) << " KiByte, "
+              << result.errors << " errors" << std::endl;
+    std::cout << "  background:      " << config.backgroundProcesses << " "
+              << (config.backgroundKind == workload::StreamKind::Thread ? "threads" : "processes") << " x "
+              << (config.backgroundBlockSize >> 10) << " KiByte " << workload::toString(config.backgroundPattern)
+              << " (" << workload::toString(config.backgroundOffsets.pattern) << ")"
+              << (config.backgroundPaths.empty() ? "" : " on " + std::to_string(config.backgroundPaths.size())
+                                                        + " targets")
+              << ", queue depth " << config.engine.queueDepth << ", " << result.backgroundRequests << " requests, "
+              << (result.wallTimeNs ? result.backgroundBytes * 1000.0 / result.wallTimeNs : 0.0) << " MB/s, "
+              << result.backgroundErrors << " errors" << std::endl;
+    std::cout << "  placement:       " << k2::toString(config.placement)
+              << (config.placementFallback ? " (no topology for " + config.device + ")" : "")
+              << ", real-time CPU " << config.realtimeCpu
+              << ", background CPUs "
+              << (config.backgroundCpus.empty() ? "any" : k2::formatCpuList(config.backgroundCpus)) << std::endl;
+    std::cout << "  engine:          " << workload::toString(config.engine.type)
+              << (config.engine.direct ? " (O_DIRECT)" : "") << ", " << config.rtQueueDepth
+              << " request(s) per period" << std::endl;
+    std::cout << "  latency [us]:    min " << h.min() / 1000.0 << ", mean " << h.mean() / 1000.0
+              << ", p50 " << h.percentile(50) / 1000.0 << ", p99 " << h.percentile(99) / 1000.0
+              << ", p99.9 " << h.percentile(99.9) / 1000.0 << ", max " << h.max() / 1000.0 << std::endl;
+    std::cout << "  deadline misses: " << result.deadlineMisses << " (interval " << config.intervalNs << " ns)"
+              << std::endl;
+    const auto &p = result.periodic;
+    std::cout << "  periods:         " << p.periods << ", " << p.overruns << " overruns, " << p.skipped
+              << " skipped, " << (result.wallTimeNs ? p.periods * 1e9 / result.wallTimeNs : 0.0) << " per s ("
+              << workload::toString(config.wait) << (config.spinNs ? " + spin" : "") << ")" << std::endl;
+    std::cout << "  jitter [us]:     p50 " << p.releaseJitter.percentile(50) / 1000.0 << ", p99 "
+              << p.releaseJitter.percentile(99) / 1000.0 << ", max " << p.releaseJitter.max() / 1000.0 << std::endl;
+    std::cout << "  completion [us]: p50 " << p.completion.percentile(50) / 1000.0 << ", p99 "
+              << p.completion.percentile(99) / 1000.0 << ", max " << p.completion.max() / 1000.0
+              << " after release, max " << p.lateness.max() / 1000.0 << " past deadline" << std::endl;
+    std::cout << "  main loop took:  " << result.wallTimeNs / 1000000 << " ms" << std::endl;
+}
+
+void printJson(const BenchmarkResult &result) {
+    const auto &h = result.latency;
+    const auto &p = result.periodic;
+    std::cout << "{\"label\":" << workload::jsonString(config.label) << ",\"device\":"
+              << workload::jsonString(config.path) << ",\"scheduler\":" << workload::jsonString(result.scheduler)
+              << ",\"k2_registered\":"
+              << (result.registered ? "true" : "false") << ",\"block_size\":" << config.blockSize
+              << ",\"interval_ns\":" << config.intervalNs << ",\"iterations\":" << config.iterations
+              << ",\"background_processes\":" << config.backgroundProcesses
+              << ",\"background_block_size\":" << config.backgroundBlockSize
+              << ",\"background_mode\":\""
+              << (config.backgroundKind == workload::StreamKind::Thread ? "thread" : "process")
+              << "\",\"background_pattern\":\"" << workload::toString(config.backgroundPattern)
+              << "\",\"background_offsets\":\"" << workload::toString(config.backgroundOffsets.pattern)
+              << "\",\"background_requests\":" << result.backgroundRequests
+              << ",\"background_bytes\":" << result.backgroundBytes
+              << ",\"background_errors\":" << result.backgroundErrors
+              << ",\"engine\":\"" << workload::toString(config.engine.type)
+              << "\",\"direct\":" << (config.engine.direct ? "true" : "false")
+              << ",\"queue_depth\":" << config.engine.queueDepth << ",\"rt_queue_depth\":" << config.rtQueueDepth
+              << ",\"placement\":\"" << k2::toString(config.placement) << "\",\"rt_cpu\":" << config.realtimeCpu
+              << ",\"requests\":" << h.count()
+              << ",\"errors\":" << result.errors << ",\"deadline_misses\":" << result.deadlineMisses
+              << ",\"wait\":\"" << workload::toString(config.wait) << "\",\"spin_ns\":" << config.spinNs
+              << ",\"periods\":" << p.periods << ",\"overruns\":" << p.overruns << ",\"skipped\":" << p.skipped
+              << ",\"jitter_ns\":{\"p50\":" << p.releaseJitter.percentile(50) << ",\"p99\":"
+              << p.releaseJitter.percentile(99) << ",\"max\":" << p.releaseJitter.max()
+              << "},\"completion_ns\":{\"p50\":" << p.completion.percentile(50) << ",\"p99\":"
+              << p.completion.percentile(99) << ",\"max\":" << p.completion.max() << "},\"max_lateness_ns\":"
+              << p.lateness.max()
+              << ",\"wall_time_ns\":" << result.wallTimeNs << ",\"latency_ns\":{\"min\":" << h.min()
+              << ",\"mean\":" << h.mean() << ",\"p50\":" << h.percentile(50) << ",\"p99\":" << h.percentile(99)
+              << ",\"p99.9\":" << h.percentile(99.9) << ",\"max\":" << h.max() << "}}" << std::endl;
 }
 
+void printCsv(const BenchmarkResult &result) {
+    const auto &h = result.latency;
+    const auto &p = result.periodic;
+    std::cout << "label,device,scheduler,k2_registered,block_size,interval_ns,iterations,background_processes,"
+                 "background_block_size,background_mode,background_pattern,background_offsets,background_requests,"
+                 "background_bytes,background_errors,engine,direct,queue_depth,rt_queue_depth,placement,rt_cpu,"
+                 "requests,errors,deadline_misses,"
+                 "wait,spin_ns,periods,overruns,skipped,jitter_p50_ns,jitter_p99_ns,jitter_max_ns,completion_p99_ns,"
+                 "max_lateness_ns,wall_time_ns,min_ns,mean_ns,p50_ns,p99_ns,"
+                 "p999_ns,max_ns" << std::endl;
+    std::cout << workload::csvField(config.label) << "," << workload::csvField(config.path) << ","
+              << workload::csvField(result.scheduler) << "," << result.registered << ","
+              << config.blockSize << "," << config.intervalNs << "," << config.iterations << ","
+              << config.backgroundProcesses << "," << config.backgroundBlockSize << ","
+              << (config.backgroundKind == workload::StreamKind::Thread ? "thread" : "process") << ","
+              << workload::toString(config.backgroundPattern) << ","
+              << workload::toString(config.backgroundOffsets.pattern) << "," << result.backgroundRequests << ","
+              << result.backgroundBytes << "," << result.backgroundErrors << ","
+              << workload::toString(config.engine.type) << "," << config.engine.direct << ","
+              << config.engine.queueDepth << ","
+              << config.rtQueueDepth << "," << k2::toString(config.placement) << "," << config.realtimeCpu << ","
+              << h.count() << ","
+              << result.errors << "," << result.deadlineMisses << "," << workload::toString(config.wait) << ","
+              << config.spinNs << "," << p.periods << "," << p.overruns << "," << p.skipped << ","
+              << p.releaseJitter.percentile(50) << "," << p.releaseJitter.percentile(99) << ","
+              << p.releaseJitter.max() << "," << p.completion.percentile(99) << "," << p.lateness.max() << ","
+              << result.wallTimeNs << "," << h.min() << ","
+              << h.mean() << "," << h.percentile(50) << "," << h.percentile(99) << "," << h.percentile(99.9) << ","
+              << h.max() << std::endl;
+}
 
 int main(int argc, char **argv) {
-    for (std::size_t i = 0; i < NUM_BACKGROUND_PROCESSES; i++) {
-        const pid_t forkPid = fork();
-        if (forkPid < 0) {
-            std::cerr << "Fork failed" << std::endl;
+    argparse::ArgumentParser program("k2-example", "0.1");
+
+    program.add_argument("--device", "-d")
+            .default_value(std::string{"nvme0n1"})
+            .help("block device name (e.g. nvme0n1) or path to a device or regular file to benchmark");
+
+    program.add_argument("--block-size", "-b")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{64})
+            .help("size of the real-time requests in KiB");
+
+    program.add_argument("--interval", "-i")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{10 * 1000 * 1000})
+            .help("period of the real-time requests in ns, also registered with k2");
+
+    program.add_argument("--iterations", "-n")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{512})
+            .help("number of real-time requests");
+
+    program.add_argument("--background", "-j")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{3})
+            .help("number of background load streams");
+
+    program.add_argument("--background-mode")
+            .default_value(std::string{"process"})
+            .help("run background streams as thread or process");
+
+    program.add_argument("--background-pattern")
+            .default_value(std::string{"write"})
+            .help("background I/O pattern: read, write or mixed");
+
+    program.add_argument("--background-read-percent")
+            .scan<'i', unsigned>()
+            .default_value(50U)
+            .help("share of reads of the mixed background pattern");
+
+    program.add_argument("--background-iops")
+            .scan<'g', double>()
+            .default_value(0.0)
+            .help("rate limit per background stream in IOPS, 0 for unlimited");
+
+    program.add_argument("--background-mbps")
+            .scan<'g', double>()
+            .default_value(0.0)
+            .help("rate limit per background stream in MB/s, 0 for unlimited");
+
+    program.add_argument("--background-class")
+            .default_value(std::string{"realtime"})
+            .help("I/O priority class of the background streams: none, realtime, best-effort or idle");
+
+    program.add_argument("--background-level")
+            .scan<'i', int>()
+            .default_value(1)
+            .help("I/O priority level of the background streams (0-7)");
+
+    program.add_argument("--background-cpus")
+            .help("CPU list like 2-7,10 to pin the background streams to round robin");
+
+    program.add_argument("--placement")
+            .default_value(std::string{"local"})
+            .help("CPU placement of the real-time task and background streams: sequential (real-time on the first "
+                  "CPU), local (real-time on a device local CPU without loaded SMT sibling) or remote (local, with "
+                  "background load on other NUMA nodes first)");
+
+    program.add_argument("--background-devices")
+            .help("comma separated devices or files the background streams are spread over round robin, defaults "
+                  "to --device");
+
+    program.add_argument("--background-offsets")
+            .default_value(std::string{"sequential"})
+            .help("background offset pattern: sequential, uniform, zipfian or hotcold");
+
+    program.add_argument("--background-offset")
+            .scan<'i', std::uint64_t>()
+            .default_value(std::uint64_t{0})
+            .help("start of the range the background streams work on in MiB");
+
+    program.add_argument("--zipf-theta")
+            .scan<'g', double>()
+            .default_value(0.99)
+            .help("skew of the zipfian background offsets");
+
+    program.add_argument("--hot-range-percent")
+            .scan<'i', unsigned>()
+            .default_value(20U)
+            .help("size of the hot region of hotcold background offsets in percent of the range");
+
+    program.add_argument("--hot-access-percent")
+            .scan<'i', unsigned>()
+            .default_value(80U)
+            .help("share of hotcold background requests that go to the hot region in percent");
+
+    program.add_argument("--background-block-size")
+            .scan<'i', std::size_t>()
+            .default_value(std::size_t{4096})
+            .help("size of the background requests in KiB");
+
+    program.add_argument("--size", "-s")
+            .scan<'i', std::uint64_t>()
+            .default_value(std::uint64_t{0})
+            .help("wrap around after this many MiB, 0 to write until the end of the device; random background "
+                  "offsets cover the whole device then");
+
+    program.add_argument("--engine", "-e")
+            .default_value(std::string{"sync"})
+            .help("I/O engine: sync (O_SYNC pwrite), direct (O_DIRECT pwrite) or io_uring");
+
+    program.add_argument("--direct")
+            .default_value(false)
+            .implicit_value(true)
+            .help("open the target with O_DIRECT to bypass the page cache, implied by --engine direct");
+
+    program.add_argument("--hugepages")
+            .default_value(false)
+            .implicit_value(true)
+            .help("back the I/O buffers with huge pages");
+
+    program.add_argument("--mlock")
+            .default_value(false)
+            .implicit_value(true)
+            .help("lock the real-time task's I/O buffers into memory");
+
+    program.add_argument("--queue-depth", "-q")
+            .scan<'i', unsigned>()
+            .default_value(1U)
+            .help("requests in flight per background process (io_uring only)");
+
+    program.add_argument("--rt-queue-depth")
+            .scan<'i', unsigned>()
+            .default_value(1U)
+            .help("requests issued together per real-time period (io_uring only)");
+
+    program.add_argument("--wait")
+            .default_value(std::string{"sleep"})
+            .help("how the real-time task waits for the next period: sleep or timerfd");
+
+    program.add_argument("--spin")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{0})
+            .help("busy poll the last us before every release");
+
+    program.add_argument("--skip-missed")
+            .default_value(false)
+            .implicit_value(true)
+            .help("drop periods that are already a full interval late instead of catching up");
+
+    program.add_argument("--registered-buffers")
+            .default_value(false)
+            .implicit_value(true)
+            .help("register the I/O buffers with io_uring");
+
+    program.add_argument("--fixed-files")
+            .default_value(false)
+            .implicit_value(true)
+            .help("register the target file with io_uring");
+
+    program.add_argument("--background-think-time")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{2000})
+            .help("pause of the background processes between completions in us");
+
+    program.add_argument("--no-k2")
+            .default_value(false)
+            .implicit_value(true)
+            .help("do not register the real-time task with k2, e.g. to benchmark other schedulers");
+
+    program.add_argument("--k2-socket")
+            .help("register through the k2-register-task daemon on this socket, which unregisters the task even "
+                  "if the benchmark is killed");
+
+    program.add_argument("--trace")
+            .help("write every real-time and background thread request to this binary trace file");
+
+    program.add_argument("--metrics")
+            .help("serve k2 ioctl and request latency metrics for Prometheus on this address, host:port or a Unix "
+                  "socket path");
+
+    program.add_argument("--label", "-l")
+            .default_value(std::string{})
+            .help("name of this run in the report, e.g. the scheduler under test");
+
+    program.add_argument("--output", "-o")
+            .default_value(std::string{"human"})
+            .help("report format: human, json or csv");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto device = program.get<std::string>("--device");
+    config.path = devicePath(device);
+    config.device = device.substr(device.find_last_of('/') + 1);
+    if (const auto devices = program.present<std::string>("--background-devices")) {
+        std::size_t begin = 0;
+        while (begin < devices->size()) {
+            const auto end = std::min(devices->find(',', begin), devices->size());
+            config.backgroundPaths.push_back(devicePath(devices->substr(begin, end - begin)));
+            begin = end + 1;
+        }
+    }
+    config.backgroundOffsets.pattern = workload::offsetPatternToEnum(program.get<std::string>("--background-offsets"));
+    if (config.backgroundOffsets.pattern == workload::OffsetPattern::NA) {
+        std::cerr << "Unknown offset pattern " << program.get<std::string>("--background-offsets") << std::endl;
+        std::exit(1);
+    }
+    config.backgroundOffset = program.get<std::uint64_t>("--background-offset") << 20;
+    config.backgroundOffsets.zipfTheta = program.get<double>("--zipf-theta");
+    config.backgroundOffsets.hotRangePercent = std::min(program.get<unsigned>("--hot-range-percent"), 100U);
+    config.backgroundOffsets.hotAccessPercent = std::min(program.get<unsigned>("--hot-access-percent"), 100U);
+    config.blockSize = program.get<std::size_t>("--block-size") << 10;
+    config.intervalNs = program.get<std::int64_t>("--interval");
+    config.iterations = program.get<std::size_t>("--iterations");
+    config.backgroundProcesses = program.get<std::size_t>("--background");
+    config.backgroundBlockSize = program.get<std::size_t>("--background-block-size") << 10;
+    const auto mode = program.get<std::string>("--background-mode");
+    if (mode != "thread" && mode != "process") {
+        std::cerr << "Unknown background mode " << mode << std::endl;
+        std::exit(1);
+    }
+    config.backgroundKind = mode == "thread" ? workload::StreamKind::Thread : workload::StreamKind::Process;
+    config.backgroundPattern = workload::ioPatternToEnum(program.get<std::string>("--background-pattern"));
+    if (config.backgroundPattern == workload::IoPattern::NA) {
+        std::cerr << "Unknown background pattern " << program.get<std::string>("--background-pattern") << std::endl;
+        std::exit(1);
+    }
+    config.backgroundReadPercent = std::min(program.get<unsigned>("--background-read-percent"), 100U);
+    config.backgroundIops = program.get<double>("--background-iops");
+    config.backgroundMBps = program.get<double>("--background-mbps");
+    config.backgroundClass = ionice::ioClassToEnum(program.get<std::string>("--background-class"));
+    config.backgroundLevel = ionice::ioLevelToEnum(program.get<int>("--background-level"));
+    if (config.backgroundClass == ionice::IoClass::NA || config.backgroundLevel == ionice::IoLevel::NA) {
+        std::cerr << "Invalid background I/O priority" << std::endl;
+        std::exit(1);
+    }
+    if (const auto cpus = program.present<std::string>("--background-cpus")) {
+        if (!k2::parseCpuList(*cpus, config.backgroundCpus)) {
+            std::cerr << "Invalid CPU list " << *cpus << std::endl;
+            std::exit(1);
+        }
+    }
+    config.placement = k2::placementPolicyToEnum(program.get<std::string>("--placement"));
+    if (config.placement == k2::PlacementPolicy::NA) {
+        std::cerr << "Unknown placement policy " << program.get<std::string>("--placement") << std::endl;
+        std::exit(1);
+    }
+    placeWorkers();
+    config.size = program.get<std::uint64_t>("--size") << 20;
+    config.engine.type = workload::engineTypeToEnum(program.get<std::string>("--engine"));
+    if (config.engine.type == workload::EngineType::NA) {
+        std::cerr << "Unknown engine " << program.get<std::string>("--engine") << std::endl;
+        std::exit(1);
+    }
+    const bool uring = config.engine.type == workload::EngineType::Uring;
+    config.engine.queueDepth = uring ? std::max(program.get<unsigned>("--queue-depth"), 1U) : 1;
+    config.rtQueueDepth = uring ? std::max(program.get<unsigned>("--rt-queue-depth"), 1U) : 1;
+    config.wait = workload::waitModeToEnum(program.get<std::string>("--wait"));
+    if (config.wait == workload::WaitMode::NA) {
+        std::cerr << "Unknown wait mode " << program.get<std::string>("--wait") << std::endl;
+        std::exit(1);
+    }
+    config.spinNs = std::max(program.get<std::int64_t>("--spin"), std::int64_t{0}) * 1000;
+    config.skipMissed = program.get<bool>("--skip-missed");
+    config.engine.direct = program.get<bool>("--direct") || config.engine.type == workload::EngineType::Direct;
+    config.engine.registeredBuffers = program.get<bool>("--registered-buffers");
+    config.hugePages = program.get<bool>("--hugepages");
+    config.lockBuffers = program.get<bool>("--mlock");
+    config.engine.fixedFiles = program.get<bool>("--fixed-files");
+    config.backgroundThinkTime = std::chrono::microseconds(program.get<std::int64_t>("--background-think-time"));
+    config.registerWithK2 = !program.get<bool>("--no-k2");
+    config.k2Socket = program.present<std::string>("--k2-socket");
+    config.tracePath = program.present<std::string>("--trace");
+    config.metricsAddress = program.present<std::string>("--metrics");
+    config.label = program.get<std::string>("--label");
+
+    int ret = 0;
+    const auto output = program.get<std::string>("--output");
+    if (output == "json") {
+        config.output = OutputFormat::Json;
+    } else if (output == "csv") {
+        config.output = OutputFormat::Csv;
+    } else if (output == "human") {
+        config.output = OutputFormat::Human;
+    } else {
+        std::cerr << "Unknown output format " << output << std::endl;
+        std::exit(1);
+    }
+
+    if (config.tracePath || config.metricsAddress) {
+        workload::CollectorOptions options;
+        options.tracePath = config.tracePath.value_or("");
+        requestCollector = std::make_unique<workload::RequestCollector>(options);
+        ret = requestCollector->start();
+        if (ret) {
+            std::cerr << "Could not start the request collector: " << strerror(ret) << std::endl;
+            std::exit(1);
+        }
+    }
+
+    backgroundPool = std::make_unique<workload::WorkerPool>(backgroundStreams());
+    ret = backgroundPool->start();
+    if (ret) {
+        std::cerr << "Could not start background load: " << strerror(ret) << std::endl;
+        terminate();
+    }
+
+    // Started after the background processes are forked, so they do not inherit the listening socket
+    if (config.metricsAddress) {
+        k2::setMetricsEnabled(true);
+        metricsSource = k2::addMetricsSource(writeWorkloadMetrics);
+        metricsServer = std::make_unique<k2::MetricsServer>(*config.metricsAddress);
+        ret = metricsServer->start();
+        if (ret) {
+            std::cerr << "Could not serve metrics on " << *config.metricsAddress << ": " << strerror(ret)
+                      << std::endl;
             terminate();
-        } else if (forkPid == 0) {
-            // Child process
-            backgroundLoad(i);
-            return 0;
-        } else {
-            // Parent process
-            std::cout << "Starting background load on pid " << forkPid << std::endl;
-            backgroundProcessPids[i] = forkPid;
         }
     }
 
     const auto mainPid = getpid();
-    const auto interval = std::chrono::milliseconds(10); // Like k2 paper
-    const auto intervalNs = std::chrono::duration_cast<std::chrono::nanoseconds>(interval).count();
 
     std::signal(SIGINT, mainSignalHandler);
     std::signal(SIGTERM, mainSignalHandler);
 
     // Assign the highest possible priority to this process
-    int ret = ionice::ioPrioSet(ionice::IoClass::RealTime, ionice::IoLevel::L0);
+    ret = ionice::ioPrioSet(ionice::IoClass::RealTime, ionice::IoLevel::L0);
     if (ret) {
         std::cerr << "Could not set main workload IO prio " << strerror(ret) << std::endl;
         terminate();
     }
 
-    std::cout << "k2 version is " << k2::getVersion() << std::endl;
-    std::cout << "k2 is active on " << k2::getActiveDevices() << std::endl;
-    k2::registerTask(disk, mainPid, intervalNs);
+    BenchmarkResult result;
+    result.scheduler = k2::activeScheduler(config.device);
+
+    k2::Result k2Result{k2::Operation::RegisterTask};
+    if (config.registerWithK2) {
+        k2Result = registerWithK2(mainPid);
+        result.registered = k2Result.ok();
+        registeredWithK2 = result.registered;
+        if (!k2Result) {
+            std::cerr << k2Result << std::endl;
+        }
+    }
     // Lock to core
-    assignThisProcessToCore(0);
+    if (config.realtimeCpu >= 0) {
+        assignThisProcessToCore(config.realtimeCpu);
+    }
     // Assign higher process scheduling priority
     setpriority(PRIO_PROCESS, 0, -10);
 
-    // Allocate memory for buffer to write
-    std::size_t bs = 64 * 1024;// 64K;
-    if (argc == 2) {
-        char *tmp;
-        bs = strtoul(argv[1], &tmp, 10) << 10;
-    }
-    buffer = malloc(bs);
-    memset(buffer, 0, bs);
+    realtimeLoad(result);
 
-    fd = open(("/dev/" + disk).c_str(), O_RDWR | O_SYNC);
-    if (fd < 0) {
-        std::cout << "Could not open raw device file" << std::endl;
-    } else {
-        auto start = std::chrono::steady_clock::now();
-        for (std::size_t i = 0; i < 512; i++) {
-            write(fd, buffer, bs);
-            std::cout << "Issued Request of size " << bs << " - (" << (bs >> 10) << " KiByte) " << i << std::endl;
-            std::this_thread::sleep_for(intervalNs * 1ns);
+    if (result.registered) {
+        registeredWithK2 = false;
+        k2Result = unregisterWithK2(mainPid);
+        if (!k2Result) {
+            std::cerr << k2Result << std::endl;
         }
-        auto end = std::chrono::steady_clock::now();
-        std::cout << "Main loop took " << std::chrono::duration_cast<std::chrono::milliseconds>(end - start).count()
-                  << "ms" << std::endl;
     }
-    k2::unregisterTask(disk, mainPid);
-    std::cout << "Finished main thread" << std::endl;
 
-    // Close all background load processes
-    for (const auto pid: backgroundProcessPids) {
-        kill(pid, SIGTERM);
-        int stat;
-        std::cout << "Waiting for PID " << pid << std::endl;
-        waitpid(pid, &stat, 0);
+    // Stop all background load streams
+    backgroundPool->stop();
+    for (std::size_t i = 0; i < backgroundPool->streams().size(); i++) {
+        const auto &stats = backgroundPool->stats(i);
+        result.backgroundRequests += stats.requests.load();
+        result.backgroundBytes += stats.bytes.load();
+        result.backgroundErrors += stats.errors.load();
+    }
+    if (metricsServer) {
+        metricsServer->stop();
+        k2::removeMetricsSource(metricsSource);
+    }
+    if (requestCollector) {
+        requestCollector->stop();
+        std::cerr << "Traced " << requestCollector->collected() << " requests, " << requestCollector->dropped()
+                  << " dropped" << std::endl;
     }
 
-    free(buffer);
+    switch (config.output) {
+        case OutputFormat::Json:
+            printJson(result);
+            break;
+        case OutputFormat::Csv:
+            printCsv(result);
+            break;
+        default:
+            printHuman(result);
+            break;
+    }
 
     return 0;
 }
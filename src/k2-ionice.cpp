@@ -0,0 +1,134 @@
+#include "libk2/ionice.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+/**
+ * @brief Parses "[<type>:]<id>", a bare id is a single process
+ * @details For cgroup targets the value is a cgroup path, or a pid whose cgroup is used if it is a number
+ */
+bool parseTarget(const std::string &value, ionice::Target &target)
+{
+    const auto separator = value.find(':');
+    std::string id = value;
+    target.type = ionice::TargetType::Process;
+    if (separator != std::string::npos) {
+        target.type = ionice::targetTypeToEnum(value.substr(0, separator));
+        id = value.substr(separator + 1);
+    }
+    if (target.type == ionice::TargetType::NA || id.empty()) {
+        return false;
+    }
+
+    const bool numeric = id.find_first_not_of("0123456789") == std::string::npos;
+    if (target.type == ionice::TargetType::Cgroup && !numeric) {
+        target.cgroup = id;
+        return true;
+    }
+    if (!numeric) {
+        return false;
+    }
+    // Target ids are ints, larger ones name no process, group or user we could address
+    errno = 0;
+    const unsigned long number = std::strtoul(id.c_str(), nullptr, 10);
+    if (errno != 0 || number > INT_MAX) {
+        return false;
+    }
+    target.id = static_cast<int>(number);
+    return true;
+}
+
+/**
+ * @brief Sets or shows the I/O priority of many threads, process groups, users or cgroups in one call
+ * @details Without --class the current priorities are printed. Every target is expanded to the threads it covers
+ * first, so a service with hundreds of threads is changed with a single invocation, and each thread that failed is
+ * reported on its own.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-ionice", "0.1");
+
+    program.add_argument("--class", "-c")
+            .help("I/O class to set: none, realtime, best-effort or idle; shows the priorities if omitted");
+
+    program.add_argument("--level", "-n")
+            .scan<'i', int>()
+            .default_value(4)
+            .help("I/O priority level 0 (highest) to 7 within the class");
+
+    program.add_argument("targets")
+            .remaining()
+            .help("targets as [process|threads|pgrp|user|cgroup:]<id>; cgroup takes a path below the cgroup root or "
+                  "the pid whose cgroup to use");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    std::vector<ionice::Target> targets;
+    if (const auto values = program.present<std::vector<std::string>>("targets")) {
+        for (const auto &value: *values) {
+            ionice::Target target;
+            if (!parseTarget(value, target)) {
+                std::cerr << "Invalid target " << value << std::endl;
+                return 1;
+            }
+            targets.push_back(std::move(target));
+        }
+    }
+    if (targets.empty()) {
+        std::cerr << "At least one target is required" << std::endl;
+        std::cerr << program;
+        return 1;
+    }
+
+    const auto className = program.present<std::string>("--class");
+    if (!className) {
+        int failed = 0;
+        for (const auto &result: ionice::expandTargets(targets)) {
+            ionice::IoClass ioClass = ionice::IoClass::NA;
+            ionice::IoLevel ioLevel = ionice::IoLevel::NA;
+            const int ret = result.error ? result.error : ionice::ioPrioGet(result.who, result.id, ioClass, ioLevel);
+            std::cout << ionice::toString(result.who) << " " << result.id << ": ";
+            if (ret) {
+                failed++;
+                std::cout << strerror(ret) << std::endl;
+            } else {
+                std::cout << ioClass << " " << ioLevel << std::endl;
+            }
+        }
+        return failed ? 1 : 0;
+    }
+
+    const auto ioClass = ionice::ioClassToEnum(*className);
+    const auto ioLevel = ionice::ioLevelToEnum(program.get<int>("--level"));
+    if (ioClass == ionice::IoClass::NA || ioLevel == ionice::IoLevel::NA) {
+        std::cerr << "Invalid I/O priority" << std::endl;
+        return 1;
+    }
+
+    std::vector<ionice::TargetResult> results;
+    const int ret = ionice::ioPrioSet(targets, ioClass, ioLevel, results);
+    std::size_t failed = 0;
+    for (const auto &result: results) {
+        if (result.error) {
+            failed++;
+            std::cerr << ionice::toString(targets[result.target].type) << " target " << result.target << ", "
+                      << ionice::toString(result.who) << " " << result.id << ": " << strerror(result.error)
+                      << std::endl;
+        }
+    }
+    std::cout << "Set " << ioClass << " " << ioLevel << " on " << results.size() - failed << " of "
+              << results.size() << " expanded targets" << std::endl;
+    return ret ? 1 : 0;
+}
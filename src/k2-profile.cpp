@@ -0,0 +1,352 @@
+#include "libk2/metrics.hpp"
+#include "libk2/profile.hpp"
+#include "libk2/requestlog.hpp"
+#include "libk2/results.hpp"
+#include "libk2/runner.hpp"
+
+#include <argparse/argparse.hpp>
+
+#include <csignal>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+
+workload::ProfileRunner *activeRunner = nullptr;
+
+void stopSignalHandler(int signal)
+{
+    if (activeRunner) {
+        activeRunner->requestStop();
+    }
+}
+
+std::string joinDevices(const workload::JobGroup &group, const std::string &separator)
+{
+    std::string devices;
+    for (const auto &device: group.devices) {
+        devices += (devices.empty() ? "" : separator) + device;
+    }
+    return devices;
+}
+
+double megabytesPerSecond(const workload::GroupResult &result)
+{
+    return result.wallTimeNs ? result.bytes * 1000.0 / result.wallTimeNs : 0.0;
+}
+
+void printHuman(const std::string &label, const workload::ProfileRunner &runner)
+{
+    const auto &profile = runner.profile();
+    std::cout << "Profile " << (profile.name.empty() ? "<unnamed>" : profile.name) << " run "
+              << (label.empty() ? "<unlabeled>" : label) << " took " << runner.wallTimeNs() / 1000000 << " ms"
+              << std::endl;
+    for (std::size_t g = 0; g < profile.groups.size(); g++) {
+        const auto &group = profile.groups[g];
+        const auto &result = runner.results()[g];
+        std::cout << "  [" << group.name << "] " << workload::toString(group.role) << ", " << group.jobs << " x "
+                  << (group.blockSize >> 10) << " KiByte " << workload::toString(group.pattern) << " on "
+                  << joinDevices(group, ", ") << ", " << workload::toString(group.offsets.pattern) << " offsets"
+                  << (group.setIoPrio ? ", ioprio " + std::string(name(group.ioPrio.ioClass())) + "/" +
+                                        std::string(name(group.ioPrio.ioLevel())) : "")
+                  << std::endl;
+        std::cout << "    requests:        " << result.requests << ", " << megabytesPerSecond(result) << " MB/s, "
+                  << result.errors << " errors" << std::endl;
+        if (group.role != workload::JobRole::Foreground) {
+            continue;
+        }
+        const auto &h = result.latency;
+        const auto &p = result.periodic;
+        std::cout << "    k2:              " << result.registered << " of " << group.jobs << " jobs registered"
+                  << std::endl;
+        std::cout << "    latency [us]:    min " << h.min() / 1000.0 << ", mean " << h.mean() / 1000.0
+                  << ", p50 " << h.percentile(50) / 1000.0 << ", p99 " << h.percentile(99) / 1000.0
+                  << ", p99.9 " << h.percentile(99.9) / 1000.0 << ", max " << h.max() / 1000.0 << std::endl;
+        std::cout << "    deadline misses: " << result.deadlineMisses << " (interval " << group.periodic.periodNs
+                  << " ns)" << std::endl;
+        std::cout << "    periods:         " << p.periods << ", " << p.overruns << " overruns, " << p.skipped
+                  << " skipped" << std::endl;
+        std::cout << "    jitter [us]:     p50 " << p.releaseJitter.percentile(50) / 1000.0 << ", p99 "
+                  << p.releaseJitter.percentile(99) / 1000.0 << ", max " << p.releaseJitter.max() / 1000.0
+                  << std::endl;
+    }
+}
+
+void printJson(const std::string &label, const workload::ProfileRunner &runner)
+{
+    const auto &profile = runner.profile();
+    std::cout << "{\"label\":" << workload::jsonString(label) << ",\"profile\":" << workload::jsonString(profile.name)
+              << ",\"wall_time_ns\":" << runner.wallTimeNs() << ",\"groups\":[";
+    for (std::size_t g = 0; g < profile.groups.size(); g++) {
+        const auto &group = profile.groups[g];
+        const auto &result = runner.results()[g];
+        const auto &h = result.latency;
+        const auto &p = result.periodic;
+        std::string devices;
+        for (const auto &device: group.devices) {
+            devices += (devices.empty() ? "" : ",") + workload::jsonString(device);
+        }
+        std::cout << (g ? "," : "") << "{\"name\":" << workload::jsonString(group.name) << ",\"role\":\""
+                  << workload::toString(group.role) << "\",\"jobs\":" << group.jobs << ",\"devices\":[" << devices
+                  << "],\"offsets\":\"" << workload::toString(group.offsets.pattern)
+                  << "\",\"block_size\":" << group.blockSize << ",\"pattern\":\""
+                  << workload::toString(group.pattern) << "\",\"requests\":" << result.requests << ",\"bytes\":"
+                  << result.bytes << ",\"errors\":" << result.errors << ",\"wall_time_ns\":" << result.wallTimeNs;
+        if (group.role == workload::JobRole::Foreground) {
+            std::cout << ",\"interval_ns\":" << group.periodic.periodNs << ",\"k2_registered\":" << result.registered
+                      << ",\"deadline_misses\":" << result.deadlineMisses << ",\"periods\":" << p.periods
+                      << ",\"overruns\":" << p.overruns << ",\"skipped\":" << p.skipped
+                      << ",\"jitter_ns\":{\"p50\":" << p.releaseJitter.percentile(50) << ",\"p99\":"
+                      << p.releaseJitter.percentile(99) << ",\"max\":" << p.releaseJitter.max()
+                      << "},\"latency_ns\":{\"min\":" << h.min() << ",\"mean\":" << h.mean() << ",\"p50\":"
+                      << h.percentile(50) << ",\"p99\":" << h.percentile(99) << ",\"p99.9\":" << h.percentile(99.9)
+                      << ",\"max\":" << h.max() << "}";
+        }
+        std::cout << "}";
+    }
+    std::cout << "]}" << std::endl;
+}
+
+void printCsv(const std::string &label, const workload::ProfileRunner &runner)
+{
+    const auto &profile = runner.profile();
+    std::cout << "label,profile,group,role,jobs,devices,offsets,block_size,pattern,requests,bytes,errors,"
+                 "wall_time_ns,interval_ns,k2_registered,deadline_misses,periods,overruns,skipped,jitter_p99_ns,"
+                 "min_ns,mean_ns,p50_ns,p99_ns,p999_ns,max_ns" << std::endl;
+    for (std::size_t g = 0; g < profile.groups.size(); g++) {
+        const auto &group = profile.groups[g];
+        const auto &result = runner.results()[g];
+        const auto &h = result.latency;
+        const auto &p = result.periodic;
+        std::cout << workload::csvField(label) << "," << workload::csvField(profile.name) << ","
+                  << workload::csvField(group.name) << "," << workload::toString(group.role) << "," << group.jobs
+                  << "," << workload::csvField(joinDevices(group, " ")) << ","
+                  << workload::toString(group.offsets.pattern) << "," << group.blockSize << ","
+                  << workload::toString(group.pattern) << "," << result.requests << "," << result.bytes << ","
+                  << result.errors << "," << result.wallTimeNs << "," << group.periodic.periodNs << ","
+                  << result.registered << "," << result.deadlineMisses << "," << p.periods << "," << p.overruns
+                  << "," << p.skipped << "," << p.releaseJitter.percentile(99) << "," << h.min() << "," << h.mean()
+                  << "," << h.percentile(50) << "," << h.percentile(99) << "," << h.percentile(99.9) << ","
+                  << h.max() << std::endl;
+    }
+}
+
+/**
+ * @brief Writes the summaries of all groups to a result file that already holds the run and its records
+ */
+int writeGroups(workload::ResultWriter &writer, const workload::ProfileRunner &runner)
+{
+    const auto &profile = runner.profile();
+    for (std::size_t g = 0; g < profile.groups.size(); g++) {
+        const auto &group = profile.groups[g];
+        const auto &result = runner.results()[g];
+        workload::GroupSummary summary;
+        summary.name = group.name;
+        summary.index = static_cast<std::uint16_t>(g);
+        summary.foreground = group.role == workload::JobRole::Foreground;
+        summary.jobs = group.jobs;
+        summary.blockSize = group.blockSize;
+        summary.intervalNs = summary.foreground ? group.periodic.periodNs : 0;
+        summary.requests = result.requests;
+        summary.bytes = result.bytes;
+        summary.errors = result.errors;
+        summary.deadlineMisses = result.deadlineMisses;
+        summary.periods = result.periodic.periods;
+        summary.overruns = result.periodic.overruns;
+        summary.wallTimeNs = result.wallTimeNs;
+        summary.latency = result.latency;
+        const int ret = writer.writeGroup(summary);
+        if (ret) {
+            return ret;
+        }
+    }
+    return writer.setWallTime(runner.wallTimeNs());
+}
+
+/**
+ * @brief Publishes the request latencies the collector gathered so far, per job group
+ */
+void writeWorkloadMetrics(k2::MetricsWriter &writer, const workload::ProfileRunner &runner,
+                          const workload::RequestCollector &collector)
+{
+    const auto &groups = runner.profile().groups;
+    writer.family("k2_workload_request_duration_seconds", "histogram", "Completion latency of workload requests.");
+    for (std::size_t g = 0; g < groups.size(); g++) {
+        const std::string labels = k2::metricsLabel("group", groups[g].name) + "," +
+                                   k2::metricsLabel("role", workload::toString(groups[g].role));
+        writer.histogram("k2_workload_request_duration_seconds", labels,
+                         collector.streamLatency(static_cast<std::uint16_t>(g)));
+    }
+    writer.family("k2_workload_requests_dropped_total", "counter", "Requests the collector could not keep up with.");
+    writer.sample("k2_workload_requests_dropped_total", {}, collector.dropped());
+}
+
+/**
+ * @brief Runs a declarative workload profile, see workload::parseProfile for the file format
+ * @details Profiles replace long k2-example command lines, so mixes of real-time and background load can be kept
+ * under version control and rerun reproducibly. SIGINT ends the run early and still reports what ran so far.
+ */
+int main(int argc, char **argv)
+{
+    argparse::ArgumentParser program("k2-profile", "0.1");
+
+    program.add_argument("profile")
+            .help("path to the profile to run");
+
+    program.add_argument("--output", "-o")
+            .default_value(std::string{"human"})
+            .help("output format: human, json or csv");
+
+    program.add_argument("--label", "-l")
+            .default_value(std::string{})
+            .help("label of this run in the output");
+
+    program.add_argument("--socket")
+            .help("register foreground jobs through the k2-register-task daemon listening on this socket");
+
+    program.add_argument("--trace")
+            .help("write every request of foreground and background thread jobs to this binary trace file");
+
+    program.add_argument("--result")
+            .help("write the configuration, all requests and the group summaries to this binary result file, see "
+                  "k2-compare");
+
+    program.add_argument("--metrics")
+            .help("serve k2 ioctl and per group request latency metrics for Prometheus on this address, host:port or "
+                  "a Unix socket path");
+
+    program.add_argument("--check")
+            .default_value(false)
+            .implicit_value(true)
+            .help("only parse and validate the profile");
+
+    try {
+        program.parse_args(argc, argv);
+    }
+    catch (const std::runtime_error &err) {
+        std::cerr << err.what() << std::endl;
+        std::cerr << program;
+        std::exit(1);
+    }
+
+    const auto output = program.get<std::string>("--output");
+    if (output != "human" && output != "json" && output != "csv") {
+        std::cerr << "Unknown output format " << output << std::endl;
+        return 1;
+    }
+
+    const auto path = program.get<std::string>("profile");
+    workload::Profile profile;
+    std::size_t failedLine = 0;
+    int ret = workload::loadProfile(path, profile, failedLine);
+    if (ret) {
+        std::cerr << "Could not load " << path;
+        if (failedLine) {
+            std::cerr << ", line " << failedLine;
+        }
+        std::cerr << ": " << strerror(ret) << std::endl;
+        return 1;
+    }
+    if (program.get<bool>("--check")) {
+        std::cout << path << ": " << profile.groups.size() << " groups" << std::endl;
+        return 0;
+    }
+
+    workload::ProfileRunner runner(std::move(profile));
+    if (const auto socket = program.present<std::string>("--socket")) {
+        runner.setK2Socket(*socket);
+    }
+    const auto label = program.get<std::string>("--label");
+    const auto trace = program.present<std::string>("--trace");
+    const auto resultPath = program.present<std::string>("--result");
+    workload::ResultWriter result;
+    if (resultPath) {
+        workload::RunInfo run;
+        run.label = label;
+        run.profile = runner.profile().name;
+        std::ostringstream config;
+        config << std::ifstream(path).rdbuf();
+        run.config = config.str();
+        run.startTimeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        ret = result.open(*resultPath, run);
+        if (ret) {
+            std::cerr << "Could not create " << *resultPath << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+    }
+    const auto metricsAddress = program.present<std::string>("--metrics");
+    std::unique_ptr<workload::RequestCollector> collector;
+    if (trace || resultPath || metricsAddress) {
+        workload::CollectorOptions options;
+        options.tracePath = trace.value_or("");
+        if (resultPath) {
+            options.sink = [&result](const workload::RequestRecord *records, std::size_t count) {
+                return result.writeRecords(records, count);
+            };
+        }
+        collector = std::make_unique<workload::RequestCollector>(options);
+        ret = collector->start();
+        if (ret) {
+            std::cerr << "Could not start the request collector: " << strerror(ret) << std::endl;
+            return 1;
+        }
+        runner.setCollector(collector.get());
+    }
+    std::unique_ptr<k2::MetricsServer> metrics;
+    int metricsSource = 0;
+    if (metricsAddress) {
+        k2::setMetricsEnabled(true);
+        metricsSource = k2::addMetricsSource([&runner, &collector](k2::MetricsWriter &writer) {
+            writeWorkloadMetrics(writer, runner, *collector);
+        });
+        metrics = std::make_unique<k2::MetricsServer>(*metricsAddress);
+        ret = metrics->start();
+        if (ret) {
+            std::cerr << "Could not serve metrics on " << *metricsAddress << ": " << strerror(ret) << std::endl;
+            k2::removeMetricsSource(metricsSource);
+            return 1;
+        }
+    }
+    activeRunner = &runner;
+    std::signal(SIGINT, stopSignalHandler);
+    std::signal(SIGTERM, stopSignalHandler);
+
+    ret = runner.run();
+    std::signal(SIGINT, SIG_DFL);
+    std::signal(SIGTERM, SIG_DFL);
+    activeRunner = nullptr;
+    if (ret) {
+        std::cerr << "Profile run failed: " << strerror(ret) << std::endl;
+    }
+    if (metrics) {
+        metrics->stop();
+        k2::removeMetricsSource(metricsSource);
+    }
+    if (collector) {
+        collector->stop();
+        std::cerr << "Traced " << collector->collected() << " requests, " << collector->dropped() << " dropped";
+        if (collector->traceError()) {
+            std::cerr << ", writing the trace failed: " << strerror(collector->traceError());
+        }
+        std::cerr << std::endl;
+    }
+    if (resultPath) {
+        int err = writeGroups(result, runner);
+        err = err ? err : result.close();
+        if (err) {
+            std::cerr << "Writing " << *resultPath << " failed: " << strerror(err) << std::endl;
+            ret = ret ? ret : err;
+        }
+    }
+    if (output == "json") {
+        printJson(label, runner);
+    } else if (output == "csv") {
+        printCsv(label, runner);
+    } else {
+        printHuman(label, runner);
+    }
+    return ret ? 1 : 0;
+}
@@ -1,15 +1,52 @@
 #include "libk2/libk2.hpp"
+#include "libk2/autotune.hpp"
+#include "libk2/blocktrace.hpp"
+#include "libk2/control.hpp"
+#include "libk2/metrics.hpp"
+#include "libk2/regtable.hpp"
+
+extern "C" {
+#include <sys/resource.h>
+#include <sys/sysmacros.h>
+}
 
 #include <argparse/argparse.hpp>
 
+#include <chrono>
+#include <csignal>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
 enum class OperationMode
 {
     Register,
     Unregister,
     UnregisterAll,
+    Update,
+    Autotune,
+    List,
+    Devices,
+    Daemon,
     NotSupported
 };
 
+k2::ControlServer *controlServer = nullptr;
+
+void daemonSignalHandler(int signal)
+{
+    if (controlServer != nullptr) {
+        controlServer->requestStop();
+    }
+}
+
+volatile std::sig_atomic_t stopAutotune = false;
+
+void autotuneSignalHandler(int signal)
+{
+    stopAutotune = true;
+}
+
 class K2App
 {
 protected:
@@ -17,6 +54,328 @@ protected:
     const std::optional<pid_t> pid;
     const std::optional<std::int64_t> interval;
     const OperationMode mode;
+    const std::optional<std::string> batchFile;
+    const std::optional<std::string> socket;
+    const k2::TunerOptions tunerOptions;
+    const std::chrono::milliseconds epoch;
+    const std::optional<std::string> metricsAddress;
+    const std::optional<std::string> registrationTable;
+
+    /**
+     * @brief Parses one task spec per line in the form "<device> <pid> [interval_ns]"
+     * @details Empty lines and lines starting with '#' are skipped
+     * @return false if a line could not be parsed or holds anything after the spec
+     */
+    static bool parseBatch(std::istream &in, std::vector<k2::TaskSpec> &specs, const bool needsInterval)
+    {
+        std::string line;
+        std::size_t lineNo = 0;
+        while (std::getline(in, line)) {
+            lineNo++;
+            const auto first = line.find_first_not_of(" \t");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+
+            std::istringstream fields(line);
+            k2::TaskSpec spec;
+            if (!(fields >> spec.device >> spec.pid)) {
+                std::cerr << "Line " << lineNo << ": expected <device> <pid> [interval_ns]" << std::endl;
+                return false;
+            }
+            if (!(fields >> spec.interval_ns) && needsInterval) {
+                std::cerr << "Line " << lineNo << ": interval is required" << std::endl;
+                return false;
+            }
+            fields.clear();
+            std::string rest;
+            if (fields >> rest) {
+                std::cerr << "Line " << lineNo << ": unexpected " << rest << std::endl;
+                return false;
+            }
+            specs.push_back(std::move(spec));
+        }
+        return true;
+    }
+
+    int runBatch()
+    {
+        if (this->mode != OperationMode::Register && this->mode != OperationMode::Unregister &&
+            this->mode != OperationMode::Update) {
+            std::cerr << "batch files are only supported for reg, unreg and update" << std::endl;
+            return 1;
+        }
+        const bool needsInterval = this->mode != OperationMode::Unregister;
+
+        std::vector<k2::TaskSpec> specs;
+        bool parsed;
+        if (*this->batchFile == "-") {
+            parsed = parseBatch(std::cin, specs, needsInterval);
+        } else {
+            std::ifstream in(*this->batchFile);
+            if (!in) {
+                std::cerr << "Could not open batch file " << *this->batchFile << std::endl;
+                return 1;
+            }
+            parsed = parseBatch(in, specs, needsInterval);
+        }
+        if (!parsed) {
+            return 1;
+        }
+
+        std::vector<k2::Result> results;
+        if (this->socket) {
+            k2::ControlClient client(*this->socket);
+            if (!client.isOpen()) {
+                std::cerr << client.error() << std::endl;
+                return 1;
+            }
+            for (const auto &spec: specs) {
+                results.push_back(batchOperation(client, spec));
+            }
+        } else {
+            k2::Session session;
+            if (!session.isOpen()) {
+                std::cerr << session.error() << std::endl;
+                return 1;
+            }
+            if (this->mode == OperationMode::Update) {
+                for (const auto &spec: specs) {
+                    results.push_back(batchOperation(session, spec));
+                }
+            } else {
+                results = this->mode == OperationMode::Register ? session.registerTasks(specs)
+                                                                : session.unregisterTasks(specs);
+            }
+        }
+
+        std::size_t failed = 0;
+        for (std::size_t i = 0; i < specs.size(); i++) {
+            if (!results[i]) {
+                failed++;
+                std::cerr << "Task with pid " << specs[i].pid << " on " << specs[i].device << ": " << results[i]
+                          << std::endl;
+            }
+        }
+        const char *done = this->mode == OperationMode::Register ? "Registered "
+                           : this->mode == OperationMode::Update ? "Updated " : "Unregistered ";
+        std::cout << done << specs.size() - failed << " of " << specs.size() << " tasks" << std::endl;
+        return failed ? 1 : 0;
+    }
+
+    template<typename Handle>
+    k2::Result batchOperation(Handle &handle, const k2::TaskSpec &spec)
+    {
+        switch (this->mode) {
+            case OperationMode::Register:
+                return handle.registerTask(spec.device, spec.pid, spec.interval_ns);
+            case OperationMode::Update:
+                return handle.updateInterval(spec.device, spec.pid, spec.interval_ns);
+            default:
+                return handle.unregisterTask(spec.device, spec.pid);
+        }
+    }
+
+    /**
+     * @brief Registers the task and adjusts its interval once per epoch from the completion latencies of its
+     * requests, traced in the block layer, until interrupted
+     * @details The task stays registered with the last chosen interval on exit
+     */
+    template<typename Handle>
+    int autotune(Handle &handle)
+    {
+        k2::BlockDevice blockDevice;
+        int ret = k2::resolveDevice(this->device, blockDevice);
+        if (ret) {
+            std::cerr << "Could not resolve " << this->device << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+        k2::BlockTracer tracer(blockDevice.id);
+        ret = tracer.open();
+        if (ret) {
+            std::cerr << "Could not trace " << blockDevice.name << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+
+        k2::IntervalTuner tuner(this->tunerOptions, *this->interval);
+        k2::Result result = handle.registerTask(this->device, *this->pid, tuner.interval());
+        if (result.error == EEXIST) {
+            result = handle.updateInterval(this->device, *this->pid, tuner.interval());
+        }
+        if (!result) {
+            std::cerr << result << std::endl;
+            return 1;
+        }
+
+        std::signal(SIGINT, autotuneSignalHandler);
+        std::signal(SIGTERM, autotuneSignalHandler);
+        std::cout << "Tuning the interval of pid " << *this->pid << " on " << this->device << " for p"
+                  << this->tunerOptions.percentile << " <= " << this->tunerOptions.targetNs / 1000 << " us"
+                  << std::endl;
+
+        const k2::Histogram noCompletions;
+        while (!stopAutotune) {
+            const auto epochEnd = std::chrono::steady_clock::now() + this->epoch;
+            while (!stopAutotune && std::chrono::steady_clock::now() < epochEnd) {
+                ret = tracer.poll(100);
+                if (ret) {
+                    std::cerr << "Tracing failed: " << strerror(ret) << std::endl;
+                    return 1;
+                }
+            }
+            if (stopAutotune) {
+                break;
+            }
+
+            const auto stats = tracer.stats().find(*this->pid);
+            const k2::Histogram &latencies = stats == tracer.stats().end() ? noCompletions : stats->second.latency;
+            const std::int64_t previous = tuner.interval();
+            const std::int64_t next = tuner.update(latencies);
+            std::cout << "interval " << previous << " ns: " << latencies.count() << " completions";
+            if (latencies.count() >= this->tunerOptions.minSamples) {
+                std::cout << ", p" << this->tunerOptions.percentile << " " << tuner.observed() / 1000.0 << " us";
+            }
+            if (next != previous) {
+                std::cout << " -> " << next << " ns";
+            } else if (tuner.converged()) {
+                std::cout << " (converged)";
+            }
+            std::cout << std::endl;
+            tracer.clearStats();
+
+            if (next != previous) {
+                result = handle.updateInterval(this->device, *this->pid, next);
+                if (!result) {
+                    std::cerr << result << std::endl;
+                    return 1;
+                }
+            }
+        }
+        std::cout << "Left pid " << *this->pid << " registered with interval " << tuner.interval() << " ns"
+                  << std::endl;
+        return 0;
+    }
+
+    int runAutotune()
+    {
+        if (this->device.empty() || !this->pid || !this->interval) {
+            std::cerr << "device, pid and the initial interval are required" << std::endl;
+            return 1;
+        }
+        if (!this->socket) {
+            k2::Session session;
+            if (!session.isOpen()) {
+                std::cerr << session.error() << std::endl;
+                return 1;
+            }
+            return autotune(session);
+        }
+        k2::ControlClient client(*this->socket);
+        if (!client.isOpen()) {
+            std::cerr << client.error() << std::endl;
+            return 1;
+        }
+        return autotune(client);
+    }
+
+    int runDaemon()
+    {
+        // Every supervised task holds a pidfd
+        struct rlimit files{};
+        if (getrlimit(RLIMIT_NOFILE, &files) == 0) {
+            files.rlim_cur = files.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &files);
+        }
+
+        k2::Session session;
+        if (!session.isOpen()) {
+            std::cerr << session.error() << std::endl;
+            return 1;
+        }
+
+        k2::ControlServer server(session, this->socket.value_or(k2::k2ControlSocket()));
+        int ret = server.open();
+        if (ret) {
+            std::cerr << "Could not listen on " << server.path() << ": " << strerror(ret) << std::endl;
+            return 1;
+        }
+        k2::MetricsServer metrics(this->metricsAddress.value_or(""));
+        if (this->metricsAddress) {
+            k2::setMetricsEnabled(true);
+            ret = metrics.start();
+            if (ret) {
+                std::cerr << "Could not serve metrics on " << metrics.address() << ": " << strerror(ret) << std::endl;
+                return 1;
+            }
+        }
+        k2::RegistrationTable table(this->registrationTable.value_or(""));
+        if (this->registrationTable) {
+            ret = table.open();
+            if (ret) {
+                std::cerr << "Could not create the registration table " << table.path() << ": " << strerror(ret)
+                          << std::endl;
+                return 1;
+            }
+            server.setRegistrationTable(&table);
+        }
+        controlServer = &server;
+        std::signal(SIGINT, daemonSignalHandler);
+        std::signal(SIGTERM, daemonSignalHandler);
+        std::cout << "Serving k2 requests on " << server.path() << std::endl;
+
+        ret = server.run();
+        controlServer = nullptr;
+        if (ret) {
+            std::cerr << "Daemon failed: " << strerror(ret) << std::endl;
+            return 1;
+        }
+        return 0;
+    }
+
+    int runList()
+    {
+        k2::ControlClient client(this->socket.value_or(k2::k2ControlSocket()));
+        std::vector<k2::TaskSpec> tasks;
+        const k2::Result result = client.isOpen() ? client.listTasks(tasks) : client.error();
+        if (!result) {
+            std::cerr << result << std::endl;
+            return 1;
+        }
+        for (const auto &task: tasks) {
+            std::cout << task.device << " " << task.pid << " " << task.interval_ns << std::endl;
+        }
+        return 0;
+    }
+
+    int runDevices()
+    {
+        k2::Session session;
+        std::vector<k2::DeviceInfo> devices;
+        const k2::Result result = session.isOpen() ? session.getDevices(devices) : session.error();
+        if (!result) {
+            std::cerr << result << std::endl;
+            return 1;
+        }
+        for (const auto &device: devices) {
+            std::cout << device.name << " " << major(device.dev) << ":" << minor(device.dev) << " "
+                      << (device.scheduler.empty() ? "-" : device.scheduler) << std::endl;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Issues the single operation through the daemon if a socket is given, directly otherwise
+     */
+    template<typename Operation>
+    k2::Result dispatch(const Operation &operation)
+    {
+        if (!this->socket) {
+            k2::Session session;
+            return session.isOpen() ? operation(session) : session.error();
+        }
+        k2::ControlClient client(*this->socket);
+        return client.isOpen() ? operation(client) : client.error();
+    }
 
 public:
     K2App() = delete;
@@ -25,15 +384,40 @@ public:
 
 
     K2App(const std::string &device, const std::optional<pid_t> &pid, const std::optional<std::int64_t> &interval,
-          const OperationMode mode) :
-            device(device), pid(pid), interval(interval), mode(mode)
+          const OperationMode mode, const std::optional<std::string> &batchFile,
+          const std::optional<std::string> &socket, const k2::TunerOptions &tunerOptions,
+          const std::chrono::milliseconds epoch, const std::optional<std::string> &metricsAddress,
+          const std::optional<std::string> &registrationTable) :
+            device(device), pid(pid), interval(interval), mode(mode), batchFile(batchFile), socket(socket),
+            tunerOptions(tunerOptions), epoch(epoch), metricsAddress(metricsAddress),
+            registrationTable(registrationTable)
     {}
 
     virtual K2App operator=(const K2App &other) = delete;
 
     virtual int run()
     {
-        int ret = 0;
+        if (this->mode == OperationMode::Daemon) {
+            return runDaemon();
+        }
+        if (this->mode == OperationMode::List) {
+            return runList();
+        }
+        if (this->mode == OperationMode::Devices) {
+            return runDevices();
+        }
+        if (this->mode == OperationMode::Autotune) {
+            return runAutotune();
+        }
+        if (this->batchFile) {
+            return runBatch();
+        }
+        if (this->device.empty()) {
+            std::cerr << "device is required" << std::endl;
+            return 1;
+        }
+
+        k2::Result result{k2::Operation::OpenDriver};
         switch (this->mode) {
             case OperationMode::Register:
                 if (!pid) {
@@ -44,23 +428,56 @@ public:
                     std::cerr << "interval is required" << std::endl;
                     return 1;
                 }
-                k2::registerTask(this->device, *this->pid, *this->interval);
+                result = dispatch([this](auto &handle) {
+                    return handle.registerTask(this->device, *this->pid, *this->interval);
+                });
+                if (result) {
+                    std::cout << "Registered periodic task with pid " << *this->pid << " and interval time[ns] "
+                              << *this->interval << " for " << this->device << std::endl;
+                }
                 break;
             case OperationMode::Unregister:
                 if (!pid) {
                     std::cerr << "pid is required" << std::endl;
                     return 1;
                 }
-                k2::unregisterTask(device, *this->pid);
+                result = dispatch([this](auto &handle) { return handle.unregisterTask(this->device, *this->pid); });
+                if (result) {
+                    std::cout << "Unregistered periodic task with pid " << *this->pid << " for " << this->device
+                              << std::endl;
+                }
+                break;
+            case OperationMode::Update:
+                if (!pid) {
+                    std::cerr << "pid is required" << std::endl;
+                    return 1;
+                }
+                if (!this->interval) {
+                    std::cerr << "interval is required" << std::endl;
+                    return 1;
+                }
+                result = dispatch([this](auto &handle) {
+                    return handle.updateInterval(this->device, *this->pid, *this->interval);
+                });
+                if (result) {
+                    std::cout << "Updated periodic task with pid " << *this->pid << " to interval time[ns] "
+                              << *this->interval << " for " << this->device << std::endl;
+                }
                 break;
             case OperationMode::UnregisterAll:
-                k2::unregisterAllTasks(device);
+                result = dispatch([this](auto &handle) { return handle.unregisterAllTasks(this->device); });
+                if (result) {
+                    std::cout << "Unregistered all periodic tasks for " << this->device << std::endl;
+                }
                 break;
             default:
-                ret = 1;
-                break;
+                return 1;
+        }
+        if (!result) {
+            std::cerr << result << std::endl;
+            return 1;
         }
-        return ret;
+        return 0;
     }
 };
 
@@ -73,7 +490,8 @@ int main(int argc, char **argv)
             .required()
             .nargs(1)
             .action([](const std::string &value) {
-                static const std::vector<std::string> choices = {"reg", "unreg", "unreg_all"};
+                static const std::vector<std::string> choices = {"reg", "unreg", "unreg_all", "update", "autotune",
+                                                                 "list", "devices", "daemon"};
                 if (std::find(choices.begin(), choices.end(), value) != choices.end()) {
                     return value;
                 }
@@ -81,7 +499,6 @@ int main(int argc, char **argv)
             });
 
     program.add_argument("--device", "-d")
-            .required()
             .help("set the device to perform the operation on");
 
     program.add_argument("--pid", "-p")
@@ -90,8 +507,48 @@ int main(int argc, char **argv)
 
     program.add_argument("--interval", "-i")
             .scan<'i', std::int64_t>()
-            .help("set the interval in ns of the process to register");
+            .help("set the interval in ns of the process to register, the initial one in autotune mode");
+
+    program.add_argument("--batch-file", "-b")
+            .help("read \"<device> <pid> [interval_ns]\" lines from a file ('-' for stdin) and (un)register them all "
+                  "through one driver session");
+
+    program.add_argument("--socket", "-s")
+            .help("talk to the k2-register-task daemon on this socket instead of opening the driver, or the socket "
+                  "to serve on in daemon mode (default " + k2::k2ControlSocket() + ")");
+
+    program.add_argument("--metrics")
+            .help("daemon: serve k2 ioctl metrics for Prometheus on this address, host:port or a Unix socket path");
+
+    program.add_argument("--registration-table")
+            .help("daemon: publish the registered tasks in a shared memory table at this path for lock-free lookups "
+                  "(libk2 readers default to " + k2::k2RegistrationTablePath() + ")");
+
+
+    program.add_argument("--target-us")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{1000})
+            .help("autotune: completion latency target in us");
 
+    program.add_argument("--percentile")
+            .scan<'g', double>()
+            .default_value(99.0)
+            .help("autotune: percentile of the completion latencies that has to meet the target");
+
+    program.add_argument("--epoch-ms")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{1000})
+            .help("autotune: measurement period between interval updates in ms");
+
+    program.add_argument("--min-interval")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{100 * 1000})
+            .help("autotune: smallest interval in ns");
+
+    program.add_argument("--max-interval")
+            .scan<'i', std::int64_t>()
+            .default_value(std::int64_t{1000 * 1000 * 1000})
+            .help("autotune: largest interval in ns");
 
     try {
         program.parse_args(argc, argv);
@@ -111,14 +568,34 @@ int main(int argc, char **argv)
         mode = OperationMode::Unregister;
     } else if (op.compare("unreg_all") == 0) {
         mode = OperationMode::UnregisterAll;
+    } else if (op.compare("update") == 0) {
+        mode = OperationMode::Update;
+    } else if (op.compare("autotune") == 0) {
+        mode = OperationMode::Autotune;
+    } else if (op.compare("list") == 0) {
+        mode = OperationMode::List;
+    } else if (op.compare("devices") == 0) {
+        mode = OperationMode::Devices;
+    } else if (op.compare("daemon") == 0) {
+        mode = OperationMode::Daemon;
     } else {
         mode = OperationMode::NotSupported;
     }
 
-    auto device = program.get<std::string>("--device");
+    auto device = program.present<std::string>("--device").value_or("");
     auto pid = program.present<pid_t>("--pid");
     auto interval = program.present<std::int64_t>("--interval");
+    auto batchFile = program.present<std::string>("--batch-file");
+    auto socket = program.present<std::string>("--socket");
+
+    k2::TunerOptions tunerOptions;
+    tunerOptions.targetNs = program.get<std::int64_t>("--target-us") * 1000;
+    tunerOptions.percentile = program.get<double>("--percentile");
+    tunerOptions.minIntervalNs = program.get<std::int64_t>("--min-interval");
+    tunerOptions.maxIntervalNs = std::max(program.get<std::int64_t>("--max-interval"), tunerOptions.minIntervalNs);
+    const std::chrono::milliseconds epoch(std::max(program.get<std::int64_t>("--epoch-ms"), std::int64_t{1}));
 
-    K2App app(device, pid, interval, mode);
+    K2App app(device, pid, interval, mode, batchFile, socket, tunerOptions, epoch,
+              program.present<std::string>("--metrics"), program.present<std::string>("--registration-table"));
     return app.run();
 }